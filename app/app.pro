@@ -6,25 +6,42 @@ INCLUDEPATH += \
     include
 
 SOURCES += \
+    src/asynclogger.cpp \
+    src/autobackupscheduler.cpp \
+    src/backupcache.cpp \
+    src/compression.cpp \
+    src/dialogbackupdiff.cpp \
     src/dialoginsertinfo.cpp \
     src/dialogselectbackupversion.cpp \
     src/dialogselectorg.cpp \
+    src/framedecoder.cpp \
     src/main.cpp \
     src/mainwindow.cpp \
+    src/remotepagesource.cpp \
+    src/remotesqlitevfs.cpp \
     src/tablecommands.cpp \
     src/tcpclient.cpp
 
 HEADERS += \
+    include/asynclogger.h \
+    include/autobackupscheduler.h \
+    include/backupcache.h \
+    include/compression.h \
     include/databasecreation.h \
+    include/dialogbackupdiff.h \
     include/dialoginsertinfo.h \
     include/dialogselectbackupversion.h \
     include/dialogselectorg.h \
+    include/framedecoder.h \
     include/mainwindow.h \
+    include/remotepagesource.h \
+    include/remotesqlitevfs.h \
     include/tablecommands.h \
     include/tcpclient.h \
     include/tcpdatatypes.h
 
 FORMS += \
+    forms/dialogbackupdiff.ui \
     forms/dialoginsertinfo.ui \
     forms/dialogselectbackupversion.ui \
     forms/dialogselectorg.ui \
@@ -33,4 +50,24 @@ FORMS += \
 RESOURCES += \
     resources/resources.qrc
 
+packagesExist(liblz4) {
+    CONFIG += link_pkgconfig
+    PKGCONFIG += liblz4
+    DEFINES += HAVE_LZ4
+}
+
+packagesExist(libzstd) {
+    CONFIG += link_pkgconfig
+    PKGCONFIG += libzstd
+    DEFINES += HAVE_ZSTD
+}
+
+# Просмотр версий с сервера (RemoteSqliteVfs) требует той же библиотеки SQLite,
+# которую использует драйвер QSQLITE
+packagesExist(sqlite3) {
+    CONFIG += link_pkgconfig
+    PKGCONFIG += sqlite3
+    DEFINES += HAVE_SQLITE3
+}
+
 RC_ICONS = resources/icons/app_icon.ico
@@ -0,0 +1,108 @@
+#ifndef ASYNCLOGGER_H
+#define ASYNCLOGGER_H
+
+#include <QString>
+#include <QByteArray>
+#include <QtGlobal>
+
+#include <atomic>
+#include <memory>
+
+class QThread;
+
+/*
+ * Асинхронный журнал сообщений qDebug, qInfo, qWarning и qCritical.
+ *
+ * Обработчик сообщений Qt только кладет запись в кольцевой буфер
+ * и сразу возвращается, а вывод в консоль выполняет отдельный поток.
+ * Поэтому вывод журнала не задерживает прием и отправку данных.
+ *
+ * Буфер - ограниченная очередь без блокировок (алгоритм Д. Вьюкова):
+ * писать в нее могут любые потоки, читает только поток вывода.
+ * Если буфер заполнен, запись отбрасывается и учитывается в счетчике,
+ * о котором поток вывода сообщает отдельной строкой.
+ *
+ * Каждая строка содержит поля в формате key=value:
+ * время, уровень, поток, категорию и текст сообщения.
+ * Сообщения qFatal выводятся сразу, так как после них программа завершается.
+ *
+ * Объект создается в main до создания остальных объектов программы.
+ * При удалении он выводит оставшиеся записи и восстанавливает
+ * прежний обработчик сообщений.
+ *
+ * Этот файл должен совпадать с AsyncLogger.h сервера.
+ */
+class AsyncLogger
+{
+public:
+    enum Level : quint8
+    {
+        LevelDebug,
+        LevelInfo,
+        LevelWarning,
+        LevelCritical,
+        LevelFatal
+    };
+
+    explicit AsyncLogger(Level minimumLevel = LevelDebug, int capacity = cDefaultCapacity);
+    ~AsyncLogger();
+
+    AsyncLogger(const AsyncLogger &) = delete;
+    AsyncLogger &operator=(const AsyncLogger &) = delete;
+
+    /*
+     * Устанавливает журнал обработчиком сообщений Qt и запускает поток вывода.
+     */
+    void install();
+
+    quint64 droppedCount() const { return m_droppedCount; }
+
+    static const int cDefaultCapacity;
+
+private:
+    struct Record
+    {
+        qint64 time = 0;
+        Level level = LevelInfo;
+        quintptr threadId = 0;
+        QByteArray category;
+        QString message;
+    };
+
+    struct Slot
+    {
+        std::atomic<quint64> sequence { 0 };
+        Record record;
+    };
+
+    std::unique_ptr<Slot[]> m_slots;
+    const quint64 m_mask;
+    const Level m_minimumLevel;
+
+    std::atomic<quint64> m_enqueuePosition { 0 };
+    quint64 m_dequeuePosition = 0;
+
+    std::atomic<quint64> m_droppedCount { 0 };
+    quint64 m_reportedDroppedCount = 0;
+
+    std::atomic<bool> m_isStopping { false };
+    QThread *m_pDrainThread = nullptr;
+    QtMessageHandler m_previousHandler = nullptr;
+
+    static std::atomic<AsyncLogger *> s_pInstance;
+    static const int cIdleSleepTime;
+
+    bool push(Record &&record);
+    bool pop(Record &record);
+
+    void drain();
+    void drainAvailable();
+
+    static void messageHandler(QtMsgType type, const QMessageLogContext &context, const QString &message);
+    static Level levelFromMessageType(QtMsgType type);
+    static const char *levelName(Level level);
+    static QByteArray format(const Record &record);
+    static void write(const QByteArray &line);
+};
+
+#endif // ASYNCLOGGER_H
@@ -0,0 +1,93 @@
+#ifndef AUTOBACKUPSCHEDULER_H
+#define AUTOBACKUPSCHEDULER_H
+
+#include <QObject>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QSettings>
+
+class TcpClient;
+
+/*
+ * Планировщик автоматической загрузки базы данных на сервер.
+ *
+ * После каждого принятия изменений главное окно вызывает noteChanges.
+ * Изменения, принятые в течение окна ожидания, объединяются в одну
+ * загрузку: она начинается, когда с последнего принятия прошло
+ * coalesceSeconds секунд.
+ *
+ * Перед загрузкой в пуле потоков вычисляется хеш SHA-256 файла
+ * базы данных. Если он совпадает с хешем последней загруженной
+ * версии этого файла, загрузка не выполняется. Между загрузками
+ * проходит не меньше minIntervalSeconds секунд, и одновременно
+ * выполняется не больше одной загрузки. Загрузка идет в потоке
+ * TcpClient, поэтому не мешает редактированию. Неудачная загрузка
+ * повторяется с теми же ограничениями.
+ *
+ * Планировщик можно приостановить: изменения, принятые во время
+ * паузы, загружаются после ее окончания.
+ *
+ * Настройки хранятся в файле settings.ini рядом с приложением,
+ * в группе autoBackup: enabled, coalesceSeconds, minIntervalSeconds
+ * и хеши последних загруженных версий по путям файлов.
+ */
+class AutoBackupScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    AutoBackupScheduler(TcpClient *client, const QString &serverHost, int serverPort,
+                        QObject *parent = nullptr);
+
+    /*
+     * Сообщает, что в базу данных dbFileInfo записаны изменения.
+     */
+    void noteChanges(const QFileInfo &dbFileInfo);
+
+    void setSuspended(bool isSuspended);
+    bool isSuspended() const { return m_isSuspended; }
+
+private:
+    TcpClient *m_pTcpClient = nullptr;
+    QString m_serverHost;
+    int m_serverPort = 0;
+
+    QSettings m_settings;
+
+    bool m_isEnabled = true;
+    int m_coalesceMs = 0;
+    int m_minIntervalMs = 0;
+
+    QTimer m_coalesceTimer;
+    QElapsedTimer m_lastUploadTimer;
+
+    QFileInfo m_dbFileInfo;
+    bool m_hasPendingChanges = false;
+    bool m_isSuspended = false;
+    bool m_isHashingInProgress = false;
+
+    /*
+     * Выполняемая загрузка и хеш загружаемого файла.
+     * m_uploadRequestId равен 0, если загрузка не выполняется.
+     */
+    quint32 m_uploadRequestId = 0;
+    QString m_uploadFilePath;
+    QByteArray m_uploadHash;
+
+    void schedule(int delayMs);
+    void startHashing();
+    void uploadIfChanged(const QFileInfo &dbFileInfo, const QByteArray &hash);
+
+    QByteArray lastUploadedHash(const QString &filePath) const;
+
+    static QByteArray fileHash(const QString &filePath);
+
+private slots:
+    void slotCoalesceTimeout();
+
+    void slotUploadFinished(quint32 requestId, bool isSucceeded);
+    void slotRequestCancelled(quint32 requestId);
+};
+
+#endif // AUTOBACKUPSCHEDULER_H
@@ -0,0 +1,80 @@
+#ifndef BACKUPCACHE_H
+#define BACKUPCACHE_H
+
+#include <QString>
+#include <QByteArray>
+#include <QDir>
+#include <QAtomicInteger>
+
+/*
+ * Локальный кэш версий баз данных, полученных с сервера.
+ *
+ * Файлы хранятся в каталоге кэша под именами из хеша содержимого
+ * (BackupInfo::hash), поэтому одна и та же версия хранится один раз,
+ * под каким бы именем файла она ни была сохранена на сервере.
+ *
+ * При каждом попадании время изменения файла обновляется. Когда общий
+ * размер файлов превышает cMaxCacheSize, удаляются файлы, к которым
+ * дольше всего не обращались.
+ *
+ * Счетчики попаданий и промахов изменяются в lookup; он, cachedFilePath
+ * и partFilePath могут вызываться из любого потока, остальные методы -
+ * только из потока клиента.
+ */
+class BackupCache
+{
+public:
+    explicit BackupCache(const QString &directoryPath);
+
+    /*
+     * Проверяет, есть ли в кэше версия с хешем hash, и учитывает
+     * попадание или промах.
+     */
+    bool lookup(const QByteArray &hash);
+
+    /*
+     * Возвращает путь к файлу версии с хешем hash
+     * или пустую строку, если его нет в кэше.
+     */
+    QString cachedFilePath(const QByteArray &hash) const;
+
+    /*
+     * Создает по пути targetPath жесткую ссылку на файл версии с хешем hash,
+     * а если ссылку создать нельзя (например, каталоги на разных дисках),
+     * копирует файл. Файла targetPath не должно существовать.
+     */
+    bool linkTo(const QByteArray &hash, const QString &targetPath) const;
+
+    /*
+     * Возвращает новый путь в каталоге кэша, по которому можно записать
+     * версию с хешем hash, чтобы затем добавить ее в кэш методом insertPart
+     * без копирования. Незаконченные файлы удаляются при создании кэша.
+     * partFileTemplate - то же в виде шаблона для QTemporaryFile.
+     */
+    QString partFilePath(const QByteArray &hash) const;
+    QString partFileTemplate(const QByteArray &hash) const;
+
+    /*
+     * Переносит записанный файл partPath в кэш под хешем hash
+     * и удаляет старые файлы, если кэш стал больше cMaxCacheSize.
+     * Содержимое файла должно быть проверено заранее.
+     */
+    bool insertPart(const QByteArray &hash, const QString &partPath);
+
+    quint64 hitCount() const { return m_hitCount.loadRelaxed(); }
+    quint64 missCount() const { return m_missCount.loadRelaxed(); }
+
+    static const qint64 cMaxCacheSize;
+
+private:
+    QDir m_directory;
+
+    QAtomicInteger<quint64> m_hitCount = 0;
+    QAtomicInteger<quint64> m_missCount = 0;
+
+    QString filePath(const QByteArray &hash) const;
+
+    void evict(const QString &keptFileName);
+};
+
+#endif // BACKUPCACHE_H
@@ -0,0 +1,73 @@
+#ifndef COMPRESSION_H
+#define COMPRESSION_H
+
+#include <QByteArray>
+#include <QList>
+
+/*
+ * Сжатие частей файлов баз данных при передаче по сети.
+ *
+ * Клиент и сервер договариваются об алгоритме сжатия при подключении
+ * (кадры Hello и HelloAck), после чего каждая часть файла сжимается
+ * отдельно, поэтому сжатие не мешает обрабатывать части по мере поступления.
+ *
+ * Сжатая часть имеет вид:
+ * - quint8 - алгоритм сжатия Codec;
+ * - quint32 - размер исходных данных (кроме CodecNone);
+ * - сжатые данные.
+ * Если часть не уменьшилась при сжатии, она передается с CodecNone без изменений.
+ *
+ * LZ4 и zstd используются, если программа собрана с ними
+ * (HAVE_LZ4 и HAVE_ZSTD), qCompress доступен всегда.
+ *
+ * Этот файл должен совпадать с Compression.h сервера.
+ */
+namespace Compression
+{
+enum Codec : quint8
+{
+    CodecNone,       // Без сжатия
+    CodecQCompress,  // zlib через qCompress, не требует дополнительных библиотек
+    CodecLz4,        // LZ4 - наибольшая скорость
+    CodecZstd,       // zstd - наилучшая степень сжатия
+};
+
+/*
+ * Возвращает доступные алгоритмы в порядке предпочтения.
+ */
+QList<quint8> supportedCodecs();
+bool isCodecSupported(quint8 codec);
+
+/*
+ * Выбирает первый из предложенных другой стороной алгоритмов,
+ * который поддерживается здесь. Возвращает CodecNone, если таких нет.
+ */
+quint8 chooseCodec(const QList<quint8> &offeredCodecs);
+
+const char *codecName(quint8 codec);
+
+/*
+ * Сжимает data алгоритмом codec с уровнем level
+ * (-1 - уровень по умолчанию для алгоритма).
+ * Возвращает пустой массив при ошибке.
+ */
+QByteArray compress(quint8 codec, const QByteArray &data, int level = -1);
+
+/*
+ * Распаковывает data, сжатые алгоритмом codec, в массив размером rawSize.
+ */
+bool decompress(quint8 codec, const QByteArray &data, int rawSize, QByteArray &rawData);
+
+/*
+ * Упаковывает часть файла в формат, описанный выше.
+ */
+QByteArray encodeChunk(quint8 codec, const QByteArray &rawChunk, int level = -1);
+
+/*
+ * Распаковывает часть файла. Возвращает false, если данные повреждены,
+ * алгоритм не поддерживается или размер исходных данных больше maxRawSize.
+ */
+bool decodeChunk(const QByteArray &encodedChunk, QByteArray &rawChunk, int maxRawSize);
+}
+
+#endif // COMPRESSION_H
@@ -0,0 +1,53 @@
+#ifndef DIALOGBACKUPDIFF_H
+#define DIALOGBACKUPDIFF_H
+
+#include "tcpdatatypes.h"
+
+#include <QDialog>
+
+namespace Ui {
+class DialogBackupDiff;
+}
+
+class TcpClient;
+
+/*
+ * Класс диалогового окна, которое сравнивает две версии
+ * базы данных, хранящиеся на сервере.
+ *
+ * Пользователь выбирает старую и новую версии, сравнение
+ * выполняется на сервере, а отличия сотрудников добавляются
+ * в дерево по мере получения: добавленные и удаленные сотрудники -
+ * одной строкой, измененные - с дочерними строками
+ * "таблица: поле", прежним и новым значением.
+ */
+class DialogBackupDiff : public QDialog
+{
+    Q_OBJECT
+
+public:
+    explicit DialogBackupDiff(const QList<BackupInfo> &backupsList, TcpClient *client,
+                              QWidget *parent = nullptr);
+    ~DialogBackupDiff();
+
+private:
+    Ui::DialogBackupDiff *ui;
+
+    TcpClient *m_pTcpClient = nullptr;
+
+    /*
+     * Номер выполняемого запроса сравнения; 0, если сравнение не выполняется.
+     */
+    quint32 m_diffRequestId = 0;
+
+    static QString valueText(const QVariant &value);
+
+private slots:
+    void on_b_compare_clicked();
+
+    void slotDiffEntriesReceived(quint32 requestId, const QList<EmployeeDiff> &entries);
+    void slotDiffFinished(quint32 requestId, bool isSucceeded, quint32 addedCount,
+                          quint32 removedCount, quint32 changedCount, const QString &error);
+};
+
+#endif // DIALOGBACKUPDIFF_H
@@ -8,9 +8,16 @@
 #include <QStack>
 #include <QDir>
 #include <QTemporaryFile>
+#include <QThread>
+#include <QProgressBar>
+#include <QSet>
+
+#include <functional>
 
 #include "dialoginsertinfo.h"
 #include "tcpclient.h"
+#include "autobackupscheduler.h"
+#include "remotepagesource.h"
 
 QT_BEGIN_NAMESPACE
 namespace Ui { class MainWindow; }
@@ -26,8 +33,11 @@ QT_END_NAMESPACE
  *   выбранном пользователем сотруднике;
  * - Отслеживание наличия внесенных пользователем изменений в базу данных;
  * - Сохранение или отмена внесенных пользователем изменений;
- * - Инициация процесса загрузки базы данных на сервер и с сервера;
+ * - Инициация процесса загрузки базы данных на сервер и с сервера
+ *   и отображение ее хода в строке состояния;
  * - Предпросмотр и сохранение загруженной с сервера базы данных;
+ * - Вызов окна сравнения версий базы данных на сервере;
+ * - Передача принятых изменений планировщику автоматической загрузки;
  */
 class MainWindow : public QMainWindow
 {
@@ -88,9 +98,59 @@ private:
     const QString m_cServerHost = "127.0.0.1";
     const int m_cServerPort = 2323;
 
+    /*
+     * Клиент работает в потоке m_pTcpClientThread.
+     */
     TcpClient *m_pTcpClient = nullptr;
+    QThread *m_pTcpClientThread = nullptr;
+
+    /*
+     * Действие, которое нужно выполнить после подключения к серверу.
+     */
+    std::function<void()> m_pendingServerAction;
 
-    QTemporaryFile *m_pTemporaryDatabaseFile = nullptr;
+    AutoBackupScheduler *m_pAutoBackupScheduler = nullptr;
+
+    /*
+     * Номера запросов списка версий для окна выбора версии
+     * и для окна сравнения версий.
+     */
+    quint32 m_selectVersionListRequestId = 0;
+    quint32 m_diffListRequestId = 0;
+
+    /*
+     * Передачи баз данных, начатые пользователем. Только они
+     * отображаются в строке состояния: загрузки планировщика
+     * автоматической загрузки идут незаметно для пользователя.
+     */
+    QSet<quint32> m_userTransferRequestIds;
+
+    /*
+     * Передача базы данных, ход которой отображается в строке состояния.
+     */
+    quint32 m_transferRequestId = 0;
+    QProgressBar *m_pTransferProgressBar = nullptr;
+    QPushButton *m_pButtonCancelTransfer = nullptr;
+
+    /*
+     * Временный файл базы данных, полученной с сервера для предпросмотра.
+     */
+    QString m_temporaryDatabaseFilePath;
+
+    /*
+     * Версия, просматриваемая с сервера без получения.
+     * m_remoteDatabaseName - имя, под которым она открыта в QSQLITE.
+     */
+    RemotePageSource *m_pRemotePageSource = nullptr;
+    QString m_remoteDatabaseName;
+    QString m_remoteDbName;
+    BackupInfo m_remoteBackupInfo;
+
+    /*
+     * Получение просматриваемой версии для сохранения в m_previewSaveFilePath.
+     */
+    quint32 m_previewSaveRequestId = 0;
+    QString m_previewSaveFilePath;
 
     QPushButton *m_pButtonSaveAs = nullptr;
     QPushButton *m_pButtonSave = nullptr;
@@ -106,9 +166,15 @@ private:
 
     void setupUi();
 
-    bool setupDatabase(const QString &databaseFilePath);
+    /*
+     * connectOptions передаются драйверу QSQLITE. Если они заданы,
+     * databaseFilePath может быть не путем к файлу, а URI,
+     * и его существование не проверяется.
+     */
+    bool setupDatabase(const QString &databaseFilePath, const QString &connectOptions = QString());
 
-    bool setupOrganization(const QString &databaseFilePath);
+    bool setupOrganization(const QString &databaseFilePath,
+                           const QString &connectOptions = QString());
 
     void selectOrganizationToDisplay();
 
@@ -123,9 +189,57 @@ private:
      * Возвращает true, если соответствует, в противном случае возвращает false.
      */
     bool checkDatabaseValidity(const QSqlDatabase &database);
+    /*
+     * То же для любого потока: записи для сравнения
+     * передаются в recordsForComparison.
+     */
+    static bool checkDatabaseValidity(const QSqlDatabase &database,
+                                      const QList<QSqlRecord> &recordsForComparison);
 
     void deleteTableModels();    
     void deleteTempDatabaseFile();
+    void closeRemoteDatabase();
+
+    /*
+     * Проверяет, что версия на сервере открывается через RemoteSqliteVfs
+     * и соответствует требованиям программы, не показывая сообщений,
+     * и заранее читает страницы, нужные окну при открытии версии
+     * (см. prefetchRemoteDatabase). Ждет ответов сервера,
+     * поэтому вызывается в пуле потоков.
+     */
+    static bool probeRemoteDatabase(const QString &databaseName,
+                                    const QList<QSqlRecord> &recordsForComparison);
+    /*
+     * Читает всю таблицу "Общая информация", которую окно сортирует
+     * и по которой составляет список отделов, и первые строки остальных
+     * таблиц. Прочитанные блоки остаются в кэше RemotePageSource,
+     * поэтому модели в потоке окна при открытии не ждут сервер.
+     */
+    static void prefetchRemoteDatabase(const QSqlDatabase &database);
+
+    /*
+     * Показывает версию backupInfo, открытую в пуле потоков
+     * под именем remoteDatabaseName. Если isValid равен false,
+     * версия запрашивается с сервера целиком.
+     */
+    void finishRemotePreviewOpening(RemotePageSource *remotePageSource,
+                                    const QString &remoteDatabaseName, bool isValid,
+                                    const BackupInfo &backupInfo);
+
+    /*
+     * Переключает интерфейс в режим предпросмотра базы данных dbName.
+     */
+    void showPreviewControls(const QString &dbName);
+
+    /*
+     * Сохраняет просматриваемую базу данных в файл filePath
+     * и открывает его. Версия, просматриваемая с сервера,
+     * сначала получается с сервера целиком, поэтому сохранение
+     * заканчивается в finishPreviewSaving.
+     */
+    void savePreviewDatabase(const QString &filePath);
+    void finishPreviewSaving(const QString &dbFilePath);
+    void cancelPreviewSaving();
 
     /*
      * Очищает табличное представление главного окна,
@@ -154,7 +268,14 @@ private:
     void submitChanges();
     void revertChanges();
 
-    bool tryToConnectToServer();
+    /*
+     * Выполняет action, если клиент подключен к серверу.
+     * Иначе начинает подключение и выполняет action после него,
+     * не блокируя окно.
+     */
+    void runWhenConnectedToServer(std::function<void()> action);
+
+    void hideTransferProgress();
 
     int askToSaveChanges();
     int askToOverwriteOrganization();
@@ -169,12 +290,26 @@ private slots:
     void setIsDatabaseModifiedFalse();
 
     /*
-     * Активирует режим предпросмотра базы данных.
-     * Создает временный файл базы данных из dbInBytes с именем dbName.
+     * Активирует режим предпросмотра базы данных dbName,
+     * полученной с сервера во временный файл dbFilePath.
      * Отображает эту базу в табличном представлении
      * и блокирует возможность ее редактировать.
+     * Файл удаляется при выходе из режима предпросмотра.
+     */
+    void activatePreviewMode(const QString &dbFilePath, QString dbName);
+    /*
+     * Передает базу данных, полученную по запросу пользователя,
+     * в activatePreviewMode. Файлы остальных запросов удаляются.
      */
-    void activatePreviewMode(const QByteArray &dbInBytes, QString dbName);
+    void slotDatabaseReceived(quint32 requestId, const QString &dbFilePath, QString dbName);
+    /*
+     * Активирует режим предпросмотра версии backupInfo,
+     * не получая ее с сервера: страницы файла запрашиваются
+     * по мере того, как их читает SQLite. Если файловая система
+     * RemoteSqliteVfs недоступна или версию не удалось открыть так,
+     * она запрашивается с сервера целиком.
+     */
+    void activateRemotePreviewMode(const BackupInfo &backupInfo);
     /*
      * Деактивирует режим предпросмотра базы данных.
      * Отображает базу данных по пути dbFilePath
@@ -184,7 +319,26 @@ private slots:
      */
     void deactivatePreviewMode(QString dbFilePath = "");
 
-    void displayDbFileCreationStatus(bool dbFileCreated);
+    void displayDbFileCreationStatus(quint32 requestId, bool dbFileCreated);
+
+    void slotConnectedToServer();
+    void slotServerConnectionFailed(const QString &error);
+
+    /*
+     * Открывает окно выбора версии или окно сравнения версий,
+     * в зависимости от того, какой запрос списка выполнен.
+     */
+    void slotBackupsListReceived(quint32 requestId, const QList<BackupInfo> &backupsList);
+
+    void showTransferProgress(quint32 requestId, qint64 doneBytes, qint64 totalBytes);
+    void slotRequestCancelled(quint32 requestId);
+    void slotDownloadFailed(quint32 requestId, const QString &error);
+    void cancelTransfer();
+
+    /*
+     * Открывает окно сравнения версий со списком backupsList.
+     */
+    void showBackupDiffDialog(const QList<BackupInfo> &backupsList);
 
     void on_b_add_clicked();
     void on_b_delete_clicked();
@@ -207,6 +361,8 @@ private slots:
     void on_action_selectNewDatabase_triggered();
     void on_action_sendToServer_triggered();
     void on_action_receiveFromServer_triggered();
+    void on_action_compareOnServer_triggered();
+    void on_action_suspendAutoBackup_toggled(bool checked);
     void on_action_exit_triggered();
 
     void on_b_previewSave_clicked();
@@ -0,0 +1,172 @@
+#ifndef REMOTEPAGESOURCE_H
+#define REMOTEPAGESOURCE_H
+
+#include "framedecoder.h"
+
+#include <QThread>
+#include <QBitArray>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QCache>
+#include <QHash>
+#include <QSet>
+#include <QString>
+
+#include <functional>
+
+class QFile;
+class QTcpSocket;
+
+/*
+ * Файл версии базы данных, читаемый с сервера по частям.
+ *
+ * Используется для предпросмотра версии без ее получения:
+ * RemoteSqliteVfs передает сюда чтения SQLite, а недостающие блоки
+ * размером cBlockSize запрашиваются у сервера кадрами DatabaseRangeRequest.
+ * Полученные блоки хранятся в кэше, поэтому повторные чтения
+ * тех же страниц не обращаются к серверу.
+ *
+ * Подключение к серверу обслуживается в собственном потоке:
+ * он отправляет запросы, принимает и распаковывает ответы,
+ * не занимая поток, который читает базу данных. SQLite читает файл
+ * синхронно, поэтому read ждет блоки, которых еще нет в кэше,
+ * не дольше cTimeoutMs. Модели предпросмотра читают версию в потоке
+ * окна, поэтому страницы, нужные при открытии, заранее читаются
+ * в пуле потоков (MainWindow::prefetchRemoteDatabase); окно может
+ * ждать сервер только при чтении строк за пределами прочитанных.
+ * Вместе с недостающим блоком запрашиваются cReadAheadBlocks следующих,
+ * так как SQLite обычно читает страницы таблицы подряд.
+ *
+ * После fetchInBackground поток подключения получает остальные блоки
+ * и записывает весь файл версии на диск, чтобы его можно было добавить
+ * в локальный кэш. Одновременно выполняется не больше cBackgroundRequests
+ * фоновых запросов, поэтому блоки, которые ждет read, приходят почти
+ * без задержки. Фоновые блоки не попадают в кэш блоков и не вытесняют
+ * из него прочитанные страницы.
+ *
+ * open, read и fetchInBackground можно вызывать из любого потока,
+ * кроме потока подключения.
+ */
+class RemotePageSource
+{
+public:
+    RemotePageSource(const QString &host, int port, const QString &backupFileName);
+    ~RemotePageSource();
+
+    /*
+     * Подключается к серверу и запрашивает размер файла версии.
+     * Возвращает false, если сервер недоступен или версия не найдена.
+     */
+    bool open();
+    void close();
+
+    QString backupFileName() const { return m_backupFileName; }
+    qint64 size() const;
+
+    /*
+     * Читает не больше length байт файла с offset в data.
+     * Возвращает количество прочитанных байт или -1 при ошибке.
+     */
+    qint64 read(qint64 offset, char *data, qint64 length);
+
+    qint64 fetchedBytes() const;
+
+    /*
+     * Начинает получение всего файла версии в filePath. Когда файл
+     * записан целиком, в потоке подключения вызывается onFetched;
+     * если версия закрыта раньше, незаконченный файл удаляется.
+     */
+    void fetchInBackground(const QString &filePath,
+                           const std::function<void(const QString &filePath)> &onFetched);
+
+    static const qint64 cBlockSize;
+
+private:
+    enum State
+    {
+        Closed,
+        Opening,
+        Opened,
+        Failed
+    };
+
+    QString m_host;
+    int m_port = 0;
+    QString m_backupFileName;
+
+    /*
+     * Поток подключения. Сокет и остальные поля этой группы
+     * используются только в нем; m_pContext - объект, в контексте
+     * которого выполняется работа с сокетом.
+     */
+    QThread m_thread;
+    QObject *m_pContext = nullptr;
+    QTcpSocket *m_pSocket = nullptr;
+    FrameDecoder m_frameDecoder;
+    quint32 m_nextRequestId = 1;
+    quint32 m_helloRequestId = 0;
+    quint32 m_sizeRequestId = 0;
+    quint8 m_codec = 0;
+
+    // Номера блоков по номерам запросов
+    QHash<quint32, qint64> m_blockRequests;
+
+    /*
+     * Получение всего файла версии: записанные блоки, следующий
+     * блок для фонового запроса и блоки, запрошенные только в фоне.
+     */
+    QFile *m_pFetchFile = nullptr;
+    std::function<void(const QString &filePath)> m_onFetched;
+    QBitArray m_storedBlocks;
+    int m_storedBlocksCount = 0;
+    qint64 m_nextBackgroundBlock = 0;
+    QSet<qint64> m_backgroundBlocks;
+
+    /*
+     * Состояние, общее для потока подключения и читающего потока.
+     * Изменения сообщаются через m_stateChanged.
+     */
+    mutable QMutex m_mutex;
+    QWaitCondition m_stateChanged;
+    State m_state = Closed;
+    qint64 m_size = -1;
+    qint64 m_fetchedBytes = 0;
+
+    // Блоки файла по номерам; стоимость блока - его размер в КБ
+    QCache<qint64, QByteArray> m_blockCache;
+    QSet<qint64> m_requestedBlocks;
+    // Блоки, которые после получения помещаются в кэш блоков
+    QSet<qint64> m_demandedBlocks;
+
+    static const int cCacheSizeKb;
+    static const int cTimeoutMs;
+    static const int cReadAheadBlocks;
+    static const int cBackgroundRequests;
+
+    /*
+     * Вызываются при заблокированном m_mutex.
+     */
+    const QByteArray *waitForBlock(qint64 blockIndex);
+    void requestBlock(qint64 blockIndex);
+
+    /*
+     * Вызываются в потоке подключения.
+     */
+    void connectToServer();
+    void sendHello();
+    quint32 sendRangeRequest(qint64 offset, qint32 length);
+    void sendBlockRequest(qint64 blockIndex);
+    void readFrames();
+    void processFrame(const FrameDecoder::Frame &frame);
+    void processRange(quint32 requestId, const QByteArray &payload);
+    void startBackgroundFetch(const QString &filePath,
+                              const std::function<void(const QString &filePath)> &onFetched);
+    void requestBackgroundBlocks();
+    void storeBlock(qint64 blockIndex, const QByteArray &block);
+    void finishBackgroundFetch();
+    void stopBackgroundFetch();
+    quint32 sendFrame(quint16 dataType, const QByteArray &payload);
+    void fail(const QString &error);
+};
+
+#endif // REMOTEPAGESOURCE_H
@@ -0,0 +1,51 @@
+#ifndef REMOTESQLITEVFS_H
+#define REMOTESQLITEVFS_H
+
+#include <QString>
+
+class RemotePageSource;
+
+/*
+ * Виртуальная файловая система SQLite для просмотра версий,
+ * хранящихся на сервере, без их получения.
+ *
+ * Файл базы данных, подключенный методом attach, открывается
+ * через QSQLITE по возвращенному имени с параметрами cConnectOptions.
+ * Каждое чтение SQLite передается в RemotePageSource, который
+ * получает с сервера только нужные страницы. Файл открывается
+ * только для чтения и считается неизменяемым, поэтому журналы
+ * и блокировки не используются.
+ *
+ * Файловая система регистрируется в библиотеке SQLite, с которой
+ * собрана программа (HAVE_SQLITE3). Драйвер QSQLITE видит ее,
+ * только если Qt использует ту же библиотеку, а не встроенную копию.
+ * Иначе открытие базы данных завершается ошибкой, и версию
+ * нужно получить с сервера целиком. isAvailable проверяет это
+ * заранее, не подключаясь к серверу.
+ */
+class RemoteSqliteVfs
+{
+public:
+    static const QString cConnectOptions;
+
+    /*
+     * Подключает source и возвращает имя базы данных для
+     * QSqlDatabase::setDatabaseName. Возвращает пустую строку,
+     * если файловая система недоступна.
+     */
+    static QString attach(RemotePageSource *source);
+    static void detach(const QString &databaseName);
+
+    /*
+     * Проверяет, что драйвер QSQLITE открывает базы данных через эту
+     * файловую систему: открывает через нее пустой файл без источника.
+     * Результат первой проверки запоминается.
+     */
+    static bool isAvailable();
+
+private:
+    static bool registerVfs();
+    static bool checkAvailability();
+};
+
+#endif // REMOTESQLITEVFS_H
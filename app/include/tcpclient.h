@@ -2,11 +2,24 @@
 #define TCPCLIENT_H
 
 #include "tcpdatatypes.h"
+#include "framedecoder.h"
+#include "backupcache.h"
 
-#include <QWidget>
+#include <QObject>
 #include <QTcpSocket>
 #include <QtSql/QSqlDatabase>
 #include <QFileInfo>
+#include <QTemporaryFile>
+#include <QCryptographicHash>
+#include <QBitArray>
+#include <QQueue>
+#include <QPair>
+#include <QHash>
+#include <QSet>
+#include <QAtomicInt>
+#include <QMetaType>
+
+#include <functional>
 
 /*
  * Класс клиента, обеспечивающего
@@ -14,7 +27,9 @@
  *
  *
  * В его задачи входят:
- * - Отправка базы данных на сервер;
+ * - Отправка базы данных на сервер. Используется разностная загрузка:
+ * серверу отправляются хеши страниц файла, а затем только те страницы,
+ * которых у сервера еще нет;
  *
  * - Получение от сервера подтверждения, что он успешно получил
  * и сохранил отправленную ему базу данных;
@@ -24,25 +39,272 @@
  * - Отправка серверу названия базы данных,
  * которую он должен отослать клиенту;
  *
- * - Получение базы данных с сервера;
+ * - Получение базы данных с сервера. Части базы данных записываются
+ * во временный файл по мере получения, а ее хеш вычисляется по ходу
+ * записи, поэтому размер базы не влияет на занимаемую клиентом память.
+ * Путь к готовому файлу передается в сигнале databaseReceived.
+ * Версии с известным хешем содержимого записываются сразу в каталог
+ * локального кэша BackupCache и переносятся в кэш без копирования,
+ * а версия из кэша открывается без обращения к серверу;
+ *
+ * - Получение отдельных записей сохраненной версии (сотрудника по номеру,
+ * сотрудников по фамилии или одной таблицы) без загрузки всей базы данных.
+ * Записи приходят пачками в сигнале backupQueryRowsReceived,
+ * окончание ответа - в сигнале backupQueryFinished;
+ *
+ * - Сравнение двух версий на сервере. Отличия сотрудников приходят
+ * пачками в сигнале backupDiffEntriesReceived, итог сравнения -
+ * в сигнале backupDiffFinished;
+ *
+ * Каждый запрос получает номер, который сервер возвращает в ответе.
+ * Запросы списка и баз данных отправляются, не дожидаясь ответов
+ * на предыдущие. Загрузки на сервер выполняются по одной,
+ * следующая ждет в очереди подтверждения предыдущей.
+ *
+ * После переподключения к серверу прерванные передачи возобновляются
+ * под прежними номерами: получение базы данных продолжается с уже
+ * полученного байта, а загрузка повторяет разностную загрузку,
+ * в которой сервер запрашивает только страницы, не сохраненные до обрыва.
+ *
+ * Клиент работает в собственном потоке (главное окно переносит его
+ * в QThread через moveToThread), поэтому подключение, чтение файлов
+ * и запись в сокет не задерживают интерфейс. Открытые методы можно
+ * вызывать из любого потока: они сразу возвращают номер запроса,
+ * а сама работа выполняется в потоке клиента. Результаты передаются
+ * сигналами, которые доходят до главного окна через очередь событий.
+ * Ход передачи базы данных сообщается сигналом transferProgress,
+ * а любой запрос можно отменить методом cancelRequest.
  */
-class TcpClient : public QWidget
+class TcpClient : public QObject
 {
     Q_OBJECT
 
 public:
-    explicit TcpClient(QString host, int port, QWidget *parent = nullptr);
+    explicit TcpClient(QObject *parent = nullptr);
+
+    /*
+     * Начинает подключение к серверу и сразу возвращает управление.
+     * Результат передается сигналом connectedToServer или connectionFailed.
+     */
+    void connectToServer(const QString &host, int port);
+    bool isConnectedToServer() const;
+
+    /*
+     * Следующие методы возвращают номер отправленного запроса.
+     */
+    quint32 sendDatabase(const QFileInfo &dbFileInfo);
+    /*
+     * Запрашивает список версий баз данных на сервере.
+     * Страницы списка запрашиваются по очереди, пока сервер
+     * не пришлет последнюю, после чего весь список передается
+     * в сигнале backupsListReceived с номером, который вернул этот метод.
+     */
+    quint32 sendDatabasesListRequest(const QString &orgName = QString(),
+                                     qint64 from = 0, qint64 to = 0);
+    quint32 sendSelectedDatabaseName(const QString &selDbName);
+    /*
+     * Запрашивает версию backupInfo. Если версия с тем же хешем
+     * есть в локальном кэше, файл для предпросмотра копируется из кэша,
+     * и сервер не запрашивается.
+     */
+    quint32 sendSelectedDatabaseName(const BackupInfo &backupInfo);
+
+    /*
+     * Проверяет, есть ли версия с хешем hash в локальном кэше,
+     * и учитывает попадание или промах в счетчиках кэша.
+     */
+    bool isBackupCached(const QByteArray &hash);
+
+    /*
+     * Путь в каталоге кэша для версии с хешем hash, получаемой
+     * не через sendSelectedDatabaseName (см. BackupCache::partFilePath).
+     */
+    QString backupCachePartFilePath(const QByteArray &hash) const;
+    /*
+     * Проверяет хеш содержимого файла partFilePath и добавляет его
+     * в локальный кэш под хешем hash. Файл с другим хешем удаляется.
+     */
+    void addToBackupCache(const QByteArray &hash, const QString &partFilePath);
+
+    quint32 sendBackupQuery(const BackupQuery &query);
+    quint32 queryEmployee(const QString &backupFileName, int employeeId);
+    quint32 searchEmployees(const QString &backupFileName, const QString &surname);
+    quint32 queryTable(const QString &backupFileName, const QString &tableName);
 
-    bool connectToServer(QString host, int port);
-    bool isConnectedToServer();
+    quint32 sendBackupDiffRequest(const QString &oldBackupFileName, const QString &newBackupFileName);
 
-    void sendDatabase(const QFileInfo &dbFileInfo);
-    void sendDatabasesListRequest();
-    void sendSelectedDatabaseName(const QString &selDbName);
+    /*
+     * Отменяет запрос requestId: удаляет его состояние на клиенте,
+     * сообщает серверу кадром CancelRequest и отправляет сигнал requestCancelled.
+     * Кадры, которые сервер успел отправить по этому запросу, пропускаются.
+     */
+    void cancelRequest(quint32 requestId);
 
 private:
     QTcpSocket *m_pServerSocket;
 
+    /*
+     * Сохраняет принимаемый кадр между вызовами slotReadyRead.
+     */
+    FrameDecoder m_frameDecoder;
+
+    /*
+     * Номера запросов выдаются из любого потока.
+     */
+    QAtomicInteger<quint32> m_nextRequestId = 1;
+
+    QAtomicInt m_isConnected = 0;
+
+    /*
+     * Отмененные запросы, кадры ответов на которые еще могут прийти.
+     */
+    QSet<quint32> m_cancelledRequests;
+
+    /*
+     * Алгоритм сжатия страниц, отправляемых серверу.
+     * Выбирается сервером в ответ на кадр Hello.
+     */
+    quint8 m_codec = 0;
+
+    /*
+     * Состояние приема базы данных от сервера.
+     * Полученная часть хранится в файле m_pReceivedDbFile.
+     */
+    quint32 m_receivedDbRequestId = 0;
+    QString m_receivedDbName;
+    QString m_receivedDbBackupFileName;
+    QByteArray m_receivedDbHash;
+    qint64 m_receivedDbExpectedSize = -1;
+    qint64 m_receivedDbSize = 0;
+    QTemporaryFile *m_pReceivedDbFile = nullptr;
+
+    /*
+     * Хеш содержимого получаемой базы данных вычисляется так же,
+     * как BackupStore::contentHash на сервере: SHA-256 списка хешей
+     * SHA-256 ее страниц. m_receivedDbPage хранит начало страницы,
+     * которая еще не получена целиком; размер страницы определяется
+     * по заголовку файла, как только получены его первые 100 байт.
+     */
+    QCryptographicHash m_receivedDbHasher{QCryptographicHash::Sha256};
+    quint32 m_receivedDbPageSize = 0;
+    QByteArray m_receivedDbPage;
+
+    /*
+     * Имена версий, запрошенных у сервера, по номерам запросов.
+     */
+    QHash<quint32, QString> m_requestedDownloads;
+
+    void requestDatabase(quint32 requestId, const QString &backupFileName,
+                         qint64 offset, const QByteArray &contentHash);
+    void resetReceivedDatabase();
+
+    /*
+     * Локальный кэш полученных версий.
+     */
+    BackupCache m_backupCache;
+
+    bool openCachedDatabase(quint32 requestId, const BackupInfo &backupInfo);
+    /*
+     * Создает для главного окна временный файл версии с хешем hash
+     * из кэша. Возвращает путь к файлу или пустую строку при ошибке.
+     */
+    QString createDatabaseFileFromCache(const QByteArray &hash, const QString &dbName);
+
+    /*
+     * Хеш содержимого файла, вычисляемый так же, как при получении.
+     */
+    static QByteArray fileContentHash(const QString &filePath);
+
+    /*
+     * Шаблон имени временного файла базы данных dbName.
+     */
+    static QString tempDatabaseFileTemplate(const QString &dbName);
+
+    /*
+     * Создает файл для получаемой базы данных: в каталоге кэша,
+     * если хеш ее содержимого dbHash известен, иначе во временном каталоге.
+     */
+    bool createReceivedDatabaseFile(const QString &dbName, const QByteArray &dbHash);
+    /*
+     * Прекращает получение базы данных по запросу requestId,
+     * удаляет временный файл и отправляет сигнал downloadFailed.
+     */
+    void failDownload(quint32 requestId, const QString &error);
+    bool appendReceivedData(const QByteArray &data);
+    void hashReceivedData(const QByteArray &data, bool isLastData);
+    /*
+     * Вычисляет хеш заново по уже записанной части файла.
+     * Нужен, если сервер продолжил передачу раньше ее конца.
+     */
+    bool rehashReceivedDatabase();
+
+    /*
+     * Состояние приема списка версий баз данных на сервере.
+     */
+    quint32 m_listRequestId = 0;
+    quint32 m_listPageRequestId = 0;
+    QString m_listOrgName;
+    qint64 m_listFrom = 0;
+    qint64 m_listTo = 0;
+    QList<BackupInfo> m_receivedBackupsList;
+
+    void sendDatabasesListPageRequest(qint64 cursor);
+
+    /*
+     * Номера запросов записей, на которые еще не получен BackupQueryEnd,
+     * и запросов сравнения версий, на которые не получен BackupDiffEnd.
+     */
+    QSet<quint32> m_pendingQueries;
+    QSet<quint32> m_pendingDiffs;
+
+    /*
+     * Состояние разностной загрузки базы данных на сервер.
+     * m_uploadRequestId равен 0, если загрузка не выполняется.
+     */
+    quint32 m_uploadRequestId = 0;
+    QFileInfo m_uploadFileInfo;
+    QString m_deltaUploadFilePath;
+    quint32 m_deltaUploadPageSize = 0;
+    QQueue<QPair<quint32, QFileInfo>> m_pendingUploads;
+
+    /*
+     * Отправка страниц, запрошенных сервером. Файл читается
+     * по одной странице, и следующая страница записывается в сокет,
+     * только когда в его буфере меньше cMaxBytesToWrite неотправленных байт,
+     * поэтому занимаемая память не зависит от размера файла.
+     */
+    QFile *m_pDeltaUploadFile = nullptr;
+    QBitArray m_missingPages;
+    int m_nextMissingPage = 0;
+    qint64 m_deltaUploadSentBytes = 0;
+    qint64 m_deltaUploadDoneBytes = 0;
+    qint64 m_deltaUploadTotalBytes = 0;
+
+    static const qint64 cMaxBytesToWrite;
+
+    quint32 newRequestId();
+
+    /*
+     * Выполняет task в потоке клиента.
+     */
+    void runInClientThread(std::function<void()> task);
+
+    void sendHello();
+    void sendFrame(quint16 dataType, quint32 requestId, const QByteArray &payload = QByteArray());
+    void processFrame(const FrameDecoder::Frame &frame);
+
+    void startDeltaUpload(quint32 requestId, const QFileInfo &dbFileInfo);
+    void sendMissingPages(const QBitArray &missingPages);
+    void writeNextMissingPages();
+    void closeDeltaUploadFile();
+    void finishUpload();
+
+    /*
+     * Определяет размер страницы по заголовку файла SQLite.
+     * Должен совпадать с BackupStore::detectPageSize на сервере.
+     */
+    static quint32 detectPageSize(const QByteArray &fileHeader);
+
 private slots:
     void slotReadyRead();
 
@@ -50,11 +312,48 @@ private slots:
 
     void slotConnected();
 
-    void slotGetSelectedBackupVersion(QString &version);
+    void slotBytesWritten(qint64 bytes);
+
+    void slotDisconnected();
 
 signals:
-    void databaseReceived(const QByteArray &dbInBytes, QString dbName);
-    void serverCreatedDatabaseFile(bool dbFileCreated);
+    void connectedToServer();
+    void connectionFailed(const QString &error);
+
+    /*
+     * База данных dbName получена по запросу requestId в файл dbFilePath.
+     * Файл переходит к получателю сигнала, который должен удалить его.
+     */
+    void databaseReceived(quint32 requestId, const QString &dbFilePath, QString dbName);
+    /*
+     * База данных по запросу requestId не получена; временный файл удален.
+     */
+    void downloadFailed(quint32 requestId, const QString &error);
+    /*
+     * Загрузка на сервер по запросу requestId завершена.
+     */
+    void uploadFinished(quint32 requestId, bool isSucceeded);
+
+    /*
+     * Передано doneBytes из totalBytes байт базы данных по запросу requestId.
+     * При загрузке на сервер считаются только отправляемые страницы.
+     */
+    void transferProgress(quint32 requestId, qint64 doneBytes, qint64 totalBytes);
+    void requestCancelled(quint32 requestId);
+
+    void backupQueryRowsReceived(quint32 requestId, const BackupQueryBatch &batch);
+    void backupQueryFinished(quint32 requestId, bool isSucceeded,
+                             quint32 rowCount, const QString &error);
+
+    void backupsListReceived(quint32 requestId, const QList<BackupInfo> &backupsList);
+
+    void backupDiffEntriesReceived(quint32 requestId, const QList<EmployeeDiff> &entries);
+    void backupDiffFinished(quint32 requestId, bool isSucceeded, quint32 addedCount,
+                            quint32 removedCount, quint32 changedCount, const QString &error);
 };
 
+Q_DECLARE_METATYPE(BackupInfo)
+Q_DECLARE_METATYPE(BackupQueryBatch)
+Q_DECLARE_METATYPE(EmployeeDiff)
+
 #endif // TCPCLIENT_H
@@ -0,0 +1,228 @@
+#include "autobackupscheduler.h"
+#include "tcpclient.h"
+
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QThreadPool>
+#include <QPointer>
+#include <QFile>
+#include <QDebug>
+
+namespace
+{
+const int cDefaultCoalesceSeconds = 60;
+const int cDefaultMinIntervalSeconds = 600;
+}
+
+AutoBackupScheduler::AutoBackupScheduler(TcpClient *client, const QString &serverHost,
+                                         int serverPort, QObject *parent)
+    : QObject(parent)
+    , m_pTcpClient(client)
+    , m_serverHost(serverHost)
+    , m_serverPort(serverPort)
+    , m_settings(QCoreApplication::applicationDirPath() + "/settings.ini", QSettings::IniFormat)
+{
+    // Значения по умолчанию записываются, чтобы их можно было найти и изменить в файле
+    if (!m_settings.contains("autoBackup/enabled"))
+        m_settings.setValue("autoBackup/enabled", true);
+    if (!m_settings.contains("autoBackup/coalesceSeconds"))
+        m_settings.setValue("autoBackup/coalesceSeconds", cDefaultCoalesceSeconds);
+    if (!m_settings.contains("autoBackup/minIntervalSeconds"))
+        m_settings.setValue("autoBackup/minIntervalSeconds", cDefaultMinIntervalSeconds);
+
+    m_isEnabled = m_settings.value("autoBackup/enabled").toBool();
+    m_coalesceMs = qMax(1, m_settings.value("autoBackup/coalesceSeconds").toInt()) * 1000;
+    m_minIntervalMs = qMax(0, m_settings.value("autoBackup/minIntervalSeconds").toInt()) * 1000;
+
+    m_coalesceTimer.setSingleShot(true);
+
+    connect(&m_coalesceTimer, SIGNAL(timeout()), this, SLOT(slotCoalesceTimeout()));
+
+    connect(m_pTcpClient, SIGNAL(uploadFinished(quint32,bool)),
+            this, SLOT(slotUploadFinished(quint32,bool)));
+
+    connect(m_pTcpClient, SIGNAL(requestCancelled(quint32)),
+            this, SLOT(slotRequestCancelled(quint32)));
+}
+
+void AutoBackupScheduler::noteChanges(const QFileInfo &dbFileInfo)
+{
+    if (!m_isEnabled || !dbFileInfo.exists())
+        return;
+
+    m_dbFileInfo = dbFileInfo;
+    m_hasPendingChanges = true;
+
+    if (!m_isSuspended)
+        schedule(m_coalesceMs);
+}
+
+void AutoBackupScheduler::setSuspended(bool isSuspended)
+{
+    m_isSuspended = isSuspended;
+
+    if (m_isSuspended)
+    {
+        m_coalesceTimer.stop();
+        qInfo() << "Автоматическая загрузка базы данных приостановлена";
+    }
+    else
+    {
+        qInfo() << "Автоматическая загрузка базы данных возобновлена";
+
+        if (m_hasPendingChanges)
+            schedule(m_coalesceMs);
+    }
+}
+
+/*
+ * Каждый вызов откладывает проверку, поэтому изменения,
+ * принятые одно за другим, загружаются вместе.
+ */
+void AutoBackupScheduler::schedule(int delayMs)
+{
+    m_coalesceTimer.start(delayMs);
+}
+
+void AutoBackupScheduler::slotCoalesceTimeout()
+{
+    if (m_isSuspended || !m_hasPendingChanges)
+        return;
+
+    // Следующая загрузка будет запланирована после окончания текущей
+    if (m_uploadRequestId != 0 || m_isHashingInProgress)
+        return;
+
+    if (m_lastUploadTimer.isValid() && m_lastUploadTimer.elapsed() < m_minIntervalMs)
+    {
+        schedule(int(m_minIntervalMs - m_lastUploadTimer.elapsed()));
+        return;
+    }
+
+    if (!m_pTcpClient->isConnectedToServer())
+    {
+        qInfo() << "Автоматическая загрузка отложена: нет подключения к серверу";
+
+        m_pTcpClient->connectToServer(m_serverHost, m_serverPort);
+        schedule(m_coalesceMs);
+        return;
+    }
+
+    startHashing();
+}
+
+/*
+ * Хеш файла вычисляется в пуле потоков, чтобы чтение
+ * большой базы данных не задерживало интерфейс.
+ */
+void AutoBackupScheduler::startHashing()
+{
+    m_hasPendingChanges = false;
+    m_isHashingInProgress = true;
+
+    QPointer<AutoBackupScheduler> scheduler(this);
+    const QFileInfo dbFileInfo = m_dbFileInfo;
+
+    QThreadPool::globalInstance()->start([scheduler, dbFileInfo]()
+    {
+        const QByteArray hash = fileHash(dbFileInfo.absoluteFilePath());
+
+        QMetaObject::invokeMethod(QCoreApplication::instance(), [scheduler, dbFileInfo, hash]()
+        {
+            if (!scheduler)
+                return;
+
+            scheduler->m_isHashingInProgress = false;
+            scheduler->uploadIfChanged(dbFileInfo, hash);
+        }, Qt::QueuedConnection);
+    });
+}
+
+void AutoBackupScheduler::uploadIfChanged(const QFileInfo &dbFileInfo, const QByteArray &hash)
+{
+    if (hash.isEmpty())
+    {
+        qInfo() << "ОШИБКА: не удалось прочитать базу данных для автоматической загрузки:"
+                << dbFileInfo.absoluteFilePath();
+    }
+    else if (hash == lastUploadedHash(dbFileInfo.absoluteFilePath()))
+    {
+        qInfo() << "Автоматическая загрузка не нужна: база данных не изменилась с последней загрузки";
+    }
+    else if (m_isSuspended)
+    {
+        // Загрузка начнется после окончания паузы
+        m_hasPendingChanges = true;
+        return;
+    }
+    else
+    {
+        m_uploadRequestId = m_pTcpClient->sendDatabase(dbFileInfo);
+        m_uploadFilePath = dbFileInfo.absoluteFilePath();
+        m_uploadHash = hash;
+        m_lastUploadTimer.start();
+
+        qInfo() << "Начата автоматическая загрузка базы данных:" << dbFileInfo.fileName();
+        return;
+    }
+
+    if (m_hasPendingChanges && !m_isSuspended)
+        schedule(m_coalesceMs);
+}
+
+void AutoBackupScheduler::slotUploadFinished(quint32 requestId, bool isSucceeded)
+{
+    if (requestId == 0 || requestId != m_uploadRequestId)
+        return;
+
+    if (isSucceeded)
+    {
+        QVariantMap lastUploadedHashes = m_settings.value("autoBackup/lastUploadedHashes").toMap();
+        lastUploadedHashes.insert(m_uploadFilePath, QString::fromLatin1(m_uploadHash.toHex()));
+        m_settings.setValue("autoBackup/lastUploadedHashes", lastUploadedHashes);
+    }
+    else
+    {
+        qInfo() << "ОШИБКА: автоматическая загрузка базы данных не удалась, она будет повторена:"
+                << m_uploadFilePath;
+
+        // Изменения другого файла, принятые во время загрузки, загружаются раньше
+        if (!m_hasPendingChanges)
+            m_dbFileInfo = QFileInfo(m_uploadFilePath);
+
+        m_hasPendingChanges = true;
+    }
+
+    m_uploadRequestId = 0;
+    m_uploadFilePath.clear();
+    m_uploadHash.clear();
+
+    if (m_hasPendingChanges && !m_isSuspended)
+        schedule(m_coalesceMs);
+}
+
+void AutoBackupScheduler::slotRequestCancelled(quint32 requestId)
+{
+    // Отмененная загрузка повторяется так же, как неудачная
+    slotUploadFinished(requestId, false);
+}
+
+QByteArray AutoBackupScheduler::lastUploadedHash(const QString &filePath) const
+{
+    const QVariantMap lastUploadedHashes = m_settings.value("autoBackup/lastUploadedHashes").toMap();
+
+    return QByteArray::fromHex(lastUploadedHashes.value(filePath).toString().toLatin1());
+}
+
+QByteArray AutoBackupScheduler::fileHash(const QString &filePath)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly))
+        return QByteArray();
+
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    if (!hash.addData(&file))
+        return QByteArray();
+
+    return hash.result();
+}
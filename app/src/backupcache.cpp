@@ -0,0 +1,143 @@
+#include "backupcache.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QUuid>
+#include <QDebug>
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+const qint64 BackupCache::cMaxCacheSize = qint64(1024) * 1024 * 1024;
+
+BackupCache::BackupCache(const QString &directoryPath)
+    : m_directory(directoryPath)
+{
+    if (!m_directory.exists())
+    {
+        m_directory.mkpath(".");
+    }
+
+    // Файлы, запись которых прервалась при прошлом запуске
+    const QStringList partFileNames = m_directory.entryList(QStringList("*.part"), QDir::Files);
+    for (const QString &partFileName : partFileNames)
+        m_directory.remove(partFileName);
+}
+
+bool BackupCache::lookup(const QByteArray &hash)
+{
+    const QString cachedPath = cachedFilePath(hash);
+
+    if (cachedPath.isEmpty())
+    {
+        m_missCount.fetchAndAddRelaxed(1);
+        return false;
+    }
+
+    m_hitCount.fetchAndAddRelaxed(1);
+
+    // Время изменения файла - время последнего обращения к нему
+    QFile file(cachedPath);
+    if (file.open(QIODevice::ReadWrite))
+        file.setFileTime(QDateTime::currentDateTime(), QFileDevice::FileModificationTime);
+
+    return true;
+}
+
+QString BackupCache::cachedFilePath(const QByteArray &hash) const
+{
+    if (hash.isEmpty())
+        return QString();
+
+    const QString path = filePath(hash);
+
+    return QFileInfo::exists(path) ? path : QString();
+}
+
+bool BackupCache::linkTo(const QByteArray &hash, const QString &targetPath) const
+{
+    const QString cachedPath = cachedFilePath(hash);
+    if (cachedPath.isEmpty())
+        return false;
+
+#ifdef Q_OS_WIN
+    if (CreateHardLinkW(reinterpret_cast<const wchar_t *>(QDir::toNativeSeparators(targetPath).utf16()),
+                        reinterpret_cast<const wchar_t *>(QDir::toNativeSeparators(cachedPath).utf16()),
+                        nullptr))
+        return true;
+#else
+    if (::link(QFile::encodeName(cachedPath).constData(), QFile::encodeName(targetPath).constData()) == 0)
+        return true;
+#endif
+
+    return QFile::copy(cachedPath, targetPath);
+}
+
+QString BackupCache::partFilePath(const QByteArray &hash) const
+{
+    return m_directory.filePath(QString::fromLatin1(hash.toHex()) + "."
+                                + QUuid::createUuid().toString(QUuid::WithoutBraces) + ".part");
+}
+
+QString BackupCache::partFileTemplate(const QByteArray &hash) const
+{
+    return m_directory.filePath(QString::fromLatin1(hash.toHex()) + ".XXXXXX.part");
+}
+
+bool BackupCache::insertPart(const QByteArray &hash, const QString &partPath)
+{
+    if (hash.isEmpty() || !cachedFilePath(hash).isEmpty())
+    {
+        QFile::remove(partPath);
+        return false;
+    }
+
+    const QString cachedPath = filePath(hash);
+
+    if (!QFile::rename(partPath, cachedPath))
+    {
+        qInfo() << "ОШИБКА: не удалось сохранить версию в кэш:" << cachedPath;
+        QFile::remove(partPath);
+
+        return false;
+    }
+
+    evict(QFileInfo(cachedPath).fileName());
+
+    return true;
+}
+
+QString BackupCache::filePath(const QByteArray &hash) const
+{
+    return m_directory.filePath(QString::fromLatin1(hash.toHex()) + ".db");
+}
+
+void BackupCache::evict(const QString &keptFileName)
+{
+    // Сначала файлы, к которым дольше всего не обращались
+    const QFileInfoList files = m_directory.entryInfoList(QStringList("*.db"), QDir::Files,
+                                                          QDir::Time | QDir::Reversed);
+
+    qint64 totalSize = 0;
+    for (const QFileInfo &fileInfo : files)
+        totalSize += fileInfo.size();
+
+    for (const QFileInfo &fileInfo : files)
+    {
+        if (totalSize <= cMaxCacheSize)
+            break;
+
+        if (fileInfo.fileName() == keptFileName)
+            continue;
+
+        if (QFile::remove(fileInfo.absoluteFilePath()))
+        {
+            totalSize -= fileInfo.size();
+            qInfo() << "Из кэша удалена версия:" << fileInfo.fileName();
+        }
+    }
+}
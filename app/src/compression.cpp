@@ -0,0 +1,209 @@
+#include "compression.h"
+
+#include <QtEndian>
+
+#ifdef HAVE_LZ4
+#include <lz4.h>
+#include <lz4hc.h>
+#endif
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+QList<quint8> Compression::supportedCodecs()
+{
+    QList<quint8> codecs;
+
+#ifdef HAVE_LZ4
+    codecs << CodecLz4;
+#endif
+#ifdef HAVE_ZSTD
+    codecs << CodecZstd;
+#endif
+    codecs << CodecQCompress;
+
+    return codecs;
+}
+
+bool Compression::isCodecSupported(quint8 codec)
+{
+    return codec == CodecNone || supportedCodecs().contains(codec);
+}
+
+quint8 Compression::chooseCodec(const QList<quint8> &offeredCodecs)
+{
+    for (quint8 codec : offeredCodecs)
+    {
+        if (isCodecSupported(codec))
+            return codec;
+    }
+
+    return CodecNone;
+}
+
+const char *Compression::codecName(quint8 codec)
+{
+    switch (codec)
+    {
+        case CodecNone :
+          return "none";
+
+        case CodecQCompress :
+          return "qCompress";
+
+        case CodecLz4 :
+          return "lz4";
+
+        case CodecZstd :
+          return "zstd";
+
+        default :
+          return "unknown";
+    }
+}
+
+QByteArray Compression::compress(quint8 codec, const QByteArray &data, int level)
+{
+    switch (codec)
+    {
+        case CodecQCompress :
+        {
+            // qCompress записывает размер исходных данных в первые 4 байта
+            QByteArray compressed = qCompress(data, level);
+            return compressed.mid(int(sizeof(quint32)));
+        }
+
+#ifdef HAVE_LZ4
+        case CodecLz4 :
+        {
+            QByteArray compressed(LZ4_compressBound(data.size()), Qt::Uninitialized);
+            int compressedSize = 0;
+
+            // Уровни выше 1 используют более медленный вариант LZ4HC
+            if (level > 1)
+                compressedSize = LZ4_compress_HC(data.constData(), compressed.data(),
+                                                 data.size(), compressed.size(), level);
+            else
+                compressedSize = LZ4_compress_default(data.constData(), compressed.data(),
+                                                      data.size(), compressed.size());
+
+            if (compressedSize <= 0)
+                return QByteArray();
+
+            compressed.resize(compressedSize);
+            return compressed;
+        }
+#endif
+
+#ifdef HAVE_ZSTD
+        case CodecZstd :
+        {
+            QByteArray compressed(int(ZSTD_compressBound(size_t(data.size()))), Qt::Uninitialized);
+            size_t compressedSize = ZSTD_compress(compressed.data(), size_t(compressed.size()),
+                                                  data.constData(), size_t(data.size()),
+                                                  level < 0 ? ZSTD_CLEVEL_DEFAULT : level);
+
+            if (ZSTD_isError(compressedSize))
+                return QByteArray();
+
+            compressed.resize(int(compressedSize));
+            return compressed;
+        }
+#endif
+
+        default :
+          return QByteArray();
+    }
+}
+
+bool Compression::decompress(quint8 codec, const QByteArray &data, int rawSize, QByteArray &rawData)
+{
+    switch (codec)
+    {
+        case CodecQCompress :
+        {
+            QByteArray compressed(int(sizeof(quint32)), Qt::Uninitialized);
+            qToBigEndian<quint32>(quint32(rawSize), compressed.data());
+            compressed.append(data);
+
+            rawData = qUncompress(compressed);
+            return rawData.size() == rawSize;
+        }
+
+#ifdef HAVE_LZ4
+        case CodecLz4 :
+        {
+            rawData.resize(rawSize);
+            int decompressedSize = LZ4_decompress_safe(data.constData(), rawData.data(),
+                                                       data.size(), rawSize);
+            return decompressedSize == rawSize;
+        }
+#endif
+
+#ifdef HAVE_ZSTD
+        case CodecZstd :
+        {
+            rawData.resize(rawSize);
+            size_t decompressedSize = ZSTD_decompress(rawData.data(), size_t(rawSize),
+                                                      data.constData(), size_t(data.size()));
+            return !ZSTD_isError(decompressedSize) && decompressedSize == size_t(rawSize);
+        }
+#endif
+
+        default :
+          return false;
+    }
+}
+
+QByteArray Compression::encodeChunk(quint8 codec, const QByteArray &rawChunk, int level)
+{
+    if (codec != CodecNone)
+    {
+        QByteArray compressed = compress(codec, rawChunk, level);
+
+        // Сжатие имеет смысл, только если часть уменьшилась
+        if (!compressed.isEmpty()
+                && compressed.size() + int(sizeof(quint32)) < rawChunk.size())
+        {
+            QByteArray encodedChunk(1 + int(sizeof(quint32)), Qt::Uninitialized);
+            encodedChunk[0] = char(codec);
+            qToBigEndian<quint32>(quint32(rawChunk.size()), encodedChunk.data() + 1);
+            encodedChunk.append(compressed);
+
+            return encodedChunk;
+        }
+    }
+
+    QByteArray encodedChunk;
+    encodedChunk.reserve(rawChunk.size() + 1);
+    encodedChunk.append(char(CodecNone));
+    encodedChunk.append(rawChunk);
+
+    return encodedChunk;
+}
+
+bool Compression::decodeChunk(const QByteArray &encodedChunk, QByteArray &rawChunk, int maxRawSize)
+{
+    if (encodedChunk.isEmpty())
+        return false;
+
+    quint8 codec = quint8(encodedChunk.at(0));
+
+    if (codec == CodecNone)
+    {
+        rawChunk = encodedChunk.mid(1);
+        return rawChunk.size() <= maxRawSize;
+    }
+
+    const int cCompressedHeaderSize = 1 + int(sizeof(quint32));
+
+    if (encodedChunk.size() < cCompressedHeaderSize || !isCodecSupported(codec))
+        return false;
+
+    quint32 rawSize = qFromBigEndian<quint32>(encodedChunk.constData() + 1);
+    if (rawSize > quint32(maxRawSize))
+        return false;
+
+    return decompress(codec, encodedChunk.mid(cCompressedHeaderSize), int(rawSize), rawChunk);
+}
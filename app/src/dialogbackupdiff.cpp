@@ -0,0 +1,115 @@
+#include "dialogbackupdiff.h"
+#include "ui_dialogbackupdiff.h"
+#include "tcpclient.h"
+
+#include <QTreeWidgetItem>
+#include <QHeaderView>
+
+DialogBackupDiff::DialogBackupDiff(const QList<BackupInfo> &backupsList, TcpClient *client,
+                                   QWidget *parent) :
+    QDialog(parent),
+    ui(new Ui::DialogBackupDiff),
+    m_pTcpClient(client)
+{
+    ui->setupUi(this);
+
+    // Список версий упорядочен от новых к старым
+    for (const BackupInfo &backupInfo : backupsList)
+    {
+        ui->comboBox_oldVersion->addItem(backupInfo.fileName);
+        ui->comboBox_newVersion->addItem(backupInfo.fileName);
+    }
+
+    if (backupsList.size() > 1)
+        ui->comboBox_oldVersion->setCurrentIndex(1);
+
+    ui->b_compare->setEnabled(backupsList.size() > 1);
+
+    ui->tree_diff->header()->setSectionResizeMode(QHeaderView::Stretch);
+
+    connect(m_pTcpClient, SIGNAL(backupDiffEntriesReceived(quint32,const QList<EmployeeDiff>&)),
+            this, SLOT(slotDiffEntriesReceived(quint32,const QList<EmployeeDiff>&)));
+
+    connect(m_pTcpClient, SIGNAL(backupDiffFinished(quint32,bool,quint32,quint32,quint32,const QString&)),
+            this, SLOT(slotDiffFinished(quint32,bool,quint32,quint32,quint32,const QString&)));
+}
+
+DialogBackupDiff::~DialogBackupDiff()
+{
+    // Сервер прекращает сравнение, результат которого больше не нужен
+    if (m_diffRequestId != 0)
+        m_pTcpClient->cancelRequest(m_diffRequestId);
+
+    delete ui;
+}
+
+void DialogBackupDiff::on_b_compare_clicked()
+{
+    ui->tree_diff->clear();
+    ui->label_summary->setText("Сравнение выполняется...");
+    ui->b_compare->setEnabled(false);
+
+    m_diffRequestId = m_pTcpClient->sendBackupDiffRequest(ui->comboBox_oldVersion->currentText(),
+                                                          ui->comboBox_newVersion->currentText());
+}
+
+void DialogBackupDiff::slotDiffEntriesReceived(quint32 requestId, const QList<EmployeeDiff> &entries)
+{
+    if (requestId != m_diffRequestId)
+        return;
+
+    for (const EmployeeDiff &diff : entries)
+    {
+        QTreeWidgetItem *employeeItem = new QTreeWidgetItem(ui->tree_diff);
+
+        QString employeeText = QString::number(diff.employeeId) + " " + diff.employeeName;
+
+        if (diff.kind == EmployeeDiff::Added)
+        {
+            employeeItem->setText(0, employeeText + " (добавлен)");
+            employeeItem->setForeground(0, Qt::darkGreen);
+        }
+        else if (diff.kind == EmployeeDiff::Removed)
+        {
+            employeeItem->setText(0, employeeText + " (удален)");
+            employeeItem->setForeground(0, Qt::darkRed);
+        }
+        else
+        {
+            employeeItem->setText(0, employeeText + " (изменен)");
+
+            for (const EmployeeDiff::FieldChange &change : diff.changes)
+            {
+                QTreeWidgetItem *fieldItem = new QTreeWidgetItem(employeeItem);
+                fieldItem->setText(0, change.tableName + ": " + change.fieldName);
+                fieldItem->setText(1, valueText(change.oldValue));
+                fieldItem->setText(2, valueText(change.newValue));
+            }
+        }
+    }
+}
+
+void DialogBackupDiff::slotDiffFinished(quint32 requestId, bool isSucceeded, quint32 addedCount,
+                                        quint32 removedCount, quint32 changedCount,
+                                        const QString &error)
+{
+    if (requestId != m_diffRequestId)
+        return;
+
+    m_diffRequestId = 0;
+    ui->b_compare->setEnabled(true);
+
+    if (!isSucceeded)
+    {
+        ui->label_summary->setText("Не удалось сравнить версии: " + error);
+        return;
+    }
+
+    ui->label_summary->setText(QString("Добавлено сотрудников: %1, удалено: %2, изменено: %3")
+                               .arg(addedCount).arg(removedCount).arg(changedCount));
+}
+
+QString DialogBackupDiff::valueText(const QVariant &value)
+{
+    return value.isNull() ? "—" : value.toString();
+}
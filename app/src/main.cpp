@@ -1,4 +1,5 @@
 #include "mainwindow.h"
+#include "asynclogger.h"
 
 #include <QApplication>
 
@@ -6,6 +7,9 @@ int main(int argc, char *argv[])
 {
     setlocale(LC_ALL, "Russian");
 
+    AsyncLogger logger;
+    logger.install();
+
     QApplication a(argc, argv);
     a.QApplication::setQuitOnLastWindowClosed(true);
 
@@ -1,8 +1,11 @@
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
 #include "dialogselectorg.h"
+#include "dialogselectbackupversion.h"
+#include "dialogbackupdiff.h"
 #include "tablecommands.h"
 #include "databasecreation.h"
+#include "remotesqlitevfs.h"
 
 #include <QCoreApplication>
 #include <QSqlQuery>
@@ -10,6 +13,9 @@
 #include <QTemporaryFile>
 #include <QShortcut>
 #include <QCloseEvent>
+#include <QUuid>
+#include <QThreadPool>
+#include <QPointer>
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
@@ -35,6 +41,12 @@ MainWindow::MainWindow(QWidget *parent)
 
 MainWindow::~MainWindow()
 {
+    deleteTempDatabaseFile();
+
+    // Клиент удаляется в своем потоке по сигналу finished
+    m_pTcpClientThread->quit();
+    m_pTcpClientThread->wait();
+
     delete ui;
 }
 
@@ -58,13 +70,43 @@ void MainWindow::setupTableCommandsStack()
 
 void MainWindow::setupTcpClient()
 {
-    m_pTcpClient = new TcpClient(m_cServerHost, m_cServerPort);
+    m_pTcpClientThread = new QThread(this);
+
+    m_pTcpClient = new TcpClient;
+    m_pTcpClient->moveToThread(m_pTcpClientThread);
+
+    connect(m_pTcpClientThread, SIGNAL(finished()), m_pTcpClient, SLOT(deleteLater()));
+
+    connect(m_pTcpClient, SIGNAL(connectedToServer()),
+            this, SLOT(slotConnectedToServer()));
+
+    connect(m_pTcpClient, SIGNAL(connectionFailed(const QString&)),
+            this, SLOT(slotServerConnectionFailed(const QString&)));
+
+    connect(m_pTcpClient, SIGNAL(databaseReceived(quint32,const QString&,QString)),
+            this, SLOT(slotDatabaseReceived(quint32,const QString&,QString)));
+
+    connect(m_pTcpClient, SIGNAL(uploadFinished(quint32,bool)),
+            this, SLOT(displayDbFileCreationStatus(quint32,bool)));
 
-    connect(m_pTcpClient, SIGNAL(databaseReceived(const QByteArray&,QString)),
-            this, SLOT(activatePreviewMode(const QByteArray&,QString)));
+    connect(m_pTcpClient, SIGNAL(backupsListReceived(quint32,const QList<BackupInfo>&)),
+            this, SLOT(slotBackupsListReceived(quint32,const QList<BackupInfo>&)));
 
-    connect(m_pTcpClient, SIGNAL(serverCreatedDatabaseFile(bool)),
-            this, SLOT(displayDbFileCreationStatus(bool)));
+    connect(m_pTcpClient, SIGNAL(transferProgress(quint32,qint64,qint64)),
+            this, SLOT(showTransferProgress(quint32,qint64,qint64)));
+
+    connect(m_pTcpClient, SIGNAL(requestCancelled(quint32)),
+            this, SLOT(slotRequestCancelled(quint32)));
+
+    connect(m_pTcpClient, SIGNAL(downloadFailed(quint32,const QString&)),
+            this, SLOT(slotDownloadFailed(quint32,const QString&)));
+
+    m_pTcpClientThread->start();
+
+    m_pAutoBackupScheduler = new AutoBackupScheduler(m_pTcpClient, m_cServerHost, m_cServerPort, this);
+
+    // Подключение не задерживает открытие окна
+    m_pTcpClient->connectToServer(m_cServerHost, m_cServerPort);
 }
 
 void MainWindow::setupUi()
@@ -73,13 +115,25 @@ void MainWindow::setupUi()
 
     ui->b_previewSave->hide();
     ui->b_previewSaveAs->hide();
+
+    m_pTransferProgressBar = new QProgressBar(this);
+    m_pTransferProgressBar->setMaximumWidth(200);
+    m_pTransferProgressBar->hide();
+
+    m_pButtonCancelTransfer = new QPushButton("Отменить", this);
+    m_pButtonCancelTransfer->hide();
+
+    connect(m_pButtonCancelTransfer, SIGNAL(clicked()), this, SLOT(cancelTransfer()));
+
+    ui->statusbar->addPermanentWidget(m_pTransferProgressBar);
+    ui->statusbar->addPermanentWidget(m_pButtonCancelTransfer);
 }
 
-bool MainWindow::setupDatabase(const QString &databaseFilePath)
+bool MainWindow::setupDatabase(const QString &databaseFilePath, const QString &connectOptions)
 {
     qInfo() << "Открытие файла базы данных... : " << databaseFilePath;
 
-    if (!QFile::exists(databaseFilePath))
+    if (connectOptions.isEmpty() && !QFile::exists(databaseFilePath))
     {
         QMessageBox::warning(this, "Внимание",
                              "Файл базы данных не существует");
@@ -89,6 +143,7 @@ bool MainWindow::setupDatabase(const QString &databaseFilePath)
 
     m_currentDatabase = QSqlDatabase::addDatabase("QSQLITE");
     m_currentDatabase.setDatabaseName(databaseFilePath);
+    m_currentDatabase.setConnectOptions(connectOptions);
 
     if (!m_currentDatabase.open())
     {
@@ -142,9 +197,9 @@ bool MainWindow::setupDatabase(const QString &databaseFilePath)
     return true;
 }
 
-bool MainWindow::setupOrganization(const QString &databaseFilePath)
+bool MainWindow::setupOrganization(const QString &databaseFilePath, const QString &connectOptions)
 {
-    if (!setupDatabase(databaseFilePath))
+    if (!setupDatabase(databaseFilePath, connectOptions))
     {
         return false;
     }
@@ -242,10 +297,16 @@ MainWindow::createRecordsForComparison()
 
 bool MainWindow::checkDatabaseValidity(const QSqlDatabase &database)
 {
-    if (database.record("[Общая информация]")  != m_recordsForComparison.at(0)  ||
-        database.record("[Паспортные данные]") != m_recordsForComparison.at(1)  ||
-        database.record("[Другие документы]")  != m_recordsForComparison.at(2)  ||
-        database.record("[Дополнительная информация]") != m_recordsForComparison.at(3))
+    return checkDatabaseValidity(database, m_recordsForComparison);
+}
+
+bool MainWindow::checkDatabaseValidity(const QSqlDatabase &database,
+                                       const QList<QSqlRecord> &recordsForComparison)
+{
+    if (database.record("[Общая информация]")  != recordsForComparison.at(0)  ||
+        database.record("[Паспортные данные]") != recordsForComparison.at(1)  ||
+        database.record("[Другие документы]")  != recordsForComparison.at(2)  ||
+        database.record("[Дополнительная информация]") != recordsForComparison.at(3))
     {
         return false;
     }
@@ -309,13 +370,84 @@ void MainWindow::deleteTableModels()
 
 void MainWindow::deleteTempDatabaseFile()
 {
-    if (m_pTemporaryDatabaseFile)
+    if (!m_temporaryDatabaseFilePath.isEmpty())
+    {
+        QSqlDatabase::removeDatabase(m_temporaryDatabaseFilePath);
+
+        QFile::remove(m_temporaryDatabaseFilePath);
+
+        m_temporaryDatabaseFilePath.clear();
+    }
+
+    closeRemoteDatabase();
+}
+
+void MainWindow::closeRemoteDatabase()
+{
+    if (m_pRemotePageSource)
     {
-        QSqlDatabase::removeDatabase(m_pTemporaryDatabaseFile->fileName());
+        // Модели не должны читать страницы после удаления источника
+        if (m_currentDatabase.databaseName() == m_remoteDatabaseName)
+        {
+            deleteTableModels();
+            m_currentDatabase.close();
+        }
+
+        RemoteSqliteVfs::detach(m_remoteDatabaseName);
 
-        delete m_pTemporaryDatabaseFile;
+        delete m_pRemotePageSource;
 
-        m_pTemporaryDatabaseFile = nullptr;
+        m_pRemotePageSource = nullptr;
+        m_remoteDatabaseName.clear();
+        m_remoteDbName.clear();
+    }
+}
+
+bool MainWindow::probeRemoteDatabase(const QString &databaseName,
+                                     const QList<QSqlRecord> &recordsForComparison)
+{
+    const QString connectionName = "remote-probe-"
+            + QUuid::createUuid().toString(QUuid::WithoutBraces);
+
+    bool isValid = false;
+
+    {
+        QSqlDatabase database = QSqlDatabase::addDatabase("QSQLITE", connectionName);
+        database.setDatabaseName(databaseName);
+        database.setConnectOptions(RemoteSqliteVfs::cConnectOptions);
+
+        isValid = database.open() && checkDatabaseValidity(database, recordsForComparison);
+
+        if (isValid)
+            prefetchRemoteDatabase(database);
+
+        database.close();
+    }
+
+    QSqlDatabase::removeDatabase(connectionName);
+
+    return isValid;
+}
+
+void MainWindow::prefetchRemoteDatabase(const QSqlDatabase &database)
+{
+    // Модель при выборке сразу получает столько строк
+    const int cFirstRowsCount = 256;
+
+    for (const QString &tableName : DatabaseCreation::cTableNamesList)
+    {
+        QSqlQuery query(database);
+        query.setForwardOnly(true);
+
+        if (tableName == DatabaseCreation::cTableNamesList.first())
+            query.exec("SELECT * FROM [" + tableName + "]");
+        else
+            query.exec("SELECT * FROM [" + tableName + "] LIMIT " + QString::number(cFirstRowsCount));
+
+        // Значения не нужны: SQLite читает страницы строк при переходе к ним
+        while (query.next())
+        {
+        }
     }
 }
 
@@ -373,8 +505,19 @@ void MainWindow::setIsDatabaseModifiedFalse()
     m_isDatabaseModified = false;
 }
 
-void MainWindow::displayDbFileCreationStatus(bool dbFileCreated)
+void MainWindow::displayDbFileCreationStatus(quint32 requestId, bool dbFileCreated)
 {
+   // Об автоматических загрузках сообщает планировщик в журнале
+   if (!m_userTransferRequestIds.remove(requestId))
+   {
+       return;
+   }
+
+   if (requestId == m_transferRequestId)
+   {
+       hideTransferProgress();
+   }
+
    if (dbFileCreated)
    {
        ui->statusbar->showMessage("Сервер успешно создал копию базы данных", 10000);
@@ -443,6 +586,8 @@ void MainWindow::submitChanges()
     m_clickedColumn = -1;
 
     m_isDatabaseModified = false;
+
+    m_pAutoBackupScheduler->noteChanges(m_currentDatabaseFileInfo);
 }
 
 void MainWindow::revertChanges()
@@ -469,22 +614,181 @@ void MainWindow::revertChanges()
     m_isDatabaseModified = false;
 }
 
-bool MainWindow::tryToConnectToServer()
+void MainWindow::runWhenConnectedToServer(std::function<void()> action)
 {
-    if(m_pTcpClient->isConnectedToServer())
+    if (m_pTcpClient->isConnectedToServer())
     {
-        return true;
+        action();
+
+        return;
     }
 
-    while (!m_pTcpClient->connectToServer(m_cServerHost, m_cServerPort))
+    m_pendingServerAction = action;
+
+    ui->statusbar->showMessage("Подключение к серверу...");
+
+    m_pTcpClient->connectToServer(m_cServerHost, m_cServerPort);
+}
+
+void MainWindow::slotConnectedToServer()
+{
+    ui->statusbar->clearMessage();
+
+    if (!m_pendingServerAction)
     {
-        if (askToReconnectToServer() != QMessageBox::Retry)
-        {
-            return false;
-        }
+        return;
     }
 
-    return true;
+    std::function<void()> action = m_pendingServerAction;
+    m_pendingServerAction = nullptr;
+
+    action();
+}
+
+void MainWindow::slotServerConnectionFailed(const QString &error)
+{
+    qInfo() << "Не удалось подключиться к серверу:" << error;
+
+    ui->statusbar->clearMessage();
+
+    // Неудачное подключение при запуске не требует ответа пользователя
+    if (!m_pendingServerAction)
+    {
+        return;
+    }
+
+    if (askToReconnectToServer() != QMessageBox::Retry)
+    {
+        m_pendingServerAction = nullptr;
+
+        return;
+    }
+
+    ui->statusbar->showMessage("Подключение к серверу...");
+
+    m_pTcpClient->connectToServer(m_cServerHost, m_cServerPort);
+}
+
+void MainWindow::slotBackupsListReceived(quint32 requestId, const QList<BackupInfo> &backupsList)
+{
+    if (requestId == m_diffListRequestId)
+    {
+        m_diffListRequestId = 0;
+
+        showBackupDiffDialog(backupsList);
+
+        return;
+    }
+
+    if (requestId != m_selectVersionListRequestId)
+    {
+        return;
+    }
+
+    m_selectVersionListRequestId = 0;
+
+    QStringList databasesOnServerList;
+    QHash<QString, BackupInfo> backupsByFileName;
+    for (const BackupInfo &backupInfo : backupsList)
+    {
+        databasesOnServerList << backupInfo.fileName;
+        backupsByFileName.insert(backupInfo.fileName, backupInfo);
+    }
+
+    DialogSelectBackupVersion dialog(databasesOnServerList, this);
+    if (dialog.exec() != QDialog::Accepted)
+    {
+        return;
+    }
+
+    const BackupInfo selectedBackup = backupsByFileName.value(dialog.getSelectedVersion());
+
+    // Версия из локального кэша открывается сразу, без обращения к серверу
+    if (m_pTcpClient->isBackupCached(selectedBackup.hash))
+    {
+        m_userTransferRequestIds.insert(m_pTcpClient->sendSelectedDatabaseName(selectedBackup));
+    }
+    else
+    {
+        activateRemotePreviewMode(selectedBackup);
+    }
+}
+
+void MainWindow::showTransferProgress(quint32 requestId, qint64 doneBytes, qint64 totalBytes)
+{
+    if (!m_userTransferRequestIds.contains(requestId))
+    {
+        return;
+    }
+
+    m_transferRequestId = requestId;
+
+    // Индикатор показывает проценты, чтобы размер базы данных не ограничивался int
+    m_pTransferProgressBar->setRange(0, 100);
+    m_pTransferProgressBar->setValue(totalBytes > 0 ? int(doneBytes * 100 / totalBytes) : 0);
+    m_pTransferProgressBar->setFormat(QString("%1 из %2 МБ")
+                                      .arg(doneBytes / (1024 * 1024))
+                                      .arg(totalBytes / (1024 * 1024)));
+
+    m_pTransferProgressBar->show();
+    m_pButtonCancelTransfer->show();
+}
+
+void MainWindow::slotRequestCancelled(quint32 requestId)
+{
+    if (!m_userTransferRequestIds.remove(requestId))
+    {
+        return;
+    }
+
+    if (requestId == m_previewSaveRequestId)
+    {
+        cancelPreviewSaving();
+    }
+
+    if (requestId == m_transferRequestId)
+    {
+        hideTransferProgress();
+    }
+
+    ui->statusbar->showMessage("Передача отменена", 10000);
+}
+
+void MainWindow::slotDownloadFailed(quint32 requestId, const QString &error)
+{
+    if (!m_userTransferRequestIds.remove(requestId))
+    {
+        return;
+    }
+
+    if (requestId == m_previewSaveRequestId)
+    {
+        cancelPreviewSaving();
+    }
+
+    if (requestId == m_transferRequestId)
+    {
+        hideTransferProgress();
+    }
+
+    ui->statusbar->showMessage("ВНИМАНИЕ: не удалось получить базу данных с сервера: "
+                               + error, 10000);
+}
+
+void MainWindow::cancelTransfer()
+{
+    if (m_transferRequestId != 0)
+    {
+        m_pTcpClient->cancelRequest(m_transferRequestId);
+    }
+}
+
+void MainWindow::hideTransferProgress()
+{
+    m_transferRequestId = 0;
+
+    m_pTransferProgressBar->hide();
+    m_pButtonCancelTransfer->hide();
 }
 
 int MainWindow::askToOverwriteOrganization()
@@ -544,7 +848,27 @@ int MainWindow::askToReconnectToServer()
     return msgBox.exec();
 }
 
-void MainWindow::activatePreviewMode(const QByteArray &dbInBytes, QString dbName)
+void MainWindow::slotDatabaseReceived(quint32 requestId, const QString &dbFilePath, QString dbName)
+{
+    if (!m_userTransferRequestIds.remove(requestId))
+    {
+        QFile::remove(dbFilePath);
+
+        return;
+    }
+
+    if (requestId == m_previewSaveRequestId)
+    {
+        hideTransferProgress();
+        finishPreviewSaving(dbFilePath);
+
+        return;
+    }
+
+    activatePreviewMode(dbFilePath, dbName);
+}
+
+void MainWindow::activatePreviewMode(const QString &dbFilePath, QString dbName)
 {
     if (dbName.isEmpty())
     {
@@ -556,23 +880,125 @@ void MainWindow::activatePreviewMode(const QByteArray &dbInBytes, QString dbName
         dbName.append(".db");
     }
 
+    hideTransferProgress();
+
     deleteTempDatabaseFile();
 
-    m_pTemporaryDatabaseFile = new QTemporaryFile(dbName, this);
-    m_pTemporaryDatabaseFile->open();
-    m_pTemporaryDatabaseFile->write(dbInBytes);
-    m_pTemporaryDatabaseFile->close();
+    m_temporaryDatabaseFilePath = dbFilePath;
 
     qInfo() << "activatePreviewMode: имя временного файла: "
-            << m_pTemporaryDatabaseFile->fileName();
+            << m_temporaryDatabaseFilePath;
 
-    if (!setupOrganization(m_pTemporaryDatabaseFile->fileName()))
+    if (!setupOrganization(m_temporaryDatabaseFilePath))
     {
         deactivatePreviewMode();
 
         return;
     }
 
+    showPreviewControls(dbName);
+}
+
+void MainWindow::activateRemotePreviewMode(const BackupInfo &backupInfo)
+{
+    // Без файловой системы версию не открыть, поэтому к серверу не подключаемся
+    if (!RemoteSqliteVfs::isAvailable())
+    {
+        m_userTransferRequestIds.insert(m_pTcpClient->sendSelectedDatabaseName(backupInfo));
+
+        return;
+    }
+
+    RemotePageSource *remotePageSource = new RemotePageSource(m_cServerHost, m_cServerPort,
+                                                              backupInfo.fileName);
+    const QList<QSqlRecord> recordsForComparison = m_recordsForComparison;
+    QPointer<MainWindow> window(this);
+
+    ui->statusbar->showMessage("Открытие версии на сервере...");
+
+    // Подключение и проверка версии ждут ответов сервера и не должны задерживать окно
+    QThreadPool::globalInstance()->start([window, remotePageSource, backupInfo,
+                                          recordsForComparison]()
+    {
+        QString remoteDatabaseName;
+
+        if (remotePageSource->open())
+            remoteDatabaseName = RemoteSqliteVfs::attach(remotePageSource);
+
+        const bool isValid = !remoteDatabaseName.isEmpty()
+                && probeRemoteDatabase(remoteDatabaseName, recordsForComparison);
+
+        QMetaObject::invokeMethod(QCoreApplication::instance(),
+                                  [window, remotePageSource, remoteDatabaseName, isValid, backupInfo]()
+        {
+            if (!window)
+            {
+                RemoteSqliteVfs::detach(remoteDatabaseName);
+                delete remotePageSource;
+
+                return;
+            }
+
+            window->finishRemotePreviewOpening(remotePageSource, remoteDatabaseName,
+                                               isValid, backupInfo);
+        }, Qt::QueuedConnection);
+    });
+}
+
+void MainWindow::finishRemotePreviewOpening(RemotePageSource *remotePageSource,
+                                            const QString &remoteDatabaseName, bool isValid,
+                                            const BackupInfo &backupInfo)
+{
+    ui->statusbar->clearMessage();
+
+    // Отображаемая база данных остается открытой, пока версия не проверена
+    if (!isValid)
+    {
+        qInfo() << "Версию не удалось просмотреть с сервера, она будет получена целиком:"
+                << backupInfo.fileName;
+
+        RemoteSqliteVfs::detach(remoteDatabaseName);
+        delete remotePageSource;
+
+        m_userTransferRequestIds.insert(m_pTcpClient->sendSelectedDatabaseName(backupInfo));
+
+        return;
+    }
+
+    deleteTempDatabaseFile();
+
+    m_pRemotePageSource = remotePageSource;
+    m_remoteDatabaseName = remoteDatabaseName;
+    m_remoteBackupInfo = backupInfo;
+    m_remoteDbName = backupInfo.orgName.isEmpty() ? "tempOrg.db" : backupInfo.orgName + ".db";
+
+    if (!setupOrganization(m_remoteDatabaseName, RemoteSqliteVfs::cConnectOptions))
+    {
+        deactivatePreviewMode();
+
+        return;
+    }
+
+    // Остальная часть версии получается в фоне и добавляется в кэш,
+    // чтобы следующее открытие и сохранение не обращались к серверу.
+    // TcpClient удаляется после m_pRemotePageSource, см. ~MainWindow
+    if (!backupInfo.hash.isEmpty())
+    {
+        TcpClient *client = m_pTcpClient;
+        const QByteArray hash = backupInfo.hash;
+
+        m_pRemotePageSource->fetchInBackground(client->backupCachePartFilePath(hash),
+                                               [client, hash](const QString &filePath)
+        {
+            client->addToBackupCache(hash, filePath);
+        });
+    }
+
+    showPreviewControls(m_remoteDbName);
+}
+
+void MainWindow::showPreviewControls(const QString &dbName)
+{
     ui->b_add->hide();
     ui->b_delete->hide();
     ui->b_submitChanges->hide();
@@ -828,12 +1254,12 @@ void MainWindow::on_action_sendToServer_triggered()
         }
     }
 
-    if (!tryToConnectToServer())
-    {
-        return;
-    }
+    const QFileInfo dbFileInfo = m_currentDatabaseFileInfo;
 
-    m_pTcpClient->sendDatabase(m_currentDatabaseFileInfo);
+    runWhenConnectedToServer([this, dbFileInfo]()
+    {
+        m_userTransferRequestIds.insert(m_pTcpClient->sendDatabase(dbFileInfo));
+    });
 }
 
 void MainWindow::on_action_receiveFromServer_triggered()
@@ -855,12 +1281,39 @@ void MainWindow::on_action_receiveFromServer_triggered()
         }
     }
 
-    if (!tryToConnectToServer())
+    runWhenConnectedToServer([this]()
     {
+        m_selectVersionListRequestId = m_pTcpClient->sendDatabasesListRequest();
+    });
+}
+
+void MainWindow::on_action_compareOnServer_triggered()
+{
+    runWhenConnectedToServer([this]()
+    {
+        m_diffListRequestId = m_pTcpClient->sendDatabasesListRequest();
+    });
+}
+
+void MainWindow::on_action_suspendAutoBackup_toggled(bool checked)
+{
+    m_pAutoBackupScheduler->setSuspended(checked);
+
+    ui->statusbar->showMessage(checked ? "Автоматическая загрузка на сервер приостановлена"
+                                       : "Автоматическая загрузка на сервер возобновлена", 10000);
+}
+
+void MainWindow::showBackupDiffDialog(const QList<BackupInfo> &backupsList)
+{
+    if (backupsList.size() < 2)
+    {
+        QMessageBox::information(this, "Сравнение версий",
+                                 "Для сравнения на сервере должно быть не меньше двух версий");
         return;
     }
 
-    m_pTcpClient->sendDatabasesListRequest();
+    DialogBackupDiff dialog(backupsList, m_pTcpClient, this);
+    dialog.exec();
 }
 
 void MainWindow::on_action_selectNewDatabase_triggered()
@@ -958,15 +1411,93 @@ void MainWindow::on_action_open_triggered()
     }
 }
 
-void MainWindow::on_b_previewSave_clicked()
+void MainWindow::savePreviewDatabase(const QString &filePath)
+{
+    /*
+     * Версия, просматриваемая с сервера, получается целиком так же,
+     * как при обычном получении: файл записывается в потоке клиента
+     * по мере поступления частей, а окно остается доступным.
+     */
+    if (m_pRemotePageSource)
+    {
+        ui->b_previewSave->setEnabled(false);
+        ui->b_previewSaveAs->setEnabled(false);
+
+        m_previewSaveFilePath = filePath;
+
+        const BackupInfo backupInfo = m_remoteBackupInfo;
+
+        runWhenConnectedToServer([this, backupInfo]()
+        {
+            m_previewSaveRequestId = m_pTcpClient->sendSelectedDatabaseName(backupInfo);
+            m_userTransferRequestIds.insert(m_previewSaveRequestId);
+        });
+
+        return;
+    }
+
+    QFile::remove(filePath);
+
+    if (!QFile::copy(m_temporaryDatabaseFilePath, filePath))
+    {
+        ui->statusbar->showMessage("ВНИМАНИЕ: не удалось сохранить базу данных!", 10000);
+
+        return;
+    }
+
+    deactivatePreviewMode(filePath);
+}
+
+void MainWindow::cancelPreviewSaving()
+{
+    m_previewSaveRequestId = 0;
+    m_previewSaveFilePath.clear();
+
+    ui->b_previewSave->setEnabled(true);
+    ui->b_previewSaveAs->setEnabled(true);
+}
+
+void MainWindow::finishPreviewSaving(const QString &dbFilePath)
 {
-    QFileInfo tempDbFileInfo(m_pTemporaryDatabaseFile->fileName());
+    const QString saveFilePath = m_previewSaveFilePath;
+
+    cancelPreviewSaving();
+
+    // Полученный файл может быть жесткой ссылкой на файл в кэше версий,
+    // поэтому он копируется: сохраненная база данных будет изменяться
+    QFile::remove(saveFilePath);
+
+    const bool isCopied = QFile::copy(dbFilePath, saveFilePath);
+    QFile::remove(dbFilePath);
 
+    if (!isCopied)
+    {
+        ui->statusbar->showMessage("ВНИМАНИЕ: не удалось сохранить базу данных!", 10000);
+
+        return;
+    }
+
+    // Пока версия получалась, пользователь мог выйти из предпросмотра
+    if (m_pRemotePageSource)
+    {
+        deactivatePreviewMode(saveFilePath);
+    }
+    else
+    {
+        ui->statusbar->showMessage("База данных сохранена: " + saveFilePath, 10000);
+    }
+}
+
+void MainWindow::on_b_previewSave_clicked()
+{
     /*
      * Имена временных файлов баз данных хранятся в формате "name.db.XXXXXX".
      * Эта переменная содержит часть "name.db" имени базы без части ".XXXXXX".
+     * Версия, просматриваемая с сервера, временного файла не имеет.
      */
-    QString tempDbFileCompleteBaseName(tempDbFileInfo.completeBaseName());
+    QString tempDbFileCompleteBaseName = m_pRemotePageSource
+            ? m_remoteDbName
+            : QFileInfo(m_temporaryDatabaseFilePath).completeBaseName();
 
     if (m_databasesDirectory.entryList().contains(tempDbFileCompleteBaseName))
     {
@@ -974,30 +1505,29 @@ void MainWindow::on_b_previewSave_clicked()
         {
             return;
         }
-
-        m_databasesDirectory.remove(tempDbFileCompleteBaseName);
     }
 
     QString newDbFilePath(m_databasesDirectory.path() + "/"
                           + tempDbFileCompleteBaseName);
 
-    QFile::copy(m_pTemporaryDatabaseFile->fileName(), newDbFilePath);
-
-    deactivatePreviewMode(newDbFilePath);
+    savePreviewDatabase(newDbFilePath);
 }
 
 void MainWindow::on_b_previewSaveAs_clicked()
 {
     QString saveFileName = QFileDialog::getSaveFileName(this);
 
+    if (saveFileName.isEmpty())
+    {
+        return;
+    }
+
     if (!saveFileName.endsWith(".db", Qt::CaseInsensitive))
     {
         saveFileName += ".db";
     }
 
-    QFile::copy(m_pTemporaryDatabaseFile->fileName(), saveFileName);
-
-    deactivatePreviewMode(saveFileName);
+    savePreviewDatabase(saveFileName);
 }
 
 void MainWindow::on_action_exit_triggered()
@@ -0,0 +1,537 @@
+#include "remotepagesource.h"
+#include "compression.h"
+
+#include <QTcpSocket>
+#include <QFile>
+#include <QDataStream>
+#include <QDeadlineTimer>
+#include <QMutexLocker>
+#include <QDebug>
+
+#include <cstring>
+
+const qint64 RemotePageSource::cBlockSize = 64 * 1024;
+const int RemotePageSource::cCacheSizeKb = 64 * 1024;
+const int RemotePageSource::cTimeoutMs = 10000;
+const int RemotePageSource::cReadAheadBlocks = 8;
+const int RemotePageSource::cBackgroundRequests = 2;
+
+RemotePageSource::RemotePageSource(const QString &host, int port, const QString &backupFileName)
+    : m_host(host)
+    , m_port(port)
+    , m_backupFileName(backupFileName)
+    , m_blockCache(cCacheSizeKb)
+{
+}
+
+RemotePageSource::~RemotePageSource()
+{
+    close();
+}
+
+bool RemotePageSource::open()
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (m_state != Closed)
+        return m_state == Opened;
+
+    m_state = Opening;
+
+    m_pContext = new QObject;
+    m_pContext->moveToThread(&m_thread);
+
+    // Сокет удаляется вместе с m_pContext в потоке подключения
+    QObject::connect(&m_thread, &QThread::finished, m_pContext, &QObject::deleteLater);
+
+    m_thread.start();
+
+    QMetaObject::invokeMethod(m_pContext, [this]() { connectToServer(); }, Qt::QueuedConnection);
+
+    // Подключение, согласование сжатия и запрос размера файла
+    QDeadlineTimer deadline(cTimeoutMs);
+    while (m_state == Opening)
+    {
+        if (!m_stateChanged.wait(&m_mutex, deadline))
+            break;
+    }
+
+    if (m_state != Opened)
+    {
+        if (m_state == Opening)
+            qInfo() << "ОШИБКА: сервер не ответил на запрос версии для просмотра:" << m_backupFileName;
+
+        locker.unlock();
+        close();
+        return false;
+    }
+
+    qInfo() << "Версия" << m_backupFileName << "открыта для просмотра с сервера; размер:" << m_size;
+
+    return true;
+}
+
+void RemotePageSource::close()
+{
+    if (m_thread.isRunning())
+    {
+        m_thread.quit();
+        m_thread.wait();
+    }
+
+    m_pContext = nullptr;
+    m_pSocket = nullptr;
+    m_frameDecoder.reset();
+    m_blockRequests.clear();
+    stopBackgroundFetch();
+
+    QMutexLocker locker(&m_mutex);
+
+    if (m_state == Opened)
+    {
+        qInfo() << "Просмотр версии" << m_backupFileName << "завершен; получено с сервера:"
+                << m_fetchedBytes << "байт из" << m_size;
+    }
+
+    m_state = Closed;
+    m_size = -1;
+    m_blockCache.clear();
+    m_requestedBlocks.clear();
+    m_demandedBlocks.clear();
+}
+
+qint64 RemotePageSource::size() const
+{
+    QMutexLocker locker(&m_mutex);
+
+    return m_size;
+}
+
+qint64 RemotePageSource::fetchedBytes() const
+{
+    QMutexLocker locker(&m_mutex);
+
+    return m_fetchedBytes;
+}
+
+qint64 RemotePageSource::read(qint64 offset, char *data, qint64 length)
+{
+    QMutexLocker locker(&m_mutex);
+
+    qint64 readBytes = 0;
+
+    while (readBytes < length && offset + readBytes < m_size)
+    {
+        const qint64 position = offset + readBytes;
+        const QByteArray *pBlock = waitForBlock(position / cBlockSize);
+        if (!pBlock)
+            return -1;
+
+        const qint64 blockOffset = position % cBlockSize;
+        const qint64 count = qMin(length - readBytes, pBlock->size() - blockOffset);
+        if (count <= 0)
+            break;
+
+        memcpy(data + readBytes, pBlock->constData() + blockOffset, size_t(count));
+        readBytes += count;
+    }
+
+    return readBytes;
+}
+
+const QByteArray *RemotePageSource::waitForBlock(qint64 blockIndex)
+{
+    if (const QByteArray *pBlock = m_blockCache.object(blockIndex))
+        return pBlock;
+
+    for (qint64 index = blockIndex; m_state == Opened
+         && index <= blockIndex + cReadAheadBlocks && index * cBlockSize < m_size; index++)
+    {
+        requestBlock(index);
+    }
+
+    QDeadlineTimer deadline(cTimeoutMs);
+
+    while (m_state == Opened)
+    {
+        if (const QByteArray *pBlock = m_blockCache.object(blockIndex))
+            return pBlock;
+
+        // Блок мог быть вытеснен из кэша раньше, чем его прочитали
+        requestBlock(blockIndex);
+
+        if (!m_stateChanged.wait(&m_mutex, deadline))
+            break;
+    }
+
+    qInfo() << "ОШИБКА: не удалось получить часть версии" << m_backupFileName
+            << "с" << blockIndex * cBlockSize << "байт";
+
+    return nullptr;
+}
+
+void RemotePageSource::fetchInBackground(const QString &filePath,
+                                         const std::function<void(const QString &filePath)> &onFetched)
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (m_state != Opened)
+        return;
+
+    QMetaObject::invokeMethod(m_pContext, [this, filePath, onFetched]()
+    {
+        startBackgroundFetch(filePath, onFetched);
+    }, Qt::QueuedConnection);
+}
+
+void RemotePageSource::requestBlock(qint64 blockIndex)
+{
+    if (m_blockCache.contains(blockIndex))
+        return;
+
+    // Блок, уже запрошенный в фоне, не запрашивается второй раз
+    m_demandedBlocks.insert(blockIndex);
+
+    if (m_requestedBlocks.contains(blockIndex))
+        return;
+
+    m_requestedBlocks.insert(blockIndex);
+
+    QMetaObject::invokeMethod(m_pContext, [this, blockIndex]()
+    {
+        sendBlockRequest(blockIndex);
+    }, Qt::QueuedConnection);
+}
+
+void RemotePageSource::connectToServer()
+{
+    m_pSocket = new QTcpSocket(m_pContext);
+
+    QObject::connect(m_pSocket, &QTcpSocket::connected, m_pContext, [this]() { sendHello(); });
+    QObject::connect(m_pSocket, &QTcpSocket::readyRead, m_pContext, [this]() { readFrames(); });
+    QObject::connect(m_pSocket, &QAbstractSocket::errorOccurred, m_pContext, [this]()
+    {
+        fail("соединение с сервером для просмотра версии прервано: " + m_pSocket->errorString());
+    });
+
+    m_pSocket->connectToHost(m_host, quint16(m_port));
+}
+
+/*
+ * Согласование сжатия, как в TcpClient::sendHello.
+ */
+void RemotePageSource::sendHello()
+{
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_0);
+    out << Compression::supportedCodecs();
+
+    m_helloRequestId = sendFrame(TcpDataType::Hello, payload);
+}
+
+quint32 RemotePageSource::sendRangeRequest(qint64 offset, qint32 length)
+{
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_0);
+    out << m_backupFileName << offset << length;
+
+    return sendFrame(TcpDataType::DatabaseRangeRequest, payload);
+}
+
+void RemotePageSource::sendBlockRequest(qint64 blockIndex)
+{
+    qint64 size = 0;
+    {
+        QMutexLocker locker(&m_mutex);
+        size = m_size;
+    }
+
+    const qint64 offset = blockIndex * cBlockSize;
+    const qint32 length = qint32(qMin(cBlockSize, size - offset));
+
+    m_blockRequests.insert(sendRangeRequest(offset, length), blockIndex);
+}
+
+void RemotePageSource::readFrames()
+{
+    for (;;)
+    {
+        FrameDecoder::Frame frame;
+        FrameDecoder::Result result = m_frameDecoder.readFrame(m_pSocket, frame);
+
+        if (result == FrameDecoder::NeedMoreData)
+            return;
+
+        if (result == FrameDecoder::InvalidFrame)
+        {
+            fail(QString("недопустимый размер кадра от сервера: %1").arg(m_frameDecoder.frameSize()));
+            m_pSocket->abort();
+            return;
+        }
+
+        processFrame(frame);
+    }
+}
+
+void RemotePageSource::processFrame(const FrameDecoder::Frame &frame)
+{
+    if (frame.version != TcpProtocol::cVersion)
+        return;
+
+    if (frame.dataType == TcpDataType::HelloAck && frame.requestId == m_helloRequestId)
+    {
+        QDataStream in(frame.payload);
+        in.setVersion(QDataStream::Qt_5_0);
+        in >> m_codec;
+
+        if (!Compression::isCodecSupported(m_codec))
+            m_codec = Compression::CodecNone;
+
+        m_sizeRequestId = sendRangeRequest(0, 0);
+    }
+    else if (frame.dataType == TcpDataType::DatabaseRange)
+    {
+        processRange(frame.requestId, frame.payload);
+    }
+}
+
+/*
+ * Ответ на запрос размера открывает версию, остальные ответы -
+ * блоки файла, которые сразу распаковываются в этом потоке.
+ */
+void RemotePageSource::processRange(quint32 requestId, const QByteArray &payload)
+{
+    QDataStream in(payload);
+    in.setVersion(QDataStream::Qt_5_0);
+
+    bool isFound = false;
+    qint64 fileSize = 0;
+    qint64 rangeOffset = 0;
+    in >> isFound >> fileSize >> rangeOffset;
+
+    if (!isFound)
+    {
+        fail("версия не найдена на сервере: " + m_backupFileName);
+        return;
+    }
+
+    if (requestId == m_sizeRequestId)
+    {
+        QMutexLocker locker(&m_mutex);
+
+        m_size = fileSize;
+        m_state = Opened;
+        m_stateChanged.wakeAll();
+        return;
+    }
+
+    if (!m_blockRequests.contains(requestId))
+        return;
+
+    const qint64 blockIndex = m_blockRequests.take(requestId);
+    const qint64 offset = blockIndex * cBlockSize;
+
+    m_backgroundBlocks.remove(blockIndex);
+
+    QByteArray *pBlock = new QByteArray();
+    const bool isDecoded = rangeOffset == offset
+            && Compression::decodeChunk(payload.mid(int(in.device()->pos())), *pBlock,
+                                        TcpProtocol::cMaxRangeSize);
+
+    QMutexLocker locker(&m_mutex);
+
+    m_requestedBlocks.remove(blockIndex);
+
+    if (!isDecoded || pBlock->size() != qMin(cBlockSize, m_size - offset))
+    {
+        delete pBlock;
+
+        locker.unlock();
+        fail(QString("получена неверная часть версии с %1 байт").arg(offset));
+        return;
+    }
+
+    m_fetchedBytes += pBlock->size();
+
+    const QByteArray block = *pBlock;
+
+    if (m_demandedBlocks.remove(blockIndex))
+        m_blockCache.insert(blockIndex, pBlock, qMax(1, int(pBlock->size() / 1024)));
+    else
+        delete pBlock;
+
+    m_stateChanged.wakeAll();
+    locker.unlock();
+
+    storeBlock(blockIndex, block);
+    requestBackgroundBlocks();
+}
+
+/*
+ * Блоки, полученные до начала, копируются из кэша блоков;
+ * вытесненные из него запрашиваются снова.
+ */
+void RemotePageSource::startBackgroundFetch(const QString &filePath,
+                                            const std::function<void(const QString &filePath)> &onFetched)
+{
+    if (m_pFetchFile)
+        return;
+
+    QHash<qint64, QByteArray> cachedBlocks;
+    qint64 size = 0;
+    {
+        QMutexLocker locker(&m_mutex);
+
+        if (m_state != Opened)
+            return;
+
+        size = m_size;
+
+        const QList<qint64> blockIndexes = m_blockCache.keys();
+        for (qint64 blockIndex : blockIndexes)
+            cachedBlocks.insert(blockIndex, *m_blockCache.object(blockIndex));
+    }
+
+    m_pFetchFile = new QFile(filePath);
+    if (!m_pFetchFile->open(QIODevice::WriteOnly) || !m_pFetchFile->resize(size))
+    {
+        qInfo() << "ОШИБКА: не удалось создать файл для получения версии:" << filePath;
+        stopBackgroundFetch();
+        return;
+    }
+
+    m_onFetched = onFetched;
+    m_storedBlocks = QBitArray(int((size + cBlockSize - 1) / cBlockSize));
+    m_storedBlocksCount = 0;
+    m_nextBackgroundBlock = 0;
+
+    if (m_storedBlocks.isEmpty())
+    {
+        finishBackgroundFetch();
+        return;
+    }
+
+    for (auto it = cachedBlocks.cbegin(); it != cachedBlocks.cend(); ++it)
+        storeBlock(it.key(), it.value());
+
+    requestBackgroundBlocks();
+}
+
+void RemotePageSource::requestBackgroundBlocks()
+{
+    while (m_pFetchFile && m_backgroundBlocks.size() < cBackgroundRequests
+           && m_nextBackgroundBlock < m_storedBlocks.size())
+    {
+        const qint64 blockIndex = m_nextBackgroundBlock++;
+
+        if (m_storedBlocks.testBit(int(blockIndex)))
+            continue;
+
+        {
+            QMutexLocker locker(&m_mutex);
+
+            if (m_state != Opened)
+                return;
+
+            // Запрошенный для чтения блок будет записан, когда придет
+            if (m_requestedBlocks.contains(blockIndex))
+                continue;
+
+            m_requestedBlocks.insert(blockIndex);
+        }
+
+        m_backgroundBlocks.insert(blockIndex);
+        sendBlockRequest(blockIndex);
+    }
+}
+
+void RemotePageSource::storeBlock(qint64 blockIndex, const QByteArray &block)
+{
+    if (!m_pFetchFile || m_storedBlocks.testBit(int(blockIndex)))
+        return;
+
+    if (!m_pFetchFile->seek(blockIndex * cBlockSize) || m_pFetchFile->write(block) != block.size())
+    {
+        qInfo() << "ОШИБКА: не удалось записать полученную часть версии:" << m_pFetchFile->fileName();
+        stopBackgroundFetch();
+        return;
+    }
+
+    m_storedBlocks.setBit(int(blockIndex));
+    m_storedBlocksCount++;
+
+    if (m_storedBlocksCount == m_storedBlocks.size())
+        finishBackgroundFetch();
+}
+
+void RemotePageSource::finishBackgroundFetch()
+{
+    if (!m_pFetchFile->flush())
+    {
+        qInfo() << "ОШИБКА: не удалось записать полученную версию:" << m_pFetchFile->fileName();
+        stopBackgroundFetch();
+        return;
+    }
+
+    const QString filePath = m_pFetchFile->fileName();
+    const std::function<void(const QString &filePath)> onFetched = m_onFetched;
+
+    m_pFetchFile->close();
+    delete m_pFetchFile;
+    m_pFetchFile = nullptr;
+    m_onFetched = nullptr;
+    m_storedBlocks.clear();
+
+    qInfo() << "Версия" << m_backupFileName << "получена с сервера целиком";
+
+    onFetched(filePath);
+}
+
+/*
+ * Незаконченный файл удаляется.
+ */
+void RemotePageSource::stopBackgroundFetch()
+{
+    if (m_pFetchFile)
+    {
+        m_pFetchFile->remove();
+        delete m_pFetchFile;
+        m_pFetchFile = nullptr;
+    }
+
+    m_onFetched = nullptr;
+    m_storedBlocks.clear();
+    m_storedBlocksCount = 0;
+    m_nextBackgroundBlock = 0;
+    m_backgroundBlocks.clear();
+}
+
+quint32 RemotePageSource::sendFrame(quint16 dataType, const QByteArray &payload)
+{
+    // Номер 0 означает отсутствие запроса
+    if (m_nextRequestId == 0)
+        m_nextRequestId = 1;
+
+    const quint32 requestId = m_nextRequestId++;
+
+    m_pSocket->write(FrameDecoder::encodeHeader(dataType, requestId, quint64(payload.size())));
+    m_pSocket->write(payload);
+
+    return requestId;
+}
+
+/*
+ * Ожидающие чтения завершаются ошибкой; новые блоки не запрашиваются.
+ */
+void RemotePageSource::fail(const QString &error)
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (m_state == Opening || m_state == Opened)
+        qInfo() << "ОШИБКА:" << error;
+
+    m_state = Failed;
+    m_stateChanged.wakeAll();
+}
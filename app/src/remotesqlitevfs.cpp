@@ -0,0 +1,346 @@
+#include "remotesqlitevfs.h"
+#include "remotepagesource.h"
+
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QUuid>
+#include <QDebug>
+
+#ifdef HAVE_SQLITE3
+#include <sqlite3.h>
+#include <cstring>
+#endif
+
+const QString RemoteSqliteVfs::cConnectOptions = "QSQLITE_OPEN_READONLY;QSQLITE_OPEN_URI";
+
+#ifdef HAVE_SQLITE3
+
+namespace
+{
+const char cVfsName[] = "ea-remote";
+const char cPathPrefix[] = "/ea-remote/";
+
+// Пустой файл без источника, через который проверяется доступность файловой системы
+const char cProbePath[] = "/ea-remote/probe";
+
+QMutex sourcesMutex;
+QHash<QString, RemotePageSource *> sources;
+int nextSourceId = 1;
+
+sqlite3_vfs *pDefaultVfs = nullptr;
+
+struct RemoteFile
+{
+    sqlite3_file base;
+    RemotePageSource *source;
+};
+
+RemotePageSource *fileSource(sqlite3_file *file)
+{
+    return reinterpret_cast<RemoteFile *>(file)->source;
+}
+
+int remoteClose(sqlite3_file *)
+{
+    return SQLITE_OK;
+}
+
+int remoteRead(sqlite3_file *file, void *buffer, int amount, sqlite3_int64 offset)
+{
+    RemotePageSource *source = fileSource(file);
+    qint64 readBytes = source ? source->read(offset, static_cast<char *>(buffer), amount) : 0;
+    if (readBytes < 0)
+        return SQLITE_IOERR_READ;
+
+    // SQLite требует заполнить непрочитанную часть нулями
+    if (readBytes < amount)
+    {
+        memset(static_cast<char *>(buffer) + readBytes, 0, size_t(amount - readBytes));
+        return SQLITE_IOERR_SHORT_READ;
+    }
+
+    return SQLITE_OK;
+}
+
+int remoteWrite(sqlite3_file *, const void *, int, sqlite3_int64)
+{
+    return SQLITE_READONLY;
+}
+
+int remoteTruncate(sqlite3_file *, sqlite3_int64)
+{
+    return SQLITE_READONLY;
+}
+
+int remoteSync(sqlite3_file *, int)
+{
+    return SQLITE_OK;
+}
+
+int remoteFileSize(sqlite3_file *file, sqlite3_int64 *pSize)
+{
+    RemotePageSource *source = fileSource(file);
+    *pSize = source ? source->size() : 0;
+    return SQLITE_OK;
+}
+
+int remoteLock(sqlite3_file *, int)
+{
+    return SQLITE_OK;
+}
+
+int remoteCheckReservedLock(sqlite3_file *, int *pResOut)
+{
+    *pResOut = 0;
+    return SQLITE_OK;
+}
+
+int remoteFileControl(sqlite3_file *, int, void *)
+{
+    return SQLITE_NOTFOUND;
+}
+
+int remoteSectorSize(sqlite3_file *)
+{
+    return 512;
+}
+
+int remoteDeviceCharacteristics(sqlite3_file *)
+{
+    return SQLITE_IOCAP_IMMUTABLE;
+}
+
+const sqlite3_io_methods cRemoteIoMethods =
+{
+    1,
+    remoteClose,
+    remoteRead,
+    remoteWrite,
+    remoteTruncate,
+    remoteSync,
+    remoteFileSize,
+    remoteLock,
+    remoteLock,
+    remoteCheckReservedLock,
+    remoteFileControl,
+    remoteSectorSize,
+    remoteDeviceCharacteristics,
+    // Методы версий 2 и 3 не используются
+    nullptr, nullptr, nullptr, nullptr, nullptr, nullptr
+};
+
+int remoteOpen(sqlite3_vfs *, const char *zName, sqlite3_file *file, int flags, int *pOutFlags)
+{
+    file->pMethods = nullptr;
+
+    // Журналы и временные файлы не нужны базе, открытой только для чтения
+    if (!zName || !(flags & SQLITE_OPEN_MAIN_DB))
+        return SQLITE_CANTOPEN;
+
+    const QString path = QString::fromUtf8(zName);
+    RemotePageSource *source = nullptr;
+    {
+        QMutexLocker locker(&sourcesMutex);
+        source = sources.value(path);
+    }
+
+    if (!source && path != cProbePath)
+        return SQLITE_CANTOPEN;
+
+    reinterpret_cast<RemoteFile *>(file)->source = source;
+    file->pMethods = &cRemoteIoMethods;
+
+    if (pOutFlags)
+        *pOutFlags = SQLITE_OPEN_READONLY;
+
+    return SQLITE_OK;
+}
+
+int remoteDelete(sqlite3_vfs *, const char *, int)
+{
+    return SQLITE_IOERR_DELETE;
+}
+
+int remoteAccess(sqlite3_vfs *, const char *, int, int *pResOut)
+{
+    // Журналов у неизменяемого файла нет
+    *pResOut = 0;
+    return SQLITE_OK;
+}
+
+int remoteFullPathname(sqlite3_vfs *, const char *zName, int nOut, char *zOut)
+{
+    sqlite3_snprintf(nOut, zOut, "%s", zName);
+    return SQLITE_OK;
+}
+
+void *remoteDlOpen(sqlite3_vfs *, const char *zFilename)
+{
+    return pDefaultVfs->xDlOpen(pDefaultVfs, zFilename);
+}
+
+void remoteDlError(sqlite3_vfs *, int nByte, char *zErrMsg)
+{
+    pDefaultVfs->xDlError(pDefaultVfs, nByte, zErrMsg);
+}
+
+void (*remoteDlSym(sqlite3_vfs *, void *pHandle, const char *zSymbol))(void)
+{
+    return pDefaultVfs->xDlSym(pDefaultVfs, pHandle, zSymbol);
+}
+
+void remoteDlClose(sqlite3_vfs *, void *pHandle)
+{
+    pDefaultVfs->xDlClose(pDefaultVfs, pHandle);
+}
+
+int remoteRandomness(sqlite3_vfs *, int nByte, char *zOut)
+{
+    return pDefaultVfs->xRandomness(pDefaultVfs, nByte, zOut);
+}
+
+int remoteSleep(sqlite3_vfs *, int microseconds)
+{
+    return pDefaultVfs->xSleep(pDefaultVfs, microseconds);
+}
+
+int remoteCurrentTime(sqlite3_vfs *, double *pTime)
+{
+    return pDefaultVfs->xCurrentTime(pDefaultVfs, pTime);
+}
+
+int remoteGetLastError(sqlite3_vfs *, int, char *)
+{
+    return 0;
+}
+
+sqlite3_vfs remoteVfs =
+{
+    1,
+    int(sizeof(RemoteFile)),
+    1024,
+    nullptr,
+    cVfsName,
+    nullptr,
+    remoteOpen,
+    remoteDelete,
+    remoteAccess,
+    remoteFullPathname,
+    remoteDlOpen,
+    remoteDlError,
+    remoteDlSym,
+    remoteDlClose,
+    remoteRandomness,
+    remoteSleep,
+    remoteCurrentTime,
+    remoteGetLastError,
+    // Методы версий 2 и 3 не используются
+    nullptr, nullptr, nullptr, nullptr
+};
+}
+
+bool RemoteSqliteVfs::registerVfs()
+{
+    if (pDefaultVfs)
+        return true;
+
+    pDefaultVfs = sqlite3_vfs_find(nullptr);
+    if (!pDefaultVfs || sqlite3_vfs_register(&remoteVfs, 0) != SQLITE_OK)
+    {
+        qInfo() << "ОШИБКА: не удалось зарегистрировать файловую систему SQLite" << cVfsName;
+        pDefaultVfs = nullptr;
+        return false;
+    }
+
+    return true;
+}
+
+QString RemoteSqliteVfs::attach(RemotePageSource *source)
+{
+    if (!registerVfs())
+        return QString();
+
+    QMutexLocker locker(&sourcesMutex);
+
+    const QString path = cPathPrefix + QString::number(nextSourceId++);
+    sources.insert(path, source);
+
+    return "file:" + path + "?vfs=" + cVfsName + "&immutable=1";
+}
+
+void RemoteSqliteVfs::detach(const QString &databaseName)
+{
+    const QString path = databaseName.section('?', 0, 0).mid(int(qstrlen("file:")));
+
+    QMutexLocker locker(&sourcesMutex);
+    sources.remove(path);
+}
+
+/*
+ * Если Qt использует встроенную копию SQLite, файловая система
+ * в ней не зарегистрирована, и открытие завершается ошибкой "no such vfs".
+ */
+bool RemoteSqliteVfs::checkAvailability()
+{
+    if (!registerVfs())
+        return false;
+
+    const QString connectionName = "remote-vfs-probe-"
+            + QUuid::createUuid().toString(QUuid::WithoutBraces);
+
+    bool isVfsAvailable = false;
+
+    {
+        QSqlDatabase database = QSqlDatabase::addDatabase("QSQLITE", connectionName);
+        database.setDatabaseName(QString("file:%1?vfs=%2&immutable=1").arg(cProbePath, cVfsName));
+        database.setConnectOptions(cConnectOptions);
+
+        isVfsAvailable = database.open()
+                && QSqlQuery(database).exec("SELECT count(*) FROM sqlite_master");
+
+        database.close();
+    }
+
+    QSqlDatabase::removeDatabase(connectionName);
+
+    if (!isVfsAvailable)
+    {
+        qInfo() << "Драйвер QSQLITE не видит файловую систему" << cVfsName
+                << "; версии будут получаться с сервера целиком";
+    }
+
+    return isVfsAvailable;
+}
+
+#else
+
+bool RemoteSqliteVfs::registerVfs()
+{
+    return false;
+}
+
+bool RemoteSqliteVfs::checkAvailability()
+{
+    return false;
+}
+
+QString RemoteSqliteVfs::attach(RemotePageSource *)
+{
+    return QString();
+}
+
+void RemoteSqliteVfs::detach(const QString &)
+{
+}
+
+#endif // HAVE_SQLITE3
+
+bool RemoteSqliteVfs::isAvailable()
+{
+    static const bool isVfsAvailable = checkAvailability();
+
+    return isVfsAvailable;
+}
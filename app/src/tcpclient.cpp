@@ -1,184 +1,1093 @@
 #include "tcpclient.h"
-#include "dialogselectbackupversion.h"
+#include "compression.h"
 
 #include <QFile>
+#include <QDir>
 #include <QCoreApplication>
 #include <QTextStream>
 #include <QDataStream>
+#include <QCryptographicHash>
+#include <QtEndian>
 
-TcpClient::TcpClient(QString host, int port, QWidget *parent)
-    : QWidget(parent)
+const qint64 TcpClient::cMaxBytesToWrite = 2 * TcpProtocol::cChunkSize;
+
+namespace
+{
+/*
+ * Шаг, с которым сообщается ход передачи базы данных.
+ */
+const qint64 cProgressStep = 1024 * 1024;
+
+bool isProgressStepPassed(qint64 previousBytes, qint64 doneBytes, qint64 totalBytes)
+{
+    return previousBytes / cProgressStep != doneBytes / cProgressStep || doneBytes == totalBytes;
+}
+}
+
+TcpClient::TcpClient(QObject *parent)
+    : QObject(parent)
+    , m_backupCache(QCoreApplication::applicationDirPath() + "/cache")
 {
+    // Сигналы с этими типами доходят до главного окна через очередь событий
+    qRegisterMetaType<QList<BackupInfo>>("QList<BackupInfo>");
+    qRegisterMetaType<BackupQueryBatch>("BackupQueryBatch");
+    qRegisterMetaType<QList<EmployeeDiff>>("QList<EmployeeDiff>");
+
     m_pServerSocket = new QTcpSocket(this);
-    connectToServer(host, port);
 
     connect(m_pServerSocket, SIGNAL(connected()), this, SLOT(slotConnected()));
+    connect(m_pServerSocket, SIGNAL(disconnected()), this, SLOT(slotDisconnected()));
     connect(m_pServerSocket, SIGNAL(readyRead()), this, SLOT(slotReadyRead()));
+    connect(m_pServerSocket, SIGNAL(bytesWritten(qint64)), this, SLOT(slotBytesWritten(qint64)));
     connect(m_pServerSocket, SIGNAL(errorOccurred(QAbstractSocket::SocketError)),
             this, SLOT(slotError(QAbstractSocket::SocketError)));
 }
 
-bool TcpClient::connectToServer(QString host, int port)
+void TcpClient::connectToServer(const QString &host, int port)
 {
-    m_pServerSocket->connectToHost(host, port);
-    m_pServerSocket->waitForConnected(150);
+    runInClientThread([this, host, port]()
+    {
+        // Подключение уже установлено или устанавливается
+        if (m_pServerSocket->state() != QAbstractSocket::UnconnectedState)
+            return;
 
-    return m_pServerSocket->state() == QAbstractSocket::ConnectedState;
+        m_pServerSocket->connectToHost(host, quint16(port));
+    });
 }
 
-bool TcpClient::isConnectedToServer()
+bool TcpClient::isConnectedToServer() const
 {
-    return m_pServerSocket->state() == QAbstractSocket::ConnectedState;
+    return m_isConnected.loadAcquire() != 0;
 }
 
-void TcpClient::sendDatabase(const QFileInfo &dbFileInfo)
+void TcpClient::runInClientThread(std::function<void()> task)
 {
-    QByteArray data;
-    data.clear();
-    QDataStream out(&data, QIODevice::WriteOnly);
-    out.setVersion(QDataStream::Qt_5_0);
+    QMetaObject::invokeMethod(this, std::move(task), Qt::QueuedConnection);
+}
+
+quint32 TcpClient::sendDatabase(const QFileInfo &dbFileInfo)
+{
+    quint32 requestId = newRequestId();
+
+    runInClientThread([this, requestId, dbFileInfo]()
+    {
+        if (m_uploadRequestId != 0)
+            m_pendingUploads.enqueue(qMakePair(requestId, dbFileInfo));
+        else
+            startDeltaUpload(requestId, dbFileInfo);
+    });
 
+    return requestId;
+}
+
+void TcpClient::startDeltaUpload(quint32 requestId, const QFileInfo &dbFileInfo)
+{
     QFile file(dbFileInfo.absoluteFilePath());
     if (!file.exists())
     {
         qInfo() << "Отправляемый файл не существует: " << dbFileInfo.absoluteFilePath();
+        emit uploadFinished(requestId, false);
+        finishUpload();
 
         return;
     }
     if (!file.open(QIODevice::ReadOnly))
     {
         qInfo() << "Не удалось открыть отправляемый файл: " << dbFileInfo.absoluteFilePath();
+        emit uploadFinished(requestId, false);
+        finishUpload();
 
         return;
     }
 
-    out << quint16(0);
-    out << quint16(TcpDataType::Database);
+    m_uploadRequestId = requestId;
+    m_uploadFileInfo = dbFileInfo;
+
+    quint32 pageSize = detectPageSize(file.peek(100));
+    quint32 pageCount = quint32((file.size() + pageSize - 1) / pageSize);
+
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_0);
+
     out << dbFileInfo.fileName().chopped(3).toUtf8();
-    out << file.readAll();
-    out.device()->seek(0);
-    out << quint16(data.size() - sizeof(quint16));
-    m_pServerSocket->write(data);
+    out << qint64(file.size());
+    out << pageSize;
+    out << pageCount;
+    sendFrame(TcpDataType::DeltaUploadOffer, requestId, payload);
+
+    QByteArray hashes;
+    while (!file.atEnd())
+    {
+        QByteArray page = file.read(pageSize);
+        if (page.isEmpty())
+            break;
+
+        hashes.append(QCryptographicHash::hash(page, QCryptographicHash::Sha256));
+
+        if (hashes.size() >= TcpProtocol::cMaxHashesPerFrame * TcpProtocol::cPageHashSize)
+        {
+            sendFrame(TcpDataType::DeltaUploadHashes, requestId, hashes);
+            hashes.clear();
+        }
+    }
+
+    if (!hashes.isEmpty())
+        sendFrame(TcpDataType::DeltaUploadHashes, requestId, hashes);
 
     file.close();
 
-    qInfo() << "Отправлена база данных:" << dbFileInfo.absoluteFilePath();
-    qInfo() << "Имя отправленной базы данных:" << dbFileInfo.fileName().chopped(3);
-    qInfo() << "Размер отправленных данных:" << data.size();
+    m_deltaUploadFilePath = dbFileInfo.absoluteFilePath();
+    m_deltaUploadPageSize = pageSize;
+
+    qInfo() << "Отправлены хеши страниц базы данных:" << dbFileInfo.absoluteFilePath();
+    qInfo() << "Размер страницы:" << pageSize << "; количество страниц:" << pageCount;
+}
+
+void TcpClient::sendMissingPages(const QBitArray &missingPages)
+{
+    if (m_deltaUploadFilePath.isEmpty() || m_pDeltaUploadFile)
+    {
+        qInfo() << "ОШИБКА: сервер запросил страницы, но разностная загрузка не начиналась";
+        return;
+    }
+
+    m_pDeltaUploadFile = new QFile(m_deltaUploadFilePath, this);
+    if (!m_pDeltaUploadFile->open(QIODevice::ReadOnly))
+    {
+        qInfo() << "Не удалось открыть отправляемый файл: " << m_deltaUploadFilePath;
+        // Завершить загрузку на сервере; версия без страниц не будет сохранена
+        sendFrame(TcpDataType::DeltaUploadEnd, m_uploadRequestId);
+        closeDeltaUploadFile();
+        return;
+    }
+
+    m_missingPages = missingPages;
+    m_nextMissingPage = 0;
+    m_deltaUploadSentBytes = 0;
+    m_deltaUploadDoneBytes = 0;
+    m_deltaUploadTotalBytes = qMin(qint64(missingPages.count(true)) * m_deltaUploadPageSize,
+                                   m_pDeltaUploadFile->size());
+
+    writeNextMissingPages();
 }
 
-void TcpClient::sendDatabasesListRequest()
+/*
+ * Записывает в сокет следующие страницы, запрошенные сервером,
+ * пока в его буфере меньше cMaxBytesToWrite неотправленных байт.
+ * Продолжается по сигналу bytesWritten, а после последней страницы
+ * отправляет DeltaUploadEnd.
+ */
+void TcpClient::writeNextMissingPages()
 {
-    QByteArray data;
-    data.clear();
-    QDataStream out(&data, QIODevice::WriteOnly);
+    while (m_pDeltaUploadFile && m_pServerSocket->bytesToWrite() < cMaxBytesToWrite)
+    {
+        while (m_nextMissingPage < m_missingPages.size()
+               && !m_missingPages.testBit(m_nextMissingPage))
+            m_nextMissingPage++;
+
+        if (m_nextMissingPage >= m_missingPages.size())
+        {
+            sendFrame(TcpDataType::DeltaUploadEnd, m_uploadRequestId);
+
+            qInfo() << "Отправлено страниц:" << m_missingPages.count(true)
+                    << "из" << m_missingPages.size()
+                    << "; размер отправленных данных:" << m_deltaUploadSentBytes;
+
+            closeDeltaUploadFile();
+            return;
+        }
+
+        const int pageIndex = m_nextMissingPage++;
+
+        m_pDeltaUploadFile->seek(qint64(pageIndex) * m_deltaUploadPageSize);
+        const QByteArray page = m_pDeltaUploadFile->read(m_deltaUploadPageSize);
+
+        QByteArray payload(int(sizeof(quint32)), Qt::Uninitialized);
+        qToBigEndian<quint32>(quint32(pageIndex), payload.data());
+        payload.append(Compression::encodeChunk(m_codec, page));
+
+        sendFrame(TcpDataType::DeltaUploadPage, m_uploadRequestId, payload);
+        m_deltaUploadSentBytes += payload.size();
+
+        const qint64 previousBytes = m_deltaUploadDoneBytes;
+        m_deltaUploadDoneBytes = qMin(m_deltaUploadDoneBytes + page.size(), m_deltaUploadTotalBytes);
+
+        if (isProgressStepPassed(previousBytes, m_deltaUploadDoneBytes, m_deltaUploadTotalBytes))
+            emit transferProgress(m_uploadRequestId, m_deltaUploadDoneBytes, m_deltaUploadTotalBytes);
+    }
+}
+
+/*
+ * Прекращает отправку страниц разностной загрузки.
+ */
+void TcpClient::closeDeltaUploadFile()
+{
+    delete m_pDeltaUploadFile;
+    m_pDeltaUploadFile = nullptr;
+
+    m_deltaUploadFilePath.clear();
+    m_missingPages.clear();
+    m_nextMissingPage = 0;
+}
+
+/*
+ * Завершает текущую загрузку после ответа сервера
+ * и начинает следующую из очереди.
+ */
+void TcpClient::finishUpload()
+{
+    m_uploadRequestId = 0;
+    m_uploadFileInfo = QFileInfo();
+    closeDeltaUploadFile();
+
+    if (!m_pendingUploads.isEmpty())
+    {
+        QPair<quint32, QFileInfo> pendingUpload = m_pendingUploads.dequeue();
+        startDeltaUpload(pendingUpload.first, pendingUpload.second);
+    }
+}
+
+/*
+ * Заголовок базы SQLite начинается со строки "SQLite format 3\0",
+ * за которой следует размер страницы: два байта в порядке big-endian.
+ * Значение 1 означает размер страницы 65536 байт.
+ */
+quint32 TcpClient::detectPageSize(const QByteArray &fileHeader)
+{
+    const quint32 cDefaultPageSize = 4096;
+    static const QByteArray cSqliteHeader("SQLite format 3\0", 16);
+
+    if (fileHeader.size() < 18 || !fileHeader.startsWith(cSqliteHeader))
+        return cDefaultPageSize;
+
+    quint32 pageSize = qFromBigEndian<quint16>(fileHeader.constData() + 16);
+    if (pageSize == 1)
+        pageSize = 65536;
+
+    if (pageSize < 512 || pageSize > 65536 || (pageSize & (pageSize - 1)) != 0)
+        return cDefaultPageSize;
+
+    return pageSize;
+}
+
+/*
+ * Предлагает серверу поддерживаемые алгоритмы сжатия.
+ */
+void TcpClient::sendHello()
+{
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
     out.setVersion(QDataStream::Qt_5_0);
 
-    out << quint16(0);
-    out << quint16(TcpDataType::DatabasesListRequest);
-    out.device()->seek(0);
-    out << quint16(data.size() - sizeof(quint16));
-    m_pServerSocket->write(data);
+    out << Compression::supportedCodecs();
+    sendFrame(TcpDataType::Hello, newRequestId(), payload);
+}
+
+quint32 TcpClient::newRequestId()
+{
+    quint32 requestId = m_nextRequestId.fetchAndAddRelaxed(1);
+
+    // Номер 0 означает отсутствие запроса
+    if (requestId == 0)
+        requestId = m_nextRequestId.fetchAndAddRelaxed(1);
+
+    return requestId;
+}
+
+quint32 TcpClient::sendDatabasesListRequest(const QString &orgName, qint64 from, qint64 to)
+{
+    quint32 requestId = newRequestId();
+
+    runInClientThread([this, requestId, orgName, from, to]()
+    {
+        // Незавершенный запрос списка заменяется новым
+        m_listRequestId = requestId;
+        m_listOrgName = orgName;
+        m_listFrom = from;
+        m_listTo = to;
+        m_receivedBackupsList.clear();
+
+        sendDatabasesListPageRequest(0);
+
+        qInfo() << "Отправлен запрос на получение списка баз данных на сервере";
+    });
+
+    return requestId;
+}
+
+void TcpClient::sendDatabasesListPageRequest(qint64 cursor)
+{
+    // Первая страница запрашивается под номером всего запроса
+    m_listPageRequestId = cursor == 0 ? m_listRequestId : newRequestId();
+
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_0);
+
+    out << m_listOrgName << m_listFrom << m_listTo << cursor << TcpProtocol::cMaxListPageSize;
+    sendFrame(TcpDataType::DatabasesListRequest, m_listPageRequestId, payload);
+}
+
+quint32 TcpClient::sendSelectedDatabaseName(const QString &selDbName)
+{
+    quint32 requestId = newRequestId();
+
+    runInClientThread([this, requestId, selDbName]()
+    {
+        requestDatabase(requestId, selDbName, 0, QByteArray());
+
+        qInfo() << "Отправлено имя базы данных, которую нужно получить с сервера:" << selDbName;
+    });
+
+    return requestId;
+}
+
+quint32 TcpClient::sendSelectedDatabaseName(const BackupInfo &backupInfo)
+{
+    quint32 requestId = newRequestId();
+
+    runInClientThread([this, requestId, backupInfo]()
+    {
+        if (openCachedDatabase(requestId, backupInfo))
+            return;
+
+        requestDatabase(requestId, backupInfo.fileName, 0, QByteArray());
+
+        qInfo() << "Отправлено имя базы данных, которую нужно получить с сервера:"
+                << backupInfo.fileName;
+    });
+
+    return requestId;
+}
+
+bool TcpClient::isBackupCached(const QByteArray &hash)
+{
+    const bool isCached = m_backupCache.lookup(hash);
+
+    qInfo() << "Кэш версий:" << (isCached ? "попадание" : "промах")
+            << "; попаданий:" << m_backupCache.hitCount()
+            << "; промахов:" << m_backupCache.missCount();
+
+    return isCached;
+}
+
+QString TcpClient::backupCachePartFilePath(const QByteArray &hash) const
+{
+    return m_backupCache.partFilePath(hash);
+}
+
+void TcpClient::addToBackupCache(const QByteArray &hash, const QString &partFilePath)
+{
+    runInClientThread([this, hash, partFilePath]()
+    {
+        if (hash.isEmpty() || fileContentHash(partFilePath) != hash)
+        {
+            qInfo() << "ОШИБКА: хеш версии не совпадает с заявленным, она не добавлена в кэш:"
+                    << partFilePath;
+            QFile::remove(partFilePath);
+            return;
+        }
+
+        if (m_backupCache.insertPart(hash, partFilePath))
+            qInfo() << "Версия добавлена в кэш:" << QString::fromLatin1(hash.toHex());
+    });
+}
+
+QByteArray TcpClient::fileContentHash(const QString &filePath)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly))
+        return QByteArray();
+
+    const quint32 pageSize = detectPageSize(file.peek(100));
+    QCryptographicHash hasher(QCryptographicHash::Sha256);
+
+    while (!file.atEnd())
+    {
+        const QByteArray page = file.read(pageSize);
+        if (page.isEmpty())
+            return QByteArray();
+
+        hasher.addData(QCryptographicHash::hash(page, QCryptographicHash::Sha256));
+    }
+
+    return hasher.result();
+}
+
+bool TcpClient::openCachedDatabase(quint32 requestId, const BackupInfo &backupInfo)
+{
+    if (m_backupCache.cachedFilePath(backupInfo.hash).isEmpty())
+        return false;
+
+    const QString dbFilePath = createDatabaseFileFromCache(backupInfo.hash, backupInfo.orgName);
+    if (dbFilePath.isEmpty())
+        return false;
+
+    qInfo() << "Версия открыта из локального кэша:" << backupInfo.fileName;
+    emit databaseReceived(requestId, dbFilePath, backupInfo.orgName);
+
+    return true;
+}
+
+/*
+ * Главное окно удаляет полученный файл, когда он больше не нужен,
+ * поэтому получает не сам файл кэша, а жесткую ссылку на него
+ * или копию. Предпросмотр файл не изменяет, а сохраненная версия
+ * копируется из него (см. MainWindow::finishPreviewSaving).
+ */
+QString TcpClient::createDatabaseFileFromCache(const QByteArray &hash, const QString &dbName)
+{
+    // Временный файл нужен только для выбора свободного имени
+    QTemporaryFile file(tempDatabaseFileTemplate(dbName));
+    if (!file.open())
+    {
+        qInfo() << "ОШИБКА: не удалось создать временный файл для версии из кэша:" << file.errorString();
+        return QString();
+    }
+
+    const QString dbFilePath = file.fileName();
+    file.setAutoRemove(false);
+    file.close();
+    QFile::remove(dbFilePath);
+
+    if (!m_backupCache.linkTo(hash, dbFilePath))
+    {
+        qInfo() << "ОШИБКА: не удалось получить версию из кэша:" << QString::fromLatin1(hash.toHex());
+        return QString();
+    }
+
+    return dbFilePath;
+}
+
+quint32 TcpClient::sendBackupQuery(const BackupQuery &query)
+{
+    quint32 requestId = newRequestId();
+
+    runInClientThread([this, requestId, query]()
+    {
+        m_pendingQueries.insert(requestId);
+
+        QByteArray payload;
+        QDataStream out(&payload, QIODevice::WriteOnly);
+        out.setVersion(QDataStream::Qt_5_0);
+
+        out << query;
+        sendFrame(TcpDataType::BackupQueryRequest, requestId, payload);
+
+        qInfo() << "Отправлен запрос записей версии" << query.backupFileName
+                << "; вид запроса:" << query.kind << "; значение:" << query.argument;
+    });
+
+    return requestId;
+}
+
+quint32 TcpClient::queryEmployee(const QString &backupFileName, int employeeId)
+{
+    BackupQuery query;
+    query.backupFileName = backupFileName;
+    query.kind = BackupQuery::EmployeeById;
+    query.argument = QString::number(employeeId);
+
+    return sendBackupQuery(query);
+}
+
+quint32 TcpClient::searchEmployees(const QString &backupFileName, const QString &surname)
+{
+    BackupQuery query;
+    query.backupFileName = backupFileName;
+    query.kind = BackupQuery::EmployeesBySurname;
+    query.argument = surname;
+
+    return sendBackupQuery(query);
+}
+
+quint32 TcpClient::queryTable(const QString &backupFileName, const QString &tableName)
+{
+    BackupQuery query;
+    query.backupFileName = backupFileName;
+    query.kind = BackupQuery::Table;
+    query.argument = tableName;
+
+    return sendBackupQuery(query);
+}
+
+quint32 TcpClient::sendBackupDiffRequest(const QString &oldBackupFileName,
+                                         const QString &newBackupFileName)
+{
+    quint32 requestId = newRequestId();
+
+    runInClientThread([this, requestId, oldBackupFileName, newBackupFileName]()
+    {
+        m_pendingDiffs.insert(requestId);
+
+        QByteArray payload;
+        QDataStream out(&payload, QIODevice::WriteOnly);
+        out.setVersion(QDataStream::Qt_5_0);
+
+        out << oldBackupFileName << newBackupFileName;
+        sendFrame(TcpDataType::BackupDiffRequest, requestId, payload);
+
+        qInfo() << "Отправлен запрос сравнения версий" << oldBackupFileName << "и" << newBackupFileName;
+    });
+
+    return requestId;
+}
+
+void TcpClient::cancelRequest(quint32 requestId)
+{
+    runInClientThread([this, requestId]()
+    {
+        bool isCancelled = false;
+
+        if (m_requestedDownloads.remove(requestId) > 0)
+        {
+            isCancelled = true;
+
+            // Недополученный файл не нужен, если больше нечего продолжать
+            if (requestId == m_receivedDbRequestId || m_requestedDownloads.isEmpty())
+                resetReceivedDatabase();
+        }
+
+        if (m_pendingQueries.remove(requestId) || m_pendingDiffs.remove(requestId))
+            isCancelled = true;
+
+        if (requestId != 0 && requestId == m_listRequestId)
+        {
+            isCancelled = true;
+
+            // Ответ ожидается на последнюю запрошенную страницу
+            m_cancelledRequests.insert(m_listPageRequestId);
+            m_listRequestId = 0;
+            m_listPageRequestId = 0;
+            m_receivedBackupsList.clear();
+        }
+
+        // Загрузка, которая ждет в очереди, еще не отправлялась серверу
+        for (int i = 0; i < m_pendingUploads.size(); i++)
+        {
+            if (m_pendingUploads.at(i).first == requestId)
+            {
+                m_pendingUploads.removeAt(i);
+                qInfo() << "Запрос" << requestId << "отменен";
+                emit requestCancelled(requestId);
+
+                return;
+            }
+        }
+
+        const bool isUploadCancelled = requestId != 0 && requestId == m_uploadRequestId;
+
+        if (!isCancelled && !isUploadCancelled)
+            return;
+
+        m_cancelledRequests.insert(requestId);
+        sendFrame(TcpDataType::CancelRequest, requestId);
 
-    qInfo() << "Отправлен запрос на получение списка баз данных на сервере";
+        qInfo() << "Запрос" << requestId << "отменен";
+        emit requestCancelled(requestId);
+
+        if (isUploadCancelled)
+            finishUpload();
+    });
 }
 
-void TcpClient::sendSelectedDatabaseName(const QString &selDbName)
+/*
+ * Запрашивает версию backupFileName под номером requestId,
+ * если первые offset байт версии с хешем содержимого contentHash уже получены.
+ */
+void TcpClient::requestDatabase(quint32 requestId, const QString &backupFileName, qint64 offset,
+                                const QByteArray &contentHash)
 {
-    QByteArray data;
-    data.clear();
-    QDataStream out(&data, QIODevice::WriteOnly);
+    m_requestedDownloads.insert(requestId, backupFileName);
+
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
     out.setVersion(QDataStream::Qt_5_0);
 
-    out << quint16(0);
-    out << quint16(TcpDataType::SelectedDatabaseName);
-    out << selDbName.toUtf8();
-    out.device()->seek(0);
-    out << quint16(data.size() - sizeof(quint16));
-    m_pServerSocket->write(data);
+    out << backupFileName.toUtf8() << offset << contentHash;
+    sendFrame(TcpDataType::SelectedDatabaseName, requestId, payload);
+}
+
+/*
+ * Удаляет состояние приема базы данных вместе с недополученным файлом.
+ */
+void TcpClient::resetReceivedDatabase()
+{
+    m_receivedDbRequestId = 0;
+    m_receivedDbName.clear();
+    m_receivedDbBackupFileName.clear();
+    m_receivedDbHash.clear();
+    m_receivedDbExpectedSize = -1;
+    m_receivedDbSize = 0;
+
+    delete m_pReceivedDbFile;
+    m_pReceivedDbFile = nullptr;
+
+    m_receivedDbHasher.reset();
+    m_receivedDbPageSize = 0;
+    m_receivedDbPage.clear();
+}
+
+/*
+ * Незаконченный временный файл удаляется вместе с m_pReceivedDbFile.
+ */
+void TcpClient::failDownload(quint32 requestId, const QString &error)
+{
+    qInfo() << "ОШИБКА:" << error;
+
+    m_requestedDownloads.remove(requestId);
+
+    if (requestId == m_receivedDbRequestId)
+        resetReceivedDatabase();
+
+    emit downloadFailed(requestId, error);
+}
+
+/*
+ * Имена временных файлов баз данных хранятся в формате "name.db.XXXXXX",
+ * как их ожидает главное окно. Пока база данных не получена целиком,
+ * файл удаляется вместе с объектом m_pReceivedDbFile.
+ */
+QString TcpClient::tempDatabaseFileTemplate(const QString &dbName)
+{
+    QString fileName = dbName.isEmpty() ? "tempOrg.db" : dbName;
+    if (!fileName.endsWith(".db", Qt::CaseInsensitive))
+        fileName.append(".db");
+
+    return QDir::tempPath() + "/" + fileName;
+}
+
+bool TcpClient::createReceivedDatabaseFile(const QString &dbName, const QByteArray &dbHash)
+{
+    m_pReceivedDbFile = new QTemporaryFile(dbHash.isEmpty() ? tempDatabaseFileTemplate(dbName)
+                                                            : m_backupCache.partFileTemplate(dbHash),
+                                           this);
+
+    if (!m_pReceivedDbFile->open())
+    {
+        qInfo() << "ОШИБКА: не удалось создать файл для получаемой базы данных:"
+                << m_pReceivedDbFile->errorString();
+
+        delete m_pReceivedDbFile;
+        m_pReceivedDbFile = nullptr;
+
+        return false;
+    }
+
+    return true;
+}
+
+bool TcpClient::appendReceivedData(const QByteArray &data)
+{
+    if (m_pReceivedDbFile->write(data) != data.size())
+    {
+        qInfo() << "ОШИБКА: не удалось записать часть базы данных в файл:"
+                << m_pReceivedDbFile->errorString();
+        return false;
+    }
+
+    m_receivedDbSize += data.size();
+    hashReceivedData(data, false);
+
+    return true;
+}
+
+/*
+ * Добавляет к хешу содержимого страницы, которые получены целиком.
+ * Если isLastData равен true, добавляет и последнюю неполную страницу.
+ */
+void TcpClient::hashReceivedData(const QByteArray &data, bool isLastData)
+{
+    m_receivedDbPage.append(data);
+
+    if (m_receivedDbPageSize == 0)
+    {
+        if (m_receivedDbPage.size() < 100 && !isLastData)
+            return;
+
+        m_receivedDbPageSize = detectPageSize(m_receivedDbPage.left(100));
+    }
+
+    const int pageSize = int(m_receivedDbPageSize);
+    int offset = 0;
 
-    qInfo() << "Отправлено имя базы данных, которую нужно получить с сервера:" << selDbName;
+    while (m_receivedDbPage.size() - offset >= pageSize
+           || (isLastData && offset < m_receivedDbPage.size()))
+    {
+        const int size = qMin(pageSize, m_receivedDbPage.size() - offset);
+
+        m_receivedDbHasher.addData(QCryptographicHash::hash(
+                                       QByteArray::fromRawData(m_receivedDbPage.constData() + offset, size),
+                                       QCryptographicHash::Sha256));
+        offset += size;
+    }
+
+    m_receivedDbPage.remove(0, offset);
+}
+
+bool TcpClient::rehashReceivedDatabase()
+{
+    m_receivedDbHasher.reset();
+    m_receivedDbPageSize = 0;
+    m_receivedDbPage.clear();
+
+    if (!m_pReceivedDbFile->seek(0))
+        return false;
+
+    while (m_pReceivedDbFile->pos() < m_receivedDbSize)
+    {
+        const QByteArray data = m_pReceivedDbFile->read(
+                    qMin(qint64(TcpProtocol::cChunkSize), m_receivedDbSize - m_pReceivedDbFile->pos()));
+        if (data.isEmpty())
+            return false;
+
+        hashReceivedData(data, false);
+    }
+
+    return true;
+}
+
+/*
+ * Записывает заголовок кадра с типом dataType и номером запроса requestId
+ * и отправляет кадр серверу.
+ */
+void TcpClient::sendFrame(quint16 dataType, quint32 requestId, const QByteArray &payload)
+{
+    m_pServerSocket->write(FrameDecoder::encodeHeader(dataType, requestId, quint64(payload.size())));
+    m_pServerSocket->write(payload);
 }
 
 void TcpClient::slotReadyRead()
 {
-    QDataStream in(m_pServerSocket);
+    for (;;)
+    {
+        FrameDecoder::Frame frame;
+        FrameDecoder::Result result = m_frameDecoder.readFrame(m_pServerSocket, frame);
+
+        if (result == FrameDecoder::NeedMoreData)
+            break;
+
+        if (result == FrameDecoder::InvalidFrame)
+        {
+            qInfo() << "ОШИБКА: недопустимый размер кадра от сервера:" << m_frameDecoder.frameSize();
+            m_frameDecoder.reset();
+            m_pServerSocket->abort();
+            return;
+        }
+
+        processFrame(frame);
+    }
+}
+
+void TcpClient::processFrame(const FrameDecoder::Frame &frame)
+{
+    if (frame.version != TcpProtocol::cVersion)
+    {
+        qInfo() << "ОШИБКА: сервер использует неподдерживаемую версию протокола:"
+                << frame.version;
+        return;
+    }
+
+    const quint16 incomingDataType = frame.dataType;
+    const quint32 requestId = frame.requestId;
+
+    // Кадры, которые сервер отправил до получения CancelRequest
+    if (m_cancelledRequests.contains(requestId))
+        return;
+
+    QDataStream in(frame.payload);
     in.setVersion(QDataStream::Qt_5_0);
 
-    quint16 nextBlockSize = 0;
-    quint16 incomingDataType = 0;
-    QStringList databasesOnServerList;
-    databasesOnServerList.clear();
-    QString receivedDbName;
-    QByteArray data;
-    data.clear();
+    if (incomingDataType == TcpDataType::HelloAck)
+    {
+        in >> m_codec;
+
+        if (!Compression::isCodecSupported(m_codec))
+            m_codec = Compression::CodecNone;
 
-    if (in.status() == QDataStream::Ok)
+        qInfo() << "Выбранный сервером алгоритм сжатия:" << Compression::codecName(m_codec);
+    }
+    else if (incomingDataType == TcpDataType::Database)
     {
-        while (true)
+        QByteArray bArray;
+        qint64 dbSize = -1;
+        qint64 offset = 0;
+        QByteArray dbHash;
+        in >> bArray >> dbSize >> offset >> dbHash;
+
+        QString backupFileName = m_requestedDownloads.value(requestId);
+
+        // Продолжение прерванной передачи той же версии
+        bool isResumed = offset > 0 && m_pReceivedDbFile && !backupFileName.isEmpty()
+                && backupFileName == m_receivedDbBackupFileName
+                && dbHash == m_receivedDbHash
+                && offset <= m_receivedDbSize;
+
+        if (isResumed && offset < m_receivedDbSize)
+        {
+            m_receivedDbSize = offset;
+            isResumed = m_pReceivedDbFile->resize(offset) && rehashReceivedDatabase();
+        }
+
+        if (isResumed)
+        {
+            qInfo() << "Получение базы данных продолжается с" << offset << "байт";
+        }
+        else
         {
-            qInfo() << "Чтение поступивших от сервера данных...";
-            if (nextBlockSize == 0)
+            resetReceivedDatabase();
+
+            if (!createReceivedDatabaseFile(QString::fromUtf8(bArray), dbHash))
             {
-                if (m_pServerSocket->bytesAvailable() < 2)
-                    break;
-                in >> nextBlockSize;
-
-                if (incomingDataType == 0)
-                {
-                    in >> incomingDataType;
-                    nextBlockSize -= sizeof(quint16);
-
-                    if (incomingDataType == TcpDataType::Database)
-                    {
-                        QByteArray bArray;
-                        in >> bArray;
-                        receivedDbName = QString::fromUtf8(bArray);
-                        nextBlockSize -= sizeof(QChar) * (receivedDbName.count() + 2);
-                    }
-                    else if (incomingDataType == TcpDataType::DatabasesList)
-                        in >> databasesOnServerList;
-                }
+                // Без файла база данных не может быть получена
+                m_cancelledRequests.insert(requestId);
+                sendFrame(TcpDataType::CancelRequest, requestId);
+
+                failDownload(requestId, "Не удалось создать временный файл для базы данных");
+                return;
             }
+        }
 
-            if (m_pServerSocket->bytesAvailable() < nextBlockSize)
-                break;
+        m_receivedDbRequestId = requestId;
+        m_receivedDbName = QString::fromUtf8(bArray);
+        m_receivedDbBackupFileName = backupFileName;
+        m_receivedDbHash = dbHash;
+        m_receivedDbExpectedSize = dbSize;
 
-            in >> data;
-            nextBlockSize = 0;
-        }
+        emit transferProgress(requestId, m_receivedDbSize, dbSize);
     }
+    else if (incomingDataType == TcpDataType::DatabaseChunk)
+    {
+        if (m_receivedDbExpectedSize < 0 || requestId != m_receivedDbRequestId)
+        {
+            qInfo() << "ОШИБКА: получена часть базы данных без начала передачи";
+            return;
+        }
+
+        QByteArray chunk;
+        QString error;
+        const qint64 previousBytes = m_receivedDbSize;
 
-    if (incomingDataType == TcpDataType::Database)
+        if (!Compression::decodeChunk(frame.payload, chunk,
+                                      int(TcpProtocol::cChunkSize)))
+        {
+            error = "Не удалось распаковать часть базы данных";
+        }
+        else if (!appendReceivedData(chunk))
+        {
+            error = "Не удалось записать часть базы данных во временный файл";
+        }
+
+        // Остальные части этой передачи уже не нужны
+        if (!error.isEmpty())
+        {
+            m_cancelledRequests.insert(requestId);
+            sendFrame(TcpDataType::CancelRequest, requestId);
+
+            failDownload(requestId, error);
+            return;
+        }
+
+        if (isProgressStepPassed(previousBytes, m_receivedDbSize, m_receivedDbExpectedSize))
+            emit transferProgress(requestId, m_receivedDbSize, m_receivedDbExpectedSize);
+    }
+    else if (incomingDataType == TcpDataType::DatabaseEnd)
     {
+        if (requestId != m_receivedDbRequestId)
+        {
+            qInfo() << "ОШИБКА: получен конец передачи базы данных без ее начала";
+            return;
+        }
+
+        QString receivedDbName = m_receivedDbName;
+        QByteArray dbHash = m_receivedDbHash;
+        bool sizeMatches = m_pReceivedDbFile && m_receivedDbExpectedSize == m_receivedDbSize;
+        bool isFlushed = false;
+        QString dbFilePath;
+
+        if (sizeMatches)
+        {
+            hashReceivedData(QByteArray(), true);
+            isFlushed = m_pReceivedDbFile->flush();
+            dbFilePath = m_pReceivedDbFile->fileName();
+        }
+
+        QByteArray receivedHash = m_receivedDbHasher.result();
+
+        QString error;
         if (receivedDbName.isEmpty())
+            error = "Сервер не отправил имя базы данных";
+        else if (!sizeMatches)
+            error = "Размер полученной базы данных не совпадает с заявленным";
+        else if (!isFlushed)
+            error = "Не удалось записать полученную базу данных в файл";
+        else if (!dbHash.isEmpty() && receivedHash != dbHash)
+            error = "Хеш полученной базы данных не совпадает с заявленным";
+
+        // Файл с ошибкой удаляется вместе с m_pReceivedDbFile
+        if (!error.isEmpty())
         {
-            qInfo() << "ОШИБКА: сервер не отправил имя базы данных";
+            failDownload(requestId, error);
             return;
         }
 
-        qInfo() << "Получена база данных с сервера:" << receivedDbName;
-        emit databaseReceived(data, receivedDbName);
+        m_pReceivedDbFile->close();
+        m_pReceivedDbFile->setAutoRemove(false);
+
+        m_requestedDownloads.remove(requestId);
+        resetReceivedDatabase();
+
+        qInfo() << "Получена база данных с сервера:" << receivedDbName << "; файл:" << dbFilePath;
+
+        // Файл записан в каталоге кэша и переносится в кэш без копирования;
+        // если версия уже попала в кэш из предпросмотра, файл удаляется
+        if (!dbHash.isEmpty())
+        {
+            m_backupCache.insertPart(dbHash, dbFilePath);
+
+            dbFilePath = createDatabaseFileFromCache(dbHash, receivedDbName);
+            if (dbFilePath.isEmpty())
+            {
+                emit downloadFailed(requestId, "Не удалось сохранить полученную базу данных");
+                return;
+            }
+        }
+
+        emit databaseReceived(requestId, dbFilePath, receivedDbName);
+    }
+    else if (incomingDataType == TcpDataType::DatabaseSendFailure)
+    {
+        QString error;
+        in >> error;
+
+        if (!m_requestedDownloads.contains(requestId))
+        {
+            qInfo() << "ОШИБКА: получено сообщение об ошибке для неизвестного запроса" << requestId;
+            return;
+        }
+
+        failDownload(requestId, error);
+    }
+    else if (incomingDataType == TcpDataType::DeltaUploadMissingPages)
+    {
+        if (requestId != m_uploadRequestId)
+        {
+            qInfo() << "ОШИБКА: сервер запросил страницы для неизвестной загрузки" << requestId;
+            return;
+        }
+
+        QBitArray missingPages;
+        in >> missingPages;
+
+        sendMissingPages(missingPages);
     }
     else if (incomingDataType == TcpDataType::DatabaseFileCreationSuccess)
     {
         qInfo() << "Получено сообщение о том, что сервер успешно сохранил полученную базу даных";
-        emit serverCreatedDatabaseFile(true);
+        emit uploadFinished(requestId, true);
+
+        if (requestId == m_uploadRequestId)
+            finishUpload();
     }
     else if (incomingDataType == TcpDataType::DatabaseFileCreationFailure)
     {
         qInfo() << "Получено сообщение о том, что сервер не смог сохранить полученную базу данных";
-        emit serverCreatedDatabaseFile(false);
+        emit uploadFinished(requestId, false);
+
+        if (requestId == m_uploadRequestId)
+            finishUpload();
+    }
+    else if (incomingDataType == TcpDataType::BackupQueryRows)
+    {
+        if (!m_pendingQueries.contains(requestId))
+        {
+            qInfo() << "ОШИБКА: получены записи для неизвестного запроса" << requestId;
+            return;
+        }
+
+        BackupQueryBatch batch;
+        in >> batch;
+
+        emit backupQueryRowsReceived(requestId, batch);
+    }
+    else if (incomingDataType == TcpDataType::BackupQueryEnd)
+    {
+        if (!m_pendingQueries.remove(requestId))
+            return;
+
+        bool isSucceeded = false;
+        quint32 rowCount = 0;
+        QString error;
+        in >> isSucceeded >> rowCount >> error;
+
+        if (isSucceeded)
+            qInfo() << "Получено записей версии:" << rowCount;
+        else
+            qInfo() << "ОШИБКА: сервер не выполнил запрос записей:" << error;
+
+        emit backupQueryFinished(requestId, isSucceeded, rowCount, error);
+    }
+    else if (incomingDataType == TcpDataType::BackupDiffEntries)
+    {
+        if (!m_pendingDiffs.contains(requestId))
+        {
+            qInfo() << "ОШИБКА: получены отличия версий для неизвестного запроса" << requestId;
+            return;
+        }
+
+        QList<EmployeeDiff> entries;
+        in >> entries;
+
+        emit backupDiffEntriesReceived(requestId, entries);
+    }
+    else if (incomingDataType == TcpDataType::BackupDiffEnd)
+    {
+        if (!m_pendingDiffs.remove(requestId))
+            return;
+
+        bool isSucceeded = false;
+        quint32 addedCount = 0;
+        quint32 removedCount = 0;
+        quint32 changedCount = 0;
+        QString error;
+        in >> isSucceeded >> addedCount >> removedCount >> changedCount >> error;
+
+        if (isSucceeded)
+            qInfo() << "Получено сравнение версий; добавлено:" << addedCount
+                    << "удалено:" << removedCount << "изменено:" << changedCount;
+        else
+            qInfo() << "ОШИБКА: сервер не выполнил сравнение версий:" << error;
+
+        emit backupDiffFinished(requestId, isSucceeded, addedCount, removedCount, changedCount, error);
     }
     else if (incomingDataType == TcpDataType::DatabasesList)
     {
-        qInfo() << "Получен список баз данных на сервере:" << databasesOnServerList;
+        // Ответ на запрос, который был заменен новым, не нужен
+        if (requestId != m_listPageRequestId)
+            return;
+
+        QList<BackupInfo> backupsPage;
+        qint64 nextCursor = 0;
+        in >> backupsPage >> nextCursor;
 
-        DialogSelectBackupVersion dialog(databasesOnServerList, this);
-        if (dialog.exec() == QDialog::Accepted)
+        m_receivedBackupsList << backupsPage;
+
+        if (nextCursor != 0)
         {
-            sendSelectedDatabaseName(dialog.getSelectedVersion());
+            sendDatabasesListPageRequest(nextCursor);
+            return;
         }
+
+        const quint32 listRequestId = m_listRequestId;
+        const QList<BackupInfo> backupsList = m_receivedBackupsList;
+        m_receivedBackupsList.clear();
+        m_listRequestId = 0;
+        m_listPageRequestId = 0;
+
+        qInfo() << "Получен список версий на сервере; количество:" << backupsList.size();
+
+        emit backupsListReceived(listRequestId, backupsList);
     }
     else
     {
@@ -197,14 +1106,90 @@ void TcpClient::slotError(QAbstractSocket::SocketError err)
                                     QString(m_pServerSocket->errorString())
                                     );
     qDebug() << strError;
+
+    // Ошибка до установки соединения означает, что подключиться не удалось
+    if (!isConnectedToServer())
+        emit connectionFailed(strError);
 }
 
 void TcpClient::slotConnected()
 {
     qInfo() << "TcpClient: подключено к серверу";
+
+    m_isConnected.storeRelease(1);
+
+    m_codec = Compression::CodecNone;
+    m_frameDecoder.reset();
+    m_cancelledRequests.clear();
+
+    sendHello();
+
+    // Список версий запрашивается заново с первой страницы
+    if (m_listRequestId != 0)
+    {
+        m_receivedBackupsList.clear();
+        sendDatabasesListPageRequest(0);
+    }
+
+    /*
+     * Запросы записей и сравнения не повторяются: часть ответа уже могла
+     * быть получена, и повторный ответ передал бы ее второй раз.
+     */
+    const QSet<quint32> pendingQueries = m_pendingQueries;
+    m_pendingQueries.clear();
+
+    for (quint32 queryRequestId : pendingQueries)
+        emit backupQueryFinished(queryRequestId, false, 0, "Соединение с сервером прервано");
+
+    const QSet<quint32> pendingDiffs = m_pendingDiffs;
+    m_pendingDiffs.clear();
+
+    for (quint32 diffRequestId : pendingDiffs)
+        emit backupDiffFinished(diffRequestId, false, 0, 0, 0, "Соединение с сервером прервано");
+
+    /*
+     * Запросы, отправленные по прежнему подключению, отправляются снова.
+     * Уже полученная часть базы данных сохраняется, а сервер
+     * продолжает передачу с ее конца, если версия та же.
+     */
+    const QHash<quint32, QString> requestedDownloads = m_requestedDownloads;
+    m_requestedDownloads.clear();
+
+    for (auto it = requestedDownloads.cbegin(); it != requestedDownloads.cend(); ++it)
+    {
+        if (it.key() == m_receivedDbRequestId)
+            requestDatabase(it.key(), it.value(), m_receivedDbSize, m_receivedDbHash);
+        else
+            requestDatabase(it.key(), it.value(), 0, QByteArray());
+    }
+
+    m_receivedDbRequestId = 0;
+    m_receivedDbExpectedSize = -1;
+
+    if (m_uploadRequestId != 0)
+    {
+        quint32 uploadRequestId = m_uploadRequestId;
+        QFileInfo uploadFileInfo = m_uploadFileInfo;
+        m_uploadRequestId = 0;
+        closeDeltaUploadFile();
+
+        qInfo() << "Возобновлена загрузка базы данных:" << uploadFileInfo.fileName();
+        startDeltaUpload(uploadRequestId, uploadFileInfo);
+    }
+
+    emit connectedToServer();
+}
+
+void TcpClient::slotBytesWritten(qint64 bytes)
+{
+    Q_UNUSED(bytes)
+
+    writeNextMissingPages();
 }
 
-void TcpClient::slotGetSelectedBackupVersion(QString &version)
+void TcpClient::slotDisconnected()
 {
-    sendSelectedDatabaseName(version);
+    qInfo() << "TcpClient: соединение с сервером разорвано";
+
+    m_isConnected.storeRelease(0);
 }
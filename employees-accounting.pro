@@ -1,4 +1,6 @@
 TEMPLATE = subdirs
 
 SUBDIRS = app \
-          server
\ No newline at end of file
+          loadgen \
+          server \
+          server/tests
\ No newline at end of file
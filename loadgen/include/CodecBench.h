@@ -0,0 +1,35 @@
+#ifndef CODECBENCH_H
+#define CODECBENCH_H
+
+#include <QByteArray>
+#include <QList>
+#include <QPair>
+#include <QJsonArray>
+
+/*
+ * Измеряет скорость и степень сжатия алгоритмов из Compression
+ * на тех же данных, что используются в нагрузочном прогоне.
+ *
+ * Данные делятся на части размером TcpProtocol::cChunkSize,
+ * как при передаче, и каждая часть сжимается отдельно.
+ * Сеть и сервер не участвуют, поэтому результат показывает,
+ * упирается ли передача в сжатие.
+ */
+class CodecBench
+{
+public:
+    /*
+     * Алгоритм сжатия и уровень (-1 - уровень по умолчанию для алгоритма).
+     */
+    using CodecLevel = QPair<quint8, int>;
+
+    /*
+     * Возвращает для каждой пары codecLevels объект JSON:
+     * codec, level, ratio, compressMegabytesPerSecond, decompressMegabytesPerSecond.
+     * Каждая пара повторяет сжатие всех данных rounds раз.
+     */
+    static QJsonArray run(const QList<QByteArray> &payloads, const QList<CodecLevel> &codecLevels,
+                          int rounds = 3);
+};
+
+#endif // CODECBENCH_H
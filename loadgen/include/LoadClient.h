@@ -0,0 +1,115 @@
+#ifndef LOADCLIENT_H
+#define LOADCLIENT_H
+
+#include "LoadStats.h"
+#include "PayloadGenerator.h"
+#include "FrameDecoder.h"
+
+#include <QObject>
+#include <QTcpSocket>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QStringList>
+#include <QBitArray>
+#include <QList>
+#include <QRandomGenerator>
+
+/*
+ * Один имитируемый клиент нагрузочного прогона.
+ *
+ * Клиент подключается к серверу, договаривается о сжатии
+ * и выполняет операции одну за другой, выбирая каждую случайно
+ * с весами из Config::mix, пока не будет вызван stop:
+ * - upload - потоковая загрузка базы данных (Database, DatabaseChunk, DatabaseEnd);
+ * - delta - разностная загрузка, как в основном приложении;
+ * - list - запрос первой страницы списка версий;
+ * - download - получение одной из версий, найденных в списке.
+ *
+ * Операция, на которую сервер не ответил за Config::operationTimeout,
+ * считается ошибкой и отменяется кадром CancelRequest; кадры ответа,
+ * отправленные до отмены, отбрасываются по номеру запроса.
+ */
+class LoadClient : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Config
+    {
+        QString host = "127.0.0.1";
+        quint16 port = 2323;
+        QList<QPair<QString, int>> mix;
+        QList<quint8> offeredCodecs;
+        int operationTimeout = 60000;
+        QString orgName;
+    };
+
+    LoadClient(const Config &config, const QList<PayloadGenerator::Payload> *payloads,
+               quint32 seed, QObject *parent = nullptr);
+
+    void start();
+    void stop();
+
+    const LoadStats &stats() const { return m_stats; }
+
+    static const QString cUpload;
+    static const QString cDelta;
+    static const QString cList;
+    static const QString cDownload;
+
+signals:
+    void finished(LoadClient *client);
+
+private:
+    Config m_config;
+    const QList<PayloadGenerator::Payload> *m_pPayloads = nullptr;
+    QRandomGenerator m_random;
+
+    QTcpSocket m_socket;
+    FrameDecoder m_frameDecoder;
+    QTimer m_timeoutTimer;
+    LoadStats m_stats;
+
+    quint8 m_codec = 0;
+    quint32 m_nextRequestId = 0;
+    bool m_isStopping = false;
+    bool m_isFinished = false;
+
+    /*
+     * Текущая операция.
+     */
+    QString m_operation;
+    quint32 m_requestId = 0;
+    QElapsedTimer m_operationTimer;
+    qint64 m_operationBytes = 0;
+    const PayloadGenerator::Payload *m_pUploadPayload = nullptr;
+    qint64 m_downloadSize = -1;
+
+    int m_nextPayloadIndex = 0;
+    QStringList m_knownBackups;
+
+    void nextOperation();
+    QString chooseOperation();
+
+    void startUpload();
+    void startDeltaUpload();
+    void startList();
+    void startDownload();
+
+    void sendUploadChunks(qint64 offset);
+    void sendMissingPages(const QBitArray &missingPages);
+
+    void finishOperation(bool isSucceeded);
+    void finish();
+
+    void processFrame(const FrameDecoder::Frame &frame);
+    void sendFrame(quint16 dataType, quint32 requestId, const QByteArray &payload = QByteArray());
+
+private slots:
+    void slotConnected();
+    void slotReadyRead();
+    void slotError(QAbstractSocket::SocketError socketError);
+    void slotOperationTimeout();
+};
+
+#endif // LOADCLIENT_H
@@ -0,0 +1,58 @@
+#ifndef LOADGENERATOR_H
+#define LOADGENERATOR_H
+
+#include "LoadClient.h"
+#include "ServerStatsProbe.h"
+
+#include <QObject>
+#include <QList>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QJsonObject>
+
+/*
+ * Нагрузочный прогон: clientsCount клиентов LoadClient
+ * одновременно работают с сервером в течение durationSeconds,
+ * после чего их результаты объединяются.
+ *
+ * Все клиенты работают в основном потоке, поэтому на время прогона
+ * нужен запущенный цикл событий; окончание прогона сообщается сигналом finished.
+ */
+class LoadGenerator : public QObject
+{
+    Q_OBJECT
+
+public:
+    LoadGenerator(const LoadClient::Config &clientConfig,
+                  const QList<PayloadGenerator::Payload> *payloads,
+                  QObject *parent = nullptr);
+
+    void start(int clientsCount, int durationSeconds);
+
+    /*
+     * Результаты последнего прогона (см. LoadStats::toJson)
+     * вместе с количеством клиентов и процессорным временем сервера
+     * (см. ServerStatsProbe::difference).
+     */
+    QJsonObject result() const { return m_result; }
+
+signals:
+    void finished();
+
+private:
+    LoadClient::Config m_clientConfig;
+    const QList<PayloadGenerator::Payload> *m_pPayloads = nullptr;
+
+    QList<LoadClient*> m_clients;
+    int m_runningClientsCount = 0;
+    QTimer m_durationTimer;
+    QElapsedTimer m_elapsedTimer;
+    QJsonObject m_result;
+    ServerStatsProbe::Snapshot m_serverStatsBefore;
+
+private slots:
+    void slotDurationElapsed();
+    void slotClientFinished(LoadClient *client);
+};
+
+#endif // LOADGENERATOR_H
@@ -0,0 +1,48 @@
+#ifndef LOADSTATS_H
+#define LOADSTATS_H
+
+#include <QString>
+#include <QMap>
+#include <QVector>
+#include <QJsonObject>
+
+/*
+ * Результаты нагрузочного прогона: количество операций каждого вида,
+ * ошибки, объем переданных данных и длительности операций.
+ *
+ * Каждый клиент ведет собственный объект, после прогона
+ * они объединяются через merge и выводятся в JSON.
+ */
+class LoadStats
+{
+public:
+    struct Operation
+    {
+        qint64 count = 0;
+        qint64 errors = 0;
+        qint64 bytes = 0;
+        QVector<double> latenciesMs;
+    };
+
+    void addSuccess(const QString &operation, double latencyMs, qint64 bytes);
+    void addError(const QString &operation);
+    void addConnectionError() { m_connectionErrors++; }
+
+    void merge(const LoadStats &other);
+
+    /*
+     * Возвращает результаты в виде JSON: для каждой операции -
+     * количество, ошибки, операций и мегабайт в секунду
+     * и квантили длительности p50, p90, p99 в миллисекундах.
+     */
+    QJsonObject toJson(double durationSeconds) const;
+
+private:
+    QMap<QString, Operation> m_operations;
+    qint64 m_connectionErrors = 0;
+
+    static QJsonObject operationToJson(const Operation &operation, double durationSeconds);
+    static double percentile(const QVector<double> &sortedValues, double q);
+};
+
+#endif // LOADSTATS_H
@@ -0,0 +1,56 @@
+#ifndef PAYLOADGENERATOR_H
+#define PAYLOADGENERATOR_H
+
+#include <QString>
+#include <QByteArray>
+#include <QList>
+
+class QSqlDatabase;
+class QRandomGenerator;
+
+/*
+ * Создает файлы баз данных для нагрузочных прогонов.
+ *
+ * Базы данных имеют ту же схему, что и базы основного приложения
+ * (DatabaseCreation), и заполнены сгенерированными сотрудниками,
+ * поэтому сервер проверяет и сжимает их так же, как настоящие.
+ * Каждая следующая версия получается из предыдущей изменением
+ * около процента сотрудников и добавлением новых, как при обычной работе
+ * с программой, поэтому разностная загрузка передает только часть страниц.
+ */
+class PayloadGenerator
+{
+public:
+    /*
+     * Версия базы данных вместе с тем, что клиент вычисляет перед отправкой.
+     */
+    struct Payload
+    {
+        QByteArray data;
+        QByteArray contentHash;
+        quint32 pageSize = 0;
+        QByteArray pageHashes;   // Хеши SHA-256 всех страниц по порядку
+    };
+
+    /*
+     * Возвращает содержимое versionsCount последовательных версий базы данных
+     * с employeesCount сотрудниками. Одинаковый seed дает одинаковые версии.
+     */
+    static QList<QByteArray> generate(int versionsCount, int employeesCount, quint32 seed);
+
+    /*
+     * Вычисляет хеши страниц и хеш содержимого dbData -
+     * SHA-256 списка хешей страниц (как BackupStore::contentHash).
+     */
+    static Payload makePayload(const QByteArray &dbData);
+    static quint32 detectPageSize(const QByteArray &fileHeader);
+
+    static const quint32 cDefaultPageSize;
+
+private:
+    static bool createTables(QSqlDatabase &db);
+    static bool insertEmployees(QSqlDatabase &db, int firstId, int count, QRandomGenerator &random);
+    static bool updateEmployees(QSqlDatabase &db, int employeesCount, QRandomGenerator &random);
+};
+
+#endif // PAYLOADGENERATOR_H
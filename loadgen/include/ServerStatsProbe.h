@@ -0,0 +1,39 @@
+#ifndef SERVERSTATSPROBE_H
+#define SERVERSTATSPROBE_H
+
+#include <QString>
+#include <QJsonObject>
+
+/*
+ * Запрашивает у сервера метрики (StatsRequest) до и после прогона.
+ *
+ * Из метрик берутся процессорное время процесса сервера
+ * (ea_process_cpu_microseconds_total) и количество отправленных
+ * им байт (сумма рядов ea_sent_bytes_total). Разница двух снимков
+ * показывает, сколько процессорного времени сервер тратит
+ * на каждый отправленный байт.
+ *
+ * Запрос выполняется по отдельному соединению с ожиданием ответа,
+ * поэтому его не следует вызывать во время прогона.
+ */
+class ServerStatsProbe
+{
+public:
+    struct Snapshot
+    {
+        bool isValid = false;
+        qint64 cpuMicroseconds = 0;
+        qint64 sentBytes = 0;
+    };
+
+    static Snapshot fetch(const QString &host, quint16 port, int timeoutMs = 5000);
+
+    /*
+     * Возвращает объект JSON: serverCpuSeconds, serverSentBytes
+     * и serverCpuNanosecondsPerByte. Если один из снимков не получен,
+     * объект пустой.
+     */
+    static QJsonObject difference(const Snapshot &before, const Snapshot &after);
+};
+
+#endif // SERVERSTATSPROBE_H
@@ -0,0 +1,51 @@
+QT -= gui
+QT += core network sql
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+# Протокол и сжатие берутся из сервера, чтобы прогон
+# передавал ровно те же кадры, что и настоящие клиенты
+SERVER_DIR = ../server
+
+INCLUDEPATH += \
+    include \
+    $$SERVER_DIR \
+    $$SERVER_DIR/include
+
+SOURCES += \
+        src/CodecBench.cpp \
+        src/LoadClient.cpp \
+        src/LoadGenerator.cpp \
+        src/LoadStats.cpp \
+        src/PayloadGenerator.cpp \
+        src/ServerStatsProbe.cpp \
+        src/main.cpp \
+        $$SERVER_DIR/src/AsyncLogger.cpp \
+        $$SERVER_DIR/src/Compression.cpp \
+        $$SERVER_DIR/src/FrameDecoder.cpp
+
+HEADERS += \
+    include/CodecBench.h \
+    include/LoadClient.h \
+    include/LoadGenerator.h \
+    include/LoadStats.h \
+    include/PayloadGenerator.h \
+    include/ServerStatsProbe.h \
+    $$SERVER_DIR/include/AsyncLogger.h \
+    $$SERVER_DIR/include/Compression.h \
+    $$SERVER_DIR/include/DatabaseCreation.h \
+    $$SERVER_DIR/include/FrameDecoder.h \
+    $$SERVER_DIR/include/TcpDataTypes.h
+
+packagesExist(liblz4) {
+    CONFIG += link_pkgconfig
+    PKGCONFIG += liblz4
+    DEFINES += HAVE_LZ4
+}
+
+packagesExist(libzstd) {
+    CONFIG += link_pkgconfig
+    PKGCONFIG += libzstd
+    DEFINES += HAVE_ZSTD
+}
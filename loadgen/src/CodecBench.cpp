@@ -0,0 +1,87 @@
+#include "CodecBench.h"
+#include "Compression.h"
+#include "include/TcpDataTypes.h"
+
+#include <QJsonObject>
+#include <QElapsedTimer>
+#include <QDebug>
+
+QJsonArray CodecBench::run(const QList<QByteArray> &payloads, const QList<CodecLevel> &codecLevels,
+                           int rounds)
+{
+    QList<QByteArray> rawChunks;
+    qint64 rawSize = 0;
+
+    for (const QByteArray &payload : payloads)
+    {
+        for (int offset = 0; offset < payload.size(); offset += int(TcpProtocol::cChunkSize))
+        {
+            rawChunks << payload.mid(offset, int(TcpProtocol::cChunkSize));
+            rawSize += rawChunks.last().size();
+        }
+    }
+
+    QJsonArray results;
+
+    for (const CodecLevel &codecLevel : codecLevels)
+    {
+        const quint8 codec = codecLevel.first;
+        const int level = codecLevel.second;
+
+        QList<QByteArray> encodedChunks;
+        qint64 encodedSize = 0;
+        qint64 compressNsecs = 0;
+        qint64 decompressNsecs = 0;
+        bool isFailed = false;
+
+        for (int round = 0; round < rounds && !isFailed; round++)
+        {
+            encodedChunks.clear();
+            encodedSize = 0;
+
+            QElapsedTimer timer;
+            timer.start();
+
+            for (const QByteArray &rawChunk : qAsConst(rawChunks))
+            {
+                encodedChunks << Compression::encodeChunk(codec, rawChunk, level);
+                encodedSize += encodedChunks.last().size();
+            }
+
+            compressNsecs += timer.nsecsElapsed();
+            timer.restart();
+
+            for (const QByteArray &encodedChunk : qAsConst(encodedChunks))
+            {
+                QByteArray rawChunk;
+                if (!Compression::decodeChunk(encodedChunk, rawChunk, int(TcpProtocol::cChunkSize)))
+                {
+                    qInfo() << "ОШИБКА: не удалось распаковать часть, сжатую алгоритмом"
+                            << Compression::codecName(codec) << "; уровень:" << level;
+                    isFailed = true;
+                    break;
+                }
+            }
+
+            decompressNsecs += timer.nsecsElapsed();
+        }
+
+        if (isFailed)
+            continue;
+
+        const double megabytes = double(rawSize) * rounds / (1024 * 1024);
+
+        QJsonObject result;
+        result.insert("codec", Compression::codecName(codec));
+        result.insert("level", level);
+        result.insert("rawBytes", double(rawSize));
+        result.insert("encodedBytes", double(encodedSize));
+        result.insert("ratio", encodedSize > 0 ? double(rawSize) / encodedSize : 0);
+        result.insert("compressMegabytesPerSecond", megabytes / qMax(compressNsecs / 1e9, 1e-9));
+        result.insert("decompressMegabytesPerSecond", megabytes / qMax(decompressNsecs / 1e9, 1e-9));
+
+        results.append(result);
+    }
+
+    return results;
+}
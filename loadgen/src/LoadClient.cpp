@@ -0,0 +1,410 @@
+#include "LoadClient.h"
+#include "Compression.h"
+
+#include <QDataStream>
+#include <QUuid>
+#include <QtEndian>
+#include <QDebug>
+
+const QString LoadClient::cUpload = "upload";
+const QString LoadClient::cDelta = "delta";
+const QString LoadClient::cList = "list";
+const QString LoadClient::cDownload = "download";
+
+LoadClient::LoadClient(const Config &config, const QList<PayloadGenerator::Payload> *payloads,
+                       quint32 seed, QObject *parent)
+    : QObject(parent)
+    , m_config(config)
+    , m_pPayloads(payloads)
+    , m_random(seed)
+{
+    m_nextPayloadIndex = int(m_random.bounded(quint32(qMax(1, payloads->size()))));
+
+    m_timeoutTimer.setSingleShot(true);
+
+    connect(&m_socket, &QTcpSocket::connected, this, &LoadClient::slotConnected);
+    connect(&m_socket, &QTcpSocket::readyRead, this, &LoadClient::slotReadyRead);
+    connect(&m_socket, &QAbstractSocket::errorOccurred, this, &LoadClient::slotError);
+    connect(&m_timeoutTimer, &QTimer::timeout, this, &LoadClient::slotOperationTimeout);
+}
+
+void LoadClient::start()
+{
+    m_socket.connectToHost(m_config.host, m_config.port);
+}
+
+/*
+ * Текущая операция доводится до конца, новые не начинаются.
+ */
+void LoadClient::stop()
+{
+    m_isStopping = true;
+
+    if (m_operation.isEmpty())
+        finish();
+}
+
+void LoadClient::slotConnected()
+{
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_0);
+
+    out << m_config.offeredCodecs;
+    sendFrame(TcpDataType::Hello, ++m_nextRequestId, payload);
+}
+
+void LoadClient::nextOperation()
+{
+    if (m_isStopping)
+    {
+        finish();
+        return;
+    }
+
+    m_operation = chooseOperation();
+
+    // Для получения версии нужно сначала узнать, какие версии есть
+    if (m_operation == cDownload && m_knownBackups.isEmpty())
+        m_operation = cList;
+
+    m_requestId = ++m_nextRequestId;
+    m_operationBytes = 0;
+    m_operationTimer.start();
+    m_timeoutTimer.start(m_config.operationTimeout);
+
+    if (m_operation == cUpload)
+        startUpload();
+    else if (m_operation == cDelta)
+        startDeltaUpload();
+    else if (m_operation == cList)
+        startList();
+    else
+        startDownload();
+}
+
+QString LoadClient::chooseOperation()
+{
+    int totalWeight = 0;
+    for (const QPair<QString, int> &operation : qAsConst(m_config.mix))
+        totalWeight += operation.second;
+
+    int choice = int(m_random.bounded(quint32(qMax(1, totalWeight))));
+
+    for (const QPair<QString, int> &operation : qAsConst(m_config.mix))
+    {
+        if (choice < operation.second)
+            return operation.first;
+
+        choice -= operation.second;
+    }
+
+    return cList;
+}
+
+void LoadClient::startUpload()
+{
+    m_pUploadPayload = &m_pPayloads->at(m_nextPayloadIndex++ % m_pPayloads->size());
+
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_0);
+
+    out << m_config.orgName.toUtf8();
+    out << qint64(m_pUploadPayload->data.size());
+    out << QUuid::createUuid().toRfc4122();
+    out << m_pUploadPayload->contentHash;
+    sendFrame(TcpDataType::Database, m_requestId, payload);
+}
+
+/*
+ * Отправляет базу данных с места, указанного сервером в UploadResumeOffset.
+ */
+void LoadClient::sendUploadChunks(qint64 offset)
+{
+    const QByteArray &data = m_pUploadPayload->data;
+
+    for (qint64 chunkOffset = qBound<qint64>(0, offset, data.size()); chunkOffset < data.size();
+         chunkOffset += TcpProtocol::cChunkSize)
+    {
+        QByteArray rawChunk = QByteArray::fromRawData(
+                    data.constData() + chunkOffset,
+                    int(qMin<qint64>(TcpProtocol::cChunkSize, data.size() - chunkOffset)));
+
+        QByteArray encodedChunk = Compression::encodeChunk(m_codec, rawChunk);
+        sendFrame(TcpDataType::DatabaseChunk, m_requestId, encodedChunk);
+
+        m_operationBytes += encodedChunk.size();
+    }
+
+    sendFrame(TcpDataType::DatabaseEnd, m_requestId);
+}
+
+void LoadClient::startDeltaUpload()
+{
+    m_pUploadPayload = &m_pPayloads->at(m_nextPayloadIndex++ % m_pPayloads->size());
+
+    const PayloadGenerator::Payload &uploadPayload = *m_pUploadPayload;
+    const quint32 pageCount = quint32(uploadPayload.pageHashes.size() / TcpProtocol::cPageHashSize);
+
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_0);
+
+    out << m_config.orgName.toUtf8();
+    out << qint64(uploadPayload.data.size());
+    out << uploadPayload.pageSize;
+    out << pageCount;
+    sendFrame(TcpDataType::DeltaUploadOffer, m_requestId, payload);
+
+    const int cMaxHashesBytes = TcpProtocol::cMaxHashesPerFrame * TcpProtocol::cPageHashSize;
+
+    for (int offset = 0; offset < uploadPayload.pageHashes.size(); offset += cMaxHashesBytes)
+    {
+        QByteArray hashes = uploadPayload.pageHashes.mid(offset, cMaxHashesBytes);
+        sendFrame(TcpDataType::DeltaUploadHashes, m_requestId, hashes);
+
+        m_operationBytes += hashes.size();
+    }
+}
+
+void LoadClient::sendMissingPages(const QBitArray &missingPages)
+{
+    const QByteArray &data = m_pUploadPayload->data;
+    const int pageSize = int(m_pUploadPayload->pageSize);
+
+    for (int i = 0; i < missingPages.size(); i++)
+    {
+        if (!missingPages.testBit(i))
+            continue;
+
+        const int pageOffset = i * pageSize;
+        if (pageOffset >= data.size())
+            break;
+
+        QByteArray payload(int(sizeof(quint32)), Qt::Uninitialized);
+        qToBigEndian<quint32>(quint32(i), payload.data());
+        payload.append(Compression::encodeChunk(m_codec, QByteArray::fromRawData(
+                                                    data.constData() + pageOffset,
+                                                    qMin(pageSize, data.size() - pageOffset))));
+
+        sendFrame(TcpDataType::DeltaUploadPage, m_requestId, payload);
+        m_operationBytes += payload.size();
+    }
+
+    sendFrame(TcpDataType::DeltaUploadEnd, m_requestId);
+}
+
+void LoadClient::startList()
+{
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_0);
+
+    out << QString() << qint64(0) << qint64(0) << qint64(0) << quint32(100);
+    sendFrame(TcpDataType::DatabasesListRequest, m_requestId, payload);
+}
+
+void LoadClient::startDownload()
+{
+    const QString backupFileName = m_knownBackups.at(
+                int(m_random.bounded(quint32(m_knownBackups.size()))));
+
+    m_downloadSize = -1;
+
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_0);
+
+    out << backupFileName.toUtf8() << qint64(0) << QByteArray();
+    sendFrame(TcpDataType::SelectedDatabaseName, m_requestId, payload);
+}
+
+void LoadClient::finishOperation(bool isSucceeded)
+{
+    m_timeoutTimer.stop();
+
+    if (isSucceeded)
+        m_stats.addSuccess(m_operation, m_operationTimer.nsecsElapsed() / 1e6, m_operationBytes);
+    else
+        m_stats.addError(m_operation);
+
+    m_operation.clear();
+    m_requestId = 0;
+    m_pUploadPayload = nullptr;
+
+    nextOperation();
+}
+
+void LoadClient::finish()
+{
+    if (m_isFinished)
+        return;
+
+    m_isFinished = true;
+    m_timeoutTimer.stop();
+    m_socket.abort();
+
+    emit finished(this);
+}
+
+void LoadClient::slotReadyRead()
+{
+    for (;;)
+    {
+        FrameDecoder::Frame frame;
+        FrameDecoder::Result result = m_frameDecoder.readFrame(&m_socket, frame);
+
+        if (result == FrameDecoder::NeedMoreData)
+            break;
+
+        if (result == FrameDecoder::InvalidFrame)
+        {
+            qInfo() << "ОШИБКА: недопустимый размер кадра от сервера:" << m_frameDecoder.frameSize();
+            m_stats.addConnectionError();
+            finish();
+            return;
+        }
+
+        processFrame(frame);
+
+        if (m_isFinished)
+            return;
+    }
+}
+
+void LoadClient::processFrame(const FrameDecoder::Frame &frame)
+{
+    if (frame.version != TcpProtocol::cVersion)
+    {
+        qInfo() << "ОШИБКА: сервер использует другую версию протокола:" << frame.version;
+        m_stats.addConnectionError();
+        finish();
+        return;
+    }
+
+    QDataStream in(frame.payload);
+    in.setVersion(QDataStream::Qt_5_0);
+
+    if (frame.dataType == TcpDataType::HelloAck)
+    {
+        in >> m_codec;
+
+        if (!Compression::isCodecSupported(m_codec))
+            m_codec = Compression::CodecNone;
+
+        nextOperation();
+        return;
+    }
+
+    // Ответы на операции, для которых истекло время ожидания
+    if (m_operation.isEmpty() || frame.requestId != m_requestId)
+        return;
+
+    switch (frame.dataType)
+    {
+        case TcpDataType::UploadResumeOffset :
+        {
+            qint64 offset = 0;
+            in >> offset;
+            sendUploadChunks(offset);
+            break;
+        }
+
+        case TcpDataType::DeltaUploadMissingPages :
+        {
+            QBitArray missingPages;
+            in >> missingPages;
+            sendMissingPages(missingPages);
+            break;
+        }
+
+        case TcpDataType::DatabaseFileCreationSuccess :
+          finishOperation(true);
+          break;
+
+        case TcpDataType::DatabaseFileCreationFailure :
+          finishOperation(false);
+          break;
+
+        case TcpDataType::DatabasesList :
+        {
+            QList<BackupInfo> backupsList;
+            qint64 nextCursor = 0;
+            in >> backupsList >> nextCursor;
+
+            m_knownBackups.clear();
+            for (const BackupInfo &backupInfo : qAsConst(backupsList))
+                m_knownBackups << backupInfo.fileName;
+
+            m_operationBytes = frame.payload.size();
+            finishOperation(in.status() == QDataStream::Ok);
+            break;
+        }
+
+        case TcpDataType::Database :
+        {
+            QByteArray dbName;
+            qint64 offset = 0;
+            in >> dbName >> m_downloadSize >> offset;
+            break;
+        }
+
+        case TcpDataType::DatabaseChunk :
+        {
+            QByteArray rawChunk;
+            if (!Compression::decodeChunk(frame.payload, rawChunk, int(TcpProtocol::cChunkSize)))
+            {
+                finishOperation(false);
+                break;
+            }
+
+            m_operationBytes += rawChunk.size();
+            break;
+        }
+
+        case TcpDataType::DatabaseEnd :
+          finishOperation(m_downloadSize >= 0 && m_operationBytes == m_downloadSize);
+          break;
+
+        case TcpDataType::DatabaseSendFailure :
+          finishOperation(false);
+          break;
+
+        default :
+          break;
+    }
+}
+
+void LoadClient::sendFrame(quint16 dataType, quint32 requestId, const QByteArray &payload)
+{
+    m_socket.write(FrameDecoder::encodeHeader(dataType, requestId, quint64(payload.size())));
+    m_socket.write(payload);
+}
+
+void LoadClient::slotError(QAbstractSocket::SocketError socketError)
+{
+    Q_UNUSED(socketError)
+
+    if (m_isFinished)
+        return;
+
+    qInfo() << "ОШИБКА: соединение с сервером:" << m_socket.errorString();
+
+    if (!m_operation.isEmpty())
+        m_stats.addError(m_operation);
+
+    m_stats.addConnectionError();
+    finish();
+}
+
+void LoadClient::slotOperationTimeout()
+{
+    qInfo() << "ОШИБКА: сервер не ответил на операцию" << m_operation << "за"
+            << m_config.operationTimeout << "мс";
+
+    // Сервер прекращает операцию и не занимает на нее очередь сессии
+    sendFrame(TcpDataType::CancelRequest, m_requestId);
+
+    finishOperation(false);
+}
@@ -0,0 +1,82 @@
+#include "LoadGenerator.h"
+
+LoadGenerator::LoadGenerator(const LoadClient::Config &clientConfig,
+                             const QList<PayloadGenerator::Payload> *payloads,
+                             QObject *parent)
+    : QObject(parent)
+    , m_clientConfig(clientConfig)
+    , m_pPayloads(payloads)
+{
+    m_durationTimer.setSingleShot(true);
+
+    connect(&m_durationTimer, &QTimer::timeout, this, &LoadGenerator::slotDurationElapsed);
+}
+
+void LoadGenerator::start(int clientsCount, int durationSeconds)
+{
+    m_result = QJsonObject();
+    m_runningClientsCount = clientsCount;
+
+    for (int i = 0; i < clientsCount; i++)
+    {
+        LoadClient::Config config = m_clientConfig;
+
+        // Каждый клиент загружает версии своей организации
+        if (config.orgName.isEmpty())
+            config.orgName = QString("Нагрузка %1").arg(i + 1);
+
+        LoadClient *client = new LoadClient(config, m_pPayloads, quint32(i + 1), this);
+        connect(client, &LoadClient::finished, this, &LoadGenerator::slotClientFinished);
+
+        m_clients << client;
+    }
+
+    m_serverStatsBefore = ServerStatsProbe::fetch(m_clientConfig.host, m_clientConfig.port);
+
+    m_elapsedTimer.start();
+    m_durationTimer.start(durationSeconds * 1000);
+
+    for (LoadClient *client : qAsConst(m_clients))
+        client->start();
+}
+
+void LoadGenerator::slotDurationElapsed()
+{
+    // Клиент без текущей операции завершается сразу, и последний из них
+    // очищает m_clients, поэтому перебирается копия списка
+    const QList<LoadClient*> clients = m_clients;
+
+    for (LoadClient *client : clients)
+        client->stop();
+}
+
+void LoadGenerator::slotClientFinished(LoadClient *client)
+{
+    Q_UNUSED(client)
+
+    if (--m_runningClientsCount > 0)
+        return;
+
+    m_durationTimer.stop();
+
+    LoadStats stats;
+    for (LoadClient *loadClient : qAsConst(m_clients))
+        stats.merge(loadClient->stats());
+
+    m_result = stats.toJson(m_elapsedTimer.nsecsElapsed() / 1e9);
+    m_result.insert("clients", m_clients.size());
+
+    const QJsonObject serverStats = ServerStatsProbe::difference(
+                m_serverStatsBefore,
+                ServerStatsProbe::fetch(m_clientConfig.host, m_clientConfig.port));
+
+    for (auto it = serverStats.constBegin(); it != serverStats.constEnd(); ++it)
+        m_result.insert(it.key(), it.value());
+
+    for (LoadClient *loadClient : qAsConst(m_clients))
+        loadClient->deleteLater();
+
+    m_clients.clear();
+
+    emit finished();
+}
@@ -0,0 +1,92 @@
+#include "LoadStats.h"
+
+#include <algorithm>
+#include <cmath>
+
+void LoadStats::addSuccess(const QString &operation, double latencyMs, qint64 bytes)
+{
+    Operation &stats = m_operations[operation];
+    stats.count++;
+    stats.bytes += bytes;
+    stats.latenciesMs << latencyMs;
+}
+
+void LoadStats::addError(const QString &operation)
+{
+    m_operations[operation].errors++;
+}
+
+void LoadStats::merge(const LoadStats &other)
+{
+    for (auto it = other.m_operations.cbegin(); it != other.m_operations.cend(); ++it)
+    {
+        Operation &stats = m_operations[it.key()];
+        stats.count += it->count;
+        stats.errors += it->errors;
+        stats.bytes += it->bytes;
+        stats.latenciesMs += it->latenciesMs;
+    }
+
+    m_connectionErrors += other.m_connectionErrors;
+}
+
+QJsonObject LoadStats::toJson(double durationSeconds) const
+{
+    QJsonObject operations;
+    Operation total;
+
+    for (auto it = m_operations.cbegin(); it != m_operations.cend(); ++it)
+    {
+        operations.insert(it.key(), operationToJson(it.value(), durationSeconds));
+
+        total.count += it->count;
+        total.errors += it->errors;
+        total.bytes += it->bytes;
+        total.latenciesMs += it->latenciesMs;
+    }
+
+    QJsonObject result;
+    result.insert("durationSeconds", durationSeconds);
+    result.insert("connectionErrors", double(m_connectionErrors));
+    result.insert("operations", operations);
+    result.insert("total", operationToJson(total, durationSeconds));
+
+    return result;
+}
+
+QJsonObject LoadStats::operationToJson(const Operation &operation, double durationSeconds)
+{
+    QVector<double> latencies = operation.latenciesMs;
+    std::sort(latencies.begin(), latencies.end());
+
+    QJsonObject latency;
+    latency.insert("p50", percentile(latencies, 0.5));
+    latency.insert("p90", percentile(latencies, 0.9));
+    latency.insert("p99", percentile(latencies, 0.99));
+    latency.insert("max", latencies.isEmpty() ? 0 : latencies.last());
+
+    const double seconds = qMax(durationSeconds, 0.001);
+
+    QJsonObject result;
+    result.insert("count", double(operation.count));
+    result.insert("errors", double(operation.errors));
+    result.insert("bytes", double(operation.bytes));
+    result.insert("operationsPerSecond", operation.count / seconds);
+    result.insert("megabytesPerSecond", operation.bytes / seconds / (1024 * 1024));
+    result.insert("latencyMs", latency);
+
+    return result;
+}
+
+/*
+ * Квантиль по методу ближайшего ранга.
+ */
+double LoadStats::percentile(const QVector<double> &sortedValues, double q)
+{
+    if (sortedValues.isEmpty())
+        return 0;
+
+    int rank = int(std::ceil(q * sortedValues.size()));
+
+    return sortedValues.at(qBound(0, rank - 1, sortedValues.size() - 1));
+}
@@ -0,0 +1,247 @@
+#include "PayloadGenerator.h"
+#include "DatabaseCreation.h"
+
+#include <QFile>
+#include <QDate>
+#include <QVariant>
+#include <QStringList>
+#include <QTemporaryDir>
+#include <QRandomGenerator>
+#include <QCryptographicHash>
+#include <QtEndian>
+#include <QtSql/QSqlDatabase>
+#include <QtSql/QSqlQuery>
+#include <QtSql/QSqlError>
+#include <QDebug>
+
+const quint32 PayloadGenerator::cDefaultPageSize = 4096;
+
+namespace
+{
+const QStringList cSurnames { "Иванов", "Петров", "Сидоров", "Кузнецов", "Смирнов",
+                              "Попов", "Васильев", "Соколов", "Михайлов", "Новиков" };
+const QStringList cNames { "Иван", "Петр", "Алексей", "Дмитрий", "Сергей",
+                           "Андрей", "Михаил", "Николай", "Павел", "Олег" };
+const QStringList cPatronymics { "Иванович", "Петрович", "Алексеевич", "Дмитриевич",
+                                 "Сергеевич", "Андреевич", "Михайлович", "Николаевич" };
+const QStringList cDepartments { "Бухгалтерия", "Отдел кадров", "Отдел продаж",
+                                 "Производство", "Склад", "ИТ-отдел" };
+const QStringList cPositions { "Специалист", "Ведущий специалист", "Инженер",
+                               "Менеджер", "Начальник отдела", "Оператор" };
+
+QString randomItem(const QStringList &items, QRandomGenerator &random)
+{
+    return items.at(int(random.bounded(quint32(items.size()))));
+}
+
+QString randomDigits(int count, QRandomGenerator &random)
+{
+    QString digits;
+    for (int i = 0; i < count; i++)
+        digits += QChar('0' + int(random.bounded(10u)));
+
+    return digits;
+}
+
+QDate randomDate(int fromYear, int toYear, QRandomGenerator &random)
+{
+    return QDate(fromYear, 1, 1).addDays(random.bounded((toYear - fromYear) * 365));
+}
+}
+
+QList<QByteArray> PayloadGenerator::generate(int versionsCount, int employeesCount, quint32 seed)
+{
+    QList<QByteArray> versions;
+
+    QTemporaryDir temporaryDir;
+    if (!temporaryDir.isValid())
+    {
+        qInfo() << "ОШИБКА: не удалось создать временную папку для баз данных";
+        return versions;
+    }
+
+    const QString dbFilePath = temporaryDir.filePath("payload.db");
+    const QString connectionName = "loadgen-payload";
+    QRandomGenerator random(seed);
+
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", connectionName);
+        db.setDatabaseName(dbFilePath);
+
+        if (!db.open() || !createTables(db) || !insertEmployees(db, 1, employeesCount, random))
+        {
+            qInfo() << "ОШИБКА: не удалось создать базу данных:" << db.lastError().text();
+            db.close();
+            QSqlDatabase::removeDatabase(connectionName);
+            return versions;
+        }
+
+        int nextId = employeesCount + 1;
+
+        for (int version = 0; version < versionsCount; version++)
+        {
+            if (version > 0)
+            {
+                // Примерно каждый сотый сотрудник изменен, несколько новых добавлено
+                int newEmployeesCount = qMax(1, employeesCount / 200);
+                if (!updateEmployees(db, nextId - 1, random)
+                        || !insertEmployees(db, nextId, newEmployeesCount, random))
+                    break;
+
+                nextId += newEmployeesCount;
+            }
+
+            // Файл читается при закрытой базе, чтобы все изменения были в нем
+            db.close();
+
+            QFile dbFile(dbFilePath);
+            if (!dbFile.open(QIODevice::ReadOnly))
+                break;
+
+            versions << dbFile.readAll();
+            dbFile.close();
+
+            if (!db.open())
+                break;
+        }
+
+        db.close();
+    }
+
+    QSqlDatabase::removeDatabase(connectionName);
+
+    return versions;
+}
+
+PayloadGenerator::Payload PayloadGenerator::makePayload(const QByteArray &dbData)
+{
+    Payload payload;
+    payload.data = dbData;
+    payload.pageSize = detectPageSize(dbData.left(100));
+
+    for (int offset = 0; offset < dbData.size(); offset += int(payload.pageSize))
+    {
+        payload.pageHashes += QCryptographicHash::hash(
+                    QByteArray::fromRawData(dbData.constData() + offset,
+                                            qMin(int(payload.pageSize), dbData.size() - offset)),
+                    QCryptographicHash::Sha256);
+    }
+
+    payload.contentHash = QCryptographicHash::hash(payload.pageHashes, QCryptographicHash::Sha256);
+
+    return payload;
+}
+
+/*
+ * Так же, как BackupStore::detectPageSize сервера.
+ */
+quint32 PayloadGenerator::detectPageSize(const QByteArray &fileHeader)
+{
+    static const QByteArray cSqliteHeader("SQLite format 3\0", 16);
+
+    if (fileHeader.size() < 18 || !fileHeader.startsWith(cSqliteHeader))
+        return cDefaultPageSize;
+
+    quint32 pageSize = qFromBigEndian<quint16>(fileHeader.constData() + 16);
+    if (pageSize == 1)
+        pageSize = 65536;
+
+    if (pageSize < 512 || pageSize > 65536 || (pageSize & (pageSize - 1)) != 0)
+        return cDefaultPageSize;
+
+    return pageSize;
+}
+
+bool PayloadGenerator::createTables(QSqlDatabase &db)
+{
+    QSqlQuery query(db);
+
+    for (const QString &command : DatabaseCreation::cTableCreationCommandsList)
+    {
+        if (!query.exec(command))
+            return false;
+    }
+
+    return true;
+}
+
+bool PayloadGenerator::insertEmployees(QSqlDatabase &db, int firstId, int count,
+                                       QRandomGenerator &random)
+{
+    if (!db.transaction())
+        return false;
+
+    QSqlQuery generalQuery(db);
+    generalQuery.prepare("INSERT INTO [Общая информация] VALUES (?, ?, ?, ?, ?, ?, ?)");
+    QSqlQuery passportQuery(db);
+    passportQuery.prepare("INSERT INTO [Паспортные данные] VALUES (?, ?, ?, ?, ?, ?, ?)");
+    QSqlQuery documentsQuery(db);
+    documentsQuery.prepare("INSERT INTO [Другие документы] VALUES (?, ?, ?, ?)");
+    QSqlQuery additionalQuery(db);
+    additionalQuery.prepare("INSERT INTO [Дополнительная информация] VALUES (?, ?, ?, ?, ?, ?)");
+
+    for (int id = firstId; id < firstId + count; id++)
+    {
+        generalQuery.addBindValue(id);
+        generalQuery.addBindValue(randomItem(cSurnames, random));
+        generalQuery.addBindValue(randomItem(cNames, random));
+        generalQuery.addBindValue(randomItem(cPatronymics, random));
+        generalQuery.addBindValue(randomItem(cDepartments, random));
+        generalQuery.addBindValue(randomItem(cPositions, random));
+        generalQuery.addBindValue(randomDate(2000, 2024, random));
+
+        passportQuery.addBindValue(id);
+        passportQuery.addBindValue(randomDigits(4, random));
+        passportQuery.addBindValue(randomDigits(6, random));
+        passportQuery.addBindValue(randomDate(2005, 2024, random));
+        passportQuery.addBindValue("ГУ МВД России");
+        passportQuery.addBindValue(randomDigits(3, random) + "-" + randomDigits(3, random));
+        passportQuery.addBindValue(randomDate(2030, 2045, random));
+
+        documentsQuery.addBindValue(id);
+        documentsQuery.addBindValue(randomDigits(12, random));
+        documentsQuery.addBindValue(randomDigits(11, random));
+        documentsQuery.addBindValue(randomDigits(16, random));
+
+        additionalQuery.addBindValue(id);
+        additionalQuery.addBindValue(randomDate(1960, 2004, random));
+        additionalQuery.addBindValue("г. Москва");
+        additionalQuery.addBindValue("Россия");
+        additionalQuery.addBindValue("Русский");
+        additionalQuery.addBindValue(random.bounded(2u) ? "Женат" : "Холост");
+
+        if (!generalQuery.exec() || !passportQuery.exec()
+                || !documentsQuery.exec() || !additionalQuery.exec())
+        {
+            db.rollback();
+            return false;
+        }
+    }
+
+    return db.commit();
+}
+
+bool PayloadGenerator::updateEmployees(QSqlDatabase &db, int employeesCount,
+                                       QRandomGenerator &random)
+{
+    if (!db.transaction())
+        return false;
+
+    QSqlQuery query(db);
+    query.prepare("UPDATE [Общая информация] SET [Должность] = ?, [Отдел] = ? WHERE [ID] = ?");
+
+    for (int i = 0; i < qMax(1, employeesCount / 100); i++)
+    {
+        query.addBindValue(randomItem(cPositions, random));
+        query.addBindValue(randomItem(cDepartments, random));
+        query.addBindValue(1 + int(random.bounded(quint32(employeesCount))));
+
+        if (!query.exec())
+        {
+            db.rollback();
+            return false;
+        }
+    }
+
+    return db.commit();
+}
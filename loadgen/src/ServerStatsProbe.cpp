@@ -0,0 +1,112 @@
+#include "ServerStatsProbe.h"
+#include "FrameDecoder.h"
+
+#include <QTcpSocket>
+#include <QDataStream>
+#include <QElapsedTimer>
+#include <QDebug>
+
+ServerStatsProbe::Snapshot ServerStatsProbe::fetch(const QString &host, quint16 port,
+                                                   int timeoutMs)
+{
+    Snapshot snapshot;
+
+    QTcpSocket socket;
+    socket.connectToHost(host, port);
+    if (!socket.waitForConnected(timeoutMs))
+    {
+        qInfo() << "ОШИБКА: не удалось запросить метрики сервера:" << socket.errorString();
+        return snapshot;
+    }
+
+    socket.write(FrameDecoder::encodeHeader(TcpDataType::StatsRequest, 1, 0));
+
+    FrameDecoder decoder;
+    FrameDecoder::Frame frame;
+    QElapsedTimer timer;
+    timer.start();
+
+    while (true)
+    {
+        const FrameDecoder::Result result = decoder.readFrame(&socket, frame);
+
+        if (result == FrameDecoder::InvalidFrame)
+        {
+            qInfo() << "ОШИБКА: получен кадр недопустимого размера в ответ на запрос метрик";
+            return snapshot;
+        }
+
+        if (result == FrameDecoder::FrameReady)
+        {
+            if (frame.dataType == TcpDataType::Stats)
+                break;
+
+            continue;
+        }
+
+        const int remainingMs = int(timeoutMs - timer.elapsed());
+        if (remainingMs <= 0 || !socket.waitForReadyRead(remainingMs))
+        {
+            qInfo() << "ОШИБКА: сервер не ответил на запрос метрик";
+            return snapshot;
+        }
+    }
+
+    QString metricsText;
+    QDataStream in(frame.payload);
+    in.setVersion(QDataStream::Qt_5_0);
+    in >> metricsText;
+
+    bool hasCpuTime = false;
+
+    for (const QString &line : metricsText.split('\n', Qt::SkipEmptyParts))
+    {
+        if (line.startsWith('#'))
+            continue;
+
+        const int valueStart = line.lastIndexOf(' ');
+        if (valueStart < 0)
+            continue;
+
+        const QString name = line.left(valueStart);
+        const qint64 value = line.mid(valueStart + 1).toLongLong();
+
+        if (name == "ea_process_cpu_microseconds_total")
+        {
+            snapshot.cpuMicroseconds = value;
+            hasCpuTime = true;
+        }
+        else if (name.startsWith("ea_sent_bytes_total{"))
+        {
+            snapshot.sentBytes += value;
+        }
+    }
+
+    if (!hasCpuTime)
+    {
+        qInfo() << "ОШИБКА: сервер не сообщает процессорное время процесса";
+        return snapshot;
+    }
+
+    snapshot.isValid = true;
+
+    return snapshot;
+}
+
+QJsonObject ServerStatsProbe::difference(const Snapshot &before, const Snapshot &after)
+{
+    QJsonObject result;
+
+    if (!before.isValid || !after.isValid)
+        return result;
+
+    const qint64 cpuMicroseconds = after.cpuMicroseconds - before.cpuMicroseconds;
+    const qint64 sentBytes = after.sentBytes - before.sentBytes;
+
+    result.insert("serverCpuSeconds", cpuMicroseconds / 1e6);
+    result.insert("serverSentBytes", double(sentBytes));
+    result.insert("serverCpuNanosecondsPerByte",
+                  sentBytes > 0 ? cpuMicroseconds * 1000.0 / sentBytes : 0);
+
+    return result;
+}
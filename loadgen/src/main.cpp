@@ -0,0 +1,266 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QJsonDocument>
+#include <QJsonArray>
+#include <QHash>
+#include <QSaveFile>
+#include <QTextStream>
+#include <QDebug>
+
+#include "AsyncLogger.h"
+#include "CodecBench.h"
+#include "Compression.h"
+#include "LoadGenerator.h"
+
+namespace
+{
+/*
+ * Разбирает строку вида "upload=1,delta=1,list=4,download=2".
+ */
+bool parseMix(const QString &text, QList<QPair<QString, int>> &mix)
+{
+    const QStringList knownOperations { LoadClient::cUpload, LoadClient::cDelta,
+                                        LoadClient::cList, LoadClient::cDownload };
+
+    for (const QString &item : text.split(',', Qt::SkipEmptyParts))
+    {
+        const QStringList parts = item.split('=');
+        bool isNumber = false;
+        const int weight = parts.size() == 2 ? parts.at(1).trimmed().toInt(&isNumber) : 0;
+        const QString operation = parts.at(0).trimmed();
+
+        if (!isNumber || weight < 0 || !knownOperations.contains(operation))
+        {
+            qInfo() << "ОШИБКА: неверная операция в --mix:" << item;
+            return false;
+        }
+
+        if (weight > 0)
+            mix << qMakePair(operation, weight);
+    }
+
+    return !mix.isEmpty();
+}
+
+QList<int> parseNumbers(const QString &text)
+{
+    QList<int> numbers;
+
+    for (const QString &item : text.split(',', Qt::SkipEmptyParts))
+    {
+        bool isNumber = false;
+        const int number = item.trimmed().toInt(&isNumber);
+
+        if (!isNumber || number <= 0)
+            return QList<int>();
+
+        numbers << number;
+    }
+
+    return numbers;
+}
+
+QList<quint8> parseCodecs(const QString &text)
+{
+    QList<quint8> codecs;
+
+    for (const QString &item : text.split(',', Qt::SkipEmptyParts))
+    {
+        for (quint8 codec : Compression::supportedCodecs() << Compression::CodecNone)
+        {
+            if (item.trimmed().compare(Compression::codecName(codec), Qt::CaseInsensitive) == 0
+                    && !codecs.contains(codec))
+                codecs << codec;
+        }
+    }
+
+    return codecs;
+}
+
+/*
+ * Разбирает строку вида "zstd=1/3/9/19,lz4=default/9"
+ * в уровни сжатия для каждого алгоритма (default - уровень по умолчанию).
+ */
+bool parseLevels(const QString &text, QHash<quint8, QList<int>> &levels)
+{
+    for (const QString &item : text.split(',', Qt::SkipEmptyParts))
+    {
+        const QStringList parts = item.split('=');
+        const QList<quint8> codecs = parseCodecs(parts.at(0));
+        QList<int> codecLevels;
+
+        if (parts.size() == 2)
+        {
+            for (const QString &levelText : parts.at(1).split('/', Qt::SkipEmptyParts))
+            {
+                bool isNumber = levelText.trimmed() == "default";
+                const int level = isNumber ? -1 : levelText.trimmed().toInt(&isNumber);
+
+                if (!isNumber)
+                {
+                    codecLevels.clear();
+                    break;
+                }
+
+                codecLevels << level;
+            }
+        }
+
+        if (codecs.size() != 1 || codecLevels.isEmpty())
+        {
+            qInfo() << "ОШИБКА: неверные уровни сжатия в --levels:" << item;
+            return false;
+        }
+
+        levels.insert(codecs.first(), codecLevels);
+    }
+
+    return true;
+}
+
+bool writeResult(const QJsonObject &result, const QString &outputPath)
+{
+    const QByteArray json = QJsonDocument(result).toJson(QJsonDocument::Indented);
+
+    if (outputPath.isEmpty())
+    {
+        QTextStream(stdout) << json;
+        return true;
+    }
+
+    QSaveFile outputFile(outputPath);
+    if (!outputFile.open(QIODevice::WriteOnly) || outputFile.write(json) != json.size()
+            || !outputFile.commit())
+    {
+        qInfo() << "ОШИБКА: не удалось записать результаты в" << outputPath;
+        return false;
+    }
+
+    return true;
+}
+}
+
+int main(int argc, char *argv[])
+{
+    setlocale(LC_ALL, "Russian");
+
+    AsyncLogger logger(AsyncLogger::LevelInfo);
+    logger.install();
+
+    QCoreApplication a(argc, argv);
+    a.setApplicationName("Учет сотрудников организаций - нагрузочный прогон");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Нагрузочный прогон сервера резервных копий. "
+                                     "Результаты выводятся в JSON.");
+    parser.addHelpOption();
+
+    QCommandLineOption hostOption("host", "Адрес сервера.", "host", "127.0.0.1");
+    QCommandLineOption portOption("port", "Порт сервера.", "port", "2323");
+    QCommandLineOption clientsOption("clients", "Количество одновременных клиентов.", "count", "8");
+    QCommandLineOption durationOption("duration", "Длительность прогона в секундах.", "seconds", "30");
+    QCommandLineOption mixOption("mix", "Веса операций upload, delta, list, download.", "mix",
+                                 "upload=1,delta=1,list=4,download=2");
+    QCommandLineOption employeesOption("employees", "Количество сотрудников в базе данных.",
+                                       "count", "5000");
+    QCommandLineOption versionsOption("versions", "Количество версий базы данных.", "count", "5");
+    QCommandLineOption scalingOption("scaling",
+                                     "Выполнить прогоны с указанными количествами клиентов, "
+                                     "например 1,8,64.", "counts");
+    QCommandLineOption codecsOption("codecs", "Алгоритмы сжатия, предлагаемые серверу "
+                                    "(none, qcompress, lz4, zstd).", "codecs");
+    QCommandLineOption codecBenchOption("codec-bench", "Измерить сжатие без подключения к серверу.");
+    QCommandLineOption levelsOption("levels", "Уровни сжатия для --codec-bench; для остальных "
+                                    "алгоритмов используется уровень по умолчанию.", "levels",
+                                    "zstd=1/3/9/19,lz4=default/9");
+    QCommandLineOption outputOption("output", "Файл для результатов вместо stdout.", "file");
+
+    parser.addOptions({ hostOption, portOption, clientsOption, durationOption, mixOption,
+                        employeesOption, versionsOption, scalingOption, codecsOption,
+                        codecBenchOption, levelsOption, outputOption });
+    parser.process(a);
+
+    const QString outputPath = parser.value(outputOption);
+
+    QList<QByteArray> versions = PayloadGenerator::generate(
+                qMax(1, parser.value(versionsOption).toInt()),
+                qMax(1, parser.value(employeesOption).toInt()), 1);
+
+    if (versions.isEmpty())
+        return 1;
+
+    QList<quint8> codecs = parser.isSet(codecsOption) ? parseCodecs(parser.value(codecsOption))
+                                                     : Compression::supportedCodecs();
+
+    if (parser.isSet(codecBenchOption))
+    {
+        if (!parser.isSet(codecsOption))
+            codecs << Compression::CodecNone;
+
+        QHash<quint8, QList<int>> levels;
+        if (!parseLevels(parser.value(levelsOption), levels))
+            return 1;
+
+        QList<CodecBench::CodecLevel> codecLevels;
+        for (quint8 codec : qAsConst(codecs))
+        {
+            for (int level : levels.value(codec, { -1 }))
+                codecLevels << qMakePair(codec, level);
+        }
+
+        QJsonObject result;
+        result.insert("codecs", CodecBench::run(versions, codecLevels));
+
+        return writeResult(result, outputPath) ? 0 : 1;
+    }
+
+    LoadClient::Config clientConfig;
+    clientConfig.host = parser.value(hostOption);
+    clientConfig.port = quint16(parser.value(portOption).toUInt());
+    clientConfig.offeredCodecs = codecs;
+
+    if (!parseMix(parser.value(mixOption), clientConfig.mix))
+        return 1;
+
+    QList<int> clientsCounts = parser.isSet(scalingOption)
+            ? parseNumbers(parser.value(scalingOption))
+            : parseNumbers(parser.value(clientsOption));
+
+    const int durationSeconds = parser.value(durationOption).toInt();
+
+    if (clientsCounts.isEmpty() || durationSeconds <= 0)
+    {
+        qInfo() << "ОШИБКА: неверное количество клиентов или длительность прогона";
+        return 1;
+    }
+
+    QList<PayloadGenerator::Payload> payloads;
+    for (const QByteArray &version : qAsConst(versions))
+        payloads << PayloadGenerator::makePayload(version);
+
+    versions.clear();
+
+    LoadGenerator generator(clientConfig, &payloads);
+    QJsonArray runs;
+
+    // Прогоны выполняются по очереди, следующий начинается по окончании предыдущего
+    QObject::connect(&generator, &LoadGenerator::finished, &a, [&]()
+    {
+        runs.append(generator.result());
+
+        if (runs.size() < clientsCounts.size())
+        {
+            generator.start(clientsCounts.at(runs.size()), durationSeconds);
+            return;
+        }
+
+        QJsonObject result = parser.isSet(scalingOption) ? QJsonObject { { "runs", runs } }
+                                                         : runs.first().toObject();
+
+        a.exit(writeResult(result, outputPath) ? 0 : 1);
+    });
+
+    generator.start(clientsCounts.first(), durationSeconds);
+
+    return a.exec();
+}
@@ -0,0 +1,65 @@
+#ifndef BACKUPCACHE_H
+#define BACKUPCACHE_H
+
+#include <QByteArray>
+#include <QString>
+#include <QCache>
+#include <QMutex>
+
+/*
+ * Кэш содержимого недавно отправленных и недавно сохраненных
+ * версий баз данных в памяти сервера.
+ *
+ * Запись кэша - файл версии целиком. Ключ - номер версии в каталоге
+ * и хеш ее содержимого. Общий размер записей не превышает maxSize байт,
+ * при нехватке места удаляются версии, которые дольше всего не запрашивались.
+ * Версии больше maxEntrySize не кэшируются, чтобы одна большая база
+ * не вытесняла все остальные.
+ *
+ * Повторные запросы одной версии (например, когда после сбоя все клиенты
+ * восстанавливают последние версии нескольких организаций)
+ * отправляются из памяти без чтения с диска.
+ *
+ * Все методы потокобезопасны.
+ */
+class BackupCache
+{
+public:
+    explicit BackupCache(qint64 maxSize = cDefaultMaxSize);
+
+    bool find(qint64 backupId, const QByteArray &contentHash, QByteArray &dbData);
+    void insert(qint64 backupId, const QByteArray &contentHash, const QByteArray &dbData);
+    void remove(qint64 backupId, const QByteArray &contentHash);
+
+    /*
+     * Читает файл dbFilePath и добавляет его в кэш.
+     * Возвращает содержимое файла или пустой массив,
+     * если файл слишком велик для кэша или не читается.
+     */
+    QByteArray insertFile(qint64 backupId, const QByteArray &contentHash, const QString &dbFilePath);
+
+    qint64 maxEntrySize() const { return m_maxEntrySize; }
+
+    qint64 hits() const;
+    qint64 misses() const;
+    qint64 size() const;
+
+    static const qint64 cDefaultMaxSize;
+
+private:
+    /*
+     * Стоимость записи в QCache - ее размер в килобайтах,
+     * поэтому бюджет кэша не ограничен разрядностью int.
+     */
+    QCache<QString, QByteArray> m_cache;
+    mutable QMutex m_mutex;
+
+    qint64 m_maxEntrySize = 0;
+    qint64 m_hits = 0;
+    qint64 m_misses = 0;
+
+    static QString cacheKey(qint64 backupId, const QByteArray &contentHash);
+    static int entryCost(const QByteArray &dbData);
+};
+
+#endif // BACKUPCACHE_H
@@ -0,0 +1,82 @@
+#ifndef BACKUPCATALOG_H
+#define BACKUPCATALOG_H
+
+#include "include/TcpDataTypes.h"
+#include "include/BackupStore.h"
+
+#include <QString>
+#include <QList>
+#include <QMutex>
+#include <QtSql/QSqlDatabase>
+
+/*
+ * Каталог версий баз данных, хранящихся на сервере.
+ *
+ * Каталог - база данных SQLite databases/.store/catalog.sqlite,
+ * в которой для каждой версии хранятся имя организации, время сохранения,
+ * размер файла, хеш содержимого, количество сотрудников
+ * и результат проверки целостности (см. BackupVerifier).
+ * Благодаря ему запрос списка версий не просматривает папку манифестов,
+ * а выбирает одну страницу записей по индексу.
+ *
+ * Каталог обновляется при сохранении каждой новой версии
+ * и сверяется с манифестами хранилища при запуске сервера.
+ *
+ * Все открытые методы потокобезопасны. Каждый поток работает
+ * с каталогом через собственное подключение QSqlDatabase.
+ */
+class BackupCatalog
+{
+public:
+    explicit BackupCatalog(const QString &databasesPath);
+
+    bool init();
+
+    /*
+     * Добавляет в каталог версию backupFileName с манифестом manifest.
+     * Возвращает номер версии в каталоге или 0 при ошибке.
+     */
+    qint64 addBackup(const QString &backupFileName, const BackupStore::Manifest &manifest,
+                     qint64 createdAt, qint32 employeeCount = -1);
+
+    bool removeBackup(const QString &backupFileName);
+    bool setVerificationResult(const QString &backupFileName, bool isValid,
+                               const QString &details, qint32 employeeCount);
+    bool findBackup(const QString &backupFileName, BackupInfo &info) const;
+
+    /*
+     * Возвращает не больше limit версий от новых к старым.
+     * Пустой orgName - версии всех организаций, from и to равные 0 -
+     * без ограничения по времени, cursor равный 0 - первая страница.
+     * В nextCursor записывается курсор следующей страницы или 0.
+     */
+    QList<BackupInfo> listBackups(const QString &orgName, qint64 from, qint64 to,
+                                  qint64 cursor, int limit, qint64 &nextCursor) const;
+
+    /*
+     * Приводит каталог в соответствие с манифестами хранилища store:
+     * добавляет отсутствующие версии и удаляет записи версий,
+     * которых в хранилище больше нет.
+     */
+    void rebuild(const BackupStore *store);
+
+    /*
+     * Разбирает имя версии "Имя день-месяц-год--час-минуты-cекунды.db".
+     * Возвращает false, если в имени нет времени сохранения.
+     */
+    static bool parseBackupFileName(const QString &backupFileName,
+                                    QString &orgName, qint64 &createdAt);
+
+private:
+    QString m_catalogFilePath;
+
+    /*
+     * SQLite допускает только одну пишущую транзакцию,
+     * поэтому запись в каталог выполняется под мьютексом.
+     */
+    QMutex m_writeMutex;
+
+    QSqlDatabase connection() const;
+};
+
+#endif // BACKUPCATALOG_H
@@ -0,0 +1,58 @@
+#ifndef BACKUPDIFFENGINE_H
+#define BACKUPDIFFENGINE_H
+
+#include "include/TcpDataTypes.h"
+
+#include <QString>
+#include <QList>
+
+#include <functional>
+
+class QSqlDatabase;
+
+/*
+ * Сравнение двух сохраненных версий базы данных по сотрудникам.
+ *
+ * Каждая из четырех таблиц обеих версий читается одним проходом
+ * в порядке возрастания ID (столбец ID уникален, поэтому SQLite
+ * читает таблицу по его индексу без сортировки). Курсоры восьми
+ * таблиц продвигаются слиянием: на каждом шаге берется наименьший
+ * из их текущих номеров, и записи сотрудника с этим номером
+ * сравниваются во всех таблицах сразу.
+ *
+ * Поэтому время сравнения линейно, а в памяти находятся только
+ * текущие записи курсоров и одна пачка отличий, независимо
+ * от количества сотрудников в организации. Обработчик пачки
+ * может задержать сравнение, пока предыдущая пачка не отправлена
+ * клиенту (см. ReplyFlow), поэтому пачки не накапливаются
+ * и в очереди отправки.
+ *
+ * Файлы версий открываются только для чтения.
+ */
+class BackupDiffEngine
+{
+public:
+    using EntriesHandler = std::function<bool(const QList<EmployeeDiff> &entries)>;
+
+    struct Summary
+    {
+        quint32 addedCount = 0;
+        quint32 removedCount = 0;
+        quint32 changedCount = 0;
+    };
+
+    /*
+     * Сравнивает версию newDbFilePath с oldDbFilePath и передает
+     * отличия в onEntries пачками не больше cDiffBatchEntries.
+     * Если onEntries возвращает false, сравнение прерывается.
+     * Возвращает false при ошибке, описание которой записывается в error.
+     */
+    static bool run(const QString &oldDbFilePath, const QString &newDbFilePath,
+                    const EntriesHandler &onEntries, Summary &summary, QString &error);
+
+private:
+    static bool compare(QSqlDatabase &oldDb, QSqlDatabase &newDb,
+                        const EntriesHandler &onEntries, Summary &summary, QString &error);
+};
+
+#endif // BACKUPDIFFENGINE_H
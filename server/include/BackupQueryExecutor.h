@@ -0,0 +1,51 @@
+#ifndef BACKUPQUERYEXECUTOR_H
+#define BACKUPQUERYEXECUTOR_H
+
+#include "include/TcpDataTypes.h"
+
+#include <QString>
+#include <QVariant>
+
+#include <functional>
+
+class QSqlDatabase;
+
+/*
+ * Выполнение запросов BackupQuery над файлом сохраненной версии.
+ *
+ * Файл открывается только для чтения. Запросы составляются
+ * из заранее заданных команд: значения передаются как параметры,
+ * а имя таблицы допускается только из DatabaseCreation::cTableNamesList,
+ * поэтому клиент не может выполнить над файлом произвольную команду.
+ *
+ * Найденные записи передаются пачками по мере чтения. Обработчик
+ * пачки может задержать чтение, пока предыдущая пачка не отправлена
+ * клиенту (см. ReplyFlow), поэтому в памяти находится не больше
+ * читаемой пачки и одной отправляемой.
+ */
+class BackupQueryExecutor
+{
+public:
+    using BatchHandler = std::function<bool(const BackupQueryBatch &batch)>;
+
+    /*
+     * Выполняет query над файлом dbFilePath и передает записи в onBatch.
+     * Если onBatch возвращает false, запрос прерывается.
+     * Возвращает количество найденных записей или -1 при ошибке,
+     * описание которой записывается в error.
+     */
+    static qint64 run(const QString &dbFilePath, const BackupQuery &query,
+                      const BatchHandler &onBatch, QString &error);
+
+private:
+    /*
+     * Выполняет "SELECT * FROM [tableName] WHERE condition" с параметром value
+     * (без WHERE, если condition пусто) и передает не больше limit записей.
+     * Условие составляется только в этом классе.
+     */
+    static qint64 selectRows(QSqlDatabase &db, const QString &tableName,
+                             const QString &condition, const QVariant &value, qint64 limit,
+                             const BatchHandler &onBatch, QString &error);
+};
+
+#endif // BACKUPQUERYEXECUTOR_H
@@ -0,0 +1,127 @@
+#ifndef BACKUPRETENTION_H
+#define BACKUPRETENTION_H
+
+#include "include/TcpDataTypes.h"
+
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <QElapsedTimer>
+
+#include <atomic>
+#include <functional>
+
+class BackupStore;
+class BackupCatalog;
+class BackupCache;
+
+/*
+ * Обслуживание хранилища версий баз данных: удаление устаревших версий
+ * и перенос страниц старых версий в холодное хранение.
+ *
+ * Политика хранения задается в файле server.ini рядом с программой:
+ *
+ * [Retention]
+ * Enabled=true
+ * KeepAllDays=1           ; все версии за последние дни
+ * KeepDailyDays=30        ; затем последняя версия за каждый день
+ * KeepMonthlyMonths=0     ; затем последняя версия за каждый месяц, 0 - бессрочно
+ * ColdAfterDays=7         ; страницы версий старше этого пересжимаются
+ * ChunkGracePeriodHours=24
+ * MaxBytesPerSecond=8388608
+ * IntervalMinutes=60
+ *
+ * Последняя версия каждой организации не удаляется никогда.
+ *
+ * Страницы, на которые ссылаются только старые версии, переносятся
+ * в холодные пакеты (BackupStore::compactChunks): страницы, идущие
+ * подряд в версиях, сжимаются вместе алгоритмом с наибольшей степенью
+ * сжатия и распаковываются при восстановлении версии
+ * (BackupStore::materialize), поэтому клиент получает такую версию
+ * как обычно. После прохода в журнал записываются степень сжатия
+ * холодных страниц и размер, освобожденный на диске.
+ *
+ * Страницы, на которые не ссылается ни одна версия, удаляются,
+ * если они не изменялись ChunkGracePeriodHours часов: так не удаляются
+ * страницы версий, которые в это время загружаются клиентами.
+ * Пакеты страниц, в которых удаленные страницы занимают больше
+ * половины места, переписываются (BackupStore::rewritePack).
+ *
+ * Обслуживание выполняется в отдельном потоке, не больше MaxBytesPerSecond
+ * байт в секунду, и приостанавливается, пока клиенты передают данные.
+ */
+class BackupRetention
+{
+public:
+    struct Policy
+    {
+        bool isEnabled = true;
+        int keepAllDays = 1;
+        int keepDailyDays = 30;
+        int keepMonthlyMonths = 0;
+        int coldAfterDays = 7;
+        int chunkGracePeriodHours = 24;
+        qint64 maxBytesPerSecond = 8 * 1024 * 1024;
+        int intervalMinutes = 60;
+    };
+
+    BackupRetention(BackupStore *store, BackupCatalog *catalog, BackupCache *cache);
+
+    static Policy loadPolicy(const QString &settingsFilePath);
+
+    void setPolicy(const Policy &policy) { m_policy = policy; }
+    Policy policy() const { return m_policy; }
+
+    /*
+     * Функция, возвращающая true, пока клиенты передают данные.
+     */
+    void setTransferActivityCheck(std::function<bool()> isTransferActive);
+
+    /*
+     * Выполняет один проход обслуживания. Вызывается из потока обслуживания.
+     */
+    void run();
+
+    /*
+     * Прерывает выполняемый проход. Вызывается при остановке сервера.
+     */
+    void stop() { m_isStopping = true; }
+
+    /*
+     * Возвращает имена версий из backups, которые не нужно хранить
+     * по политике policy на момент now (миллисекунды с начала эпохи).
+     */
+    static QStringList expiredBackups(QList<BackupInfo> backups, const Policy &policy, qint64 now);
+
+private:
+    BackupStore *m_pStore = nullptr;
+    BackupCatalog *m_pCatalog = nullptr;
+    BackupCache *m_pCache = nullptr;
+
+    Policy m_policy;
+    std::function<bool()> m_isTransferActive;
+    std::atomic<bool> m_isStopping { false };
+
+    /*
+     * Объем данных, обработанных с момента m_throttleTimer.
+     * По ним вычисляется пауза, ограничивающая скорость обслуживания.
+     */
+    QElapsedTimer m_throttleTimer;
+    qint64 m_throttledBytes = 0;
+
+    static const qint64 cMsecsPerDay;
+    static const int cIdleCheckInterval;
+    static const int cColdBatchChunks;
+
+    QList<BackupInfo> catalogBackups() const;
+    int removeExpiredBackups(const QList<BackupInfo> &backups);
+    void compactStore(const QList<BackupInfo> &backups);
+
+    /*
+     * Ждет окончания передач клиентов и выдерживает паузу
+     * после обработки bytes байт. Возвращает false, если проход прерван.
+     */
+    bool throttle(qint64 bytes);
+};
+
+#endif // BACKUPRETENTION_H
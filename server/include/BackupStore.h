@@ -0,0 +1,296 @@
+#ifndef BACKUPSTORE_H
+#define BACKUPSTORE_H
+
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QList>
+#include <QPair>
+#include <QSet>
+#include <QHash>
+#include <QCache>
+#include <QMutex>
+
+/*
+ * Хранилище резервных копий баз данных с дедупликацией страниц.
+ *
+ * Файл каждой загруженной базы данных разбивается на страницы SQLite
+ * (размер страницы берется из заголовка файла). Каждая уникальная
+ * страница хранится один раз и находится по ее хешу SHA-256.
+ * Для каждой версии базы данных хранится манифест - размер файла,
+ * размер страницы и список хешей страниц по порядку.
+ *
+ * Соседние версии одной организации обычно отличаются несколькими
+ * страницами, поэтому новая версия занимает на диске
+ * и требует записи только этих страниц и манифеста.
+ *
+ * Новые страницы записываются пакетами: страницы одной загрузки
+ * дописываются подряд в файл пакета, а рядом сохраняется индекс
+ * пакета - хеши страниц и их места в файле. Пакет и индекс сбрасываются
+ * на диск один раз, поэтому загрузка тысяч новых страниц требует
+ * нескольких синхронизаций, а не синхронизации каждой страницы.
+ * Индексы всех пакетов хранятся в памяти и загружаются в init.
+ * Страница, удаленная из хранилища, остается в файле пакета,
+ * пока пакет не будет переписан (см. rewritePack).
+ *
+ * Страницы старых версий переносятся в холодные пакеты (compactChunks):
+ * страницы, идущие подряд в версиях, собираются в сегменты
+ * по cColdSegmentSize байт, и каждый сегмент сжимается целиком.
+ * Соседние страницы базы данных похожи, поэтому сегмент сжимается
+ * намного сильнее, чем те же страницы по отдельности. Для чтения
+ * страницы распаковывается ее сегмент; последние распакованные
+ * сегменты хранятся в памяти, поэтому восстановление версии
+ * распаковывает каждый сегмент один раз.
+ *
+ * Структура папки databases/.store:
+ * - packs/<имя>.pack и packs/<имя>.index - пакеты страниц и их индексы;
+ *   пакет без индекса не дописан и удаляется при запуске;
+ * - manifests/<имя версии>.manifest - манифесты версий;
+ * - restore/<имя версии> - файлы, восстановленные из страниц для отправки.
+ *
+ * Имя версии имеет прежний формат "Имя день-месяц-год--час-минуты-cекунды.db",
+ * поэтому клиент работает с хранилищем так же, как с папкой файлов.
+ *
+ * Все открытые методы потокобезопасны и вызываются из пула рабочих потоков.
+ */
+class BackupStore
+{
+public:
+    /*
+     * Манифест версии базы данных.
+     */
+    struct Manifest
+    {
+        qint64 fileSize = 0;
+        quint32 pageSize = 0;
+        QList<QByteArray> pageHashes;
+    };
+
+    // Хеш и содержимое страницы
+    using Chunk = QPair<QByteArray, QByteArray>;
+
+    /*
+     * Итог переноса страниц в холодное хранение.
+     */
+    struct CompactionResult
+    {
+        bool isSucceeded = true;
+        int chunksCount = 0;     // Перенесено страниц
+        qint64 rawSize = 0;      // Их размер без сжатия
+        qint64 packSize = 0;     // Размер холодного пакета с индексом
+    };
+
+    explicit BackupStore(const QString &databasesPath);
+
+    bool init();
+
+    /*
+     * Разбивает файл filePath на страницы и сохраняет его как версию
+     * с именем backupFileName. Если версия с таким именем уже есть,
+     * к имени добавляется номер. Возвращает итоговое имя версии
+     * или пустую строку при ошибке. Исходный файл не удаляется.
+     */
+    QString importFile(const QString &filePath, const QString &backupFileName);
+
+    /*
+     * Переносит в хранилище файлы *.db, лежащие прямо в папке databases
+     * (так сервер хранил базы данных раньше), и удаляет их.
+     */
+    void importLegacyFiles();
+
+    /*
+     * Сохраняет страницы chunks, которых еще нет в хранилище,
+     * одним пакетом. Страницы становятся доступны все сразу
+     * после записи индекса пакета.
+     */
+    bool addChunks(const QList<Chunk> &chunks);
+    bool containsChunk(const QByteArray &hash) const;
+
+    /*
+     * То же, что containsChunk, но дополнительно защищает найденную страницу
+     * от удаления сборщиком мусора (см. removeUnusedChunk):
+     * версия, которая будет на нее ссылаться, еще не сохранена.
+     */
+    bool retainChunk(const QByteArray &hash);
+
+    /*
+     * Читает страницу hash, распаковывая ее, если она в холодном хранении.
+     */
+    bool readChunk(const QByteArray &hash, QByteArray &page) const;
+
+    QSet<QByteArray> chunksList() const;
+
+    /*
+     * Переносит страницы hashes одним холодным пакетом, сжимая их
+     * сегментами алгоритмом codec с уровнем level. Страницы лучше
+     * передавать в порядке манифестов. Страницы, которые уже
+     * в холодном пакете или удалены, пропускаются.
+     */
+    CompactionResult compactChunks(const QList<QByteArray> &hashes, quint8 codec, int level);
+
+    /*
+     * Размер файлов пакетов на диске.
+     */
+    qint64 chunksDiskSize() const;
+
+    /*
+     * Удаляет страницу hash, на которую не ссылается ни одна версия,
+     * если она не изменялась и не была защищена retainChunk
+     * в течение gracePeriod миллисекунд. Возвращает размер удаленной
+     * страницы; место страницы в пакете освобождает rewritePack.
+     */
+    qint64 removeUnusedChunk(const QByteArray &hash, qint64 gracePeriod);
+
+    QStringList packsList() const;
+
+    /*
+     * Удаляет пакет packName, если в нем не осталось страниц хранилища,
+     * или переписывает оставшиеся страницы в новый пакет, если удаленные
+     * занимают больше половины файла. Пакеты, записанные меньше
+     * gracePeriod миллисекунд назад, не изменяются. Возвращает
+     * число освобожденных байт или -1 при ошибке.
+     */
+    qint64 rewritePack(const QString &packName, qint64 gracePeriod);
+
+    /*
+     * Забывает защиту страниц, установленную раньше gracePeriod миллисекунд назад.
+     */
+    void pruneRetainedChunks(qint64 gracePeriod);
+
+    /*
+     * Создает версию backupFileName из манифеста, все страницы
+     * которого уже есть в хранилище. Выбор имени - как в importFile.
+     */
+    QString addBackup(const QString &backupFileName, const Manifest &manifest);
+
+    QStringList backupsList() const;
+    bool contains(const QString &backupFileName) const;
+
+    /*
+     * Удаляет манифест и восстановленный файл версии backupFileName.
+     * Страницы версии удаляются позже сборщиком мусора.
+     */
+    bool removeBackup(const QString &backupFileName);
+    bool readManifest(const QString &backupFileName, Manifest &manifest) const;
+
+    /*
+     * Восстанавливает файл версии backupFileName из страниц.
+     * Восстановленный файл сохраняется в папке restore
+     * и используется повторно при следующих запросах.
+     * Возвращает путь к файлу или пустую строку при ошибке.
+     *
+     * Возвращенный файл не удаляется при очистке папки restore,
+     * пока для него не вызван releaseRestoredFile. Его нужно вызвать
+     * один раз на каждый успешный вызов materialize, когда файл
+     * прочитан или открыт для отправки.
+     */
+    QString materialize(const QString &backupFileName);
+    void releaseRestoredFile(const QString &backupFileName);
+
+    /*
+     * Определяет размер страницы по заголовку файла SQLite.
+     * Для файлов, которые не являются базой SQLite, возвращает cDefaultPageSize.
+     */
+    static quint32 detectPageSize(const QByteArray &fileHeader);
+
+    /*
+     * Хеш содержимого версии - SHA-256 списка хешей ее страниц.
+     * Совпадает у версий с одинаковым содержимым файла.
+     */
+    static QByteArray contentHash(const Manifest &manifest);
+
+    static const quint32 cDefaultPageSize;
+
+private:
+    /*
+     * Место страницы в файле пакета: запись offset размером size
+     * и страница с pageOffset размером pageSize в ней. В обычном пакете
+     * запись - сама страница, в холодном - сжатый сегмент (codec).
+     */
+    struct ChunkLocation
+    {
+        QString packName;
+        quint8 codec = 0;
+        qint64 offset = 0;
+        qint32 size = 0;
+        qint32 pageOffset = 0;
+        qint32 pageSize = 0;
+    };
+
+    QString m_storePath;
+    QString m_databasesPath;
+
+    /*
+     * Имена версий, которые сейчас создаются.
+     * Вместе с m_namesMutex защищают выбор уникального имени новой версии.
+     */
+    QSet<QString> m_reservedNames;
+    QMutex m_namesMutex;
+
+    /*
+     * Время последнего вызова retainChunk для страниц,
+     * найденных при сохранении еще не записанных версий.
+     * Вместе с m_chunksMutex не дают сборщику мусора удалить такую страницу.
+     */
+    QHash<QByteArray, qint64> m_retainedChunks;
+    QMutex m_chunksMutex;
+
+    /*
+     * Места страниц всех пакетов по хешам.
+     * Если m_chunksMutex тоже нужен, он блокируется первым.
+     */
+    QHash<QByteArray, ChunkLocation> m_packedChunks;
+    mutable QMutex m_packsMutex;
+
+    /*
+     * Распакованные сегменты холодных пакетов по имени пакета и смещению;
+     * стоимость сегмента - его размер в КБ.
+     */
+    mutable QCache<QString, QByteArray> m_decodedSegments;
+    mutable QMutex m_segmentsMutex;
+
+    /*
+     * Число пользователей восстановленных файлов по имени файла в папке restore.
+     * Вместе с m_restoreMutex не дают удалить используемый файл при очистке папки.
+     */
+    QHash<QString, int> m_restoredFileUsers;
+    QMutex m_restoreMutex;
+
+    static const quint32 cManifestMagic;
+    static const quint32 cManifestVersion;
+    static const qint64 cMaxRestoreDirSize;
+    static const quint32 cPackIndexMagic;
+    static const quint32 cPackIndexVersion;
+    static const qint64 cMaxPackSize;
+    static const int cColdSegmentSize;
+    static const int cDecodedSegmentsCacheKb;
+
+    QString packFilePath(const QString &packName) const;
+    QString packIndexFilePath(const QString &packName) const;
+
+    bool loadPacks();
+    bool findPackedChunk(const QByteArray &hash, ChunkLocation &location) const;
+    bool readPackedChunk(const ChunkLocation &location, QByteArray &page) const;
+
+    /*
+     * Записывает страницы chunks в новый пакет и его индекс,
+     * не добавляя их в m_packedChunks. Места страниц сохраняются в locations.
+     * Если codec не CodecNone, пакет холодный и сжимается с уровнем level.
+     */
+    bool writePack(const QList<Chunk> &chunks, QHash<QByteArray, ChunkLocation> &locations,
+                   quint8 codec = 0, int level = -1);
+    bool readPackIndex(const QString &packName, QHash<QByteArray, ChunkLocation> &locations,
+                       int *pLevel = nullptr) const;
+
+    QString manifestFilePath(const QString &backupFileName) const;
+    QString restoreFilePath(const QString &backupFileName) const;
+
+    bool writeManifest(const QString &backupFileName, const Manifest &manifest);
+    QString reserveBackupFileName(const QString &backupFileName);
+    void releaseBackupFileName(const QString &backupFileName);
+
+    bool useRestoredFile(const QString &backupFileName);
+    void trimRestoreDirectory();
+};
+
+#endif // BACKUPSTORE_H
@@ -0,0 +1,36 @@
+#ifndef BACKUPVERIFIER_H
+#define BACKUPVERIFIER_H
+
+#include <QString>
+#include <QByteArray>
+
+/*
+ * Проверка целостности сохраненной версии базы данных.
+ *
+ * Проверка выполняется в пуле рабочих потоков уже после того,
+ * как клиент получил подтверждение сохранения, и состоит из шагов:
+ * 1) хеш содержимого файла сравнивается с хешем версии в каталоге;
+ * 2) файл открывается только для чтения как база SQLite;
+ * 3) выполняется PRAGMA quick_check;
+ * 4) схема таблиц сравнивается с DatabaseCreation::cTableCreationCommandsList.
+ * Результат записывается в каталог версий, поэтому поврежденная версия
+ * обнаруживается сразу после загрузки, а не при восстановлении.
+ */
+class BackupVerifier
+{
+public:
+    struct Result
+    {
+        bool isValid = false;
+        QString details;            // Описание первой найденной ошибки
+        qint32 employeeCount = -1;
+    };
+
+    static Result verify(const QString &dbFilePath, const QByteArray &expectedContentHash);
+
+private:
+    static QByteArray fileContentHash(const QString &dbFilePath, bool &isRead);
+    static QString normalizeSql(const QString &sql);
+};
+
+#endif // BACKUPVERIFIER_H
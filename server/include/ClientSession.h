@@ -0,0 +1,289 @@
+#ifndef CLIENTSESSION_H
+#define CLIENTSESSION_H
+
+#include "include/TcpDataTypes.h"
+#include "include/DeltaUpload.h"
+#include "include/FrameDecoder.h"
+#include "include/BackupDiffEngine.h"
+
+#include <QObject>
+#include <QTcpSocket>
+#include <QStringList>
+#include <QQueue>
+#include <QHash>
+#include <QElapsedTimer>
+
+#include <memory>
+
+class TcpServer;
+class UploadIngest;
+class DownloadStream;
+class ReplyFlow;
+
+/*
+ * Класс сессии одного подключенного клиента.
+ *
+ * Для каждого подключения сервер создает отдельный объект сессии
+ * с собственным сокетом, состоянием разбора входящих блоков данных
+ * и буфером. Поэтому ответы всегда отправляются тому клиенту,
+ * от которого пришел запрос, а несколько клиентов могут
+ * обмениваться данными с сервером одновременно.
+ *
+ * Работа с диском и сжатие выполняются в пуле рабочих потоков сервера,
+ * результат возвращается в сессию через очередь событий.
+ *
+ * Запросы списка версий выполняются параллельно, запросы на получение
+ * базы данных ставятся в очередь, поэтому клиент может отправлять
+ * запросы, не дожидаясь ответов на предыдущие. Ответ несет номер запроса.
+ *
+ * Части файлов баз данных передаются по разрешениям планировщика
+ * сервера TransferScheduler, управляющие кадры отправляются сразу.
+ */
+class ClientSession : public QObject
+{
+    Q_OBJECT
+
+public:
+    ClientSession(qintptr socketDescriptor, TcpServer *server);
+    ~ClientSession();
+
+    qintptr socketDescriptor() const { return m_socketDescriptor; }
+
+    /*
+     * Состояние очередей сессии для метрик сервера.
+     */
+    qint64 pendingBytes() const { return m_pendingChunksBytes + m_pendingPagesBytes; }
+    int pendingDownloadsCount() const { return m_pendingDownloads.size(); }
+    qint64 bytesToWrite() const { return m_pSocket->bytesToWrite(); }
+
+    void sendDatabase(quint32 requestId, const std::shared_ptr<DownloadStream> &download,
+                      qint64 offset = 0, const QByteArray &contentHash = QByteArray());
+    void sendDatabaseFileCreationResult(quint32 requestId, bool dbFileCreated);
+    /*
+     * Сообщает клиенту, что запрошенную базу данных отправить нельзя.
+     */
+    void sendDatabaseSendFailure(quint32 requestId, const QString &error);
+    void sendDatabasesList(quint32 requestId, const QList<BackupInfo> &backupsList, qint64 nextCursor);
+
+    /*
+     * Вызывается планировщиком, когда сессии выдано разрешение
+     * на передачу TransferScheduler::cGrantSize байт.
+     */
+    void transferGranted();
+
+private:
+    TcpServer *m_pServer = nullptr;
+    QTcpSocket *m_pSocket = nullptr;
+    qintptr m_socketDescriptor = 0;
+
+    /*
+     * Сохраняет принимаемый кадр между вызовами slotReadyRead,
+     * поэтому кадр, пришедший несколькими TCP-сегментами, не теряется.
+     */
+    FrameDecoder m_frameDecoder;
+
+    /*
+     * Алгоритм сжатия частей файлов, отправляемых клиенту.
+     * Выбирается по кадру Hello, до него части не сжимаются.
+     */
+    quint8 m_codec = 0;
+
+    /*
+     * Состояние приема базы данных, которую присылает клиент.
+     *
+     * Полученные части ждут записи в очереди m_pendingChunks.
+     * В рабочем потоке одновременно записывается не более одной части,
+     * что сохраняет их порядок в файле.
+     *
+     * Ожидающие записи данные обеих загрузок (pendingBytes) и буфер
+     * сокета вместе не превышают квоты m_readQuota: когда квота
+     * исчерпана, сессия не разбирает новые кадры, а сокет перестает
+     * читать данные из ядра, и TCP притормаживает только этого клиента.
+     */
+    std::shared_ptr<UploadIngest> m_pIngest;
+    quint32 m_ingestRequestId = 0;
+    QQueue<QByteArray> m_pendingChunks;
+    qint64 m_pendingChunksBytes = 0;
+    bool m_isChunkWriteInProgress = false;
+    bool m_isIngestFailed = false;
+    bool m_isIngestFinishRequested = false;
+    qint64 m_readQuota = 0;
+
+    /*
+     * Разрешения планировщика на прием частей загружаемой базы данных.
+     * m_readAllowance - сколько байт частей еще можно принять,
+     * m_inboundHeldBytes - сколько байт бюджета занято принятыми,
+     * но еще не записанными частями и неизрасходованным разрешением.
+     */
+    qint64 m_readAllowance = 0;
+    qint64 m_inboundHeldBytes = 0;
+    bool m_isReadWaitingForGrant = false;
+
+    /*
+     * Отправляемая клиенту база данных.
+     * Следующая часть записывается в сокет только тогда, когда
+     * в его буфере осталось меньше cMaxBytesToWrite неотправленных байт.
+     * Пока часть сжимается в рабочем потоке, следующая не читается.
+     *
+     * Базы данных, запрошенные во время отправки другой,
+     * ждут в очереди m_pendingDownloads.
+     */
+    struct PendingDownload
+    {
+        quint32 requestId;
+        std::shared_ptr<DownloadStream> download;
+        qint64 offset;
+        QByteArray contentHash;
+    };
+
+    std::shared_ptr<DownloadStream> m_pDownload;
+    quint32 m_downloadRequestId = 0;
+    bool m_isChunkEncodingInProgress = false;
+    QQueue<PendingDownload> m_pendingDownloads;
+
+    static const qint64 cMaxBytesToWrite;
+
+    /*
+     * Каждая отправляемая часть читается по разрешению планировщика,
+     * которое возвращается в бюджет, когда кадр с частью передан в ядро.
+     * m_bulkFrameEnds - позиции концов таких кадров в потоке записанных
+     * в сокет байт, m_sentBytes - сколько байт сокет уже передал.
+     */
+    bool m_hasDownloadGrant = false;
+    bool m_isDownloadWaitingForGrant = false;
+    qint64 m_writtenBytes = 0;
+    qint64 m_sentBytes = 0;
+    QQueue<qint64> m_bulkFrameEnds;
+
+    /*
+     * Время выполнения запросов на загрузку и получение баз данных
+     * от первого кадра запроса до ответа. По завершении запроса
+     * записывается в распределение metricName метрик сервера.
+     */
+    struct RequestTimer
+    {
+        QString metricName;
+        QElapsedTimer timer;
+    };
+
+    QHash<quint32, RequestTimer> m_requestTimers;
+
+    void startRequestTimer(quint32 requestId, const QString &metricName);
+    void finishRequestTimer(quint32 requestId);
+
+    /*
+     * Состояние разностной загрузки базы данных.
+     *
+     * Присланные страницы ждут проверки и записи в m_pendingPages.
+     * Пока рабочий поток записывает одну пачку страниц,
+     * новые страницы накапливаются в следующую пачку.
+     * Объем ожидающих страниц учитывается в m_pendingPagesBytes
+     * отдельно от частей потоковой загрузки, поэтому сброс одной
+     * загрузки не искажает квоту другой.
+     */
+    std::shared_ptr<DeltaUpload> m_pDeltaUpload;
+    quint32 m_deltaRequestId = 0;
+    QList<DeltaUpload::Page> m_pendingPages;
+    qint64 m_pendingPagesBytes = 0;
+    bool m_isDeltaTaskInProgress = false;
+    bool m_isDeltaUploadFailed = false;
+    bool m_isDeltaFinishRequested = false;
+
+    void beginDeltaUpload(quint32 requestId, const QByteArray &payload);
+    void appendDeltaHashes(const QByteArray &hashes);
+    void appendDeltaPage(const QByteArray &payload);
+    void finishDeltaUpload();
+
+    void writeNextPagesBatch();
+    void deltaTaskFinished(const DeltaUpload *deltaUpload, bool isSucceeded, qint64 storedBytes);
+    void commitDeltaUpload();
+    void resetDeltaUpload();
+
+    void startNextDownload();
+
+    /*
+     * Прекращает отправку или прием базы данных, разностную загрузку,
+     * запрос записей или сравнение версий с номером requestId
+     * по кадру CancelRequest.
+     */
+    void cancelRequest(quint32 requestId);
+    void writeNextDownloadChunks();
+    void encodeDownloadChunk(const QByteArray &rawChunk);
+    void markBulkFrameWritten();
+
+    bool isReceivingDatabase() const;
+    void requestTransferGrant(bool &isWaitingForGrant);
+    void releaseInboundBytes(qint64 bytes);
+    void releaseUnusedInboundBytes();
+    void updateReadBufferSize();
+
+    void processFrame(const FrameDecoder::Frame &frame);
+
+    void beginReceivingDatabase(quint32 requestId, const QByteArray &payload);
+    void appendDatabaseChunk(const QByteArray &chunk);
+    void finishReceivingDatabase();
+
+    void writeNextPendingChunk();
+    void chunkWritten(const UploadIngest *ingest, bool isWritten, qint64 chunkSize);
+    void commitIngest();
+    void resetIngest();
+
+    void processHello(quint32 requestId, const QByteArray &payload);
+
+    /*
+     * Запрос записей сохраненной версии выполняется в рабочем потоке,
+     * найденные записи отправляются пачками по мере чтения.
+     */
+    void processBackupQuery(quint32 requestId, const QByteArray &payload);
+    void sendBackupQueryBatch(quint32 requestId, const std::shared_ptr<ReplyFlow> &replyFlow,
+                              const BackupQueryBatch &batch);
+    void sendBackupQueryEnd(quint32 requestId, qint64 rowCount, const QString &error);
+
+    /*
+     * Части файлов версий, которые клиент просматривает без получения,
+     * читаются из открытых DownloadStream. Открытые версии сохраняются
+     * между запросами, чтобы не открывать файл для каждой части.
+     */
+    QHash<QString, std::shared_ptr<DownloadStream>> m_rangeStreams;
+
+    static const int cMaxRangeStreams;
+
+    void processDatabaseRangeRequest(quint32 requestId, const QByteArray &payload);
+
+    /*
+     * Ответы, которые рабочие потоки передают сессии пачками,
+     * по номерам запросов. Если после записи пачки в буфере сокета
+     * осталось не меньше cMaxBytesToWrite байт, ответ ждет
+     * в m_waitingReplyFlows, и рабочий поток получает разрешение
+     * на следующую пачку, когда сокет отправит данные (см. ReplyFlow).
+     */
+    QHash<quint32, std::shared_ptr<ReplyFlow>> m_replyFlows;
+    QList<std::shared_ptr<ReplyFlow>> m_waitingReplyFlows;
+
+    void replyBatchSent(const std::shared_ptr<ReplyFlow> &replyFlow);
+    void releaseWaitingReplyFlows();
+
+    /*
+     * Сравнение двух версий выполняется в рабочем потоке,
+     * отличия отправляются пачками по мере сравнения.
+     */
+    void processBackupDiff(quint32 requestId, const QByteArray &payload);
+    void sendBackupDiffEntries(quint32 requestId, const std::shared_ptr<ReplyFlow> &replyFlow,
+                               const QList<EmployeeDiff> &entries);
+    void sendBackupDiffEnd(quint32 requestId, bool isSucceeded,
+                           const BackupDiffEngine::Summary &summary, const QString &error);
+
+    void sendFrame(quint16 dataType, quint32 requestId, const QByteArray &payload = QByteArray());
+    void sendFrame(quint16 dataType, quint32 requestId,
+                   const QByteArray &payloadHead, const QByteArray &payloadTail);
+
+private slots:
+    void slotReadyRead();
+    void slotBytesWritten(qint64 bytes);
+    void slotDisconnected();
+
+signals:
+    void finished(ClientSession *session);
+};
+
+#endif // CLIENTSESSION_H
@@ -0,0 +1,73 @@
+#ifndef DELTAUPLOAD_H
+#define DELTAUPLOAD_H
+
+#include "include/BackupStore.h"
+
+#include <QBitArray>
+#include <QPair>
+
+/*
+ * Класс разностной загрузки базы данных на сервер.
+ *
+ * Клиент присылает хеши всех страниц своего файла базы данных,
+ * сервер определяет, каких страниц нет в хранилище, и клиент
+ * присылает только их. Из полученных страниц и страниц, которые
+ * уже были в хранилище, собирается манифест новой версии.
+ *
+ * Методы findMissingPages, storePages и commit работают с диском
+ * и вызываются из пула рабочих потоков, но не одновременно:
+ * сессия клиента ставит следующую задачу только после завершения предыдущей.
+ */
+class DeltaUpload
+{
+public:
+    typedef QPair<quint32, QByteArray> Page;
+
+    DeltaUpload(const QString &dbName, qint64 fileSize, quint32 pageSize, quint32 pageCount);
+
+    /*
+     * Проверяет параметры, присланные клиентом в DeltaUploadOffer.
+     */
+    bool isValid() const;
+
+    bool appendHashes(const QByteArray &hashes);
+    bool hasAllHashes() const { return quint32(m_manifest.pageHashes.size()) == m_pageCount; }
+
+    QString dbName() const { return m_dbName; }
+    QBitArray missingPages() const { return m_missingPages; }
+
+    /*
+     * Отмечает страницы, которых нет в хранилище store,
+     * и возвращает их битовую карту. Найденные в хранилище страницы
+     * защищаются от удаления до сохранения версии.
+     */
+    QBitArray findMissingPages(BackupStore *store);
+
+    /*
+     * Распаковывает присланные страницы (см. Compression),
+     * проверяет их хеши и сохраняет в хранилище.
+     * Возвращает false, если страница не запрашивалась
+     * или ее содержимое не совпадает с хешем.
+     */
+    bool storePages(BackupStore *store, const QList<Page> &pages);
+
+    /*
+     * Проверяет, что получены все недостающие страницы,
+     * и создает в хранилище версию backupFileName.
+     * Возвращает итоговое имя версии или пустую строку при ошибке.
+     */
+    QString commit(BackupStore *store, const QString &backupFileName);
+
+private:
+    QString m_dbName;
+    quint32 m_pageCount = 0;
+
+    BackupStore::Manifest m_manifest;
+
+    QBitArray m_missingPages;
+    QBitArray m_receivedPages;
+
+    qint64 expectedPageSize(quint32 pageIndex) const;
+};
+
+#endif // DELTAUPLOAD_H
@@ -0,0 +1,69 @@
+#ifndef DOWNLOADSTREAM_H
+#define DOWNLOADSTREAM_H
+
+#include <QFile>
+#include <QByteArray>
+#include <QString>
+
+/*
+ * Класс отправляемого клиенту файла базы данных.
+ *
+ * Файл отображается в память (QFile::map), и части для кадров
+ * DatabaseChunk выдаются методом nextChunk без копирования:
+ * QByteArray ссылается прямо на отображенную область.
+ * Единственное копирование происходит в буфер сокета,
+ * поэтому объем памяти на одну отправку не зависит от размера файла,
+ * если сессия передает следующую часть только после того,
+ * как сокет отправил предыдущие.
+ *
+ * Версия, найденная в кэше BackupCache, отправляется
+ * так же, но из содержимого в памяти.
+ */
+class DownloadStream
+{
+public:
+    DownloadStream(const QString &dbFilePath, const QString &dbName);
+    DownloadStream(const QByteArray &dbData, const QString &dbName);
+    ~DownloadStream();
+
+    bool open();
+
+    QString dbName() const { return m_dbName; }
+    qint64 size() const { return m_size; }
+    qint64 offset() const { return m_offset; }
+    bool atEnd() const { return m_offset >= m_size; }
+
+    /*
+     * Пропускает первые offset байт файла, которые клиент
+     * получил до обрыва предыдущей передачи.
+     */
+    void skipTo(qint64 offset) { m_offset = qBound(qint64(0), offset, m_size); }
+
+    /*
+     * Возвращает следующую часть файла размером не более maxChunkSize.
+     * Данные действительны, пока существует объект DownloadStream.
+     */
+    QByteArray nextChunk(qint64 maxChunkSize);
+
+    /*
+     * Возвращает часть файла размером не более maxChunkSize,
+     * начиная с offset. Текущее смещение не изменяется,
+     * поэтому метод можно вызывать из нескольких потоков.
+     */
+    QByteArray chunkAt(qint64 offset, qint64 maxChunkSize) const;
+
+private:
+    QFile m_dbFile;
+    QString m_dbName;
+
+    // Содержимое версии из кэша; пусто, если версия отправляется из файла
+    QByteArray m_dbData;
+    bool m_isInMemory = false;
+
+    uchar *m_pMappedData = nullptr;
+    const char *m_pData = nullptr;
+    qint64 m_size = 0;
+    qint64 m_offset = 0;
+};
+
+#endif // DOWNLOADSTREAM_H
@@ -0,0 +1,24 @@
+#ifndef FILEUTILS_H
+#define FILEUTILS_H
+
+#include <QFile>
+#include <QString>
+
+/*
+ * Вспомогательные функции для надежной записи файлов на диск.
+ */
+namespace FileUtils
+{
+/*
+ * Сбрасывает на диск содержимое открытого файла file.
+ */
+bool syncToDisk(QFile &file);
+
+/*
+ * Сбрасывает на диск запись каталога dirPath,
+ * чтобы переименование файла в нем пережило сбой питания.
+ */
+void syncDirectory(const QString &dirPath);
+}
+
+#endif // FILEUTILS_H
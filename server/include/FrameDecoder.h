@@ -0,0 +1,65 @@
+#ifndef FRAMEDECODER_H
+#define FRAMEDECODER_H
+
+#include "include/TcpDataTypes.h"
+
+#include <QByteArray>
+#include <QIODevice>
+
+/*
+ * Разбор входящих кадров протокола (см. TcpDataTypes.h).
+ *
+ * Декодер - конечный автомат, который сохраняет уже прочитанную
+ * часть кадра между вызовами readFrame. Поэтому кадр, пришедший
+ * несколькими TCP-сегментами, собирается по мере поступления данных,
+ * а не дожидается целиком в буфере сокета.
+ *
+ * Каждое подключение использует собственный декодер.
+ */
+class FrameDecoder
+{
+public:
+    struct Frame
+    {
+        quint16 version = 0;
+        quint16 dataType = 0;
+        quint32 requestId = 0;
+        QByteArray payload;
+    };
+
+    enum Result
+    {
+        NeedMoreData,   // Кадр еще не получен полностью
+        FrameReady,     // Кадр записан в frame
+        InvalidFrame    // Недопустимый размер кадра; подключение нужно разорвать
+    };
+
+    /*
+     * Читает из device доступные данные текущего кадра.
+     * Данные следующего кадра остаются в device.
+     */
+    Result readFrame(QIODevice *device, Frame &frame);
+
+    void reset();
+
+    // Размер кадра, на котором декодер остановился из-за ошибки
+    quint64 frameSize() const { return m_frameSize; }
+
+    /*
+     * Возвращает заголовок кадра с содержимым размером payloadSize.
+     */
+    static QByteArray encodeHeader(quint16 dataType, quint32 requestId, quint64 payloadSize);
+
+private:
+    enum State
+    {
+        ReadingSize,
+        ReadingFrame
+    };
+
+    State m_state = ReadingSize;
+    quint64 m_frameSize = 0;
+    QByteArray m_frameData;
+};
+
+#endif // FRAMEDECODER_H
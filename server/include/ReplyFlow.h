@@ -0,0 +1,36 @@
+#ifndef REPLYFLOW_H
+#define REPLYFLOW_H
+
+#include <QSemaphore>
+#include <QAtomicInt>
+
+/*
+ * Управление потоком ответа, который рабочий поток передает
+ * сессии пачками (сравнение версий, запрос записей).
+ *
+ * Перед передачей каждой пачки рабочий поток вызывает waitForSlot
+ * и ждет, пока сессия не запишет предыдущую пачку в сокет
+ * и в буфере сокета не останется меньше ClientSession::cMaxBytesToWrite
+ * неотправленных байт. Поэтому пачки не накапливаются в очереди
+ * событий и буфере сокета, если клиент читает ответ медленно.
+ *
+ * После отмены запроса или закрытия сессии ожидание прерывается,
+ * а waitForSlot возвращает false.
+ */
+class ReplyFlow
+{
+public:
+    ReplyFlow();
+
+    bool waitForSlot();
+    void releaseSlot();
+
+    void cancel();
+    bool isCanceled() const;
+
+private:
+    QSemaphore m_slots;
+    QAtomicInt m_isCanceled;
+};
+
+#endif // REPLYFLOW_H
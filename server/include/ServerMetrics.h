@@ -0,0 +1,87 @@
+#ifndef SERVERMETRICS_H
+#define SERVERMETRICS_H
+
+#include <QString>
+#include <QMap>
+#include <QVector>
+#include <QMutex>
+
+/*
+ * Реестр метрик сервера: счетчики, текущие значения и распределения
+ * длительностей операций.
+ *
+ * Имя ряда может содержать метки в формате Prometheus,
+ * например ea_requests_total{type="Database"}; для их записи
+ * используется labeled. Распределения хранятся в корзинах
+ * с шагом 2^(1/4), поэтому квантили p50 и p99 вычисляются
+ * с погрешностью не более 19% без хранения всех значений.
+ *
+ * toText возвращает все метрики в текстовом формате Prometheus.
+ * Сервер периодически записывает его в файл metrics.prom
+ * и отправляет клиенту в ответ на StatsRequest.
+ *
+ * Все методы потокобезопасны.
+ */
+class ServerMetrics
+{
+public:
+    ServerMetrics() = default;
+
+    void incrementCounter(const QString &name, qint64 value = 1);
+
+    /*
+     * Записывает значение счетчика, который ведется в другом месте
+     * (например, попадания в кэш версий).
+     */
+    void setCounter(const QString &name, qint64 value);
+    void setGauge(const QString &name, qint64 value);
+    void addToGauge(const QString &name, qint64 delta);
+
+    /*
+     * Добавляет в распределение name длительность seconds секунд.
+     */
+    void observe(const QString &name, double seconds);
+
+    QString toText() const;
+
+    static QString labeled(const QString &name, const QString &labelName, const QString &labelValue);
+
+    /*
+     * Имя типа данных TcpDataType для меток.
+     */
+    static QString dataTypeName(quint16 dataType);
+
+    /*
+     * Процессорное время процесса (пользовательское и системное)
+     * в микросекундах с момента его запуска.
+     */
+    static qint64 processCpuMicroseconds();
+
+private:
+    struct Histogram
+    {
+        QVector<qint64> buckets;
+        qint64 count = 0;
+        double sum = 0;
+        double max = 0;
+
+        double quantile(double q) const;
+    };
+
+    mutable QMutex m_mutex;
+
+    // QMap хранит ряды одной метрики рядом, что нужно для toText
+    QMap<QString, qint64> m_counters;
+    QMap<QString, qint64> m_gauges;
+    QMap<QString, Histogram> m_histograms;
+
+    static const int cBucketCount;
+    static const double cFirstBucketBound;
+
+    static int bucketIndex(double seconds);
+    static double bucketBound(int index);
+    static QString baseName(const QString &name);
+    static QString withLabel(const QString &name, const QString &label);
+};
+
+#endif // SERVERMETRICS_H
@@ -1,34 +1,377 @@
 #ifndef TCPDATATYPES_H
 #define TCPDATATYPES_H
 
+#include <QtGlobal>
+#include <QString>
+#include <QByteArray>
+#include <QStringList>
+#include <QVariant>
+#include <QDataStream>
+
+/*
+ * Параметры протокола обмена данными между клиентом и сервером.
+ *
+ * Данные передаются кадрами. Каждый кадр начинается с заголовка:
+ * - quint64 - размер кадра без учета этого поля;
+ * - quint16 - версия протокола cVersion;
+ * - quint16 - тип данных TcpDataType;
+ * - quint32 - номер запроса.
+ * После заголовка следует содержимое кадра.
+ *
+ * Клиент присваивает каждому запросу новый номер, а все кадры ответа
+ * сервера (и все кадры одной передачи файла) несут номер этого запроса.
+ * Поэтому клиент может отправить несколько запросов, не дожидаясь ответов,
+ * и сопоставить ответы с запросами, даже если они приходят в другом порядке.
+ *
+ * Файл базы данных передается последовательностью кадров:
+ * Database с именем и размером файла, несколько кадров DatabaseChunk
+ * с частями файла размером не более cChunkSize и кадр DatabaseEnd.
+ * Поэтому размер файла не ограничен размером одного кадра,
+ * а принимающая сторона может обрабатывать части по мере их поступления.
+ *
+ * Прерванная передача продолжается с места обрыва:
+ * - при загрузке на сервер кадр Database содержит также номер передачи
+ *   (QUuid, 16 байт) и хеш SHA-256 всего файла. Сервер хранит полученную
+ *   часть во временном файле и отвечает UploadResumeOffset - количеством
+ *   байт, уже записанных на диск; клиент продолжает отправку с этого места;
+ * - при получении с сервера SelectedDatabaseName содержит количество
+ *   уже полученных байт и хеш содержимого версии из BackupInfo.
+ *   Если хеш совпадает, сервер продолжает отправку с этого места;
+ *   Database от сервера содержит имя, размер, начальное смещение и хеш.
+ *   Если версию не удалось открыть, сервер отвечает DatabaseSendFailure
+ *   с описанием ошибки вместо Database.
+ * Разностная загрузка продолжается сама собой: страницы, сохраненные
+ * до обрыва, уже есть в хранилище и повторно не запрашиваются.
+ *
+ * Части файла в кадрах DatabaseChunk и DeltaUploadPage могут быть сжаты
+ * (см. Compression). Алгоритм сжатия выбирается после подключения:
+ * клиент отправляет Hello со списком поддерживаемых алгоритмов,
+ * сервер отвечает HelloAck с выбранным.
+ *
+ * Разностная загрузка базы данных на сервер:
+ * 1) клиент отправляет DeltaUploadOffer с именем, размером файла,
+ *    размером и количеством страниц, затем кадры DeltaUploadHashes
+ *    с хешами SHA-256 всех страниц файла по порядку;
+ * 2) сервер отвечает DeltaUploadMissingPages - битовой картой страниц,
+ *    которых нет в его хранилище;
+ * 3) клиент отправляет только эти страницы кадрами DeltaUploadPage
+ *    и завершает загрузку кадром DeltaUploadEnd;
+ * 4) сервер собирает новую версию и отвечает
+ *    DatabaseFileCreationSuccess или DatabaseFileCreationFailure.
+ *
+ * Список версий запрашивается постранично. DatabasesListRequest содержит
+ * фильтр по имени организации (пустая строка - все организации),
+ * границы времени сохранения from и to в мс от начала эпохи (0 - без границы),
+ * курсор страницы (0 - первая страница) и наибольшее количество записей.
+ * DatabasesList содержит список BackupInfo от новых версий к старым
+ * и курсор следующей страницы (0 - страниц больше нет).
+ *
+ * На StatsRequest сервер отвечает кадром Stats - строкой с метриками
+ * сервера в текстовом формате Prometheus.
+ *
+ * Отдельные записи сохраненной версии запрашиваются без получения
+ * всего файла: клиент отправляет BackupQueryRequest с BackupQuery,
+ * сервер выполняет запрос только для чтения над файлом версии
+ * и присылает найденные записи кадрами BackupQueryRows - пачками
+ * не больше cQueryBatchRows записей одной таблицы, после чего
+ * отправляет BackupQueryEnd: признак успеха, количество записей
+ * и описание ошибки.
+ *
+ * Для просмотра версии без ее получения клиент читает файл версии
+ * по частям: DatabaseRangeRequest содержит имя версии, смещение
+ * и длину (не больше cMaxRangeSize; 0 - только размер файла).
+ * DatabaseRange содержит признак того, что версия найдена, размер файла
+ * и смещение, за которыми без разделителя следует часть файла
+ * в формате Compression.
+ *
+ * Две сохраненные версии сравниваются на сервере: BackupDiffRequest
+ * содержит имена старой и новой версий. Сервер отвечает кадрами
+ * BackupDiffEntries - списками EmployeeDiff не длиннее cDiffBatchEntries
+ * в порядке возрастания номеров сотрудников, после чего отправляет
+ * BackupDiffEnd: признак успеха, количество добавленных, удаленных
+ * и измененных сотрудников и описание ошибки.
+ *
+ * CancelRequest несет номер отменяемого запроса и не имеет содержимого.
+ * Сервер прекращает отправку или прием базы данных, разностную
+ * загрузку, запрос записей или сравнение версий с этим номером
+ * и ничего не отвечает; кадры, отправленные до отмены, получатель
+ * пропускает.
+ */
+namespace TcpProtocol
+{
+const quint16 cVersion = 10;
+
+// Размер полей версии, типа данных и номера запроса в заголовке кадра
+const quint64 cHeaderSize = sizeof(quint16) + sizeof(quint16) + sizeof(quint32);
+
+// Максимальный размер части файла в кадре DatabaseChunk
+const qint64 cChunkSize = 1024 * 1024;
+
+// Кадры большего размера считаются ошибкой протокола
+const quint64 cMaxFrameSize = cHeaderSize + cChunkSize + 64 * 1024;
+
+// Размер хеша страницы (SHA-256) в кадрах разностной загрузки
+const int cPageHashSize = 32;
+
+// Наибольшее количество хешей страниц в одном кадре DeltaUploadHashes
+const int cMaxHashesPerFrame = int(cChunkSize / cPageHashSize);
+
+// Наибольшее количество записей на одной странице списка версий
+const quint32 cMaxListPageSize = 1000;
+
+// Наибольшее количество записей в одном кадре BackupQueryRows
+const int cQueryBatchRows = 256;
+
+// Наибольшее количество записей в ответе на один BackupQuery
+const quint32 cMaxQueryRows = 10000;
+
+// Наибольшая длина части файла в ответе на DatabaseRangeRequest
+const qint32 cMaxRangeSize = 256 * 1024;
+
+// Наибольшее количество сотрудников в одном кадре BackupDiffEntries
+const int cDiffBatchEntries = 256;
+}
+
+/*
+ * Описание версии базы данных, хранящейся на сервере.
+ */
+struct BackupInfo
+{
+    /*
+     * Результат проверки целостности версии на сервере.
+     */
+    enum VerificationStatus : qint8
+    {
+        NotVerified = -1,        // Проверка еще не выполнялась
+        Verified = 0,            // Файл является базой данных программы
+        Corrupted = 1            // Файл поврежден или имеет другую схему
+    };
+
+    qint64 id = 0;               // Номер версии в каталоге сервера
+    QString fileName;            // "Имя день-месяц-год--час-минуты-cекунды.db"
+    QString orgName;             // Имя организации
+    qint64 createdAt = 0;        // Время сохранения, мс от начала эпохи
+    qint64 size = 0;             // Размер файла базы данных
+    QByteArray hash;             // SHA-256 списка хешей страниц версии
+    qint32 employeeCount = -1;   // Количество сотрудников, -1 - неизвестно
+    qint8 verificationStatus = NotVerified;
+};
+
+inline QDataStream &operator<<(QDataStream &out, const BackupInfo &info)
+{
+    out << info.id << info.fileName << info.orgName << info.createdAt
+        << info.size << info.hash << info.employeeCount << info.verificationStatus;
+
+    return out;
+}
+
+inline QDataStream &operator>>(QDataStream &in, BackupInfo &info)
+{
+    in >> info.id >> info.fileName >> info.orgName >> info.createdAt
+       >> info.size >> info.hash >> info.employeeCount >> info.verificationStatus;
+
+    return in;
+}
+
+/*
+ * Запрос записей сохраненной версии базы данных.
+ */
+struct BackupQuery
+{
+    enum Kind : quint8
+    {
+        EmployeeById,         // Записи сотрудника с номером argument во всех таблицах
+        EmployeesBySurname,   // Записи таблицы "Общая информация",
+                              // фамилия в которых начинается с argument
+        Table                 // Все записи таблицы argument
+    };
+
+    QString backupFileName;      // Версия из BackupInfo::fileName
+    quint8 kind = EmployeeById;
+    QString argument;
+    quint32 limit = 0;           // Наибольшее количество записей, 0 - cMaxQueryRows
+};
+
+inline QDataStream &operator<<(QDataStream &out, const BackupQuery &query)
+{
+    out << query.backupFileName << query.kind << query.argument << query.limit;
+
+    return out;
+}
+
+inline QDataStream &operator>>(QDataStream &in, BackupQuery &query)
+{
+    in >> query.backupFileName >> query.kind >> query.argument >> query.limit;
+
+    return in;
+}
+
+/*
+ * Пачка найденных записей одной таблицы.
+ * Значения каждой записи идут в порядке столбцов columns.
+ */
+struct BackupQueryBatch
+{
+    QString tableName;
+    QStringList columns;
+    QList<QVariantList> rows;
+};
+
+inline QDataStream &operator<<(QDataStream &out, const BackupQueryBatch &batch)
+{
+    out << batch.tableName << batch.columns << batch.rows;
+
+    return out;
+}
+
+inline QDataStream &operator>>(QDataStream &in, BackupQueryBatch &batch)
+{
+    in >> batch.tableName >> batch.columns >> batch.rows;
+
+    return in;
+}
+
+/*
+ * Отличие сотрудника в новой версии базы данных от старой.
+ */
+struct EmployeeDiff
+{
+    enum Kind : quint8
+    {
+        Added,      // Сотрудник есть только в новой версии
+        Removed,    // Сотрудник есть только в старой версии
+        Changed     // Значения полей сотрудника различаются
+    };
+
+    /*
+     * Различающееся поле одной из таблиц. Если записи сотрудника
+     * в таблице одной из версий нет, ее значение - пустой QVariant.
+     */
+    struct FieldChange
+    {
+        QString tableName;
+        QString fieldName;
+        QVariant oldValue;
+        QVariant newValue;
+    };
+
+    qint32 employeeId = 0;
+    quint8 kind = Changed;
+    QString employeeName;           // Фамилия, имя и отчество
+    QList<FieldChange> changes;     // Заполняется только для Changed
+};
+
+inline QDataStream &operator<<(QDataStream &out, const EmployeeDiff::FieldChange &change)
+{
+    out << change.tableName << change.fieldName << change.oldValue << change.newValue;
+
+    return out;
+}
+
+inline QDataStream &operator>>(QDataStream &in, EmployeeDiff::FieldChange &change)
+{
+    in >> change.tableName >> change.fieldName >> change.oldValue >> change.newValue;
+
+    return in;
+}
+
+inline QDataStream &operator<<(QDataStream &out, const EmployeeDiff &diff)
+{
+    out << diff.employeeId << diff.kind << diff.employeeName << diff.changes;
+
+    return out;
+}
+
+inline QDataStream &operator>>(QDataStream &in, EmployeeDiff &diff)
+{
+    in >> diff.employeeId >> diff.kind >> diff.employeeName >> diff.changes;
+
+    return in;
+}
+
 /*
  * Содержит типы данных, передаваемых по протоколу TCP.
  * Это необходимо, чтобы понять тип передаваемого блок аданных.
  *
- * Записывается в блок передаваемых данных после записи его размера.
- * Считывается после считывания размера присылаемого блока данных.
+ * Записывается в заголовок кадра после версии протокола.
+ * Считывается после считывания размера кадра и версии протокола.
  */
 enum TcpDataType{
     Unknown,                      // Тип данных неизвестен
 
 
-    Database,                     // База данных
+    Database,                     // Начало передачи базы данных:
+                                  // имя базы данных, размер файла
+                                  // и параметры продолжения передачи
 
 
-    DatabasesList,                // Список баз данных, хранящихся на сервере
+    DatabasesList,                // Страница списка версий баз данных,
+                                  // хранящихся на сервере
 
 
-    DatabasesListRequest,         // Запрос от клиента на получение списка
-                                  // хранящихся на сервере баз данных
+    DatabasesListRequest,         // Запрос от клиента на получение страницы списка
+                                  // хранящихся на сервере баз данных с фильтрами
 
     SelectedDatabaseName,         // Имя выбранной клиентом базы данных,
-                                  // которую он хочет получить от сервера
+                                  // которую он хочет получить от сервера,
+                                  // количество уже полученных байт и хеш
 
     DatabaseFileCreationSuccess,  // Сообщение от сервера об успешном создании
                                   // файла с базой данных, которую прислал клиент
 
     DatabaseFileCreationFailure,  // Сообщение от сервера о том, что
                                   // создание файла с присланной базой данных прошло неудачно
+
+    DatabaseChunk,                // Очередная часть файла базы данных
+
+    DatabaseEnd,                  // Конец передачи базы данных
+
+    DeltaUploadOffer,             // Начало разностной загрузки: имя базы данных,
+                                  // размер файла, размер и количество страниц
+
+    DeltaUploadHashes,            // Очередная часть списка хешей страниц
+
+    DeltaUploadMissingPages,      // Битовая карта страниц, которых нет на сервере
+
+    DeltaUploadPage,              // Номер страницы и ее содержимое
+
+    DeltaUploadEnd,               // Конец разностной загрузки
+
+    Hello,                        // Список алгоритмов сжатия, поддерживаемых клиентом
+
+    HelloAck,                     // Алгоритм сжатия, выбранный сервером
+
+    UploadResumeOffset,           // Смещение, с которого клиент
+                                  // продолжает загрузку базы данных
+
+    StatsRequest,                 // Запрос метрик сервера
+
+    Stats,                        // Метрики сервера в формате Prometheus
+
+    BackupQueryRequest,           // Запрос записей сохраненной версии (BackupQuery)
+
+    BackupQueryRows,              // Пачка найденных записей (BackupQueryBatch)
+
+    BackupQueryEnd,               // Конец ответа на запрос записей: признак успеха,
+                                  // количество записей и описание ошибки
+
+    DatabaseRangeRequest,         // Запрос части файла версии: имя, смещение и длина
+
+    DatabaseRange,                // Признак наличия версии, размер файла, смещение
+                                  // и часть файла
+
+    BackupDiffRequest,            // Имена старой и новой версий для сравнения
+
+    BackupDiffEntries,            // Пачка отличий сотрудников (EmployeeDiff)
+
+    BackupDiffEnd,                // Конец сравнения: признак успеха, количество
+                                  // добавленных, удаленных и измененных сотрудников
+                                  // и описание ошибки
+
+    CancelRequest,                // Отмена запроса с номером из заголовка кадра
+
+    DatabaseSendFailure,          // Сообщение от сервера о том, что запрошенную
+                                  // базу данных не удалось открыть, и описание ошибки
 };
 
 #endif // TCPDATATYPES_H
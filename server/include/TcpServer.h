@@ -2,14 +2,49 @@
 #define TCPSERVER_H
 
 #include "include/TcpDataTypes.h"
+#include "include/BackupStore.h"
+#include "include/BackupCatalog.h"
+#include "include/BackupCache.h"
+#include "include/BackupRetention.h"
+#include "include/ServerMetrics.h"
+#include "include/TransferScheduler.h"
 
 #include <QTcpServer>
-#include <QTcpSocket>
+#include <QThreadPool>
 #include <QDir>
+#include <QSet>
+#include <QTimer>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+
+class ClientSession;
+class DownloadStream;
 
 /*
  * Класс сервера, обеспечивающего
- * обмен данными с одним клиентом по протоколу TCP.
+ * обмен данными с клиентами по протоколу TCP.
+ *
+ * Для каждого подключения создается отдельная сессия ClientSession,
+ * поэтому сервер одновременно обслуживает несколько клиентов.
+ * Работа с диском (запись и чтение файлов баз данных,
+ * просмотр папки databases) выполняется в ограниченном пуле рабочих потоков,
+ * чтобы медленная загрузка одного клиента не задерживала остальных.
+ *
+ * Версии баз данных хранятся в хранилище BackupStore
+ * с дедупликацией страниц, а их описания - в каталоге BackupCatalog.
+ * Устаревшие версии удаляются по политике хранения BackupRetention
+ * в отдельном потоке обслуживания.
+ *
+ * Пропускная способность и память для передаваемых частей файлов
+ * распределяются между подключениями планировщиком TransferScheduler.
+ * В пуле рабочих потоков задачи управляющих запросов (список версий,
+ * открытие и сохранение версии) выполняются раньше записи и сжатия частей.
+ *
+ * Метрики сервера собираются в ServerMetrics и раз в DumpIntervalSeconds
+ * секунд (группа [Metrics] файла server.ini, 0 - не записывать)
+ * записываются в файл DumpFile (по умолчанию metrics.prom рядом с программой).
  *
  * В его задачи входят:
  *
@@ -31,20 +66,127 @@ public:
     TcpServer();
     ~TcpServer();
 
+    enum TaskPriority
+    {
+        BulkTaskPriority,     // Запись и сжатие частей файлов
+        ControlTaskPriority   // Остальные задачи
+    };
+
+    /*
+     * Ставит задачу в очередь пула рабочих потоков.
+     * Задача не должна обращаться к сокетам сессий напрямую,
+     * результат передается в сессию через QMetaObject::invokeMethod.
+     */
+    void runInWorkerPool(std::function<void()> task, TaskPriority priority = ControlTaskPriority);
+
+    /*
+     * Планировщик передачи частей файлов. Только для основного потока.
+     */
+    TransferScheduler *transferScheduler() { return &m_transferScheduler; }
+
+    /*
+     * Следующие методы потокобезопасны
+     * и вызываются из рабочих потоков.
+     */
+    QString databasesPath() const { return m_databasesPath; }
+    BackupStore *backupStore() { return &m_backupStore; }
+    BackupCatalog *backupCatalog() { return &m_backupCatalog; }
+    ServerMetrics *metrics() { return &m_metrics; }
+    QString newBackupFileName(const QString &dbName) const;
+
+    /*
+     * Добавляет сохраненную в хранилище версию в каталог.
+     */
+    bool registerBackup(const QString &backupFileName);
+
+    /*
+     * Проверяет целостность файла dbFilePath версии backupFileName
+     * и записывает результат в каталог. Вызывается после ответа клиенту.
+     */
+    void verifyBackup(const QString &backupFileName, const QString &dbFilePath);
+
+    /*
+     * Открывает версию backupFileName для отправки клиенту:
+     * из кэша, если она там есть, иначе из восстановленного файла.
+     * В contentHash записывается хеш содержимого версии.
+     */
+    std::shared_ptr<DownloadStream> openBackup(const QString &backupFileName, QByteArray &contentHash);
+
+    /*
+     * Если версия backupFileName еще не проверялась, проверяет ее
+     * в рабочем потоке. Вызывается, когда файл версии восстановлен
+     * по запросу клиента, поэтому сохранение версии не требует
+     * восстанавливать ее файл только ради проверки.
+     */
+    void verifyOnFirstRestore(const QString &backupFileName);
+    QString getDatabaseNameOnly(QString dbFileName) const;
+
+    /*
+     * Отмечает, что сессия передала или получила данные клиента.
+     * Пока передача идет, обслуживание хранилища приостановлено.
+     */
+    void noteTransferActivity();
+    bool isTransferActive() const;
+
+    /*
+     * Обновляет текущие значения метрик и возвращает их
+     * в формате Prometheus. Вызывается из основного потока.
+     */
+    QString metricsText();
+
 private:
-    QTcpSocket *m_pClientSocket;
-    QDir m_databasesDirectory;
-
-    void sendDatabase(const QFileInfo &dbFileInfo);
-    void sendDatabaseFileCreationResult(bool dbFileCreated);
-    void sendDatabasesList();
-    bool createNewDatabaseFile(const QByteArray &dbInBytes, QString dbName);
-    QString getDatabaseNameOnly(QString dbFileName);
-    QString getDateAndTimeForName();
-
-public slots:
-    void incomingConnection(qintptr socketDescriptor);
-    void slotReadyRead();
+    /*
+     * Путь к папке databases. Рабочие потоки создают
+     * собственные объекты QDir по этому пути, так как QDir
+     * не является потокобезопасным.
+     */
+    QString m_databasesPath;
+
+    BackupStore m_backupStore;
+    BackupCatalog m_backupCatalog;
+    BackupCache m_backupCache;
+    BackupRetention m_backupRetention;
+    ServerMetrics m_metrics;
+    TransferScheduler m_transferScheduler;
+
+    QThreadPool m_workerPool;
+
+    /*
+     * Отдельный поток обслуживания хранилища. Обслуживание подолгу
+     * ждет окончания передач клиентов и не должно занимать рабочие потоки.
+     */
+    QThreadPool m_maintenancePool;
+    QTimer m_retentionTimer;
+
+    /*
+     * Время последней передачи данных клиентам
+     * в миллисекундах с начала эпохи.
+     */
+    std::atomic<qint64> m_lastTransferActivity { 0 };
+
+    QTimer m_metricsDumpTimer;
+    QString m_metricsFilePath;
+
+    static const qint64 cTransferIdleTime;
+
+    QSet<ClientSession *> m_sessions;
+
+    /*
+     * Периодически удаляет временные файлы прерванных загрузок,
+     * которые клиенты так и не продолжили.
+     */
+    QTimer m_uploadsCleanupTimer;
+
+    static QString getDateAndTimeForName();
+
+    void removeExpiredUploads();
+    void dumpMetrics();
+
+protected:
+    void incomingConnection(qintptr socketDescriptor) override;
+
+private slots:
+    void slotSessionFinished(ClientSession *session);
 };
 
 #endif // TCPSERVER_H
@@ -0,0 +1,95 @@
+#ifndef TRANSFERSCHEDULER_H
+#define TRANSFERSCHEDULER_H
+
+#include "include/TcpDataTypes.h"
+
+#include <QString>
+#include <QHash>
+#include <QList>
+
+class ClientSession;
+
+/*
+ * Распределение пропускной способности сервера между подключениями.
+ *
+ * Части файлов баз данных (отправляемые клиенту и получаемые от него)
+ * передаются только по разрешениям планировщика. Каждое разрешение
+ * занимает cGrantSize байт общего бюджета, пока данные не покинут сервер:
+ * отправляемая часть - пока не будет передана сокетом в ядро,
+ * полученная - пока не будет записана на диск. Поэтому общий объем данных
+ * клиентов в памяти сервера не превышает бюджет.
+ *
+ * Ожидающие подключения получают разрешения по очереди справедливого
+ * взвешенного обслуживания: следующим обслуживается подключение
+ * с наименьшим виртуальным временем, которое растет на cGrantSize / вес
+ * с каждым разрешением. Поэтому клиент, загружающий большой архив,
+ * получает не больше своей доли, а остальные не ждут окончания его загрузки.
+ *
+ * Небольшие управляющие кадры (списки версий, результаты сохранения и т. п.)
+ * разрешений не требуют и отправляются сразу.
+ *
+ * Параметры задаются в файле server.ini рядом с программой:
+ *
+ * [Transfers]
+ * InFlightBytes=67108864        ; общий бюджет
+ * SessionReadQuotaBytes=4194304 ; полученные, но не записанные данные одного подключения
+ *
+ * Методы вызываются только из основного потока.
+ */
+class TransferScheduler
+{
+public:
+    struct Settings
+    {
+        qint64 inFlightBytes = 64 * 1024 * 1024;
+        qint64 sessionReadQuota = 4 * 1024 * 1024;
+    };
+
+    static Settings loadSettings(const QString &settingsFilePath);
+
+    void setSettings(const Settings &settings) { m_settings = settings; }
+    const Settings &settings() const { return m_settings; }
+
+    void addSession(ClientSession *session, int weight = 1);
+
+    /*
+     * Освобождает все, что занимало подключение.
+     */
+    void removeSession(ClientSession *session);
+
+    /*
+     * Ставит подключение в очередь на разрешение. Разрешение передается
+     * вызовом ClientSession::transferGranted через очередь событий,
+     * даже если бюджета достаточно, поэтому сессия не получает его
+     * посреди собственного цикла отправки или разбора кадров.
+     */
+    void requestGrant(ClientSession *session);
+
+    /*
+     * Возвращает в бюджет bytes байт, занятых разрешениями подключения.
+     */
+    void release(ClientSession *session, qint64 bytes);
+
+    qint64 inFlightBytes() const { return m_inFlightBytes; }
+    int waitingSessionsCount() const { return m_waitingSessions.size(); }
+
+    static const qint64 cGrantSize;
+
+private:
+    struct SessionState
+    {
+        int weight = 1;
+        qint64 virtualFinishTime = 0;
+        qint64 heldBytes = 0;
+    };
+
+    Settings m_settings;
+    QHash<ClientSession *, SessionState> m_sessions;
+    QList<ClientSession *> m_waitingSessions;
+    qint64 m_inFlightBytes = 0;
+    qint64 m_virtualTime = 0;
+
+    void dispatch();
+};
+
+#endif // TRANSFERSCHEDULER_H
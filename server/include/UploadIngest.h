@@ -0,0 +1,94 @@
+#ifndef UPLOADINGEST_H
+#define UPLOADINGEST_H
+
+#include <QFile>
+#include <QString>
+#include <QByteArray>
+#include <QSet>
+#include <QMutex>
+
+/*
+ * Класс приема загружаемой клиентом базы данных на диск.
+ *
+ * Части файла дописываются во временный файл ".part" в папке databases
+ * по мере их поступления, поэтому в памяти сервера
+ * никогда не находится весь файл целиком.
+ * После получения последней части хранилище BackupStore создает
+ * из временного файла новую версию базы данных, надежно записывая
+ * на диск ее страницы и манифест.
+ *
+ * Имя временного файла составляется из номера передачи и хеша файла.
+ * Если передача прервалась, файл остается на диске, и после
+ * переподключения клиент продолжает загрузку с resumeOffset.
+ * Временные файлы, которые долго не изменялись, удаляет сервер
+ * (см. TcpServer::removeExpiredUploads). Завершенная или
+ * отброшенная загрузка удаляет файл вместе с объектом.
+ *
+ * Методы append и finish выполняют запись на диск и вызываются
+ * из пула рабочих потоков, но не одновременно: сессия клиента
+ * передает следующую часть только после записи предыдущей.
+ */
+class UploadIngest
+{
+public:
+    UploadIngest(const QString &databasesPath, const QString &dbName, qint64 expectedSize,
+                 const QByteArray &transferId, const QByteArray &contentHash);
+    ~UploadIngest();
+
+    /*
+     * Открывает временный файл. Если он остался от прерванной
+     * передачи, запись продолжается с его конца.
+     */
+    bool open();
+    bool append(const QByteArray &chunk);
+
+    /*
+     * Проверяет, что получен весь файл и его хеш совпадает
+     * с заявленным, и закрывает его.
+     */
+    bool finish();
+
+    /*
+     * Временный файл будет удален вместе с объектом,
+     * даже если передача не завершена.
+     */
+    void discard() { m_isResumable = false; }
+
+    QString dbName() const { return m_dbName; }
+    QString partFilePath() const { return m_partFile.fileName(); }
+    qint64 expectedSize() const { return m_expectedSize; }
+    qint64 writtenSize() const { return m_writtenSize; }
+
+    // Количество байт, полученных до обрыва предыдущей передачи
+    qint64 resumeOffset() const { return m_resumeOffset; }
+
+    /*
+     * Возвращает true, если временный файл сейчас принимает данные.
+     */
+    static bool isActive(const QString &partFilePath);
+
+    static const QString cPartFileSuffix;
+
+    // Через сколько секунд без изменений удаляется временный файл
+    static const qint64 cPartFileTimeout;
+
+    // Через сколько байт данные принудительно записываются на диск
+    static const qint64 cSyncInterval;
+
+private:
+    QString m_dbName;
+    qint64 m_expectedSize = 0;
+    qint64 m_writtenSize = 0;
+    qint64 m_resumeOffset = 0;
+    qint64 m_syncedSize = 0;
+    QByteArray m_contentHash;
+    bool m_isResumable = false;
+    bool m_isActive = false;
+
+    QFile m_partFile;
+
+    static QSet<QString> s_activePartFiles;
+    static QMutex s_activePartFilesMutex;
+};
+
+#endif // UPLOADINGEST_H
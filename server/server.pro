@@ -1,5 +1,5 @@
 QT -= gui
-QT += core network
+QT += core network sql
 
 CONFIG += c++11 console
 CONFIG -= app_bundle
@@ -8,9 +8,58 @@ INCLUDEPATH += \
     include
 
 SOURCES += \
+        src/AsyncLogger.cpp \
+        src/BackupCache.cpp \
+        src/BackupCatalog.cpp \
+        src/BackupDiffEngine.cpp \
+        src/BackupQueryExecutor.cpp \
+        src/BackupRetention.cpp \
+        src/BackupStore.cpp \
+        src/BackupVerifier.cpp \
+        src/ClientSession.cpp \
+        src/Compression.cpp \
+        src/DeltaUpload.cpp \
+        src/DownloadStream.cpp \
+        src/FileUtils.cpp \
+        src/FrameDecoder.cpp \
+        src/ReplyFlow.cpp \
+        src/ServerMetrics.cpp \
         src/TcpServer.cpp \
+        src/TransferScheduler.cpp \
+        src/UploadIngest.cpp \
         src/main.cpp
 
 HEADERS += \
+    include/AsyncLogger.h \
+    include/BackupCache.h \
+    include/BackupCatalog.h \
+    include/BackupDiffEngine.h \
+    include/BackupQueryExecutor.h \
+    include/BackupRetention.h \
+    include/BackupStore.h \
+    include/BackupVerifier.h \
+    include/ClientSession.h \
+    include/Compression.h \
+    include/DatabaseCreation.h \
+    include/DeltaUpload.h \
+    include/DownloadStream.h \
+    include/FileUtils.h \
+    include/FrameDecoder.h \
+    include/ReplyFlow.h \
+    include/ServerMetrics.h \
     include/TcpDataTypes.h \
-    include/TcpServer.h
+    include/TcpServer.h \
+    include/TransferScheduler.h \
+    include/UploadIngest.h
+
+packagesExist(liblz4) {
+    CONFIG += link_pkgconfig
+    PKGCONFIG += liblz4
+    DEFINES += HAVE_LZ4
+}
+
+packagesExist(libzstd) {
+    CONFIG += link_pkgconfig
+    PKGCONFIG += libzstd
+    DEFINES += HAVE_ZSTD
+}
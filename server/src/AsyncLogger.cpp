@@ -0,0 +1,262 @@
+#include "AsyncLogger.h"
+
+#include <QThread>
+#include <QDateTime>
+
+#include <cstdio>
+#include <cstdlib>
+
+const int AsyncLogger::cDefaultCapacity = 8192;
+const int AsyncLogger::cIdleSleepTime = 10;
+
+std::atomic<AsyncLogger *> AsyncLogger::s_pInstance { nullptr };
+
+namespace
+{
+/*
+ * Размер кольцевого буфера округляется вверх до степени двойки,
+ * чтобы номер ячейки вычислялся маской.
+ */
+quint64 roundUpToPowerOfTwo(int capacity)
+{
+    quint64 roundedCapacity = 2;
+    while (roundedCapacity < quint64(qMax(capacity, 2)))
+        roundedCapacity <<= 1;
+
+    return roundedCapacity;
+}
+}
+
+AsyncLogger::AsyncLogger(Level minimumLevel, int capacity)
+    : m_slots(new Slot[roundUpToPowerOfTwo(capacity)])
+    , m_mask(roundUpToPowerOfTwo(capacity) - 1)
+    , m_minimumLevel(minimumLevel)
+{
+    // Ячейка свободна для записи с номером, равным ее последовательности
+    for (quint64 i = 0; i <= m_mask; i++)
+        m_slots[i].sequence.store(i, std::memory_order_relaxed);
+}
+
+AsyncLogger::~AsyncLogger()
+{
+    if (!m_pDrainThread)
+        return;
+
+    qInstallMessageHandler(m_previousHandler);
+    s_pInstance = nullptr;
+
+    m_isStopping = true;
+    m_pDrainThread->wait();
+    delete m_pDrainThread;
+
+    // Записи, добавленные после остановки потока вывода
+    drainAvailable();
+}
+
+void AsyncLogger::install()
+{
+    if (m_pDrainThread)
+        return;
+
+    m_pDrainThread = QThread::create([this]()
+    {
+        drain();
+    });
+    m_pDrainThread->start(QThread::LowPriority);
+
+    s_pInstance = this;
+    m_previousHandler = qInstallMessageHandler(&AsyncLogger::messageHandler);
+}
+
+bool AsyncLogger::push(Record &&record)
+{
+    quint64 position = m_enqueuePosition.load(std::memory_order_relaxed);
+    Slot *pSlot = nullptr;
+
+    for (;;)
+    {
+        pSlot = &m_slots[position & m_mask];
+        const quint64 sequence = pSlot->sequence.load(std::memory_order_acquire);
+        const qint64 difference = qint64(sequence) - qint64(position);
+
+        if (difference == 0)
+        {
+            if (m_enqueuePosition.compare_exchange_weak(position, position + 1,
+                                                        std::memory_order_relaxed))
+                break;
+        }
+        else if (difference < 0)
+        {
+            // Поток вывода еще не освободил ячейку: буфер заполнен
+            return false;
+        }
+        else
+        {
+            position = m_enqueuePosition.load(std::memory_order_relaxed);
+        }
+    }
+
+    pSlot->record = std::move(record);
+    pSlot->sequence.store(position + 1, std::memory_order_release);
+
+    return true;
+}
+
+bool AsyncLogger::pop(Record &record)
+{
+    Slot &slot = m_slots[m_dequeuePosition & m_mask];
+
+    if (slot.sequence.load(std::memory_order_acquire) != m_dequeuePosition + 1)
+        return false;
+
+    record = std::move(slot.record);
+    slot.record = Record();
+    slot.sequence.store(m_dequeuePosition + m_mask + 1, std::memory_order_release);
+    m_dequeuePosition++;
+
+    return true;
+}
+
+void AsyncLogger::drain()
+{
+    while (!m_isStopping)
+    {
+        drainAvailable();
+        QThread::msleep(cIdleSleepTime);
+    }
+
+    drainAvailable();
+}
+
+void AsyncLogger::drainAvailable()
+{
+    Record record;
+    bool isWritten = false;
+
+    while (pop(record))
+    {
+        write(format(record));
+        isWritten = true;
+    }
+
+    const quint64 droppedCount = m_droppedCount;
+    if (droppedCount != m_reportedDroppedCount)
+    {
+        Record droppedRecord;
+        droppedRecord.time = QDateTime::currentMSecsSinceEpoch();
+        droppedRecord.level = LevelWarning;
+        droppedRecord.threadId = quintptr(QThread::currentThreadId());
+        droppedRecord.message = QString("Журнал переполнен, пропущено строк: %1")
+                .arg(droppedCount - m_reportedDroppedCount);
+
+        write(format(droppedRecord));
+        m_reportedDroppedCount = droppedCount;
+        isWritten = true;
+    }
+
+    if (isWritten)
+        std::fflush(stderr);
+}
+
+void AsyncLogger::messageHandler(QtMsgType type, const QMessageLogContext &context,
+                                 const QString &message)
+{
+    AsyncLogger *pLogger = s_pInstance;
+    const Level level = levelFromMessageType(type);
+
+    if (pLogger && level < pLogger->m_minimumLevel)
+        return;
+
+    Record record;
+    record.time = QDateTime::currentMSecsSinceEpoch();
+    record.level = level;
+    record.threadId = quintptr(QThread::currentThreadId());
+    record.category = context.category;
+    record.message = message;
+
+    // После qFatal программа завершается, поэтому сообщение выводится сразу
+    if (!pLogger || level == LevelFatal)
+    {
+        write(format(record));
+        std::fflush(stderr);
+
+        if (level == LevelFatal)
+            std::abort();
+
+        return;
+    }
+
+    if (!pLogger->push(std::move(record)))
+        pLogger->m_droppedCount++;
+}
+
+AsyncLogger::Level AsyncLogger::levelFromMessageType(QtMsgType type)
+{
+    switch (type)
+    {
+        case QtDebugMsg :
+          return LevelDebug;
+        case QtInfoMsg :
+          return LevelInfo;
+        case QtWarningMsg :
+          return LevelWarning;
+        case QtCriticalMsg :
+          return LevelCritical;
+        default :
+          return LevelFatal;
+    }
+}
+
+const char *AsyncLogger::levelName(Level level)
+{
+    switch (level)
+    {
+        case LevelDebug :
+          return "debug";
+        case LevelInfo :
+          return "info";
+        case LevelWarning :
+          return "warning";
+        case LevelCritical :
+          return "critical";
+        default :
+          return "fatal";
+    }
+}
+
+/*
+ * Кавычки и переводы строк в тексте экранируются,
+ * чтобы каждая запись занимала одну строку.
+ */
+QByteArray AsyncLogger::format(const Record &record)
+{
+    QByteArray message = record.message.toLocal8Bit();
+    message.replace('\\', "\\\\").replace('"', "\\\"").replace('\n', "\\n");
+
+    QByteArray line;
+    line.reserve(message.size() + 96);
+
+    line += "time=";
+    line += QDateTime::fromMSecsSinceEpoch(record.time).toString(Qt::ISODateWithMs).toLatin1();
+    line += " level=";
+    line += levelName(record.level);
+    line += " thread=";
+    line += QByteArray::number(quint64(record.threadId), 16);
+
+    if (!record.category.isEmpty() && record.category != "default")
+    {
+        line += " category=";
+        line += record.category;
+    }
+
+    line += " msg=\"";
+    line += message;
+    line += "\"\n";
+
+    return line;
+}
+
+void AsyncLogger::write(const QByteArray &line)
+{
+    std::fwrite(line.constData(), 1, size_t(line.size()), stderr);
+}
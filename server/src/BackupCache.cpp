@@ -0,0 +1,94 @@
+#include "BackupCache.h"
+
+#include <QFile>
+#include <QMutexLocker>
+#include <QDebug>
+
+const qint64 BackupCache::cDefaultMaxSize = 256LL * 1024 * 1024;
+
+BackupCache::BackupCache(qint64 maxSize)
+    : m_cache(int(maxSize / 1024))
+    , m_maxEntrySize(maxSize / 4)
+{
+
+}
+
+bool BackupCache::find(qint64 backupId, const QByteArray &contentHash, QByteArray &dbData)
+{
+    QMutexLocker locker(&m_mutex);
+
+    // Указатель действителен только до следующего изменения кэша,
+    // поэтому содержимое копируется (без копирования данных) под мьютексом
+    const QByteArray *pCachedData = m_cache.object(cacheKey(backupId, contentHash));
+    if (!pCachedData)
+    {
+        m_misses++;
+        return false;
+    }
+
+    m_hits++;
+    dbData = *pCachedData;
+
+    return true;
+}
+
+void BackupCache::insert(qint64 backupId, const QByteArray &contentHash, const QByteArray &dbData)
+{
+    if (backupId <= 0 || dbData.size() > m_maxEntrySize)
+        return;
+
+    QMutexLocker locker(&m_mutex);
+
+    m_cache.insert(cacheKey(backupId, contentHash), new QByteArray(dbData), entryCost(dbData));
+}
+
+void BackupCache::remove(qint64 backupId, const QByteArray &contentHash)
+{
+    QMutexLocker locker(&m_mutex);
+
+    m_cache.remove(cacheKey(backupId, contentHash));
+}
+
+QByteArray BackupCache::insertFile(qint64 backupId, const QByteArray &contentHash,
+                                   const QString &dbFilePath)
+{
+    QFile dbFile(dbFilePath);
+    if (backupId <= 0 || dbFile.size() > m_maxEntrySize || !dbFile.open(QIODevice::ReadOnly))
+        return QByteArray();
+
+    QByteArray dbData = dbFile.readAll();
+    if (dbData.size() != dbFile.size())
+        return QByteArray();
+
+    insert(backupId, contentHash, dbData);
+
+    return dbData;
+}
+
+qint64 BackupCache::hits() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_hits;
+}
+
+qint64 BackupCache::misses() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_misses;
+}
+
+qint64 BackupCache::size() const
+{
+    QMutexLocker locker(&m_mutex);
+    return qint64(m_cache.totalCost()) * 1024;
+}
+
+QString BackupCache::cacheKey(qint64 backupId, const QByteArray &contentHash)
+{
+    return QString::number(backupId) + ":" + QString::fromLatin1(contentHash.toHex());
+}
+
+int BackupCache::entryCost(const QByteArray &dbData)
+{
+    return qMax(1, int((dbData.size() + 1023) / 1024));
+}
@@ -0,0 +1,354 @@
+#include "BackupCatalog.h"
+
+#include <QtSql/QSqlQuery>
+#include <QtSql/QSqlError>
+#include <QMutexLocker>
+#include <QThread>
+#include <QDateTime>
+#include <QSet>
+#include <QVariant>
+#include <QDebug>
+
+#include <algorithm>
+
+BackupCatalog::BackupCatalog(const QString &databasesPath)
+    : m_catalogFilePath(databasesPath + "/.store/catalog.sqlite")
+{
+
+}
+
+bool BackupCatalog::init()
+{
+    QSqlDatabase db = connection();
+    if (!db.isOpen())
+        return false;
+
+    QSqlQuery query(db);
+
+    // WAL позволяет читать каталог во время записи в него
+    query.exec("PRAGMA journal_mode=WAL");
+
+    const QStringList cCreationCommands {
+        "CREATE TABLE IF NOT EXISTS backups ("
+        "id INTEGER PRIMARY KEY AUTOINCREMENT, "
+        "file_name TEXT NOT NULL UNIQUE, "
+        "org_name TEXT NOT NULL, "
+        "created_at INTEGER NOT NULL, "
+        "size INTEGER NOT NULL, "
+        "hash BLOB NOT NULL, "
+        "employee_count INTEGER NOT NULL DEFAULT -1, "
+        "verification_status INTEGER NOT NULL DEFAULT -1, "
+        "verification_details TEXT, "
+        "verified_at INTEGER)",
+        "CREATE INDEX IF NOT EXISTS backups_org_name ON backups (org_name, id)",
+        "CREATE INDEX IF NOT EXISTS backups_created_at ON backups (created_at)"
+    };
+
+    for (const QString &command : cCreationCommands)
+    {
+        if (!query.exec(command))
+        {
+            qInfo() << "ОШИБКА: не удалось создать каталог версий:" << query.lastError().text();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+qint64 BackupCatalog::addBackup(const QString &backupFileName, const BackupStore::Manifest &manifest,
+                                qint64 createdAt, qint32 employeeCount)
+{
+    QMutexLocker locker(&m_writeMutex);
+
+    QSqlDatabase db = connection();
+    QString orgName;
+    qint64 nameCreatedAt = 0;
+    parseBackupFileName(backupFileName, orgName, nameCreatedAt);
+
+    QSqlQuery query(db);
+    query.prepare("INSERT OR REPLACE INTO backups "
+                  "(file_name, org_name, created_at, size, hash, employee_count) "
+                  "VALUES (?, ?, ?, ?, ?, ?)");
+    query.addBindValue(backupFileName);
+    query.addBindValue(orgName);
+    query.addBindValue(createdAt);
+    query.addBindValue(manifest.fileSize);
+    query.addBindValue(BackupStore::contentHash(manifest));
+    query.addBindValue(employeeCount);
+
+    if (!query.exec())
+    {
+        qInfo() << "ОШИБКА: не удалось добавить версию" << backupFileName
+                << "в каталог:" << query.lastError().text();
+        return 0;
+    }
+
+    return query.lastInsertId().toLongLong();
+}
+
+bool BackupCatalog::removeBackup(const QString &backupFileName)
+{
+    QMutexLocker locker(&m_writeMutex);
+
+    QSqlQuery query(connection());
+    query.prepare("DELETE FROM backups WHERE file_name = ?");
+    query.addBindValue(backupFileName);
+
+    return query.exec();
+}
+
+bool BackupCatalog::setVerificationResult(const QString &backupFileName, bool isValid,
+                                          const QString &details, qint32 employeeCount)
+{
+    QMutexLocker locker(&m_writeMutex);
+
+    QSqlQuery query(connection());
+    query.prepare("UPDATE backups SET verification_status = ?, verification_details = ?, "
+                  "verified_at = ?, employee_count = ? WHERE file_name = ?");
+    query.addBindValue(int(isValid ? BackupInfo::Verified : BackupInfo::Corrupted));
+    query.addBindValue(details);
+    query.addBindValue(QDateTime::currentMSecsSinceEpoch());
+    query.addBindValue(employeeCount);
+    query.addBindValue(backupFileName);
+
+    return query.exec();
+}
+
+bool BackupCatalog::findBackup(const QString &backupFileName, BackupInfo &info) const
+{
+    QSqlQuery query(connection());
+    query.prepare("SELECT id, file_name, org_name, created_at, size, hash, employee_count, "
+                  "verification_status "
+                  "FROM backups WHERE file_name = ?");
+    query.addBindValue(backupFileName);
+
+    if (!query.exec() || !query.next())
+        return false;
+
+    info.id = query.value(0).toLongLong();
+    info.fileName = query.value(1).toString();
+    info.orgName = query.value(2).toString();
+    info.createdAt = query.value(3).toLongLong();
+    info.size = query.value(4).toLongLong();
+    info.hash = query.value(5).toByteArray();
+    info.employeeCount = query.value(6).toInt();
+    info.verificationStatus = qint8(query.value(7).toInt());
+
+    return true;
+}
+
+/*
+ * Версии выбираются по убыванию номера, а курсор - номер
+ * последней отправленной версии. Поэтому следующая страница
+ * не сдвигается, если между запросами были сохранены новые версии.
+ */
+QList<BackupInfo> BackupCatalog::listBackups(const QString &orgName, qint64 from, qint64 to,
+                                             qint64 cursor, int limit, qint64 &nextCursor) const
+{
+    nextCursor = 0;
+
+    QStringList conditions;
+    QVariantList bindValues;
+
+    if (!orgName.isEmpty())
+    {
+        conditions << "org_name = ?";
+        bindValues << orgName;
+    }
+    if (from > 0)
+    {
+        conditions << "created_at >= ?";
+        bindValues << from;
+    }
+    if (to > 0)
+    {
+        conditions << "created_at <= ?";
+        bindValues << to;
+    }
+    if (cursor > 0)
+    {
+        conditions << "id < ?";
+        bindValues << cursor;
+    }
+
+    QString queryText = "SELECT id, file_name, org_name, created_at, size, hash, employee_count, "
+                        "verification_status FROM backups";
+    if (!conditions.isEmpty())
+        queryText += " WHERE " + conditions.join(" AND ");
+    queryText += " ORDER BY id DESC LIMIT ?";
+
+    // Лишняя запись показывает, есть ли следующая страница
+    bindValues << limit + 1;
+
+    QSqlQuery query(connection());
+    query.prepare(queryText);
+    for (const QVariant &value : qAsConst(bindValues))
+        query.addBindValue(value);
+
+    QList<BackupInfo> backups;
+
+    if (!query.exec())
+    {
+        qInfo() << "ОШИБКА: не удалось прочитать каталог версий:" << query.lastError().text();
+        return backups;
+    }
+
+    while (query.next())
+    {
+        if (backups.size() == limit)
+        {
+            nextCursor = backups.last().id;
+            break;
+        }
+
+        BackupInfo info;
+        info.id = query.value(0).toLongLong();
+        info.fileName = query.value(1).toString();
+        info.orgName = query.value(2).toString();
+        info.createdAt = query.value(3).toLongLong();
+        info.size = query.value(4).toLongLong();
+        info.hash = query.value(5).toByteArray();
+        info.employeeCount = query.value(6).toInt();
+        info.verificationStatus = qint8(query.value(7).toInt());
+
+        backups << info;
+    }
+
+    return backups;
+}
+
+void BackupCatalog::rebuild(const BackupStore *store)
+{
+    // Манифест версии пишется до ее записи в каталог, поэтому
+    // список, прочитанный под мьютексом, содержит все записанные версии
+    QMutexLocker locker(&m_writeMutex);
+
+    const QStringList storedList = store->backupsList();
+    QSet<QString> storedBackups(storedList.begin(), storedList.end());
+
+    QSqlDatabase db = connection();
+    QSqlQuery query(db);
+
+    if (!query.exec("SELECT file_name FROM backups"))
+    {
+        qInfo() << "ОШИБКА: не удалось прочитать каталог версий:" << query.lastError().text();
+        return;
+    }
+
+    QSet<QString> catalogedBackups;
+    while (query.next())
+        catalogedBackups.insert(query.value(0).toString());
+
+    // Новые версии добавляются по порядку времени сохранения
+    QList<QPair<qint64, QString>> missingBackups;
+    for (const QString &backupFileName : storedList)
+    {
+        if (catalogedBackups.contains(backupFileName))
+            continue;
+
+        QString orgName;
+        qint64 createdAt = 0;
+        if (!parseBackupFileName(backupFileName, orgName, createdAt))
+            createdAt = QDateTime::currentMSecsSinceEpoch();
+
+        missingBackups << qMakePair(createdAt, backupFileName);
+    }
+
+    std::sort(missingBackups.begin(), missingBackups.end());
+
+    db.transaction();
+
+    for (const QString &backupFileName : qAsConst(catalogedBackups))
+    {
+        if (storedBackups.contains(backupFileName))
+            continue;
+
+        query.prepare("DELETE FROM backups WHERE file_name = ?");
+        query.addBindValue(backupFileName);
+        query.exec();
+    }
+
+    int addedCount = 0;
+
+    for (const QPair<qint64, QString> &missingBackup : qAsConst(missingBackups))
+    {
+        BackupStore::Manifest manifest;
+        if (!store->readManifest(missingBackup.second, manifest))
+            continue;
+
+        QSqlQuery insertQuery(db);
+        insertQuery.prepare("INSERT OR REPLACE INTO backups "
+                            "(file_name, org_name, created_at, size, hash) "
+                            "VALUES (?, ?, ?, ?, ?)");
+
+        QString orgName;
+        qint64 createdAt = 0;
+        parseBackupFileName(missingBackup.second, orgName, createdAt);
+
+        insertQuery.addBindValue(missingBackup.second);
+        insertQuery.addBindValue(orgName);
+        insertQuery.addBindValue(missingBackup.first);
+        insertQuery.addBindValue(manifest.fileSize);
+        insertQuery.addBindValue(BackupStore::contentHash(manifest));
+
+        if (insertQuery.exec())
+            addedCount++;
+    }
+
+    db.commit();
+
+    qInfo() << "Каталог версий сверен с хранилищем; добавлено версий:" << addedCount
+            << "; удалено:" << (catalogedBackups - storedBackups).size();
+}
+
+bool BackupCatalog::parseBackupFileName(const QString &backupFileName,
+                                        QString &orgName, qint64 &createdAt)
+{
+    QString baseName = backupFileName;
+    if (baseName.endsWith(".db", Qt::CaseInsensitive))
+        baseName.chop(3);
+
+    int spaceIndex = baseName.lastIndexOf(' ');
+    orgName = spaceIndex > 0 ? baseName.left(spaceIndex) : baseName;
+
+    if (spaceIndex <= 0)
+        return false;
+
+    // "день-месяц-год--час-минуты-cекунды", за которыми может идти "-номер"
+    const QStringList parts = baseName.mid(spaceIndex + 1).split('-', Qt::SkipEmptyParts);
+    if (parts.size() < 6)
+        return false;
+
+    QDateTime dateTime(QDate(parts.at(2).toInt(), parts.at(1).toInt(), parts.at(0).toInt()),
+                       QTime(parts.at(3).toInt(), parts.at(4).toInt(), parts.at(5).toInt()));
+    if (!dateTime.isValid())
+        return false;
+
+    createdAt = dateTime.toMSecsSinceEpoch();
+
+    return true;
+}
+
+/*
+ * Подключение QSqlDatabase можно использовать только в создавшем его потоке,
+ * поэтому для каждого потока создается отдельное подключение.
+ * Потоки пула сервера не завершаются, и подключения не накапливаются.
+ */
+QSqlDatabase BackupCatalog::connection() const
+{
+    const QString connectionName = "backup-catalog-"
+            + QString::number(quintptr(QThread::currentThreadId()));
+
+    if (QSqlDatabase::contains(connectionName))
+        return QSqlDatabase::database(connectionName);
+
+    QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", connectionName);
+    db.setDatabaseName(m_catalogFilePath);
+    db.setConnectOptions("QSQLITE_BUSY_TIMEOUT=5000");
+
+    if (!db.open())
+        qInfo() << "ОШИБКА: не удалось открыть каталог версий:" << db.lastError().text();
+
+    return db;
+}
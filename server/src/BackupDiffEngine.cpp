@@ -0,0 +1,234 @@
+#include "BackupDiffEngine.h"
+#include "DatabaseCreation.h"
+
+#include <QUuid>
+#include <QtSql/QSqlDatabase>
+#include <QtSql/QSqlQuery>
+#include <QtSql/QSqlRecord>
+#include <QtSql/QSqlError>
+
+#include <vector>
+
+namespace
+{
+/*
+ * Курсор по записям таблицы в порядке возрастания ID.
+ */
+class TableCursor
+{
+public:
+    bool open(QSqlDatabase &db, const QString &tableName, QString &error)
+    {
+        m_query = QSqlQuery(db);
+        m_query.setForwardOnly(true);
+
+        if (!m_query.exec("SELECT * FROM [" + tableName + "] ORDER BY [ID]"))
+        {
+            error = "Не удалось прочитать таблицу " + tableName + ": " + m_query.lastError().text();
+            return false;
+        }
+
+        advance();
+        return true;
+    }
+
+    bool hasRow() const { return m_hasRow; }
+    qint64 id() const { return m_id; }
+
+    /*
+     * Возвращает текущую запись и переходит к следующей,
+     * если номер текущей записи равен id. Иначе возвращает пустую запись.
+     */
+    QSqlRecord take(qint64 id)
+    {
+        if (!m_hasRow || m_id != id)
+            return QSqlRecord();
+
+        QSqlRecord record = m_query.record();
+        advance();
+
+        return record;
+    }
+
+private:
+    QSqlQuery m_query;
+    bool m_hasRow = false;
+    qint64 m_id = 0;
+
+    void advance()
+    {
+        m_hasRow = m_query.next();
+        if (m_hasRow)
+            m_id = m_query.value("ID").toLongLong();
+    }
+};
+
+/*
+ * Добавляет в changes поля таблицы tableName, значения которых
+ * в записях oldRecord и newRecord различаются.
+ */
+void compareRecords(const QString &tableName, const QSqlRecord &oldRecord,
+                    const QSqlRecord &newRecord, QList<EmployeeDiff::FieldChange> &changes)
+{
+    const QSqlRecord &fieldsRecord = newRecord.isEmpty() ? oldRecord : newRecord;
+
+    for (int i = 0; i < fieldsRecord.count(); i++)
+    {
+        const QString fieldName = fieldsRecord.fieldName(i);
+        if (fieldName == "ID")
+            continue;
+
+        const QVariant oldValue = oldRecord.isEmpty() ? QVariant() : oldRecord.value(fieldName);
+        const QVariant newValue = newRecord.isEmpty() ? QVariant() : newRecord.value(fieldName);
+
+        if (oldValue != newValue)
+            changes << EmployeeDiff::FieldChange{tableName, fieldName, oldValue, newValue};
+    }
+}
+
+QString employeeName(const QSqlRecord &generalInfoRecord)
+{
+    return QStringList{generalInfoRecord.value("Фамилия").toString(),
+                       generalInfoRecord.value("Имя").toString(),
+                       generalInfoRecord.value("Отчество").toString()}.join(' ').simplified();
+}
+}
+
+bool BackupDiffEngine::run(const QString &oldDbFilePath, const QString &newDbFilePath,
+                           const EntriesHandler &onEntries, Summary &summary, QString &error)
+{
+    const QString connectionSuffix = QUuid::createUuid().toString(QUuid::WithoutBraces);
+    const QString oldConnectionName = "backup-diff-old-" + connectionSuffix;
+    const QString newConnectionName = "backup-diff-new-" + connectionSuffix;
+
+    bool isSucceeded = false;
+
+    {
+        QSqlDatabase oldDb = QSqlDatabase::addDatabase("QSQLITE", oldConnectionName);
+        oldDb.setDatabaseName(oldDbFilePath);
+        oldDb.setConnectOptions("QSQLITE_OPEN_READONLY");
+
+        QSqlDatabase newDb = QSqlDatabase::addDatabase("QSQLITE", newConnectionName);
+        newDb.setDatabaseName(newDbFilePath);
+        newDb.setConnectOptions("QSQLITE_OPEN_READONLY");
+
+        if (!oldDb.open())
+            error = "Не удалось открыть старую версию: " + oldDb.lastError().text();
+        else if (!newDb.open())
+            error = "Не удалось открыть новую версию: " + newDb.lastError().text();
+        else
+            isSucceeded = compare(oldDb, newDb, onEntries, summary, error);
+
+        oldDb.close();
+        newDb.close();
+    }
+
+    QSqlDatabase::removeDatabase(oldConnectionName);
+    QSqlDatabase::removeDatabase(newConnectionName);
+
+    return isSucceeded;
+}
+
+bool BackupDiffEngine::compare(QSqlDatabase &oldDb, QSqlDatabase &newDb,
+                               const EntriesHandler &onEntries, Summary &summary, QString &error)
+{
+    const QList<QString> &tableNames = DatabaseCreation::cTableNamesList;
+
+    std::vector<TableCursor> oldCursors(size_t(tableNames.size()));
+    std::vector<TableCursor> newCursors(size_t(tableNames.size()));
+
+    for (int i = 0; i < tableNames.size(); i++)
+    {
+        if (!oldCursors[size_t(i)].open(oldDb, tableNames.at(i), error)
+                || !newCursors[size_t(i)].open(newDb, tableNames.at(i), error))
+            return false;
+    }
+
+    QList<EmployeeDiff> entries;
+
+    for (;;)
+    {
+        bool hasRows = false;
+        qint64 employeeId = 0;
+
+        for (const std::vector<TableCursor> *cursors : {&oldCursors, &newCursors})
+        {
+            for (const TableCursor &cursor : *cursors)
+            {
+                if (cursor.hasRow() && (!hasRows || cursor.id() < employeeId))
+                {
+                    employeeId = cursor.id();
+                    hasRows = true;
+                }
+            }
+        }
+
+        if (!hasRows)
+            break;
+
+        EmployeeDiff diff;
+        diff.employeeId = qint32(employeeId);
+
+        bool isInOld = false;
+        bool isInNew = false;
+
+        for (int i = 0; i < tableNames.size(); i++)
+        {
+            const QSqlRecord oldRecord = oldCursors[size_t(i)].take(employeeId);
+            const QSqlRecord newRecord = newCursors[size_t(i)].take(employeeId);
+
+            // Сотрудник существует, если у него есть запись в таблице "Общая информация"
+            if (i == 0)
+            {
+                isInOld = !oldRecord.isEmpty();
+                isInNew = !newRecord.isEmpty();
+                diff.employeeName = employeeName(isInNew ? newRecord : oldRecord);
+            }
+
+            compareRecords(tableNames.at(i), oldRecord, newRecord, diff.changes);
+        }
+
+        if (isInOld && !isInNew)
+        {
+            diff.kind = EmployeeDiff::Removed;
+            diff.changes.clear();
+            summary.removedCount++;
+        }
+        else if (!isInOld && isInNew)
+        {
+            diff.kind = EmployeeDiff::Added;
+            diff.changes.clear();
+            summary.addedCount++;
+        }
+        else if (!diff.changes.isEmpty())
+        {
+            diff.kind = EmployeeDiff::Changed;
+            summary.changedCount++;
+        }
+        else
+        {
+            continue;
+        }
+
+        entries << diff;
+
+        if (entries.size() >= TcpProtocol::cDiffBatchEntries)
+        {
+            if (!onEntries(entries))
+            {
+                error = "Сравнение прервано";
+                return false;
+            }
+
+            entries.clear();
+        }
+    }
+
+    if (!entries.isEmpty() && !onEntries(entries))
+    {
+        error = "Сравнение прервано";
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,150 @@
+#include "BackupQueryExecutor.h"
+#include "DatabaseCreation.h"
+
+#include <QUuid>
+#include <QtSql/QSqlDatabase>
+#include <QtSql/QSqlQuery>
+#include <QtSql/QSqlRecord>
+#include <QtSql/QSqlError>
+
+qint64 BackupQueryExecutor::run(const QString &dbFilePath, const BackupQuery &query,
+                                const BatchHandler &onBatch, QString &error)
+{
+    const qint64 limit = query.limit == 0 ? TcpProtocol::cMaxQueryRows
+                                          : qMin(query.limit, TcpProtocol::cMaxQueryRows);
+
+    const QString connectionName = "backup-query-"
+            + QUuid::createUuid().toString(QUuid::WithoutBraces);
+
+    qint64 rowCount = -1;
+
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", connectionName);
+        db.setDatabaseName(dbFilePath);
+        db.setConnectOptions("QSQLITE_OPEN_READONLY");
+
+        if (!db.open())
+        {
+            error = "Не удалось открыть базу данных: " + db.lastError().text();
+        }
+        else if (query.kind == BackupQuery::EmployeeById)
+        {
+            bool isNumber = false;
+            const int employeeId = query.argument.toInt(&isNumber);
+
+            if (!isNumber)
+            {
+                error = "Номер сотрудника должен быть числом";
+            }
+            else
+            {
+                rowCount = 0;
+
+                for (const QString &tableName : DatabaseCreation::cTableNamesList)
+                {
+                    qint64 tableRowCount = selectRows(db, tableName, "[ID] = ?", employeeId,
+                                                      limit - rowCount, onBatch, error);
+                    if (tableRowCount < 0)
+                    {
+                        rowCount = -1;
+                        break;
+                    }
+
+                    rowCount += tableRowCount;
+                }
+            }
+        }
+        else if (query.kind == BackupQuery::EmployeesBySurname)
+        {
+            // Символы шаблона LIKE в фамилии ищутся как обычные символы
+            QString pattern = query.argument;
+            pattern.replace("\\", "\\\\").replace("%", "\\%").replace("_", "\\_");
+
+            rowCount = selectRows(db, DatabaseCreation::cTableNamesList.first(),
+                                  "[Фамилия] LIKE ? ESCAPE '\\'", pattern + "%",
+                                  limit, onBatch, error);
+        }
+        else if (query.kind == BackupQuery::Table)
+        {
+            if (!DatabaseCreation::cTableNamesList.contains(query.argument))
+                error = "Неизвестная таблица: " + query.argument;
+            else
+                rowCount = selectRows(db, query.argument, QString(), QVariant(), limit, onBatch, error);
+        }
+        else
+        {
+            error = "Неизвестный вид запроса: " + QString::number(query.kind);
+        }
+
+        db.close();
+    }
+
+    QSqlDatabase::removeDatabase(connectionName);
+
+    return rowCount;
+}
+
+qint64 BackupQueryExecutor::selectRows(QSqlDatabase &db, const QString &tableName,
+                                       const QString &condition, const QVariant &value,
+                                       qint64 limit, const BatchHandler &onBatch, QString &error)
+{
+    if (limit <= 0)
+        return 0;
+
+    QSqlQuery query(db);
+    query.setForwardOnly(true);
+    query.prepare("SELECT * FROM [" + tableName + "]"
+                  + (condition.isEmpty() ? QString() : " WHERE " + condition)
+                  + " ORDER BY [ID] LIMIT ?");
+
+    if (!condition.isEmpty())
+        query.addBindValue(value);
+
+    query.addBindValue(limit);
+
+    if (!query.exec())
+    {
+        error = "Не удалось выполнить запрос к таблице " + tableName + ": " + query.lastError().text();
+        return -1;
+    }
+
+    BackupQueryBatch batch;
+    batch.tableName = tableName;
+
+    const QSqlRecord record = query.record();
+    for (int i = 0; i < record.count(); i++)
+        batch.columns << record.fieldName(i);
+
+    qint64 rowCount = 0;
+
+    while (query.next())
+    {
+        QVariantList row;
+        row.reserve(record.count());
+
+        for (int i = 0; i < record.count(); i++)
+            row << query.value(i);
+
+        batch.rows << row;
+        rowCount++;
+
+        if (batch.rows.size() >= TcpProtocol::cQueryBatchRows)
+        {
+            if (!onBatch(batch))
+            {
+                error = "Запрос прерван";
+                return -1;
+            }
+
+            batch.rows.clear();
+        }
+    }
+
+    if (!batch.rows.isEmpty() && !onBatch(batch))
+    {
+        error = "Запрос прерван";
+        return -1;
+    }
+
+    return rowCount;
+}
@@ -0,0 +1,366 @@
+#include "BackupRetention.h"
+#include "BackupStore.h"
+#include "BackupCatalog.h"
+#include "BackupCache.h"
+#include "Compression.h"
+
+#include <QSettings>
+#include <QDateTime>
+#include <QHash>
+#include <QSet>
+#include <QThread>
+#include <QDebug>
+
+#include <algorithm>
+
+const qint64 BackupRetention::cMsecsPerDay = 24LL * 60 * 60 * 1000;
+const int BackupRetention::cIdleCheckInterval = 500;
+const int BackupRetention::cColdBatchChunks = 4096;
+
+BackupRetention::BackupRetention(BackupStore *store, BackupCatalog *catalog, BackupCache *cache)
+    : m_pStore(store)
+    , m_pCatalog(catalog)
+    , m_pCache(cache)
+{
+
+}
+
+BackupRetention::Policy BackupRetention::loadPolicy(const QString &settingsFilePath)
+{
+    QSettings settings(settingsFilePath, QSettings::IniFormat);
+    settings.beginGroup("Retention");
+
+    Policy policy;
+    policy.isEnabled = settings.value("Enabled", policy.isEnabled).toBool();
+    policy.keepAllDays = settings.value("KeepAllDays", policy.keepAllDays).toInt();
+    policy.keepDailyDays = settings.value("KeepDailyDays", policy.keepDailyDays).toInt();
+    policy.keepMonthlyMonths = settings.value("KeepMonthlyMonths", policy.keepMonthlyMonths).toInt();
+    policy.coldAfterDays = settings.value("ColdAfterDays", policy.coldAfterDays).toInt();
+    policy.chunkGracePeriodHours = settings.value("ChunkGracePeriodHours",
+                                                  policy.chunkGracePeriodHours).toInt();
+    policy.maxBytesPerSecond = settings.value("MaxBytesPerSecond",
+                                              policy.maxBytesPerSecond).toLongLong();
+    policy.intervalMinutes = qMax(1, settings.value("IntervalMinutes",
+                                                    policy.intervalMinutes).toInt());
+
+    // Защита от удаления страниц загружаемых версий не может быть отключена
+    policy.chunkGracePeriodHours = qMax(1, policy.chunkGracePeriodHours);
+
+    return policy;
+}
+
+void BackupRetention::setTransferActivityCheck(std::function<bool()> isTransferActive)
+{
+    m_isTransferActive = std::move(isTransferActive);
+}
+
+void BackupRetention::run()
+{
+    if (!m_policy.isEnabled || m_isStopping)
+        return;
+
+    m_throttleTimer.start();
+    m_throttledBytes = 0;
+
+    QList<BackupInfo> backups = catalogBackups();
+
+    const QStringList expired = expiredBackups(backups, m_policy,
+                                               QDateTime::currentMSecsSinceEpoch());
+    if (!expired.isEmpty())
+    {
+        const QSet<QString> expiredSet(expired.begin(), expired.end());
+
+        QList<BackupInfo> expiredBackupsInfo;
+        QList<BackupInfo> keptBackups;
+        for (const BackupInfo &backupInfo : qAsConst(backups))
+        {
+            if (expiredSet.contains(backupInfo.fileName))
+                expiredBackupsInfo << backupInfo;
+            else
+                keptBackups << backupInfo;
+        }
+
+        int removedCount = removeExpiredBackups(expiredBackupsInfo);
+        qInfo() << "Удалено устаревших версий:" << removedCount;
+
+        backups = keptBackups;
+    }
+
+    compactStore(backups);
+}
+
+/*
+ * Версии каждой организации просматриваются от новых к старым.
+ * В каждом дне (месяце) сохраняется первая, то есть последняя по времени, версия.
+ */
+QStringList BackupRetention::expiredBackups(QList<BackupInfo> backups, const Policy &policy,
+                                            qint64 now)
+{
+    std::sort(backups.begin(), backups.end(), [](const BackupInfo &first, const BackupInfo &second)
+    {
+        return first.createdAt > second.createdAt;
+    });
+
+    const qint64 dailyStart = policy.keepAllDays;
+    const qint64 monthlyStart = dailyStart + policy.keepDailyDays;
+
+    QSet<QString> keptOrganizations;
+    QSet<QString> keptPeriods;
+    QStringList expired;
+
+    for (const BackupInfo &backupInfo : qAsConst(backups))
+    {
+        if (!keptOrganizations.contains(backupInfo.orgName))
+        {
+            keptOrganizations.insert(backupInfo.orgName);
+            continue;
+        }
+
+        // Время сохранения версий с нестандартным именем неизвестно
+        if (backupInfo.createdAt <= 0)
+            continue;
+
+        const qint64 ageDays = (now - backupInfo.createdAt) / cMsecsPerDay;
+        if (ageDays < dailyStart)
+            continue;
+
+        const QDate createdDate = QDateTime::fromMSecsSinceEpoch(backupInfo.createdAt).date();
+        QString period;
+
+        if (ageDays < monthlyStart)
+            period = "day " + createdDate.toString(Qt::ISODate);
+        else if (policy.keepMonthlyMonths <= 0
+                 || ageDays < monthlyStart + qint64(policy.keepMonthlyMonths) * 30)
+            period = "month " + createdDate.toString("yyyy-MM");
+
+        if (!period.isEmpty())
+        {
+            const QString periodKey = backupInfo.orgName + "/" + period;
+            if (!keptPeriods.contains(periodKey))
+            {
+                keptPeriods.insert(periodKey);
+                continue;
+            }
+        }
+
+        expired << backupInfo.fileName;
+    }
+
+    return expired;
+}
+
+QList<BackupInfo> BackupRetention::catalogBackups() const
+{
+    QList<BackupInfo> backups;
+    qint64 cursor = 0;
+
+    do
+    {
+        backups << m_pCatalog->listBackups(QString(), 0, 0, cursor,
+                                           int(TcpProtocol::cMaxListPageSize), cursor);
+    }
+    while (cursor != 0);
+
+    return backups;
+}
+
+/*
+ * Сначала версия удаляется из каталога, чтобы клиенты
+ * больше не видели ее в списке, затем из кэша и хранилища.
+ * Если манифест удалить не удалось, версия вернется
+ * в каталог при следующем запуске сервера.
+ */
+int BackupRetention::removeExpiredBackups(const QList<BackupInfo> &backups)
+{
+    int removedCount = 0;
+
+    for (const BackupInfo &backupInfo : backups)
+    {
+        if (!throttle(0))
+            break;
+
+        if (!m_pCatalog->removeBackup(backupInfo.fileName))
+        {
+            qInfo() << "ОШИБКА: не удалось удалить версию из каталога:" << backupInfo.fileName;
+            continue;
+        }
+
+        m_pCache->remove(backupInfo.id, backupInfo.hash);
+
+        if (m_pStore->removeBackup(backupInfo.fileName))
+            removedCount++;
+    }
+
+    return removedCount;
+}
+
+/*
+ * Страница остается в обычном хранении, если на нее ссылается
+ * хотя бы одна новая версия, в том числе версия, которой еще нет в каталоге.
+ */
+void BackupRetention::compactStore(const QList<BackupInfo> &backups)
+{
+    const qint64 coldStart = QDateTime::currentMSecsSinceEpoch()
+            - qint64(m_policy.coldAfterDays) * cMsecsPerDay;
+    const qint64 gracePeriod = qint64(m_policy.chunkGracePeriodHours) * 60 * 60 * 1000;
+
+    QHash<QString, qint64> createdAt;
+    for (const BackupInfo &backupInfo : backups)
+        createdAt.insert(backupInfo.fileName, backupInfo.createdAt);
+
+    QSet<QByteArray> referencedChunks;
+    QSet<QByteArray> hotChunks;
+
+    // Страницы старых версий в порядке манифестов, без повторов
+    QList<QByteArray> coldCandidates;
+    QSet<QByteArray> coldCandidatesSet;
+
+    const QStringList storedBackups = m_pStore->backupsList();
+    for (const QString &backupFileName : storedBackups)
+    {
+        BackupStore::Manifest manifest;
+        if (!m_pStore->readManifest(backupFileName, manifest))
+        {
+            // Без всех манифестов нельзя определить, какие страницы не используются
+            qInfo() << "ОШИБКА: не удалось прочитать манифест версии" << backupFileName
+                    << "; обслуживание страниц пропущено";
+            return;
+        }
+
+        const qint64 backupCreatedAt = createdAt.value(backupFileName, 0);
+        const bool isCold = backupCreatedAt > 0 && backupCreatedAt < coldStart;
+
+        for (const QByteArray &hash : qAsConst(manifest.pageHashes))
+        {
+            referencedChunks.insert(hash);
+
+            if (!isCold)
+                hotChunks.insert(hash);
+            else if (!coldCandidatesSet.contains(hash))
+            {
+                coldCandidates << hash;
+                coldCandidatesSet.insert(hash);
+            }
+        }
+
+        if (!throttle(manifest.pageHashes.size() * 32))
+            return;
+    }
+
+    m_pStore->pruneRetainedChunks(gracePeriod);
+
+    const qint64 initialDiskSize = m_pStore->chunksDiskSize();
+
+    int removedChunksCount = 0;
+    qint64 removedBytes = 0;
+
+    const QSet<QByteArray> storedChunks = m_pStore->chunksList();
+    for (const QByteArray &hash : storedChunks)
+    {
+        if (referencedChunks.contains(hash))
+            continue;
+
+        qint64 chunkSize = m_pStore->removeUnusedChunk(hash, gracePeriod);
+        if (chunkSize > 0)
+        {
+            removedChunksCount++;
+            removedBytes += chunkSize;
+        }
+
+        if (!throttle(0))
+            return;
+    }
+
+    // zstd с высоким уровнем сжимает сильнее zlib, но доступен не во всех сборках
+    const bool hasZstd = Compression::isCodecSupported(Compression::CodecZstd);
+    const quint8 coldCodec = hasZstd ? Compression::CodecZstd : Compression::CodecQCompress;
+    const int coldLevel = hasZstd ? 19 : 9;
+
+    /*
+     * Страницы, идущие подряд в старых версиях, переносятся вместе:
+     * так они попадают в один сжимаемый сегмент.
+     */
+    int compactedChunksCount = 0;
+    qint64 compactedRawBytes = 0;
+    qint64 coldPacksBytes = 0;
+
+    QList<QByteArray> coldBatch;
+    for (int i = 0; i < coldCandidates.size() && !m_isStopping; i++)
+    {
+        if (!hotChunks.contains(coldCandidates.at(i)))
+            coldBatch << coldCandidates.at(i);
+
+        if (coldBatch.size() < cColdBatchChunks && i + 1 < coldCandidates.size())
+            continue;
+
+        const BackupStore::CompactionResult result = m_pStore->compactChunks(coldBatch, coldCodec,
+                                                                              coldLevel);
+        coldBatch.clear();
+
+        if (!result.isSucceeded)
+            break;
+
+        compactedChunksCount += result.chunksCount;
+        compactedRawBytes += result.rawSize;
+        coldPacksBytes += result.packSize;
+
+        if (!throttle(result.rawSize))
+            return;
+    }
+
+    // Место удаленных и перенесенных страниц в пакетах освобождается перезаписью пакетов
+    int rewrittenPacksCount = 0;
+
+    const QStringList packs = m_pStore->packsList();
+    for (const QString &packName : packs)
+    {
+        if (m_isStopping)
+            return;
+
+        qint64 freedBytes = m_pStore->rewritePack(packName, gracePeriod);
+        if (freedBytes > 0)
+            rewrittenPacksCount++;
+
+        if (!throttle(qMax<qint64>(0, freedBytes)))
+            return;
+    }
+
+    const qint64 finalDiskSize = m_pStore->chunksDiskSize();
+
+    qInfo() << "Обслуживание хранилища: удалено страниц:" << removedChunksCount
+            << "(" << removedBytes << "байт ); перенесено в холодное хранение:"
+            << compactedChunksCount << "(" << compactedRawBytes << "байт сжаты до"
+            << coldPacksBytes << "; степень сжатия:"
+            << (coldPacksBytes > 0 ? double(compactedRawBytes) / coldPacksBytes : 0.0)
+            << "); переписано пакетов:" << rewrittenPacksCount
+            << "; размер страниц на диске:" << initialDiskSize << "->" << finalDiskSize
+            << "байт (освобождено" << initialDiskSize - finalDiskSize << "байт )";
+}
+
+bool BackupRetention::throttle(qint64 bytes)
+{
+    if (m_isTransferActive && m_isTransferActive())
+    {
+        while (!m_isStopping && m_isTransferActive())
+            QThread::msleep(cIdleCheckInterval);
+
+        // После паузы обслуживание не наверстывает упущенное время
+        m_throttleTimer.restart();
+        m_throttledBytes = 0;
+    }
+
+    if (m_isStopping)
+        return false;
+
+    m_throttledBytes += bytes;
+
+    if (m_policy.maxBytesPerSecond > 0)
+    {
+        qint64 delay = m_throttledBytes * 1000 / m_policy.maxBytesPerSecond
+                - m_throttleTimer.elapsed();
+        if (delay > 0)
+            QThread::msleep(quint64(delay));
+    }
+
+    return !m_isStopping;
+}
@@ -0,0 +1,954 @@
+#include "BackupStore.h"
+#include "FileUtils.h"
+#include "Compression.h"
+
+#include <QDir>
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QDataStream>
+#include <QCryptographicHash>
+#include <QMutexLocker>
+#include <QUuid>
+#include <QtEndian>
+#include <QDebug>
+
+const quint32 BackupStore::cDefaultPageSize = 4096;
+const quint32 BackupStore::cManifestMagic = 0x45414D46;  // "EAMF"
+const quint32 BackupStore::cManifestVersion = 1;
+const qint64 BackupStore::cMaxRestoreDirSize = 1024LL * 1024 * 1024;
+const quint32 BackupStore::cPackIndexMagic = 0x4541504B;  // "EAPK"
+const quint32 BackupStore::cPackIndexVersion = 1;
+const qint64 BackupStore::cMaxPackSize = 16 * 1024 * 1024;
+const int BackupStore::cColdSegmentSize = 1024 * 1024;
+const int BackupStore::cDecodedSegmentsCacheKb = 32 * 1024;
+
+BackupStore::BackupStore(const QString &databasesPath)
+    : m_storePath(databasesPath + "/.store")
+    , m_databasesPath(databasesPath)
+    , m_decodedSegments(cDecodedSegmentsCacheKb)
+{
+
+}
+
+bool BackupStore::init()
+{
+    QDir storeDirectory(m_storePath);
+
+    return storeDirectory.mkpath("packs")
+        && storeDirectory.mkpath("manifests")
+        && storeDirectory.mkpath("restore")
+        && loadPacks();
+}
+
+/*
+ * Пакет без индекса не был дописан: его страницы не попали
+ * ни в одну версию, поэтому он удаляется.
+ */
+bool BackupStore::loadPacks()
+{
+    QDir packsDirectory(m_storePath + "/packs");
+
+    const QStringList packFiles = packsDirectory.entryList(QStringList("*.pack"), QDir::Files);
+    for (const QString &packFile : packFiles)
+    {
+        if (!QFile::exists(packIndexFilePath(QFileInfo(packFile).completeBaseName())))
+            packsDirectory.remove(packFile);
+    }
+
+    const QStringList packs = packsList();
+    for (const QString &packName : packs)
+    {
+        QHash<QByteArray, ChunkLocation> locations;
+        if (!readPackIndex(packName, locations))
+        {
+            qInfo() << "ОШИБКА: не удалось прочитать индекс пакета страниц:" << packName;
+            return false;
+        }
+
+        for (auto it = locations.cbegin(); it != locations.cend(); ++it)
+        {
+            if (!m_packedChunks.contains(it.key()))
+                m_packedChunks.insert(it.key(), it.value());
+        }
+    }
+
+    qInfo() << "Загружено пакетов страниц:" << packs.size() << "; страниц в них:" << m_packedChunks.size();
+
+    return true;
+}
+
+QString BackupStore::importFile(const QString &filePath, const QString &backupFileName)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        qInfo() << "ОШИБКА: не удалось открыть файл для сохранения в хранилище:" << filePath;
+        return QString();
+    }
+
+    Manifest manifest;
+    manifest.fileSize = file.size();
+    manifest.pageSize = detectPageSize(file.peek(100));
+
+    int newChunksCount = 0;
+
+    // Новые страницы, еще не записанные в пакет
+    QList<Chunk> newChunks;
+    QSet<QByteArray> newHashes;
+    qint64 newChunksSize = 0;
+
+    while (!file.atEnd())
+    {
+        QByteArray page = file.read(manifest.pageSize);
+        if (page.isEmpty())
+            break;
+
+        QByteArray hash = QCryptographicHash::hash(page, QCryptographicHash::Sha256);
+
+        if (!newHashes.contains(hash) && !retainChunk(hash))
+        {
+            newChunks << Chunk(hash, page);
+            newHashes.insert(hash);
+            newChunksSize += page.size();
+            newChunksCount++;
+
+            // Пакет ограничен, чтобы не держать в памяти всю базу данных
+            if (newChunksSize >= cMaxPackSize)
+            {
+                if (!addChunks(newChunks))
+                    return QString();
+
+                newChunks.clear();
+                newHashes.clear();
+                newChunksSize = 0;
+            }
+        }
+
+        manifest.pageHashes << hash;
+    }
+
+    file.close();
+
+    if (!addChunks(newChunks))
+        return QString();
+
+    QString newBackupFileName = addBackup(backupFileName, manifest);
+
+    if (!newBackupFileName.isEmpty())
+        qInfo() << "Новых страниц:" << newChunksCount;
+
+    return newBackupFileName;
+}
+
+QString BackupStore::addBackup(const QString &backupFileName, const Manifest &manifest)
+{
+    QString newBackupFileName = reserveBackupFileName(backupFileName);
+    bool manifestWritten = writeManifest(newBackupFileName, manifest);
+    releaseBackupFileName(newBackupFileName);
+
+    if (!manifestWritten)
+        return QString();
+
+    qInfo() << "В хранилище сохранена версия" << newBackupFileName
+            << "; страниц:" << manifest.pageHashes.size();
+
+    return newBackupFileName;
+}
+
+void BackupStore::importLegacyFiles()
+{
+    QDir databasesDirectory(m_databasesPath);
+    const QStringList legacyFiles = databasesDirectory.entryList(
+                QStringList() << "*.db" << "*.DB", QDir::Files);
+
+    for (const QString &legacyFile : legacyFiles)
+    {
+        if (contains(legacyFile))
+        {
+            databasesDirectory.remove(legacyFile);
+            continue;
+        }
+
+        if (!importFile(databasesDirectory.filePath(legacyFile), legacyFile).isEmpty())
+            databasesDirectory.remove(legacyFile);
+    }
+}
+
+QStringList BackupStore::backupsList() const
+{
+    const QString cManifestSuffix = ".manifest";
+
+    QStringList backups;
+    const QStringList manifests = QDir(m_storePath + "/manifests").entryList(
+                QStringList() << "*" + cManifestSuffix, QDir::Files);
+
+    for (const QString &manifest : manifests)
+        backups << manifest.chopped(cManifestSuffix.size());
+
+    return backups;
+}
+
+bool BackupStore::containsChunk(const QByteArray &hash) const
+{
+    QMutexLocker locker(&m_packsMutex);
+
+    return m_packedChunks.contains(hash);
+}
+
+bool BackupStore::retainChunk(const QByteArray &hash)
+{
+    QMutexLocker locker(&m_chunksMutex);
+
+    if (!containsChunk(hash))
+        return false;
+
+    m_retainedChunks.insert(hash, QDateTime::currentMSecsSinceEpoch());
+
+    return true;
+}
+
+bool BackupStore::readChunk(const QByteArray &hash, QByteArray &page) const
+{
+    // Пакет мог быть переписан между поиском страницы и ее чтением
+    ChunkLocation location;
+    for (int attempt = 0; attempt < 2 && findPackedChunk(hash, location); attempt++)
+    {
+        if (readPackedChunk(location, page))
+            return true;
+    }
+
+    return false;
+}
+
+QSet<QByteArray> BackupStore::chunksList() const
+{
+    QSet<QByteArray> hashes;
+
+    QMutexLocker locker(&m_packsMutex);
+
+    for (auto it = m_packedChunks.cbegin(); it != m_packedChunks.cend(); ++it)
+        hashes.insert(it.key());
+
+    return hashes;
+}
+
+/*
+ * Страница переносится, только если холодный пакет записан:
+ * до этого она читается из прежнего места. Место страницы
+ * в обычном пакете освобождается при его перезаписи.
+ */
+BackupStore::CompactionResult BackupStore::compactChunks(const QList<QByteArray> &hashes,
+                                                         quint8 codec, int level)
+{
+    CompactionResult result;
+    QList<Chunk> chunks;
+
+    for (const QByteArray &hash : hashes)
+    {
+        ChunkLocation location;
+        if (findPackedChunk(hash, location) && location.codec != Compression::CodecNone)
+            continue;
+
+        QByteArray page;
+        if (!readChunk(hash, page))
+            continue;
+
+        if (QCryptographicHash::hash(page, QCryptographicHash::Sha256) != hash)
+        {
+            qInfo() << "ОШИБКА: содержимое страницы не совпадает с ее хешем:" << hash.toHex();
+            continue;
+        }
+
+        chunks << Chunk(hash, page);
+        result.rawSize += page.size();
+    }
+
+    if (chunks.isEmpty())
+        return result;
+
+    QHash<QByteArray, ChunkLocation> locations;
+    if (!writePack(chunks, locations, codec, level))
+    {
+        result.isSucceeded = false;
+        result.rawSize = 0;
+        return result;
+    }
+
+    {
+        QMutexLocker locker(&m_packsMutex);
+
+        for (auto it = locations.cbegin(); it != locations.cend(); ++it)
+            m_packedChunks.insert(it.key(), it.value());
+    }
+
+    const QString packName = locations.cbegin()->packName;
+
+    result.chunksCount = chunks.size();
+    result.packSize = QFileInfo(packFilePath(packName)).size()
+            + QFileInfo(packIndexFilePath(packName)).size();
+
+    return result;
+}
+
+qint64 BackupStore::chunksDiskSize() const
+{
+    qint64 size = 0;
+
+    const QFileInfoList packFiles = QDir(m_storePath + "/packs").entryInfoList(QDir::Files);
+    for (const QFileInfo &packFile : packFiles)
+        size += packFile.size();
+
+    return size;
+}
+
+qint64 BackupStore::removeUnusedChunk(const QByteArray &hash, qint64 gracePeriod)
+{
+    QMutexLocker locker(&m_chunksMutex);
+
+    if (m_retainedChunks.contains(hash))
+        return 0;
+
+    ChunkLocation location;
+    if (!findPackedChunk(hash, location))
+        return 0;
+
+    // Страница недавно записанного пакета может принадлежать еще не сохраненной версии
+    const QDateTime graceStart = QDateTime::currentDateTime().addMSecs(-gracePeriod);
+    if (QFileInfo(packIndexFilePath(location.packName)).lastModified() > graceStart)
+        return 0;
+
+    QMutexLocker packsLocker(&m_packsMutex);
+
+    m_packedChunks.remove(hash);
+
+    return location.pageSize;
+}
+
+QStringList BackupStore::packsList() const
+{
+    const QString cIndexSuffix = ".index";
+
+    QStringList packs;
+    const QStringList indexes = QDir(m_storePath + "/packs").entryList(
+                QStringList() << "*" + cIndexSuffix, QDir::Files);
+
+    for (const QString &index : indexes)
+        packs << index.chopped(cIndexSuffix.size());
+
+    return packs;
+}
+
+/*
+ * Страница пакета считается оставшейся, если индекс хранилища
+ * все еще указывает на ее место в этом пакете. Сегмент холодного
+ * пакета занимает место, пока в нем остается хотя бы одна страница.
+ * Страницы нового пакета попадают в индекс хранилища чуть позже
+ * записи индекса пакета, поэтому новые пакеты не переписываются.
+ * Индекс старого пакета удаляется раньше его файла,
+ * поэтому после сбоя остается либо весь пакет, либо ничего.
+ */
+qint64 BackupStore::rewritePack(const QString &packName, qint64 gracePeriod)
+{
+    const QFileInfo packFileInfo(packFilePath(packName));
+    const QFileInfo indexFileInfo(packIndexFilePath(packName));
+
+    if (indexFileInfo.lastModified() > QDateTime::currentDateTime().addMSecs(-gracePeriod))
+        return 0;
+
+    QHash<QByteArray, ChunkLocation> locations;
+    int level = -1;
+    if (!readPackIndex(packName, locations, &level))
+    {
+        qInfo() << "ОШИБКА: не удалось прочитать индекс пакета страниц:" << packName;
+        return -1;
+    }
+
+    QHash<QByteArray, ChunkLocation> keptLocations;
+    QHash<qint64, qint32> keptRecords;
+    {
+        QMutexLocker locker(&m_packsMutex);
+
+        for (auto it = locations.cbegin(); it != locations.cend(); ++it)
+        {
+            auto packedIt = m_packedChunks.constFind(it.key());
+            if (packedIt != m_packedChunks.cend() && packedIt->packName == packName
+                    && packedIt->offset == it->offset && packedIt->pageOffset == it->pageOffset)
+            {
+                keptLocations.insert(it.key(), it.value());
+                keptRecords.insert(it->offset, it->size);
+            }
+        }
+    }
+
+    qint64 keptSize = 0;
+    for (qint32 recordSize : qAsConst(keptRecords))
+        keptSize += recordSize;
+
+    if (!keptLocations.isEmpty() && keptSize * 2 >= packFileInfo.size())
+        return 0;
+
+    qint64 freedSize = packFileInfo.size() + indexFileInfo.size();
+
+    if (!keptLocations.isEmpty())
+    {
+        QList<Chunk> keptChunks;
+        for (auto it = keptLocations.cbegin(); it != keptLocations.cend(); ++it)
+        {
+            QByteArray page;
+            if (!readPackedChunk(it.value(), page))
+            {
+                qInfo() << "ОШИБКА: не удалось прочитать страницу пакета" << packName;
+                return -1;
+            }
+
+            keptChunks << Chunk(it.key(), page);
+        }
+
+        // Холодный пакет остается холодным
+        QHash<QByteArray, ChunkLocation> newLocations;
+        if (!writePack(keptChunks, newLocations, keptLocations.cbegin()->codec, level))
+            return -1;
+
+        QMutexLocker locker(&m_packsMutex);
+
+        // Страницы, удаленные за время перезаписи, остаются удаленными
+        for (auto it = newLocations.cbegin(); it != newLocations.cend(); ++it)
+        {
+            auto packedIt = m_packedChunks.find(it.key());
+            if (packedIt != m_packedChunks.end() && packedIt->packName == packName)
+                *packedIt = it.value();
+        }
+
+        const QString newPackName = newLocations.cbegin()->packName;
+        freedSize -= QFileInfo(packFilePath(newPackName)).size()
+                + QFileInfo(packIndexFilePath(newPackName)).size();
+    }
+
+    QFile::remove(indexFileInfo.absoluteFilePath());
+    FileUtils::syncDirectory(m_storePath + "/packs");
+    QFile::remove(packFileInfo.absoluteFilePath());
+
+    return freedSize;
+}
+
+void BackupStore::pruneRetainedChunks(qint64 gracePeriod)
+{
+    QMutexLocker locker(&m_chunksMutex);
+
+    const qint64 graceStart = QDateTime::currentMSecsSinceEpoch() - gracePeriod;
+
+    for (auto it = m_retainedChunks.begin(); it != m_retainedChunks.end();)
+    {
+        if (it.value() < graceStart)
+            it = m_retainedChunks.erase(it);
+        else
+            ++it;
+    }
+}
+
+bool BackupStore::contains(const QString &backupFileName) const
+{
+    return QFile::exists(manifestFilePath(backupFileName));
+}
+
+bool BackupStore::removeBackup(const QString &backupFileName)
+{
+    QFile::remove(restoreFilePath(backupFileName));
+
+    if (!QFile::remove(manifestFilePath(backupFileName)))
+    {
+        qInfo() << "ОШИБКА: не удалось удалить манифест версии:" << backupFileName;
+        return false;
+    }
+
+    FileUtils::syncDirectory(m_storePath + "/manifests");
+
+    return true;
+}
+
+bool BackupStore::readManifest(const QString &backupFileName, Manifest &manifest) const
+{
+    QFile manifestFile(manifestFilePath(backupFileName));
+    if (!manifestFile.open(QIODevice::ReadOnly))
+        return false;
+
+    QDataStream in(&manifestFile);
+    in.setVersion(QDataStream::Qt_5_0);
+
+    quint32 magic = 0;
+    quint32 version = 0;
+    in >> magic >> version;
+
+    if (magic != cManifestMagic || version != cManifestVersion)
+    {
+        qInfo() << "ОШИБКА: неизвестный формат манифеста:" << manifestFile.fileName();
+        return false;
+    }
+
+    in >> manifest.fileSize >> manifest.pageSize >> manifest.pageHashes;
+
+    return in.status() == QDataStream::Ok;
+}
+
+QString BackupStore::materialize(const QString &backupFileName)
+{
+    QString restoredFilePath = restoreFilePath(backupFileName);
+
+    // Версии не изменяются, поэтому ранее восстановленный файл можно использовать повторно
+    if (useRestoredFile(backupFileName))
+        return restoredFilePath;
+
+    Manifest manifest;
+    if (!readManifest(backupFileName, manifest))
+    {
+        qInfo() << "ОШИБКА: версия базы данных не найдена в хранилище:" << backupFileName;
+        return QString();
+    }
+
+    QFile restoredFile(m_storePath + "/restore/.restore-"
+                       + QUuid::createUuid().toString(QUuid::WithoutBraces));
+    if (!restoredFile.open(QIODevice::WriteOnly))
+    {
+        qInfo() << "ОШИБКА: не удалось создать файл для восстановления версии:" << backupFileName;
+        return QString();
+    }
+
+    for (const QByteArray &hash : qAsConst(manifest.pageHashes))
+    {
+        QByteArray page;
+        if (!readChunk(hash, page) || restoredFile.write(page) < 0)
+        {
+            qInfo() << "ОШИБКА: не удалось восстановить страницу" << hash.toHex()
+                    << "версии" << backupFileName;
+            restoredFile.remove();
+            return QString();
+        }
+    }
+
+    restoredFile.close();
+
+    if (restoredFile.size() != manifest.fileSize)
+    {
+        qInfo() << "ОШИБКА: размер восстановленной версии не совпадает с манифестом:" << backupFileName;
+        restoredFile.remove();
+        return QString();
+    }
+
+    QMutexLocker locker(&m_restoreMutex);
+
+    // Файл мог быть восстановлен параллельно другим потоком
+    if (!restoredFile.rename(restoredFilePath))
+        restoredFile.remove();
+
+    if (!QFile::exists(restoredFilePath))
+        return QString();
+
+    m_restoredFileUsers[QFileInfo(restoredFilePath).fileName()]++;
+
+    trimRestoreDirectory();
+
+    return restoredFilePath;
+}
+
+void BackupStore::releaseRestoredFile(const QString &backupFileName)
+{
+    QMutexLocker locker(&m_restoreMutex);
+
+    auto it = m_restoredFileUsers.find(QFileInfo(restoreFilePath(backupFileName)).fileName());
+    if (it != m_restoredFileUsers.end() && --it.value() <= 0)
+        m_restoredFileUsers.erase(it);
+}
+
+/*
+ * Заголовок базы SQLite начинается со строки "SQLite format 3\0",
+ * за которой следует размер страницы: два байта в порядке big-endian.
+ * Значение 1 означает размер страницы 65536 байт.
+ */
+quint32 BackupStore::detectPageSize(const QByteArray &fileHeader)
+{
+    static const QByteArray cSqliteHeader("SQLite format 3\0", 16);
+
+    if (fileHeader.size() < 18 || !fileHeader.startsWith(cSqliteHeader))
+        return cDefaultPageSize;
+
+    quint32 pageSize = qFromBigEndian<quint16>(fileHeader.constData() + 16);
+    if (pageSize == 1)
+        pageSize = 65536;
+
+    // Размер страницы SQLite - степень двойки от 512 до 65536
+    if (pageSize < 512 || pageSize > 65536 || (pageSize & (pageSize - 1)) != 0)
+        return cDefaultPageSize;
+
+    return pageSize;
+}
+
+QByteArray BackupStore::contentHash(const Manifest &manifest)
+{
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+
+    for (const QByteArray &pageHash : manifest.pageHashes)
+        hash.addData(pageHash);
+
+    return hash.result();
+}
+
+QString BackupStore::packFilePath(const QString &packName) const
+{
+    return m_storePath + "/packs/" + packName + ".pack";
+}
+
+QString BackupStore::packIndexFilePath(const QString &packName) const
+{
+    return m_storePath + "/packs/" + packName + ".index";
+}
+
+QString BackupStore::manifestFilePath(const QString &backupFileName) const
+{
+    // Имя не должно выводить за пределы папки manifests
+    return m_storePath + "/manifests/" + QFileInfo(backupFileName).fileName() + ".manifest";
+}
+
+QString BackupStore::restoreFilePath(const QString &backupFileName) const
+{
+    return m_storePath + "/restore/" + QFileInfo(backupFileName).fileName();
+}
+
+/*
+ * Страницы, которые уже есть в хранилище или повторяются в chunks,
+ * не записываются. Если ту же страницу параллельно сохранил
+ * другой поток, в индексе остается первое место, а копия
+ * освобождается при перезаписи пакета.
+ */
+bool BackupStore::addChunks(const QList<Chunk> &chunks)
+{
+    QList<Chunk> newChunks;
+    QSet<QByteArray> newHashes;
+
+    for (const Chunk &chunk : chunks)
+    {
+        if (newHashes.contains(chunk.first) || containsChunk(chunk.first))
+            continue;
+
+        newChunks << chunk;
+        newHashes.insert(chunk.first);
+    }
+
+    if (newChunks.isEmpty())
+        return true;
+
+    QHash<QByteArray, ChunkLocation> locations;
+    if (!writePack(newChunks, locations))
+        return false;
+
+    QMutexLocker locker(&m_packsMutex);
+
+    for (auto it = locations.cbegin(); it != locations.cend(); ++it)
+    {
+        if (!m_packedChunks.contains(it.key()))
+            m_packedChunks.insert(it.key(), it.value());
+    }
+
+    return true;
+}
+
+/*
+ * Файл пакета сбрасывается на диск до записи индекса,
+ * поэтому индекс никогда не ссылается на недописанные страницы.
+ * Сегмент холодного пакета записывается в формате сжатой части
+ * файла Compression, поэтому алгоритм берется из самого сегмента.
+ */
+bool BackupStore::writePack(const QList<Chunk> &chunks, QHash<QByteArray, ChunkLocation> &locations,
+                            quint8 codec, int level)
+{
+    const QString packName = QUuid::createUuid().toString(QUuid::WithoutBraces);
+
+    QFile packFile(packFilePath(packName));
+    if (!packFile.open(QIODevice::WriteOnly))
+    {
+        qInfo() << "ОШИБКА: не удалось создать пакет страниц:" << packFile.fileName();
+        return false;
+    }
+
+    locations.clear();
+
+    // Страницы записи, которая еще не записана в файл
+    QByteArray record;
+    QList<QPair<QByteArray, ChunkLocation>> recordLocations;
+    bool isWritten = true;
+
+    auto writeRecord = [&]()
+    {
+        const QByteArray data = codec == Compression::CodecNone
+                ? record : Compression::encodeChunk(codec, record, level);
+
+        for (QPair<QByteArray, ChunkLocation> &recordLocation : recordLocations)
+        {
+            recordLocation.second.offset = packFile.pos();
+            recordLocation.second.size = data.size();
+            locations.insert(recordLocation.first, recordLocation.second);
+        }
+
+        isWritten = !data.isEmpty() && packFile.write(data) == data.size();
+
+        record.clear();
+        recordLocations.clear();
+    };
+
+    for (const Chunk &chunk : chunks)
+    {
+        // В обычном пакете запись - одна страница
+        if (!record.isEmpty() && (codec == Compression::CodecNone
+                                  || record.size() + chunk.second.size() > cColdSegmentSize))
+        {
+            writeRecord();
+            if (!isWritten)
+                break;
+        }
+
+        ChunkLocation location;
+        location.packName = packName;
+        location.codec = codec;
+        location.pageOffset = record.size();
+        location.pageSize = chunk.second.size();
+
+        record += chunk.second;
+        recordLocations << qMakePair(chunk.first, location);
+    }
+
+    if (isWritten && !record.isEmpty())
+        writeRecord();
+
+    if (!isWritten || locations.size() != chunks.size() || !FileUtils::syncToDisk(packFile))
+    {
+        qInfo() << "ОШИБКА: не удалось записать пакет страниц:" << packFile.fileName();
+        packFile.remove();
+        return false;
+    }
+
+    packFile.close();
+
+    QSaveFile indexFile(packIndexFilePath(packName));
+    if (!indexFile.open(QIODevice::WriteOnly))
+    {
+        qInfo() << "ОШИБКА: не удалось создать индекс пакета страниц:" << packName;
+        packFile.remove();
+        return false;
+    }
+
+    QDataStream out(&indexFile);
+    out.setVersion(QDataStream::Qt_5_0);
+
+    out << cPackIndexMagic << cPackIndexVersion << codec << qint32(level)
+        << quint32(locations.size());
+    for (auto it = locations.cbegin(); it != locations.cend(); ++it)
+        out << it.key() << it->offset << it->size << it->pageOffset << it->pageSize;
+
+    if (!indexFile.commit())
+    {
+        qInfo() << "ОШИБКА: не удалось записать индекс пакета страниц:" << packName;
+        packFile.remove();
+        return false;
+    }
+
+    FileUtils::syncDirectory(m_storePath + "/packs");
+
+    return true;
+}
+
+bool BackupStore::readPackIndex(const QString &packName,
+                                QHash<QByteArray, ChunkLocation> &locations, int *pLevel) const
+{
+    QFile indexFile(packIndexFilePath(packName));
+    if (!indexFile.open(QIODevice::ReadOnly))
+        return false;
+
+    QDataStream in(&indexFile);
+    in.setVersion(QDataStream::Qt_5_0);
+
+    quint32 magic = 0;
+    quint32 version = 0;
+    quint8 codec = Compression::CodecNone;
+    qint32 level = -1;
+    quint32 count = 0;
+    in >> magic >> version >> codec >> level >> count;
+
+    if (magic != cPackIndexMagic || version != cPackIndexVersion)
+        return false;
+
+    if (pLevel)
+        *pLevel = level;
+
+    locations.clear();
+
+    for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; i++)
+    {
+        QByteArray hash;
+        ChunkLocation location;
+        location.packName = packName;
+        location.codec = codec;
+        in >> hash >> location.offset >> location.size >> location.pageOffset >> location.pageSize;
+
+        locations.insert(hash, location);
+    }
+
+    return in.status() == QDataStream::Ok;
+}
+
+bool BackupStore::findPackedChunk(const QByteArray &hash, ChunkLocation &location) const
+{
+    QMutexLocker locker(&m_packsMutex);
+
+    auto it = m_packedChunks.constFind(hash);
+    if (it == m_packedChunks.cend())
+        return false;
+
+    location = it.value();
+
+    return true;
+}
+
+bool BackupStore::readPackedChunk(const ChunkLocation &location, QByteArray &page) const
+{
+    const QString segmentKey = location.packName + ":" + QString::number(location.offset);
+
+    if (location.codec != Compression::CodecNone)
+    {
+        QMutexLocker locker(&m_segmentsMutex);
+
+        if (const QByteArray *pSegment = m_decodedSegments.object(segmentKey))
+        {
+            page = pSegment->mid(location.pageOffset, location.pageSize);
+            return page.size() == location.pageSize;
+        }
+    }
+
+    QFile packFile(packFilePath(location.packName));
+    if (!packFile.open(QIODevice::ReadOnly) || !packFile.seek(location.offset))
+        return false;
+
+    const QByteArray record = packFile.read(location.size);
+    if (record.size() != location.size)
+        return false;
+
+    if (location.codec == Compression::CodecNone)
+    {
+        page = record;
+        return page.size() == location.pageSize;
+    }
+
+    QByteArray *pSegment = new QByteArray();
+    if (!Compression::decodeChunk(record, *pSegment, cColdSegmentSize))
+    {
+        delete pSegment;
+        return false;
+    }
+
+    page = pSegment->mid(location.pageOffset, location.pageSize);
+
+    QMutexLocker locker(&m_segmentsMutex);
+    m_decodedSegments.insert(segmentKey, pSegment, qMax(1, int(pSegment->size() / 1024)));
+
+    return page.size() == location.pageSize;
+}
+
+bool BackupStore::writeManifest(const QString &backupFileName, const Manifest &manifest)
+{
+    QSaveFile manifestFile(manifestFilePath(backupFileName));
+    if (!manifestFile.open(QIODevice::WriteOnly))
+    {
+        qInfo() << "ОШИБКА: не удалось создать манифест версии:" << backupFileName;
+        return false;
+    }
+
+    QDataStream out(&manifestFile);
+    out.setVersion(QDataStream::Qt_5_0);
+
+    out << cManifestMagic << cManifestVersion;
+    out << manifest.fileSize << manifest.pageSize << manifest.pageHashes;
+
+    if (!manifestFile.commit())
+    {
+        qInfo() << "ОШИБКА: не удалось записать манифест версии:" << backupFileName;
+        return false;
+    }
+
+    FileUtils::syncDirectory(m_storePath + "/manifests");
+
+    return true;
+}
+
+QString BackupStore::reserveBackupFileName(const QString &backupFileName)
+{
+    QMutexLocker locker(&m_namesMutex);
+
+    QFileInfo backupFileInfo(backupFileName);
+    QString newBackupFileName = backupFileInfo.fileName();
+
+    for (int i = 2; contains(newBackupFileName) || m_reservedNames.contains(newBackupFileName); i++)
+    {
+        newBackupFileName = backupFileInfo.completeBaseName() + "-" + QString::number(i)
+                + "." + backupFileInfo.suffix();
+    }
+
+    m_reservedNames.insert(newBackupFileName);
+
+    return newBackupFileName;
+}
+
+void BackupStore::releaseBackupFileName(const QString &backupFileName)
+{
+    QMutexLocker locker(&m_namesMutex);
+
+    m_reservedNames.remove(backupFileName);
+}
+
+/*
+ * Отмечает ранее восстановленный файл версии как используемый.
+ * Время изменения файла обновляется, поэтому при очистке папки restore
+ * первыми удаляются файлы, которые дольше всего не запрашивались.
+ */
+bool BackupStore::useRestoredFile(const QString &backupFileName)
+{
+    QMutexLocker locker(&m_restoreMutex);
+
+    QFile restoredFile(restoreFilePath(backupFileName));
+    if (!restoredFile.exists())
+        return false;
+
+    if (restoredFile.open(QIODevice::ReadWrite))
+        restoredFile.setFileTime(QDateTime::currentDateTime(), QFileDevice::FileModificationTime);
+
+    m_restoredFileUsers[QFileInfo(restoredFile).fileName()]++;
+
+    return true;
+}
+
+/*
+ * Удаляет самые старые восстановленные файлы,
+ * если их общий размер превышает cMaxRestoreDirSize.
+ * Используемые файлы не удаляются, даже если папка остается больше предела.
+ * Вызывается под m_restoreMutex.
+ */
+void BackupStore::trimRestoreDirectory()
+{
+    QDir restoreDirectory(m_storePath + "/restore");
+    QFileInfoList restoredFiles = restoreDirectory.entryInfoList(QDir::Files, QDir::Time);
+
+    qint64 totalSize = 0;
+    for (const QFileInfo &restoredFile : qAsConst(restoredFiles))
+        totalSize += restoredFile.size();
+
+    while (totalSize > cMaxRestoreDirSize && !restoredFiles.isEmpty())
+    {
+        QFileInfo oldestFile = restoredFiles.takeLast();
+
+        if (m_restoredFileUsers.contains(oldestFile.fileName()))
+            continue;
+
+        // Открытый файл может быть занят отправкой; тогда он будет удален позже
+        if (QFile::remove(oldestFile.absoluteFilePath()))
+            totalSize -= oldestFile.size();
+    }
+}
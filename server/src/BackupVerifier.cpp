@@ -0,0 +1,146 @@
+#include "BackupVerifier.h"
+#include "BackupStore.h"
+#include "DatabaseCreation.h"
+
+#include <QFile>
+#include <QHash>
+#include <QUuid>
+#include <QVariant>
+#include <QCryptographicHash>
+#include <QtSql/QSqlDatabase>
+#include <QtSql/QSqlQuery>
+#include <QtSql/QSqlError>
+
+BackupVerifier::Result BackupVerifier::verify(const QString &dbFilePath,
+                                              const QByteArray &expectedContentHash)
+{
+    Result result;
+
+    bool isRead = false;
+    QByteArray contentHash = fileContentHash(dbFilePath, isRead);
+
+    if (!isRead)
+    {
+        result.details = "Не удалось прочитать файл";
+        return result;
+    }
+
+    if (!expectedContentHash.isEmpty() && contentHash != expectedContentHash)
+    {
+        result.details = "Хеш содержимого не совпадает с каталогом";
+        return result;
+    }
+
+    const QString connectionName = "backup-verifier-"
+            + QUuid::createUuid().toString(QUuid::WithoutBraces);
+
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", connectionName);
+        db.setDatabaseName(dbFilePath);
+        db.setConnectOptions("QSQLITE_OPEN_READONLY");
+
+        if (!db.open())
+        {
+            result.details = "Не удалось открыть базу данных: " + db.lastError().text();
+        }
+        else
+        {
+            QSqlQuery query(db);
+
+            if (!query.exec("PRAGMA quick_check") || !query.next())
+            {
+                result.details = "Не удалось выполнить quick_check: " + query.lastError().text();
+            }
+            else if (query.value(0).toString() != "ok")
+            {
+                result.details = "quick_check: " + query.value(0).toString();
+            }
+            else
+            {
+                QHash<QString, QString> tablesSql;
+                query.exec("SELECT name, sql FROM sqlite_master WHERE type = 'table'");
+                while (query.next())
+                    tablesSql.insert(query.value(0).toString(), query.value(1).toString());
+
+                // Списки команд создания и названий таблиц идут в одном порядке
+                for (int i = 0; i < DatabaseCreation::cTableNamesList.size(); i++)
+                {
+                    const QString &tableName = DatabaseCreation::cTableNamesList.at(i);
+
+                    if (!tablesSql.contains(tableName))
+                    {
+                        result.details = "Нет таблицы " + tableName;
+                        break;
+                    }
+
+                    if (normalizeSql(tablesSql.value(tableName))
+                            != normalizeSql(DatabaseCreation::cTableCreationCommandsList.at(i)))
+                    {
+                        result.details = "Схема таблицы " + tableName + " отличается от ожидаемой";
+                        break;
+                    }
+                }
+
+                if (result.details.isEmpty()
+                        && query.exec("SELECT COUNT(*) FROM [Общая информация]") && query.next())
+                {
+                    result.employeeCount = query.value(0).toInt();
+                    result.isValid = true;
+                }
+            }
+
+            db.close();
+        }
+    }
+
+    QSqlDatabase::removeDatabase(connectionName);
+
+    return result;
+}
+
+/*
+ * Хеш считается так же, как BackupStore::contentHash:
+ * SHA-256 списка хешей страниц файла.
+ */
+QByteArray BackupVerifier::fileContentHash(const QString &dbFilePath, bool &isRead)
+{
+    isRead = false;
+
+    QFile dbFile(dbFilePath);
+    if (!dbFile.open(QIODevice::ReadOnly))
+        return QByteArray();
+
+    const qint64 pageSize = BackupStore::detectPageSize(dbFile.peek(100));
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+
+    while (!dbFile.atEnd())
+    {
+        QByteArray page = dbFile.read(pageSize);
+        if (page.isEmpty())
+            return QByteArray();
+
+        hash.addData(QCryptographicHash::hash(page, QCryptographicHash::Sha256));
+    }
+
+    isRead = true;
+
+    return hash.result();
+}
+
+/*
+ * SQLite хранит в sqlite_master текст команды создания без точки с запятой,
+ * поэтому команды сравниваются без нее и без пробельных символов.
+ */
+QString BackupVerifier::normalizeSql(const QString &sql)
+{
+    QString normalizedSql;
+    normalizedSql.reserve(sql.size());
+
+    for (const QChar &ch : sql)
+    {
+        if (!ch.isSpace() && ch != ';')
+            normalizedSql.append(ch);
+    }
+
+    return normalizedSql;
+}
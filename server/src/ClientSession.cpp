@@ -0,0 +1,1402 @@
+#include "ClientSession.h"
+#include "TcpServer.h"
+#include "UploadIngest.h"
+#include "DownloadStream.h"
+#include "Compression.h"
+#include "TransferScheduler.h"
+#include "BackupQueryExecutor.h"
+#include "ReplyFlow.h"
+
+#include <QDataStream>
+#include <QPointer>
+#include <QFileInfo>
+#include <QtEndian>
+#include <QDebug>
+
+const qint64 ClientSession::cMaxBytesToWrite = 2 * TcpProtocol::cChunkSize;
+const int ClientSession::cMaxRangeStreams = 4;
+
+ClientSession::ClientSession(qintptr socketDescriptor, TcpServer *server)
+    : QObject(server)
+    , m_pServer(server)
+    , m_socketDescriptor(socketDescriptor)
+{
+    m_pSocket = new QTcpSocket(this);
+    m_pSocket->setSocketDescriptor(socketDescriptor);
+
+    m_readQuota = server->transferScheduler()->settings().sessionReadQuota;
+    updateReadBufferSize();
+
+    connect(m_pSocket, &QTcpSocket::readyRead, this, &ClientSession::slotReadyRead);
+    connect(m_pSocket, &QTcpSocket::disconnected, this, &ClientSession::slotDisconnected);
+    connect(m_pSocket, &QTcpSocket::bytesWritten, this, &ClientSession::slotBytesWritten);
+}
+
+ClientSession::~ClientSession()
+{
+    // Рабочие потоки, ждущие отправки пачек ответов, больше их не передают
+    for (const std::shared_ptr<ReplyFlow> &replyFlow : qAsConst(m_replyFlows))
+        replyFlow->cancel();
+}
+
+/*
+ * Отправляет клиенту открытую в рабочем потоке версию download.
+ */
+void ClientSession::sendDatabase(quint32 requestId, const std::shared_ptr<DownloadStream> &download,
+                                 qint64 offset, const QByteArray &contentHash)
+{
+    if (m_pDownload)
+    {
+        m_pendingDownloads.enqueue(PendingDownload { requestId, download, offset, contentHash });
+        return;
+    }
+
+    const QString dbName = download->dbName();
+
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_0);
+
+    download->skipTo(offset);
+
+    out << dbName.toUtf8();
+    out << download->size();
+    out << download->offset();
+    out << contentHash;
+    sendFrame(TcpDataType::Database, requestId, payload);
+
+    if (download->offset() > 0)
+    {
+        qInfo() << "Отправка базы данных" << dbName << "клиенту" << m_socketDescriptor
+                << "продолжается с" << download->offset() << "байт";
+    }
+
+    m_pDownload = download;
+    m_downloadRequestId = requestId;
+    writeNextDownloadChunks();
+}
+
+void ClientSession::startNextDownload()
+{
+    while (!m_pDownload && !m_pendingDownloads.isEmpty())
+    {
+        PendingDownload pendingDownload = m_pendingDownloads.dequeue();
+        sendDatabase(pendingDownload.requestId, pendingDownload.download,
+                     pendingDownload.offset, pendingDownload.contentHash);
+    }
+}
+
+void ClientSession::cancelRequest(quint32 requestId)
+{
+    for (int i = m_pendingDownloads.size() - 1; i >= 0; i--)
+    {
+        if (m_pendingDownloads.at(i).requestId == requestId)
+            m_pendingDownloads.removeAt(i);
+    }
+
+    if (m_pDownload && m_downloadRequestId == requestId)
+    {
+        qInfo() << "Клиент" << m_socketDescriptor << "отменил получение базы данных"
+                << m_pDownload->dbName();
+
+        m_pDownload.reset();
+        m_downloadRequestId = 0;
+        m_isChunkEncodingInProgress = false;
+        m_requestTimers.remove(requestId);
+
+        startNextDownload();
+
+        if (!m_pDownload && m_hasDownloadGrant)
+        {
+            m_hasDownloadGrant = false;
+            m_pServer->transferScheduler()->release(this, TransferScheduler::cGrantSize);
+        }
+    }
+
+    if (m_pIngest && m_ingestRequestId == requestId)
+    {
+        qInfo() << "Клиент" << m_socketDescriptor << "отменил загрузку базы данных"
+                << m_pIngest->dbName();
+
+        m_requestTimers.remove(requestId);
+        resetIngest();
+    }
+
+    if (m_pDeltaUpload && m_deltaRequestId == requestId)
+    {
+        qInfo() << "Клиент" << m_socketDescriptor << "отменил загрузку базы данных";
+
+        m_requestTimers.remove(requestId);
+        resetDeltaUpload();
+    }
+
+    if (std::shared_ptr<ReplyFlow> replyFlow = m_replyFlows.take(requestId))
+    {
+        qInfo() << "Клиент" << m_socketDescriptor << "отменил запрос" << requestId;
+
+        replyFlow->cancel();
+        m_waitingReplyFlows.removeAll(replyFlow);
+        m_requestTimers.remove(requestId);
+    }
+}
+
+void ClientSession::writeNextDownloadChunks()
+{
+    while (m_pDownload && !m_isChunkEncodingInProgress
+           && m_pSocket->bytesToWrite() < cMaxBytesToWrite)
+    {
+        if (m_pDownload->atEnd())
+        {
+            sendFrame(TcpDataType::DatabaseEnd, m_downloadRequestId);
+            finishRequestTimer(m_downloadRequestId);
+
+            qInfo() << "База данных" << m_pDownload->dbName()
+                    << "была отправлена клиенту" << m_socketDescriptor;
+
+            m_pDownload.reset();
+            startNextDownload();
+            return;
+        }
+
+        if (!m_hasDownloadGrant)
+        {
+            requestTransferGrant(m_isDownloadWaitingForGrant);
+            return;
+        }
+
+        m_hasDownloadGrant = false;
+
+        QByteArray rawChunk = m_pDownload->nextChunk(TcpProtocol::cChunkSize);
+
+        if (m_codec == Compression::CodecNone)
+        {
+            // Несжатая часть отправляется прямо из отображенного файла
+            sendFrame(TcpDataType::DatabaseChunk, m_downloadRequestId,
+                      QByteArray(1, char(Compression::CodecNone)), rawChunk);
+            markBulkFrameWritten();
+        }
+        else
+        {
+            encodeDownloadChunk(rawChunk);
+        }
+    }
+}
+
+void ClientSession::encodeDownloadChunk(const QByteArray &rawChunk)
+{
+    m_isChunkEncodingInProgress = true;
+
+    QPointer<ClientSession> session(this);
+    TcpServer *server = m_pServer;
+    std::shared_ptr<DownloadStream> download = m_pDownload;
+    quint8 codec = m_codec;
+
+    // rawChunk ссылается на отображенный файл, который держит download
+    server->runInWorkerPool([server, session, download, rawChunk, codec]()
+    {
+        QByteArray encodedChunk = Compression::encodeChunk(codec, rawChunk);
+
+        QMetaObject::invokeMethod(server, [session, download, encodedChunk]()
+        {
+            if (!session)
+                return;
+
+            // Отправка отменена, пока часть сжималась: разрешение на нее не понадобится
+            if (download != session->m_pDownload)
+            {
+                session->m_pServer->transferScheduler()->release(session, TransferScheduler::cGrantSize);
+                return;
+            }
+
+            session->m_isChunkEncodingInProgress = false;
+            session->sendFrame(TcpDataType::DatabaseChunk, session->m_downloadRequestId, encodedChunk);
+            session->markBulkFrameWritten();
+            session->writeNextDownloadChunks();
+        }, Qt::QueuedConnection);
+    }, TcpServer::BulkTaskPriority);
+}
+
+void ClientSession::markBulkFrameWritten()
+{
+    m_bulkFrameEnds.enqueue(m_writtenBytes);
+}
+
+void ClientSession::slotBytesWritten(qint64 bytes)
+{
+    m_pServer->noteTransferActivity();
+
+    m_sentBytes += bytes;
+    while (!m_bulkFrameEnds.isEmpty() && m_bulkFrameEnds.head() <= m_sentBytes)
+    {
+        m_bulkFrameEnds.dequeue();
+        m_pServer->transferScheduler()->release(this, TransferScheduler::cGrantSize);
+    }
+
+    writeNextDownloadChunks();
+    releaseWaitingReplyFlows();
+}
+
+void ClientSession::replyBatchSent(const std::shared_ptr<ReplyFlow> &replyFlow)
+{
+    if (m_pSocket->bytesToWrite() < cMaxBytesToWrite)
+        replyFlow->releaseSlot();
+    else
+        m_waitingReplyFlows << replyFlow;
+}
+
+void ClientSession::releaseWaitingReplyFlows()
+{
+    if (m_pSocket->bytesToWrite() >= cMaxBytesToWrite)
+        return;
+
+    for (const std::shared_ptr<ReplyFlow> &replyFlow : qAsConst(m_waitingReplyFlows))
+        replyFlow->releaseSlot();
+
+    m_waitingReplyFlows.clear();
+}
+
+void ClientSession::transferGranted()
+{
+    TransferScheduler *scheduler = m_pServer->transferScheduler();
+
+    if (m_isReadWaitingForGrant)
+    {
+        m_isReadWaitingForGrant = false;
+        m_readAllowance += TransferScheduler::cGrantSize;
+        m_inboundHeldBytes += TransferScheduler::cGrantSize;
+        slotReadyRead();
+    }
+    else if (m_isDownloadWaitingForGrant)
+    {
+        m_isDownloadWaitingForGrant = false;
+        m_hasDownloadGrant = true;
+        writeNextDownloadChunks();
+    }
+    else
+    {
+        // Передача, для которой запрашивалось разрешение, уже прервана
+        scheduler->release(this, TransferScheduler::cGrantSize);
+    }
+
+    if (m_isReadWaitingForGrant || m_isDownloadWaitingForGrant)
+        scheduler->requestGrant(this);
+}
+
+void ClientSession::requestTransferGrant(bool &isWaitingForGrant)
+{
+    if (isWaitingForGrant)
+        return;
+
+    isWaitingForGrant = true;
+    m_pServer->transferScheduler()->requestGrant(this);
+}
+
+bool ClientSession::isReceivingDatabase() const
+{
+    return m_pIngest || m_pDeltaUpload;
+}
+
+void ClientSession::releaseInboundBytes(qint64 bytes)
+{
+    bytes = qMin(bytes, m_inboundHeldBytes);
+    m_inboundHeldBytes -= bytes;
+    m_pServer->transferScheduler()->release(this, bytes);
+}
+
+/*
+ * Возвращает в бюджет все, что занимал прием баз данных,
+ * когда ни одна загрузка больше не идет.
+ */
+void ClientSession::releaseUnusedInboundBytes()
+{
+    if (isReceivingDatabase())
+        return;
+
+    m_readAllowance = 0;
+    m_isReadWaitingForGrant = false;
+    releaseInboundBytes(m_inboundHeldBytes);
+}
+
+/*
+ * Сокет читает данные из ядра, только пока в квоте сессии есть место.
+ */
+void ClientSession::updateReadBufferSize()
+{
+    // Размер 0 означает неограниченный буфер
+    m_pSocket->setReadBufferSize(qMax<qint64>(1, m_readQuota - pendingBytes()));
+}
+
+void ClientSession::sendDatabaseFileCreationResult(quint32 requestId, bool dbFileCreated)
+{
+    if (dbFileCreated)
+        sendFrame(TcpDataType::DatabaseFileCreationSuccess, requestId);
+    else
+        sendFrame(TcpDataType::DatabaseFileCreationFailure, requestId);
+
+    m_pServer->metrics()->incrementCounter(ServerMetrics::labeled(
+        "ea_ingest_results_total", "result", dbFileCreated ? "success" : "failure"));
+    finishRequestTimer(requestId);
+}
+
+void ClientSession::startRequestTimer(quint32 requestId, const QString &metricName)
+{
+    RequestTimer &requestTimer = m_requestTimers[requestId];
+    requestTimer.metricName = metricName;
+    requestTimer.timer.start();
+}
+
+void ClientSession::finishRequestTimer(quint32 requestId)
+{
+    auto it = m_requestTimers.find(requestId);
+    if (it == m_requestTimers.end())
+        return;
+
+    m_pServer->metrics()->observe(it->metricName, it->timer.nsecsElapsed() / 1e9);
+    m_requestTimers.erase(it);
+}
+
+void ClientSession::sendDatabasesList(quint32 requestId, const QList<BackupInfo> &backupsList,
+                                      qint64 nextCursor)
+{
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_0);
+
+    out << backupsList << nextCursor;
+    sendFrame(TcpDataType::DatabasesList, requestId, payload);
+
+    qInfo() << "Список баз данных был отправлен клиенту" << m_socketDescriptor
+            << "; версий:" << backupsList.size();
+}
+
+void ClientSession::sendDatabaseSendFailure(quint32 requestId, const QString &error)
+{
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_0);
+
+    out << error;
+    sendFrame(TcpDataType::DatabaseSendFailure, requestId, payload);
+
+    qInfo() << "Клиенту" << m_socketDescriptor << "отправлено сообщение об ошибке:" << error;
+}
+
+/*
+ * Записывает заголовок кадра с типом dataType и номером запроса requestId
+ * и отправляет кадр клиенту этой сессии.
+ */
+void ClientSession::sendFrame(quint16 dataType, quint32 requestId, const QByteArray &payload)
+{
+    sendFrame(dataType, requestId, payload, QByteArray());
+}
+
+/*
+ * Отправляет кадр, содержимое которого состоит из двух частей.
+ * Позволяет не копировать большую часть payloadTail ради
+ * нескольких байт в начале кадра.
+ */
+void ClientSession::sendFrame(quint16 dataType, quint32 requestId,
+                              const QByteArray &payloadHead, const QByteArray &payloadTail)
+{
+    const qint64 frameSize = qint64(sizeof(quint64) + TcpProtocol::cHeaderSize)
+            + payloadHead.size() + payloadTail.size();
+
+    const QString typeName = ServerMetrics::dataTypeName(dataType);
+    ServerMetrics *metrics = m_pServer->metrics();
+    metrics->incrementCounter(ServerMetrics::labeled("ea_sent_frames_total", "type", typeName));
+    metrics->incrementCounter(ServerMetrics::labeled("ea_sent_bytes_total", "type", typeName),
+                              frameSize);
+    m_writtenBytes += frameSize;
+
+    m_pSocket->write(FrameDecoder::encodeHeader(
+                         dataType, requestId, quint64(payloadHead.size() + payloadTail.size())));
+    m_pSocket->write(payloadHead);
+
+    if (!payloadTail.isEmpty())
+        m_pSocket->write(payloadTail);
+}
+
+void ClientSession::slotReadyRead()
+{
+    m_pServer->noteTransferActivity();
+
+    for (;;)
+    {
+        // Продолжить разбор после записи накопившихся частей;
+        // в квоте остается место хотя бы для одного кадра
+        if (pendingBytes() >= m_readQuota - qint64(TcpProtocol::cMaxFrameSize))
+            break;
+
+        // Части загружаемой базы данных принимаются только по разрешениям планировщика
+        if (isReceivingDatabase() && m_readAllowance <= 0 && m_pSocket->bytesAvailable() > 0)
+        {
+            requestTransferGrant(m_isReadWaitingForGrant);
+            break;
+        }
+
+        FrameDecoder::Frame frame;
+        FrameDecoder::Result result = m_frameDecoder.readFrame(m_pSocket, frame);
+
+        if (result == FrameDecoder::NeedMoreData)
+            break;
+
+        if (result == FrameDecoder::InvalidFrame)
+        {
+            qInfo() << "ОШИБКА: недопустимый размер кадра" << m_frameDecoder.frameSize()
+                    << "от клиента" << m_socketDescriptor;
+            m_frameDecoder.reset();
+            m_pSocket->abort();
+            return;
+        }
+
+        if (frame.dataType == TcpDataType::DatabaseChunk
+                || frame.dataType == TcpDataType::DeltaUploadPage)
+            m_readAllowance -= frame.payload.size();
+
+        processFrame(frame);
+    }
+
+    updateReadBufferSize();
+}
+
+void ClientSession::processFrame(const FrameDecoder::Frame &frame)
+{
+    if (frame.version != TcpProtocol::cVersion)
+    {
+        qInfo() << "ОШИБКА: клиент" << m_socketDescriptor
+                << "использует неподдерживаемую версию протокола" << frame.version;
+        m_pSocket->abort();
+        return;
+    }
+
+    const quint16 incomingDataType = frame.dataType;
+    const quint32 requestId = frame.requestId;
+    const QByteArray &payload = frame.payload;
+
+    const QString typeName = ServerMetrics::dataTypeName(incomingDataType);
+    m_pServer->metrics()->incrementCounter(
+                ServerMetrics::labeled("ea_requests_total", "type", typeName));
+    m_pServer->metrics()->incrementCounter(
+                ServerMetrics::labeled("ea_received_bytes_total", "type", typeName),
+                qint64(sizeof(quint64) + TcpProtocol::cHeaderSize) + payload.size());
+
+    QDataStream in(payload);
+    in.setVersion(QDataStream::Qt_5_0);
+
+    /*
+     * Сессия может быть удалена, пока рабочий поток
+     * выполняет задачу, поэтому результат передается
+     * через охраняемый указатель.
+     */
+    QPointer<ClientSession> session(this);
+    TcpServer *server = m_pServer;
+
+    if (incomingDataType == TcpDataType::Hello)
+    {
+        processHello(requestId, payload);
+    }
+    else if (incomingDataType == TcpDataType::Database)
+    {
+        beginReceivingDatabase(requestId, payload);
+    }
+    else if (incomingDataType == TcpDataType::DatabaseChunk
+             || incomingDataType == TcpDataType::DatabaseEnd)
+    {
+        if (!m_pIngest || requestId != m_ingestRequestId)
+        {
+            qInfo() << "ОШИБКА: получена часть базы данных без начала передачи; запрос" << requestId;
+            return;
+        }
+
+        if (incomingDataType == TcpDataType::DatabaseChunk)
+            appendDatabaseChunk(payload);
+        else
+            finishReceivingDatabase();
+    }
+    else if (incomingDataType == TcpDataType::DeltaUploadOffer)
+    {
+        beginDeltaUpload(requestId, payload);
+    }
+    else if (incomingDataType == TcpDataType::DeltaUploadHashes
+             || incomingDataType == TcpDataType::DeltaUploadPage
+             || incomingDataType == TcpDataType::DeltaUploadEnd)
+    {
+        if (!m_pDeltaUpload || requestId != m_deltaRequestId)
+        {
+            qInfo() << "ОШИБКА: получены данные разностной загрузки без ее начала; запрос" << requestId;
+            return;
+        }
+
+        if (incomingDataType == TcpDataType::DeltaUploadHashes)
+            appendDeltaHashes(payload);
+        else if (incomingDataType == TcpDataType::DeltaUploadPage)
+            appendDeltaPage(payload);
+        else
+            finishDeltaUpload();
+    }
+    else if (incomingDataType == TcpDataType::DatabasesListRequest)
+    {
+        QString orgName;
+        qint64 from = 0;
+        qint64 to = 0;
+        qint64 cursor = 0;
+        quint32 limit = 0;
+        in >> orgName >> from >> to >> cursor >> limit;
+
+        if (limit == 0 || limit > TcpProtocol::cMaxListPageSize)
+            limit = TcpProtocol::cMaxListPageSize;
+
+        qInfo() << "Получен запрос на отправку списка баз данных; организация:" << orgName
+                << "курсор:" << cursor;
+
+        server->runInWorkerPool([server, session, requestId, orgName, from, to, cursor, limit]()
+        {
+            qint64 nextCursor = 0;
+            QList<BackupInfo> backupsList = server->backupCatalog()->listBackups(
+                        orgName, from, to, cursor, int(limit), nextCursor);
+
+            QMetaObject::invokeMethod(server, [session, requestId, backupsList, nextCursor]()
+            {
+                if (session)
+                    session->sendDatabasesList(requestId, backupsList, nextCursor);
+            }, Qt::QueuedConnection);
+        });
+    }
+    else if (incomingDataType == TcpDataType::SelectedDatabaseName)
+    {
+        QByteArray bArray;
+        qint64 receivedOffset = 0;
+        QByteArray receivedHash;
+        in >> bArray >> receivedOffset >> receivedHash;
+        QString dbFileForSendName = QString::fromUtf8(bArray);
+
+        if (dbFileForSendName.isEmpty())
+        {
+            qInfo() << "ОШИБКА: клиент не отправил имя базы данных, которую хочет получить";
+            sendDatabaseSendFailure(requestId, "Не указано имя базы данных");
+            return;
+        }
+
+        qInfo() << "Получено имя выбранной клиентом базы данных: " << dbFileForSendName;
+
+        startRequestTimer(requestId, "ea_serve_duration_seconds");
+
+        server->runInWorkerPool([server, session, requestId, dbFileForSendName,
+                                receivedOffset, receivedHash]()
+        {
+            QByteArray contentHash;
+            std::shared_ptr<DownloadStream> download = server->openBackup(dbFileForSendName, contentHash);
+            if (!download)
+            {
+                server->metrics()->incrementCounter("ea_serve_failures_total");
+
+                QMetaObject::invokeMethod(server, [session, requestId, dbFileForSendName]()
+                {
+                    if (!session)
+                        return;
+
+                    session->m_requestTimers.remove(requestId);
+                    session->sendDatabaseSendFailure(
+                                requestId, QString("Версия %1 не найдена или не может быть прочитана")
+                                .arg(dbFileForSendName));
+                }, Qt::QueuedConnection);
+                return;
+            }
+
+            // Полученная клиентом часть относится к другому содержимому
+            qint64 offset = receivedHash == contentHash ? receivedOffset : 0;
+
+            QMetaObject::invokeMethod(server, [session, requestId, download, offset, contentHash]()
+            {
+                if (session)
+                    session->sendDatabase(requestId, download, offset, contentHash);
+            }, Qt::QueuedConnection);
+        });
+    }
+    else if (incomingDataType == TcpDataType::BackupQueryRequest)
+    {
+        processBackupQuery(requestId, payload);
+    }
+    else if (incomingDataType == TcpDataType::DatabaseRangeRequest)
+    {
+        processDatabaseRangeRequest(requestId, payload);
+    }
+    else if (incomingDataType == TcpDataType::BackupDiffRequest)
+    {
+        processBackupDiff(requestId, payload);
+    }
+    else if (incomingDataType == TcpDataType::CancelRequest)
+    {
+        cancelRequest(requestId);
+    }
+    else if (incomingDataType == TcpDataType::StatsRequest)
+    {
+        QByteArray reply;
+        QDataStream out(&reply, QIODevice::WriteOnly);
+        out.setVersion(QDataStream::Qt_5_0);
+
+        out << server->metricsText();
+        sendFrame(TcpDataType::Stats, requestId, reply);
+    }
+    else
+    {
+        qInfo() << "ВНИМАНИЕ: тип получаемых данных неизвестен";
+    }
+}
+
+void ClientSession::processHello(quint32 requestId, const QByteArray &payload)
+{
+    QDataStream in(payload);
+    in.setVersion(QDataStream::Qt_5_0);
+
+    QList<quint8> offeredCodecs;
+    in >> offeredCodecs;
+
+    m_codec = Compression::chooseCodec(offeredCodecs);
+
+    QByteArray reply;
+    QDataStream out(&reply, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_0);
+
+    out << m_codec;
+    sendFrame(TcpDataType::HelloAck, requestId, reply);
+
+    qInfo() << "Клиент" << m_socketDescriptor << "; алгоритм сжатия:"
+            << Compression::codecName(m_codec);
+}
+
+void ClientSession::processBackupQuery(quint32 requestId, const QByteArray &payload)
+{
+    QDataStream in(payload);
+    in.setVersion(QDataStream::Qt_5_0);
+
+    BackupQuery query;
+    in >> query;
+
+    qInfo() << "Получен запрос записей версии" << query.backupFileName
+            << "; вид запроса:" << query.kind << "; значение:" << query.argument;
+
+    startRequestTimer(requestId, "ea_query_duration_seconds");
+
+    std::shared_ptr<ReplyFlow> replyFlow = std::make_shared<ReplyFlow>();
+    m_replyFlows.insert(requestId, replyFlow);
+
+    QPointer<ClientSession> session(this);
+    TcpServer *server = m_pServer;
+
+    server->runInWorkerPool([server, session, requestId, replyFlow, query]()
+    {
+        QString error;
+        qint64 rowCount = -1;
+
+        QString dbFilePath = server->backupStore()->materialize(query.backupFileName);
+        if (dbFilePath.isEmpty())
+        {
+            error = "Версия не найдена: " + query.backupFileName;
+        }
+        else
+        {
+            rowCount = BackupQueryExecutor::run(dbFilePath, query,
+                                                [server, session, requestId, replyFlow](const BackupQueryBatch &batch)
+            {
+                // Пачка передается, когда клиент получил предыдущие
+                if (!replyFlow->waitForSlot())
+                    return false;
+
+                QMetaObject::invokeMethod(server, [session, requestId, replyFlow, batch]()
+                {
+                    if (session)
+                        session->sendBackupQueryBatch(requestId, replyFlow, batch);
+                }, Qt::QueuedConnection);
+
+                return true;
+            }, error);
+
+            server->backupStore()->releaseRestoredFile(query.backupFileName);
+            server->verifyOnFirstRestore(query.backupFileName);
+        }
+
+        // Конец ответа ставится в очередь после всех пачек
+        QMetaObject::invokeMethod(server, [session, requestId, rowCount, error]()
+        {
+            if (session)
+                session->sendBackupQueryEnd(requestId, rowCount, error);
+        }, Qt::QueuedConnection);
+    });
+}
+
+void ClientSession::sendBackupQueryBatch(quint32 requestId, const std::shared_ptr<ReplyFlow> &replyFlow,
+                                         const BackupQueryBatch &batch)
+{
+    // Запрос отменен клиентом
+    if (replyFlow->isCanceled())
+        return;
+
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_0);
+
+    out << batch;
+    sendFrame(TcpDataType::BackupQueryRows, requestId, payload);
+
+    replyBatchSent(replyFlow);
+}
+
+void ClientSession::sendBackupQueryEnd(quint32 requestId, qint64 rowCount, const QString &error)
+{
+    // Запрос отменен клиентом
+    if (!m_replyFlows.remove(requestId))
+        return;
+
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_0);
+
+    out << (rowCount >= 0) << quint32(qMax<qint64>(0, rowCount)) << error;
+    sendFrame(TcpDataType::BackupQueryEnd, requestId, payload);
+
+    finishRequestTimer(requestId);
+
+    if (rowCount >= 0)
+        qInfo() << "Клиенту" << m_socketDescriptor << "отправлено записей:" << rowCount;
+    else
+        qInfo() << "ОШИБКА: запрос записей клиента" << m_socketDescriptor << "не выполнен:" << error;
+}
+
+void ClientSession::processBackupDiff(quint32 requestId, const QByteArray &payload)
+{
+    QDataStream in(payload);
+    in.setVersion(QDataStream::Qt_5_0);
+
+    QString oldBackupFileName;
+    QString newBackupFileName;
+    in >> oldBackupFileName >> newBackupFileName;
+
+    qInfo() << "Получен запрос сравнения версий" << oldBackupFileName << "и" << newBackupFileName;
+
+    startRequestTimer(requestId, "ea_diff_duration_seconds");
+
+    std::shared_ptr<ReplyFlow> replyFlow = std::make_shared<ReplyFlow>();
+    m_replyFlows.insert(requestId, replyFlow);
+
+    QPointer<ClientSession> session(this);
+    TcpServer *server = m_pServer;
+
+    server->runInWorkerPool([server, session, requestId, replyFlow,
+                            oldBackupFileName, newBackupFileName]()
+    {
+        QString error;
+        BackupDiffEngine::Summary summary;
+        bool isSucceeded = false;
+
+        QString oldDbFilePath = server->backupStore()->materialize(oldBackupFileName);
+        QString newDbFilePath = server->backupStore()->materialize(newBackupFileName);
+
+        if (oldDbFilePath.isEmpty())
+        {
+            error = "Версия не найдена: " + oldBackupFileName;
+        }
+        else if (newDbFilePath.isEmpty())
+        {
+            error = "Версия не найдена: " + newBackupFileName;
+        }
+        else
+        {
+            isSucceeded = BackupDiffEngine::run(oldDbFilePath, newDbFilePath,
+                                                [server, session, requestId, replyFlow](const QList<EmployeeDiff> &entries)
+            {
+                // Пачка передается, когда клиент получил предыдущие
+                if (!replyFlow->waitForSlot())
+                    return false;
+
+                QMetaObject::invokeMethod(server, [session, requestId, replyFlow, entries]()
+                {
+                    if (session)
+                        session->sendBackupDiffEntries(requestId, replyFlow, entries);
+                }, Qt::QueuedConnection);
+
+                return true;
+            }, summary, error);
+        }
+
+        if (!oldDbFilePath.isEmpty())
+        {
+            server->backupStore()->releaseRestoredFile(oldBackupFileName);
+            server->verifyOnFirstRestore(oldBackupFileName);
+        }
+
+        if (!newDbFilePath.isEmpty())
+        {
+            server->backupStore()->releaseRestoredFile(newBackupFileName);
+            server->verifyOnFirstRestore(newBackupFileName);
+        }
+
+        // Конец ответа ставится в очередь после всех пачек
+        QMetaObject::invokeMethod(server, [session, requestId, isSucceeded, summary, error]()
+        {
+            if (session)
+                session->sendBackupDiffEnd(requestId, isSucceeded, summary, error);
+        }, Qt::QueuedConnection);
+    });
+}
+
+void ClientSession::sendBackupDiffEntries(quint32 requestId, const std::shared_ptr<ReplyFlow> &replyFlow,
+                                          const QList<EmployeeDiff> &entries)
+{
+    // Сравнение отменено клиентом
+    if (replyFlow->isCanceled())
+        return;
+
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_0);
+
+    out << entries;
+    sendFrame(TcpDataType::BackupDiffEntries, requestId, payload);
+
+    replyBatchSent(replyFlow);
+}
+
+void ClientSession::sendBackupDiffEnd(quint32 requestId, bool isSucceeded,
+                                      const BackupDiffEngine::Summary &summary, const QString &error)
+{
+    // Сравнение отменено клиентом
+    if (!m_replyFlows.remove(requestId))
+        return;
+
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_0);
+
+    out << isSucceeded << summary.addedCount << summary.removedCount << summary.changedCount << error;
+    sendFrame(TcpDataType::BackupDiffEnd, requestId, payload);
+
+    finishRequestTimer(requestId);
+
+    if (isSucceeded)
+        qInfo() << "Клиенту" << m_socketDescriptor << "отправлено сравнение версий; добавлено:"
+                << summary.addedCount << "удалено:" << summary.removedCount
+                << "изменено:" << summary.changedCount;
+    else
+        qInfo() << "ОШИБКА: сравнение версий для клиента" << m_socketDescriptor << "не выполнено:" << error;
+}
+
+void ClientSession::processDatabaseRangeRequest(quint32 requestId, const QByteArray &payload)
+{
+    QDataStream in(payload);
+    in.setVersion(QDataStream::Qt_5_0);
+
+    QString backupFileName;
+    qint64 offset = 0;
+    qint32 length = 0;
+    in >> backupFileName >> offset >> length;
+
+    length = qBound(0, length, TcpProtocol::cMaxRangeSize);
+
+    QPointer<ClientSession> session(this);
+    TcpServer *server = m_pServer;
+    std::shared_ptr<DownloadStream> openedDownload = m_rangeStreams.value(backupFileName);
+    quint8 codec = m_codec;
+
+    server->runInWorkerPool([server, session, requestId, backupFileName,
+                            offset, length, openedDownload, codec]()
+    {
+        std::shared_ptr<DownloadStream> download = openedDownload;
+        if (!download)
+        {
+            QByteArray contentHash;
+            download = server->openBackup(backupFileName, contentHash);
+        }
+
+        QByteArray header;
+        QDataStream out(&header, QIODevice::WriteOnly);
+        out.setVersion(QDataStream::Qt_5_0);
+
+        QByteArray encodedChunk;
+
+        if (download)
+        {
+            out << true << download->size() << offset;
+
+            if (length > 0)
+                encodedChunk = Compression::encodeChunk(codec, download->chunkAt(offset, length));
+        }
+        else
+        {
+            out << false << qint64(0) << offset;
+        }
+
+        QMetaObject::invokeMethod(server, [session, requestId, backupFileName,
+                                           download, header, encodedChunk]()
+        {
+            if (!session)
+                return;
+
+            if (download && !session->m_rangeStreams.contains(backupFileName))
+            {
+                if (session->m_rangeStreams.size() >= cMaxRangeStreams)
+                    session->m_rangeStreams.clear();
+
+                session->m_rangeStreams.insert(backupFileName, download);
+            }
+
+            session->sendFrame(TcpDataType::DatabaseRange, requestId, header, encodedChunk);
+        }, Qt::QueuedConnection);
+    });
+}
+
+void ClientSession::beginReceivingDatabase(quint32 requestId, const QByteArray &payload)
+{
+    QDataStream in(payload);
+    in.setVersion(QDataStream::Qt_5_0);
+
+    QByteArray bArray;
+    qint64 dbSize = -1;
+    QByteArray transferId;
+    QByteArray contentHash;
+    in >> bArray >> dbSize >> transferId >> contentHash;
+
+    QString receivedDbName = QString::fromUtf8(bArray);
+    if (receivedDbName.endsWith(".db", Qt::CaseInsensitive))
+        receivedDbName.chop(3);
+
+    // Имя не должно выводить за пределы папки databases
+    receivedDbName = QFileInfo(receivedDbName).fileName();
+
+    if (m_pIngest)
+    {
+        qInfo() << "ВНИМАНИЕ: предыдущая загрузка базы данных прервана новой";
+        resetIngest();
+    }
+
+    if (receivedDbName.isEmpty() || dbSize < 0)
+    {
+        qInfo() << "ОШИБКА: клиент не отправил имя или размер базы данных";
+        sendDatabaseFileCreationResult(requestId, false);
+        return;
+    }
+
+    m_pIngest = std::make_shared<UploadIngest>(m_pServer->databasesPath(), receivedDbName, dbSize,
+                                               transferId, contentHash);
+    m_ingestRequestId = requestId;
+    startRequestTimer(requestId, ServerMetrics::labeled("ea_ingest_duration_seconds", "mode", "stream"));
+
+    if (!m_pIngest->open())
+    {
+        resetIngest();
+        sendDatabaseFileCreationResult(requestId, false);
+        return;
+    }
+
+    QByteArray reply;
+    QDataStream out(&reply, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_0);
+
+    out << m_pIngest->resumeOffset();
+    sendFrame(TcpDataType::UploadResumeOffset, requestId, reply);
+
+    qInfo() << "Начат прием базы данных:" << receivedDbName << "размер:" << dbSize;
+}
+
+void ClientSession::appendDatabaseChunk(const QByteArray &chunk)
+{
+    if (m_isIngestFailed)
+        return;
+
+    m_pendingChunks.enqueue(chunk);
+    m_pendingChunksBytes += chunk.size();
+
+    writeNextPendingChunk();
+}
+
+void ClientSession::finishReceivingDatabase()
+{
+    m_isIngestFinishRequested = true;
+
+    if (!m_isChunkWriteInProgress && m_pendingChunks.isEmpty())
+        commitIngest();
+}
+
+void ClientSession::writeNextPendingChunk()
+{
+    if (m_isChunkWriteInProgress || m_pendingChunks.isEmpty())
+        return;
+
+    QByteArray chunk = m_pendingChunks.dequeue();
+    m_isChunkWriteInProgress = true;
+
+    QPointer<ClientSession> session(this);
+    TcpServer *server = m_pServer;
+    std::shared_ptr<UploadIngest> ingest = m_pIngest;
+
+    server->runInWorkerPool([server, session, ingest, chunk]()
+    {
+        QByteArray rawChunk;
+        bool isWritten = Compression::decodeChunk(chunk, rawChunk, int(TcpProtocol::cChunkSize));
+
+        if (isWritten)
+        {
+            QElapsedTimer writeTimer;
+            writeTimer.start();
+
+            isWritten = ingest->append(rawChunk);
+
+            server->metrics()->observe(ServerMetrics::labeled(
+                "ea_disk_write_duration_seconds", "operation", "chunk"), writeTimer.nsecsElapsed() / 1e9);
+        }
+
+        // Неизвестно, что из части попало в файл, поэтому продолжать с него нельзя
+        if (!isWritten)
+            ingest->discard();
+
+        const qint64 chunkSize = chunk.size();
+
+        QMetaObject::invokeMethod(server, [session, ingest, isWritten, chunkSize]()
+        {
+            if (session)
+                session->chunkWritten(ingest.get(), isWritten, chunkSize);
+        }, Qt::QueuedConnection);
+    }, TcpServer::BulkTaskPriority);
+
+    m_pendingChunksBytes -= chunk.size();
+}
+
+void ClientSession::chunkWritten(const UploadIngest *ingest, bool isWritten, qint64 chunkSize)
+{
+    // Результат записи для уже прерванной загрузки не влияет на текущую
+    if (ingest != m_pIngest.get())
+        return;
+
+    m_isChunkWriteInProgress = false;
+    releaseInboundBytes(chunkSize);
+
+    if (!isWritten)
+    {
+        m_isIngestFailed = true;
+        m_pendingChunks.clear();
+        m_pendingChunksBytes = 0;
+    }
+
+    if (!m_pendingChunks.isEmpty())
+        writeNextPendingChunk();
+    else if (m_isIngestFinishRequested)
+        commitIngest();
+
+    // Возобновить разбор кадров, если он был приостановлен
+    slotReadyRead();
+}
+
+void ClientSession::commitIngest()
+{
+    std::shared_ptr<UploadIngest> ingest = m_pIngest;
+    quint32 requestId = m_ingestRequestId;
+    bool isIngestFailed = m_isIngestFailed;
+    resetIngest();
+
+    if (isIngestFailed)
+    {
+        sendDatabaseFileCreationResult(requestId, false);
+        return;
+    }
+
+    qInfo() << "Получена база данных: " << ingest->dbName();
+
+    QPointer<ClientSession> session(this);
+    TcpServer *server = m_pServer;
+
+    server->runInWorkerPool([server, session, ingest, requestId]()
+    {
+        QString backupFileName;
+        QElapsedTimer commitTimer;
+        commitTimer.start();
+
+        if (ingest->finish())
+        {
+            backupFileName = server->backupStore()->importFile(
+                        ingest->partFilePath(), server->newBackupFileName(ingest->dbName()));
+        }
+
+        server->metrics()->observe(ServerMetrics::labeled(
+            "ea_disk_write_duration_seconds", "operation", "commit"), commitTimer.nsecsElapsed() / 1e9);
+
+        bool dbFileCreated = !backupFileName.isEmpty();
+        if (dbFileCreated && !server->registerBackup(backupFileName))
+            qInfo() << "ВНИМАНИЕ: версия" << backupFileName << "будет добавлена в каталог при перезапуске";
+
+        QMetaObject::invokeMethod(server, [session, requestId, dbFileCreated]()
+        {
+            if (session)
+                session->sendDatabaseFileCreationResult(requestId, dbFileCreated);
+        }, Qt::QueuedConnection);
+
+        // Проверка целостности не задерживает ответ клиенту
+        if (dbFileCreated)
+            server->verifyBackup(backupFileName, ingest->partFilePath());
+    });
+}
+
+/*
+ * Сбрасывает состояние приема базы данных.
+ * Если запись еще выполняется в рабочем потоке, ее результат
+ * будет проигнорирован, а временный файл будет удален
+ * вместе с последней ссылкой на UploadIngest.
+ */
+void ClientSession::resetIngest()
+{
+    m_pIngest.reset();
+    m_ingestRequestId = 0;
+    m_pendingChunks.clear();
+    m_pendingChunksBytes = 0;
+    m_isChunkWriteInProgress = false;
+    m_isIngestFailed = false;
+    m_isIngestFinishRequested = false;
+
+    releaseUnusedInboundBytes();
+}
+
+void ClientSession::beginDeltaUpload(quint32 requestId, const QByteArray &payload)
+{
+    QDataStream in(payload);
+    in.setVersion(QDataStream::Qt_5_0);
+
+    QByteArray bArray;
+    qint64 fileSize = -1;
+    quint32 pageSize = 0;
+    quint32 pageCount = 0;
+    in >> bArray >> fileSize >> pageSize >> pageCount;
+
+    QString receivedDbName = QString::fromUtf8(bArray);
+    if (receivedDbName.endsWith(".db", Qt::CaseInsensitive))
+        receivedDbName.chop(3);
+
+    // Имя не должно выводить за пределы папки databases
+    receivedDbName = QFileInfo(receivedDbName).fileName();
+
+    if (m_pDeltaUpload)
+    {
+        qInfo() << "ВНИМАНИЕ: предыдущая разностная загрузка прервана новой";
+        resetDeltaUpload();
+    }
+
+    m_pDeltaUpload = std::make_shared<DeltaUpload>(receivedDbName, fileSize, pageSize, pageCount);
+    m_deltaRequestId = requestId;
+    startRequestTimer(requestId, ServerMetrics::labeled("ea_ingest_duration_seconds", "mode", "delta"));
+
+    if (!m_pDeltaUpload->isValid())
+    {
+        qInfo() << "ОШИБКА: неверные параметры разностной загрузки от клиента" << m_socketDescriptor;
+        resetDeltaUpload();
+        sendDatabaseFileCreationResult(requestId, false);
+        return;
+    }
+
+    qInfo() << "Начата разностная загрузка базы данных:" << receivedDbName
+            << "размер:" << fileSize << "страниц:" << pageCount;
+
+    // Пустой файл не содержит страниц, поэтому хешей не будет
+    if (pageCount == 0)
+        appendDeltaHashes(QByteArray());
+}
+
+void ClientSession::appendDeltaHashes(const QByteArray &hashes)
+{
+    if (!m_pDeltaUpload || m_isDeltaUploadFailed)
+        return;
+
+    if (!m_pDeltaUpload->appendHashes(hashes))
+    {
+        qInfo() << "ОШИБКА: неверный список хешей страниц от клиента" << m_socketDescriptor;
+        m_isDeltaUploadFailed = true;
+        return;
+    }
+
+    if (!m_pDeltaUpload->hasAllHashes())
+        return;
+
+    QPointer<ClientSession> session(this);
+    TcpServer *server = m_pServer;
+    std::shared_ptr<DeltaUpload> deltaUpload = m_pDeltaUpload;
+
+    m_isDeltaTaskInProgress = true;
+
+    server->runInWorkerPool([server, session, deltaUpload]()
+    {
+        QBitArray missingPages = deltaUpload->findMissingPages(server->backupStore());
+
+        QMetaObject::invokeMethod(server, [session, deltaUpload, missingPages]()
+        {
+            if (!session)
+                return;
+
+            session->deltaTaskFinished(deltaUpload.get(), true, 0);
+
+            if (deltaUpload == session->m_pDeltaUpload)
+            {
+                QByteArray payload;
+                QDataStream out(&payload, QIODevice::WriteOnly);
+                out.setVersion(QDataStream::Qt_5_0);
+
+                out << missingPages;
+                session->sendFrame(TcpDataType::DeltaUploadMissingPages,
+                                   session->m_deltaRequestId, payload);
+
+                qInfo() << "Клиенту" << session->m_socketDescriptor << "нужно прислать"
+                        << missingPages.count(true) << "страниц из" << missingPages.size();
+            }
+        }, Qt::QueuedConnection);
+    });
+}
+
+void ClientSession::appendDeltaPage(const QByteArray &payload)
+{
+    if (!m_pDeltaUpload || m_isDeltaUploadFailed)
+        return;
+
+    if (payload.size() < int(sizeof(quint32)))
+    {
+        m_isDeltaUploadFailed = true;
+        return;
+    }
+
+    quint32 pageIndex = qFromBigEndian<quint32>(payload.constData());
+    QByteArray page = payload.mid(sizeof(quint32));
+
+    m_pendingPages << DeltaUpload::Page(pageIndex, page);
+    m_pendingPagesBytes += page.size();
+
+    writeNextPagesBatch();
+}
+
+void ClientSession::finishDeltaUpload()
+{
+    m_isDeltaFinishRequested = true;
+
+    if (!m_isDeltaTaskInProgress && m_pendingPages.isEmpty())
+        commitDeltaUpload();
+}
+
+void ClientSession::writeNextPagesBatch()
+{
+    if (m_isDeltaTaskInProgress || m_pendingPages.isEmpty())
+        return;
+
+    QList<DeltaUpload::Page> pages;
+    pages.swap(m_pendingPages);
+
+    qint64 batchBytes = 0;
+    for (const DeltaUpload::Page &page : qAsConst(pages))
+        batchBytes += page.second.size();
+
+    m_isDeltaTaskInProgress = true;
+
+    QPointer<ClientSession> session(this);
+    TcpServer *server = m_pServer;
+    std::shared_ptr<DeltaUpload> deltaUpload = m_pDeltaUpload;
+
+    server->runInWorkerPool([server, session, deltaUpload, pages, batchBytes]()
+    {
+        QElapsedTimer writeTimer;
+        writeTimer.start();
+
+        bool isStored = deltaUpload->storePages(server->backupStore(), pages);
+
+        server->metrics()->observe(ServerMetrics::labeled(
+            "ea_disk_write_duration_seconds", "operation", "pages"), writeTimer.nsecsElapsed() / 1e9);
+
+        QMetaObject::invokeMethod(server, [session, deltaUpload, isStored, batchBytes]()
+        {
+            if (session)
+                session->deltaTaskFinished(deltaUpload.get(), isStored, batchBytes);
+        }, Qt::QueuedConnection);
+    }, TcpServer::BulkTaskPriority);
+
+    m_pendingPagesBytes -= batchBytes;
+}
+
+void ClientSession::deltaTaskFinished(const DeltaUpload *deltaUpload, bool isSucceeded,
+                                      qint64 storedBytes)
+{
+    // Результат задачи для уже прерванной загрузки не влияет на текущую
+    if (deltaUpload != m_pDeltaUpload.get())
+        return;
+
+    m_isDeltaTaskInProgress = false;
+    releaseInboundBytes(storedBytes);
+
+    if (!isSucceeded)
+    {
+        m_isDeltaUploadFailed = true;
+        m_pendingPagesBytes = 0;
+        m_pendingPages.clear();
+    }
+
+    if (!m_pendingPages.isEmpty())
+        writeNextPagesBatch();
+    else if (m_isDeltaFinishRequested)
+        commitDeltaUpload();
+
+    // Возобновить разбор кадров, если он был приостановлен
+    slotReadyRead();
+}
+
+void ClientSession::commitDeltaUpload()
+{
+    std::shared_ptr<DeltaUpload> deltaUpload = m_pDeltaUpload;
+    quint32 requestId = m_deltaRequestId;
+    bool isDeltaUploadFailed = m_isDeltaUploadFailed;
+    resetDeltaUpload();
+
+    if (isDeltaUploadFailed)
+    {
+        sendDatabaseFileCreationResult(requestId, false);
+        return;
+    }
+
+    QPointer<ClientSession> session(this);
+    TcpServer *server = m_pServer;
+
+    server->runInWorkerPool([server, session, deltaUpload, requestId]()
+    {
+        QElapsedTimer commitTimer;
+        commitTimer.start();
+
+        QString backupFileName = deltaUpload->commit(
+                    server->backupStore(), server->newBackupFileName(deltaUpload->dbName()));
+
+        server->metrics()->observe(ServerMetrics::labeled(
+            "ea_disk_write_duration_seconds", "operation", "commit"), commitTimer.nsecsElapsed() / 1e9);
+
+        bool dbFileCreated = !backupFileName.isEmpty();
+        if (dbFileCreated && !server->registerBackup(backupFileName))
+            qInfo() << "ВНИМАНИЕ: версия" << backupFileName << "будет добавлена в каталог при перезапуске";
+
+        // Файл версии не восстанавливается: версия проверяется
+        // при первом запросе клиента (см. TcpServer::verifyOnFirstRestore)
+        QMetaObject::invokeMethod(server, [session, requestId, dbFileCreated]()
+        {
+            if (session)
+                session->sendDatabaseFileCreationResult(requestId, dbFileCreated);
+        }, Qt::QueuedConnection);
+    });
+}
+
+void ClientSession::resetDeltaUpload()
+{
+    m_pDeltaUpload.reset();
+    m_deltaRequestId = 0;
+    m_pendingPages.clear();
+    m_pendingPagesBytes = 0;
+    m_isDeltaTaskInProgress = false;
+    m_isDeltaUploadFailed = false;
+    m_isDeltaFinishRequested = false;
+
+    releaseUnusedInboundBytes();
+}
+
+void ClientSession::slotDisconnected()
+{
+    qInfo() << "Клиент отключился: " << m_socketDescriptor;
+
+    emit finished(this);
+    deleteLater();
+}
@@ -0,0 +1,122 @@
+#include "DeltaUpload.h"
+#include "TcpDataTypes.h"
+#include "Compression.h"
+
+#include <QCryptographicHash>
+#include <QDebug>
+
+DeltaUpload::DeltaUpload(const QString &dbName, qint64 fileSize, quint32 pageSize, quint32 pageCount)
+    : m_dbName(dbName)
+    , m_pageCount(pageCount)
+{
+    m_manifest.fileSize = fileSize;
+    m_manifest.pageSize = pageSize;
+}
+
+bool DeltaUpload::isValid() const
+{
+    const quint32 pageSize = m_manifest.pageSize;
+
+    if (m_dbName.isEmpty() || m_manifest.fileSize < 0)
+        return false;
+
+    // Размер страницы SQLite - степень двойки от 512 до 65536
+    if (pageSize < 512 || pageSize > 65536 || (pageSize & (pageSize - 1)) != 0)
+        return false;
+
+    qint64 expectedPageCount = (m_manifest.fileSize + pageSize - 1) / pageSize;
+
+    return expectedPageCount == qint64(m_pageCount);
+}
+
+bool DeltaUpload::appendHashes(const QByteArray &hashes)
+{
+    if (hashes.size() % TcpProtocol::cPageHashSize != 0)
+        return false;
+
+    if (quint32(m_manifest.pageHashes.size() + hashes.size() / TcpProtocol::cPageHashSize)
+            > m_pageCount)
+        return false;
+
+    for (int offset = 0; offset < hashes.size(); offset += TcpProtocol::cPageHashSize)
+        m_manifest.pageHashes << hashes.mid(offset, TcpProtocol::cPageHashSize);
+
+    return true;
+}
+
+QBitArray DeltaUpload::findMissingPages(BackupStore *store)
+{
+    m_missingPages = QBitArray(int(m_pageCount));
+    m_receivedPages = QBitArray(int(m_pageCount));
+
+    for (int i = 0; i < m_manifest.pageHashes.size(); i++)
+    {
+        /*
+         * Проверяется наличие страницы во всем хранилище,
+         * а не только в последней версии этой организации:
+         * так не нужно присылать и страницы, совпадающие с другими версиями.
+         */
+        if (!store->retainChunk(m_manifest.pageHashes.at(i)))
+            m_missingPages.setBit(i);
+    }
+
+    return m_missingPages;
+}
+
+bool DeltaUpload::storePages(BackupStore *store, const QList<Page> &pages)
+{
+    // Страницы кадра записываются одним пакетом
+    QList<BackupStore::Chunk> chunks;
+
+    for (const Page &page : pages)
+    {
+        if (page.first >= m_pageCount || !m_missingPages.testBit(int(page.first)))
+        {
+            qInfo() << "ОШИБКА: клиент прислал незапрошенную страницу" << page.first;
+            return false;
+        }
+
+        QByteArray rawPage;
+        if (!Compression::decodeChunk(page.second, rawPage, int(m_manifest.pageSize))
+                || rawPage.size() != expectedPageSize(page.first))
+        {
+            qInfo() << "ОШИБКА: неверный размер страницы" << page.first;
+            return false;
+        }
+
+        const QByteArray &expectedHash = m_manifest.pageHashes.at(int(page.first));
+        if (QCryptographicHash::hash(rawPage, QCryptographicHash::Sha256) != expectedHash)
+        {
+            qInfo() << "ОШИБКА: содержимое страницы" << page.first << "не совпадает с ее хешем";
+            return false;
+        }
+
+        chunks << BackupStore::Chunk(expectedHash, rawPage);
+    }
+
+    if (!store->addChunks(chunks))
+        return false;
+
+    for (const Page &page : pages)
+        m_receivedPages.setBit(int(page.first));
+
+    return true;
+}
+
+QString DeltaUpload::commit(BackupStore *store, const QString &backupFileName)
+{
+    if (!hasAllHashes() || m_receivedPages != m_missingPages)
+    {
+        qInfo() << "ОШИБКА: клиент прислал не все недостающие страницы базы данных" << m_dbName;
+        return QString();
+    }
+
+    return store->addBackup(backupFileName, m_manifest);
+}
+
+qint64 DeltaUpload::expectedPageSize(quint32 pageIndex) const
+{
+    qint64 pageOffset = qint64(pageIndex) * m_manifest.pageSize;
+
+    return qMin<qint64>(m_manifest.pageSize, m_manifest.fileSize - pageOffset);
+}
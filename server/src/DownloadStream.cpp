@@ -0,0 +1,85 @@
+#include "DownloadStream.h"
+
+#include <QDebug>
+
+DownloadStream::DownloadStream(const QString &dbFilePath, const QString &dbName)
+    : m_dbFile(dbFilePath)
+    , m_dbName(dbName)
+{
+
+}
+
+DownloadStream::DownloadStream(const QByteArray &dbData, const QString &dbName)
+    : m_dbName(dbName)
+    , m_dbData(dbData)
+    , m_isInMemory(true)
+{
+
+}
+
+DownloadStream::~DownloadStream()
+{
+    if (m_pMappedData)
+        m_dbFile.unmap(m_pMappedData);
+
+    m_dbFile.close();
+}
+
+bool DownloadStream::open()
+{
+    if (m_isInMemory)
+    {
+        m_size = m_dbData.size();
+        m_offset = 0;
+        m_pData = m_dbData.constData();
+        return true;
+    }
+
+    if (!m_dbFile.exists())
+    {
+        qInfo() << "ОШИБКА: отправляемый файл не существует: " << m_dbFile.fileName();
+        return false;
+    }
+
+    if (!m_dbFile.open(QIODevice::ReadOnly))
+    {
+        qInfo() << "ОШИБКА: не удалось открыть отправляемый файл:" << m_dbFile.fileName();
+        return false;
+    }
+
+    m_size = m_dbFile.size();
+    m_offset = 0;
+
+    // Пустой файл нельзя отобразить в память, но и отправлять в нем нечего
+    if (m_size == 0)
+        return true;
+
+    m_pMappedData = m_dbFile.map(0, m_size);
+    if (!m_pMappedData)
+    {
+        qInfo() << "ОШИБКА: не удалось отобразить в память отправляемый файл:"
+                << m_dbFile.fileName();
+        return false;
+    }
+
+    m_pData = reinterpret_cast<const char *>(m_pMappedData);
+
+    return true;
+}
+
+QByteArray DownloadStream::nextChunk(qint64 maxChunkSize)
+{
+    QByteArray chunk = chunkAt(m_offset, maxChunkSize);
+    m_offset += chunk.size();
+
+    return chunk;
+}
+
+QByteArray DownloadStream::chunkAt(qint64 offset, qint64 maxChunkSize) const
+{
+    qint64 chunkSize = qMin(maxChunkSize, m_size - offset);
+    if (offset < 0 || chunkSize <= 0)
+        return QByteArray();
+
+    return QByteArray::fromRawData(m_pData + offset, int(chunkSize));
+}
@@ -0,0 +1,34 @@
+#include "FileUtils.h"
+
+#ifdef Q_OS_WIN
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+bool FileUtils::syncToDisk(QFile &file)
+{
+    if (!file.flush())
+        return false;
+
+#ifdef Q_OS_WIN
+    return _commit(file.handle()) == 0;
+#else
+    return ::fsync(file.handle()) == 0;
+#endif
+}
+
+void FileUtils::syncDirectory(const QString &dirPath)
+{
+#ifndef Q_OS_WIN
+    int dirFd = ::open(QFile::encodeName(dirPath).constData(), O_RDONLY);
+    if (dirFd >= 0)
+    {
+        ::fsync(dirFd);
+        ::close(dirFd);
+    }
+#else
+    Q_UNUSED(dirPath);
+#endif
+}
@@ -0,0 +1,64 @@
+#include "FrameDecoder.h"
+
+#include <QDataStream>
+#include <QtEndian>
+
+FrameDecoder::Result FrameDecoder::readFrame(QIODevice *device, Frame &frame)
+{
+    if (m_state == ReadingSize)
+    {
+        if (device->bytesAvailable() < qint64(sizeof(quint64)))
+            return NeedMoreData;
+
+        char sizeBytes[sizeof(quint64)];
+        device->read(sizeBytes, sizeof(sizeBytes));
+        m_frameSize = qFromBigEndian<quint64>(sizeBytes);
+
+        if (m_frameSize < TcpProtocol::cHeaderSize || m_frameSize > TcpProtocol::cMaxFrameSize)
+            return InvalidFrame;
+
+        m_frameData.clear();
+        m_frameData.reserve(int(m_frameSize));
+        m_state = ReadingFrame;
+    }
+
+    qint64 remainingSize = qint64(m_frameSize) - m_frameData.size();
+    if (remainingSize > 0)
+    {
+        m_frameData.append(device->read(remainingSize));
+
+        if (m_frameData.size() < qint64(m_frameSize))
+            return NeedMoreData;
+    }
+
+    const char *header = m_frameData.constData();
+    frame.version = qFromBigEndian<quint16>(header);
+    frame.dataType = qFromBigEndian<quint16>(header + sizeof(quint16));
+    frame.requestId = qFromBigEndian<quint32>(header + 2 * sizeof(quint16));
+    frame.payload = m_frameData.mid(int(TcpProtocol::cHeaderSize));
+
+    reset();
+
+    return FrameReady;
+}
+
+void FrameDecoder::reset()
+{
+    m_state = ReadingSize;
+    m_frameSize = 0;
+    m_frameData.clear();
+}
+
+QByteArray FrameDecoder::encodeHeader(quint16 dataType, quint32 requestId, quint64 payloadSize)
+{
+    QByteArray header;
+    QDataStream out(&header, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_0);
+
+    out << quint64(TcpProtocol::cHeaderSize + payloadSize);
+    out << TcpProtocol::cVersion;
+    out << dataType;
+    out << requestId;
+
+    return header;
+}
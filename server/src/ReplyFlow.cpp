@@ -0,0 +1,42 @@
+#include "ReplyFlow.h"
+
+// Первая пачка передается без ожидания
+ReplyFlow::ReplyFlow()
+    : m_slots(1)
+    , m_isCanceled(0)
+{
+
+}
+
+bool ReplyFlow::waitForSlot()
+{
+    if (isCanceled())
+        return false;
+
+    m_slots.acquire();
+
+    // Ожидание прервано отменой: разрешение остается следующему вызову
+    if (isCanceled())
+    {
+        m_slots.release();
+        return false;
+    }
+
+    return true;
+}
+
+void ReplyFlow::releaseSlot()
+{
+    m_slots.release();
+}
+
+void ReplyFlow::cancel()
+{
+    m_isCanceled.storeRelease(1);
+    m_slots.release();
+}
+
+bool ReplyFlow::isCanceled() const
+{
+    return m_isCanceled.loadAcquire() != 0;
+}
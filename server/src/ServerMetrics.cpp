@@ -0,0 +1,254 @@
+#include "ServerMetrics.h"
+#include "TcpDataTypes.h"
+
+#include <QMutexLocker>
+#include <QTextStream>
+
+#include <cmath>
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#endif
+
+const int ServerMetrics::cBucketCount = 112;
+const double ServerMetrics::cFirstBucketBound = 0.00001;
+
+void ServerMetrics::incrementCounter(const QString &name, qint64 value)
+{
+    QMutexLocker locker(&m_mutex);
+    m_counters[name] += value;
+}
+
+void ServerMetrics::setCounter(const QString &name, qint64 value)
+{
+    QMutexLocker locker(&m_mutex);
+    m_counters[name] = value;
+}
+
+void ServerMetrics::setGauge(const QString &name, qint64 value)
+{
+    QMutexLocker locker(&m_mutex);
+    m_gauges[name] = value;
+}
+
+void ServerMetrics::addToGauge(const QString &name, qint64 delta)
+{
+    QMutexLocker locker(&m_mutex);
+    m_gauges[name] += delta;
+}
+
+void ServerMetrics::observe(const QString &name, double seconds)
+{
+    QMutexLocker locker(&m_mutex);
+
+    Histogram &histogram = m_histograms[name];
+    if (histogram.buckets.isEmpty())
+        histogram.buckets.fill(0, cBucketCount);
+
+    histogram.buckets[bucketIndex(seconds)]++;
+    histogram.count++;
+    histogram.sum += seconds;
+    histogram.max = qMax(histogram.max, seconds);
+}
+
+/*
+ * Распределения выводятся как summary: квантили 0.5 и 0.99,
+ * сумма и количество значений.
+ */
+QString ServerMetrics::toText() const
+{
+    QMutexLocker locker(&m_mutex);
+
+    QString text;
+    QTextStream out(&text);
+    QString lastBaseName;
+
+    auto writeType = [&out, &lastBaseName](const QString &name, const char *type)
+    {
+        const QString metricName = baseName(name);
+        if (metricName != lastBaseName)
+        {
+            out << "# TYPE " << metricName << " " << type << "\n";
+            lastBaseName = metricName;
+        }
+    };
+
+    for (auto it = m_counters.cbegin(); it != m_counters.cend(); ++it)
+    {
+        writeType(it.key(), "counter");
+        out << it.key() << " " << it.value() << "\n";
+    }
+
+    for (auto it = m_gauges.cbegin(); it != m_gauges.cend(); ++it)
+    {
+        writeType(it.key(), "gauge");
+        out << it.key() << " " << it.value() << "\n";
+    }
+
+    for (auto it = m_histograms.cbegin(); it != m_histograms.cend(); ++it)
+    {
+        const QString &name = it.key();
+        const Histogram &histogram = it.value();
+        const QString metricName = baseName(name);
+        const QString labels = name.mid(metricName.size());
+
+        writeType(name, "summary");
+        out << withLabel(name, "quantile=\"0.5\"") << " " << histogram.quantile(0.5) << "\n";
+        out << withLabel(name, "quantile=\"0.99\"") << " " << histogram.quantile(0.99) << "\n";
+        out << metricName << "_sum" << labels << " " << histogram.sum << "\n";
+        out << metricName << "_count" << labels << " " << histogram.count << "\n";
+    }
+
+    out.flush();
+
+    return text;
+}
+
+QString ServerMetrics::labeled(const QString &name, const QString &labelName,
+                               const QString &labelValue)
+{
+    return withLabel(name, labelName + "=\"" + labelValue + "\"");
+}
+
+QString ServerMetrics::dataTypeName(quint16 dataType)
+{
+    switch (dataType)
+    {
+        case TcpDataType::Database :
+          return "Database";
+        case TcpDataType::DatabasesList :
+          return "DatabasesList";
+        case TcpDataType::DatabasesListRequest :
+          return "DatabasesListRequest";
+        case TcpDataType::SelectedDatabaseName :
+          return "SelectedDatabaseName";
+        case TcpDataType::DatabaseFileCreationSuccess :
+          return "DatabaseFileCreationSuccess";
+        case TcpDataType::DatabaseFileCreationFailure :
+          return "DatabaseFileCreationFailure";
+        case TcpDataType::DatabaseChunk :
+          return "DatabaseChunk";
+        case TcpDataType::DatabaseEnd :
+          return "DatabaseEnd";
+        case TcpDataType::DeltaUploadOffer :
+          return "DeltaUploadOffer";
+        case TcpDataType::DeltaUploadHashes :
+          return "DeltaUploadHashes";
+        case TcpDataType::DeltaUploadMissingPages :
+          return "DeltaUploadMissingPages";
+        case TcpDataType::DeltaUploadPage :
+          return "DeltaUploadPage";
+        case TcpDataType::DeltaUploadEnd :
+          return "DeltaUploadEnd";
+        case TcpDataType::Hello :
+          return "Hello";
+        case TcpDataType::HelloAck :
+          return "HelloAck";
+        case TcpDataType::UploadResumeOffset :
+          return "UploadResumeOffset";
+        case TcpDataType::StatsRequest :
+          return "StatsRequest";
+        case TcpDataType::Stats :
+          return "Stats";
+        case TcpDataType::BackupQueryRequest :
+          return "BackupQueryRequest";
+        case TcpDataType::BackupQueryRows :
+          return "BackupQueryRows";
+        case TcpDataType::BackupQueryEnd :
+          return "BackupQueryEnd";
+        case TcpDataType::DatabaseRangeRequest :
+          return "DatabaseRangeRequest";
+        case TcpDataType::DatabaseRange :
+          return "DatabaseRange";
+        case TcpDataType::BackupDiffRequest :
+          return "BackupDiffRequest";
+        case TcpDataType::BackupDiffEntries :
+          return "BackupDiffEntries";
+        case TcpDataType::BackupDiffEnd :
+          return "BackupDiffEnd";
+        case TcpDataType::CancelRequest :
+          return "CancelRequest";
+        case TcpDataType::DatabaseSendFailure :
+          return "DatabaseSendFailure";
+        default :
+          return "Unknown";
+    }
+}
+
+qint64 ServerMetrics::processCpuMicroseconds()
+{
+#ifdef Q_OS_WIN
+    FILETIME creationTime, exitTime, kernelTime, userTime;
+    if (!GetProcessTimes(GetCurrentProcess(), &creationTime, &exitTime, &kernelTime, &userTime))
+        return 0;
+
+    // FILETIME измеряется в интервалах по 100 нс
+    auto toMicroseconds = [](const FILETIME &time)
+    {
+        return ((qint64(time.dwHighDateTime) << 32) | time.dwLowDateTime) / 10;
+    };
+
+    return toMicroseconds(kernelTime) + toMicroseconds(userTime);
+#else
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+
+    return qint64(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000
+            + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+#endif
+}
+
+/*
+ * Значение квантиля - верхняя граница корзины, в которую он попадает,
+ * но не больше наибольшего наблюдавшегося значения.
+ */
+double ServerMetrics::Histogram::quantile(double q) const
+{
+    if (count == 0)
+        return 0;
+
+    const qint64 rank = qMax<qint64>(1, qint64(std::ceil(q * count)));
+    qint64 seen = 0;
+
+    for (int i = 0; i < buckets.size(); i++)
+    {
+        seen += buckets.at(i);
+        if (seen >= rank)
+            return qMin(bucketBound(i), max);
+    }
+
+    return max;
+}
+
+int ServerMetrics::bucketIndex(double seconds)
+{
+    if (seconds <= cFirstBucketBound)
+        return 0;
+
+    int index = int(std::ceil(4 * std::log2(seconds / cFirstBucketBound)));
+
+    return qBound(0, index, cBucketCount - 1);
+}
+
+double ServerMetrics::bucketBound(int index)
+{
+    return cFirstBucketBound * std::exp2(index / 4.0);
+}
+
+QString ServerMetrics::baseName(const QString &name)
+{
+    int labelsStart = name.indexOf('{');
+
+    return labelsStart < 0 ? name : name.left(labelsStart);
+}
+
+QString ServerMetrics::withLabel(const QString &name, const QString &label)
+{
+    if (!name.endsWith('}'))
+        return name + "{" + label + "}";
+
+    return name.left(name.size() - 1) + "," + label + "}";
+}
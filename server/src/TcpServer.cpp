@@ -1,17 +1,92 @@
 #include "TcpServer.h"
+#include "ClientSession.h"
+#include "UploadIngest.h"
+#include "DownloadStream.h"
+#include "BackupVerifier.h"
 
 #include <QCoreApplication>
 #include <QFile>
+#include <QSaveFile>
+#include <QSettings>
 #include <QDateTime>
 #include <QDebug>
-#include <QTextStream>
-#include <QDataStream>
+#include <QThread>
+
+const qint64 TcpServer::cTransferIdleTime = 2000;
 
 TcpServer::TcpServer()
+    : m_databasesPath(QCoreApplication::applicationDirPath() + "/databases")
+    , m_backupStore(m_databasesPath)
+    , m_backupCatalog(m_databasesPath)
+    , m_backupRetention(&m_backupStore, &m_backupCatalog, &m_backupCache)
 {
-    m_databasesDirectory = QCoreApplication::applicationDirPath() + "/databases";
-    if (!m_databasesDirectory.exists())
-        m_databasesDirectory.mkpath(".");
+    QDir databasesDirectory(m_databasesPath);
+    if (!databasesDirectory.exists())
+        databasesDirectory.mkpath(".");
+
+    m_workerPool.setMaxThreadCount(qMax(2, QThread::idealThreadCount()));
+    // Потоки не завершаются, поэтому их подключения к каталогу не накапливаются
+    m_workerPool.setExpiryTimeout(-1);
+
+    if (!m_backupStore.init())
+        qInfo() << "ОШИБКА: не удалось создать папки хранилища баз данных";
+
+    if (!m_backupCatalog.init())
+        qInfo() << "ОШИБКА: не удалось открыть каталог версий баз данных";
+
+    runInWorkerPool([this]()
+    {
+        removeExpiredUploads();
+        m_backupStore.importLegacyFiles();
+        m_backupCatalog.rebuild(&m_backupStore);
+    });
+
+    connect(&m_uploadsCleanupTimer, &QTimer::timeout, this, [this]()
+    {
+        runInWorkerPool([this]()
+        {
+            removeExpiredUploads();
+        });
+    });
+    m_uploadsCleanupTimer.start(10 * 60 * 1000);
+
+    m_maintenancePool.setMaxThreadCount(1);
+    m_maintenancePool.setExpiryTimeout(-1);
+
+    const QString settingsFilePath = QCoreApplication::applicationDirPath() + "/server.ini";
+
+    m_backupRetention.setPolicy(BackupRetention::loadPolicy(settingsFilePath));
+    m_backupRetention.setTransferActivityCheck([this]()
+    {
+        return isTransferActive();
+    });
+
+    connect(&m_retentionTimer, &QTimer::timeout, this, [this]()
+    {
+        // Следующий проход не ставится в очередь, пока не закончен предыдущий
+        if (m_maintenancePool.activeThreadCount() == 0)
+        {
+            m_maintenancePool.start([this]()
+            {
+                m_backupRetention.run();
+            });
+        }
+    });
+
+    if (m_backupRetention.policy().isEnabled)
+        m_retentionTimer.start(m_backupRetention.policy().intervalMinutes * 60 * 1000);
+
+    m_transferScheduler.setSettings(TransferScheduler::loadSettings(settingsFilePath));
+
+    QSettings settings(settingsFilePath, QSettings::IniFormat);
+    settings.beginGroup("Metrics");
+    int metricsDumpInterval = settings.value("DumpIntervalSeconds", 15).toInt();
+    m_metricsFilePath = QDir(QCoreApplication::applicationDirPath()).absoluteFilePath(
+                settings.value("DumpFile", "metrics.prom").toString());
+
+    connect(&m_metricsDumpTimer, &QTimer::timeout, this, &TcpServer::dumpMetrics);
+    if (metricsDumpInterval > 0)
+        m_metricsDumpTimer.start(metricsDumpInterval * 1000);
 
     if (this->listen(QHostAddress::Any, 2323))
         qInfo() << "Сервер запущен";
@@ -21,107 +96,235 @@ TcpServer::TcpServer()
 
 TcpServer::~TcpServer()
 {
+    // Рабочие потоки, ждущие отправки ответов сессиям, продолжают работу без них
+    const QSet<ClientSession *> sessions = m_sessions;
+    m_sessions.clear();
+    qDeleteAll(sessions);
+
+    m_backupRetention.stop();
+    m_maintenancePool.waitForDone();
+    m_workerPool.waitForDone();
+}
+
+void TcpServer::runInWorkerPool(std::function<void()> task, TaskPriority priority)
+{
+    m_metrics.addToGauge("ea_worker_queue_depth", 1);
 
+    m_workerPool.start([this, task]()
+    {
+        m_metrics.addToGauge("ea_worker_queue_depth", -1);
+        task();
+    }, priority);
 }
 
-void TcpServer::sendDatabase(const QFileInfo &dbFileInfo)
+QString TcpServer::newBackupFileName(const QString &dbName) const
 {
-    QFile dbFile(dbFileInfo.absoluteFilePath());
+    return dbName + " " + getDateAndTimeForName() + ".db";
+}
 
-    if (!dbFile.exists())
+std::shared_ptr<DownloadStream> TcpServer::openBackup(const QString &backupFileName,
+                                                      QByteArray &contentHash)
+{
+    // Версия, которой еще нет в каталоге, не кэшируется (ее номер равен 0)
+    BackupInfo backupInfo;
+    if (m_backupCatalog.findBackup(backupFileName, backupInfo))
     {
-        qInfo() << "ОШИБКА: отправляемый файл не существует: " << dbFileInfo.absoluteFilePath();
-        return;
+        contentHash = backupInfo.hash;
     }
+    else
+    {
+        BackupStore::Manifest manifest;
+        if (!m_backupStore.readManifest(backupFileName, manifest))
+        {
+            qInfo() << "ОШИБКА: версия базы данных не найдена в хранилище:" << backupFileName;
+            return nullptr;
+        }
 
-    if (!dbFile.open(QIODevice::ReadOnly))
+        contentHash = BackupStore::contentHash(manifest);
+    }
+
+    QString dbName = getDatabaseNameOnly(backupFileName);
+    std::shared_ptr<DownloadStream> download;
+    QByteArray dbData;
+
+    if (m_backupCache.find(backupInfo.id, contentHash, dbData))
     {
-        qInfo() << "ОШИБКА: не удалось открыть отправляемый файл:" << dbFileInfo.absoluteFilePath();
-        return;
+        qInfo() << "Версия" << backupFileName << "отправляется из кэша; попаданий:"
+                << m_backupCache.hits() << "промахов:" << m_backupCache.misses();
+
+        download = std::make_shared<DownloadStream>(dbData, dbName);
     }
+    else
+    {
+        QString dbFilePath = m_backupStore.materialize(backupFileName);
+        if (dbFilePath.isEmpty())
+            return nullptr;
+
+        dbData = m_backupCache.insertFile(backupInfo.id, contentHash, dbFilePath);
 
-    QByteArray data;
-    data.clear();
+        if (dbData.isEmpty())
+            download = std::make_shared<DownloadStream>(dbFilePath, dbName);
+        else
+            download = std::make_shared<DownloadStream>(dbData, dbName);
 
-    QDataStream out(&data, QIODevice::WriteOnly);
-    out.setVersion(QDataStream::Qt_5_0);
+        // Открытый файл остается доступен отправке, даже если его потом удалят из папки restore
+        bool isOpened = download->open();
+        m_backupStore.releaseRestoredFile(backupFileName);
 
-    out << quint16(0);
-    out << quint16(TcpDataType::Database);
-    out << getDatabaseNameOnly(dbFileInfo.fileName()).toUtf8();
-    out << dbFile.readAll();
-    out.device()->seek(0);
-    out << quint16(data.size() - sizeof(quint16));
-    m_pClientSocket->write(data);
+        verifyOnFirstRestore(backupFileName);
 
-    dbFile.close();
+        return isOpened ? download : nullptr;
+    }
 
-    qInfo() << "База данных " << dbFileInfo.fileName() << "была отправлена клиенту";
+    if (!download->open())
+        return nullptr;
+
+    return download;
 }
 
-void TcpServer::sendDatabaseFileCreationResult(bool dbFileCreated)
+void TcpServer::noteTransferActivity()
 {
-    QByteArray data;
-    data.clear();
-
-    QDataStream out(&data, QIODevice::WriteOnly);
-    out.setVersion(QDataStream::Qt_5_0);
+    m_lastTransferActivity = QDateTime::currentMSecsSinceEpoch();
+}
 
-    out << quint16(0);
-    if (dbFileCreated)
-        out << quint16(TcpDataType::DatabaseFileCreationSuccess);
-    else
-        out << quint16(TcpDataType::DatabaseFileCreationFailure);
-    out.device()->seek(0);
-    out << quint16(data.size() - sizeof(quint16));
-    m_pClientSocket->write(data);
+bool TcpServer::isTransferActive() const
+{
+    return QDateTime::currentMSecsSinceEpoch() - m_lastTransferActivity < cTransferIdleTime;
 }
 
-void TcpServer::sendDatabasesList()
+QString TcpServer::metricsText()
 {
-    QByteArray data;
-    data.clear();
+    qint64 pendingBytes = 0;
+    qint64 pendingDownloads = 0;
+    qint64 bytesToWrite = 0;
+
+    for (const ClientSession *session : qAsConst(m_sessions))
+    {
+        pendingBytes += session->pendingBytes();
+        pendingDownloads += session->pendingDownloadsCount();
+        bytesToWrite += session->bytesToWrite();
+    }
 
-    QDataStream out(&data, QIODevice::WriteOnly);
-    out.setVersion(QDataStream::Qt_5_0);
+    m_metrics.setGauge("ea_connections_active", m_sessions.size());
+    m_metrics.setGauge("ea_session_pending_bytes", pendingBytes);
+    m_metrics.setGauge("ea_session_pending_downloads", pendingDownloads);
+    m_metrics.setGauge("ea_socket_bytes_to_write", bytesToWrite);
+    m_metrics.setGauge("ea_worker_threads_active", m_workerPool.activeThreadCount());
+    m_metrics.setGauge("ea_maintenance_active", m_maintenancePool.activeThreadCount());
+    m_metrics.setGauge("ea_transfer_in_flight_bytes", m_transferScheduler.inFlightBytes());
+    m_metrics.setGauge("ea_transfer_waiting_sessions", m_transferScheduler.waitingSessionsCount());
+    m_metrics.setGauge("ea_cache_size_bytes", m_backupCache.size());
+    m_metrics.setCounter("ea_cache_hits_total", m_backupCache.hits());
+    m_metrics.setCounter("ea_cache_misses_total", m_backupCache.misses());
+    m_metrics.setCounter("ea_process_cpu_microseconds_total",
+                         ServerMetrics::processCpuMicroseconds());
+
+    return m_metrics.toText();
+}
 
-    out << quint16(0);
-    out << quint16(TcpDataType::DatabasesList);
-    out << m_databasesDirectory.entryList(QStringList() << "*.db" << "*.DB", QDir::Files);
-    out.device()->seek(0);
-    out << quint16(data.size() - sizeof(quint16));
-    m_pClientSocket->write(data);
+/*
+ * Файл метрик заменяется целиком, поэтому программа сбора
+ * никогда не читает его недописанным.
+ */
+void TcpServer::dumpMetrics()
+{
+    const QString text = metricsText();
+    const QString metricsFilePath = m_metricsFilePath;
 
-    qInfo() << "Список баз данных был отправлен клиенту";
+    runInWorkerPool([text, metricsFilePath]()
+    {
+        QSaveFile metricsFile(metricsFilePath);
+        if (!metricsFile.open(QIODevice::WriteOnly)
+                || metricsFile.write(text.toUtf8()) < 0
+                || !metricsFile.commit())
+        {
+            qInfo() << "ОШИБКА: не удалось записать файл метрик:" << metricsFilePath;
+        }
+    });
 }
 
-bool TcpServer::createNewDatabaseFile(const QByteArray &dbInBytes, QString dbName)
-{    
-    qInfo() << "Размер массива байтов с базой данных:" << dbInBytes.size();
+/*
+ * Удаляет временные файлы загрузок, которые не изменялись
+ * дольше UploadIngest::cPartFileTimeout секунд. Файлы более новых
+ * прерванных загрузок остаются, чтобы клиент мог их продолжить.
+ */
+void TcpServer::removeExpiredUploads()
+{
+    QDir databasesDirectory(m_databasesPath);
+    const QFileInfoList partFiles = databasesDirectory.entryInfoList(
+                QStringList() << "*" + UploadIngest::cPartFileSuffix,
+                QDir::Files | QDir::Hidden);
 
-    QString newDbFilePath = m_databasesDirectory.path() + "/" + dbName
-            + " " + getDateAndTimeForName() + ".db";
+    const QDateTime expirationTime =
+            QDateTime::currentDateTime().addSecs(-UploadIngest::cPartFileTimeout);
 
-    QFile newDbfile(newDbFilePath);
-    if (!newDbfile.open(QIODevice::WriteOnly))
+    for (const QFileInfo &partFile : partFiles)
     {
-        qInfo() << "ОШИБКА: не удалось открыть файл при создании базы данных: " << newDbFilePath;
-        return false;
+        if (partFile.lastModified() > expirationTime
+                || UploadIngest::isActive(partFile.absoluteFilePath()))
+            continue;
+
+        databasesDirectory.remove(partFile.fileName());
+        qInfo() << "Удален файл незавершенной загрузки:" << partFile.fileName();
     }
+}
 
-    if (newDbfile.write(dbInBytes) == -1)
-    {
-        newDbfile.close();
-        newDbfile.remove();
-        qInfo() << "ОШИБКА: не удалось создать файл с базой данных: " << dbName;
+bool TcpServer::registerBackup(const QString &backupFileName)
+{
+    BackupStore::Manifest manifest;
+    if (!m_backupStore.readManifest(backupFileName, manifest))
         return false;
+
+    return m_backupCatalog.addBackup(backupFileName, manifest,
+                                     QDateTime::currentMSecsSinceEpoch()) != 0;
+}
+
+void TcpServer::verifyBackup(const QString &backupFileName, const QString &dbFilePath)
+{
+    BackupInfo backupInfo;
+    if (!m_backupCatalog.findBackup(backupFileName, backupInfo))
+        return;
+
+    BackupVerifier::Result result = BackupVerifier::verify(dbFilePath, backupInfo.hash);
+    m_backupCatalog.setVerificationResult(backupFileName, result.isValid,
+                                          result.details, result.employeeCount);
+
+    if (result.isValid)
+    {
+        qInfo() << "Версия" << backupFileName << "прошла проверку целостности; сотрудников:"
+                << result.employeeCount;
     }
+    else
+    {
+        qInfo() << "ОШИБКА: версия" << backupFileName << "не прошла проверку целостности:"
+                << result.details;
+    }
+}
+
+/*
+ * Файл версии к этому моменту уже восстановлен, поэтому проверка
+ * использует его повторно. Так же проверяются версии, сохраненные
+ * до перезапуска сервера и еще не проверенные.
+ */
+void TcpServer::verifyOnFirstRestore(const QString &backupFileName)
+{
+    BackupInfo backupInfo;
+    if (!m_backupCatalog.findBackup(backupFileName, backupInfo)
+            || backupInfo.verificationStatus != BackupInfo::NotVerified)
+        return;
+
+    runInWorkerPool([this, backupFileName]()
+    {
+        QString dbFilePath = m_backupStore.materialize(backupFileName);
+        if (dbFilePath.isEmpty())
+            return;
 
-    newDbfile.close();
-    return true;
+        verifyBackup(backupFileName, dbFilePath);
+        m_backupStore.releaseRestoredFile(backupFileName);
+    });
 }
 
-/* Базы данных хранятся в папке databases
+/* Версии баз данных хранятся
  * с именем в формате "Имя день-месяц-год--час-минуты-cекунды.db".
  *
  * Функция отделяет "Имя" от " день-месяц-год--час-минуты-cекунды.db"
@@ -129,7 +332,7 @@ bool TcpServer::createNewDatabaseFile(const QByteArray &dbInBytes, QString dbNam
  *
  * Возвращает пустую строку, если в названии базы данных нет части "Имя".
  * */
-QString TcpServer::getDatabaseNameOnly(QString dbFileName)
+QString TcpServer::getDatabaseNameOnly(QString dbFileName) const
 {
     for (int i = dbFileName.count() - 1; i > 0; i--)
     {
@@ -164,100 +367,22 @@ QString TcpServer::getDateAndTimeForName()
 
 void TcpServer::incomingConnection(qintptr socketDescriptor)
 {
-    m_pClientSocket = new QTcpSocket(this);
-    m_pClientSocket->setSocketDescriptor(socketDescriptor);
-    connect(m_pClientSocket, &QTcpSocket::readyRead, this, &TcpServer::slotReadyRead);
-    connect(m_pClientSocket, &QTcpSocket::disconnected, m_pClientSocket, &TcpServer::deleteLater);
+    ClientSession *session = new ClientSession(socketDescriptor, this);
+    connect(session, &ClientSession::finished, this, &TcpServer::slotSessionFinished);
+    m_sessions.insert(session);
+    m_transferScheduler.addSession(session);
 
-    qInfo() << "Клиент подключился: " << socketDescriptor;
+    m_metrics.incrementCounter("ea_connections_total");
+    m_metrics.setGauge("ea_connections_active", m_sessions.size());
+
+    qInfo() << "Клиент подключился: " << socketDescriptor
+            << "; активных подключений:" << m_sessions.size();
 }
 
-void TcpServer::slotReadyRead()
+void TcpServer::slotSessionFinished(ClientSession *session)
 {
-    m_pClientSocket = (QTcpSocket*)sender();
-    QDataStream in(m_pClientSocket);
-    in.setVersion(QDataStream::Qt_5_0);
-
-    QByteArray data;
-    data.clear();
-    quint16 nextBlockSize = 0;
-    quint16 incomingDataType = 0;
-    QString receivedDbName;
-    QString dbFileForSendName;
-
-    if (in.status() == QDataStream::Ok)
-    {
-        qInfo() << "Чтение поступивших данных...";
-
-        for (;;)
-        {
-            if (nextBlockSize == 0)
-            {
-                if (m_pClientSocket->bytesAvailable() < 2)
-                    break;
-                in >> nextBlockSize;
-
-                if (incomingDataType == 0)
-                {
-                    in >> incomingDataType;
-                    nextBlockSize -= sizeof(quint16);
-
-                    if (incomingDataType == TcpDataType::Database)
-                    {
-                        QByteArray bArray;
-                        in >> bArray;
-                        receivedDbName = QString::fromUtf8(bArray);
-                        nextBlockSize -= sizeof(QChar) * (receivedDbName.count() + 2);
-                    }
-                    else if (incomingDataType == TcpDataType::SelectedDatabaseName)
-                    {
-                        QByteArray bArray;
-                        in >> bArray;
-                        dbFileForSendName = QString::fromUtf8(bArray);
-                        nextBlockSize -= sizeof(QChar) * (dbFileForSendName.count() + 2);
-                    }
-                }
-            }
-
-            if (m_pClientSocket->bytesAvailable() < nextBlockSize)
-            {
-                break;
-            }
-
-            in >> data;
-            nextBlockSize = 0;
-        }
-    }
-
-    if (incomingDataType == TcpDataType::Database)
-    {
-        if (receivedDbName.endsWith(".db", Qt::CaseInsensitive))
-            receivedDbName.chop(3);
-        qInfo() << "Получена база данных: " << receivedDbName;
+    m_sessions.remove(session);
+    m_transferScheduler.removeSession(session);
 
-        if (createNewDatabaseFile(data, receivedDbName))
-            sendDatabaseFileCreationResult(true);
-        else
-            sendDatabaseFileCreationResult(false);
-    }
-    else if (incomingDataType == TcpDataType::DatabasesListRequest)
-    {
-        qInfo() << "Получен запрос на отправку списка баз данных";
-        sendDatabasesList();
-    }
-    else if (incomingDataType == TcpDataType::SelectedDatabaseName)
-    {
-        if (dbFileForSendName.isEmpty())
-        {
-            qInfo() << "ОШИБКА: клиент не отправил имя базы данных, которую хочет получить";
-            return;
-        }
-
-        qInfo() << "Получено имя выбранной клиентом базы данных: " << dbFileForSendName;
-        sendDatabase(QFileInfo(m_databasesDirectory, dbFileForSendName));
-    }
-    else
-    {
-        qInfo() << "ВНИМАНИЕ: тип получаемых данных неизвестен";
-    }
+    m_metrics.setGauge("ea_connections_active", m_sessions.size());
 }
@@ -0,0 +1,105 @@
+#include "TransferScheduler.h"
+#include "ClientSession.h"
+
+#include <QSettings>
+
+const qint64 TransferScheduler::cGrantSize = TcpProtocol::cChunkSize;
+
+TransferScheduler::Settings TransferScheduler::loadSettings(const QString &settingsFilePath)
+{
+    QSettings settings(settingsFilePath, QSettings::IniFormat);
+    settings.beginGroup("Transfers");
+
+    Settings result;
+    result.inFlightBytes = settings.value("InFlightBytes", result.inFlightBytes).toLongLong();
+    result.sessionReadQuota = settings.value("SessionReadQuotaBytes",
+                                             result.sessionReadQuota).toLongLong();
+
+    // Меньшие значения не позволили бы принять ни одного кадра с частью файла
+    result.inFlightBytes = qMax(result.inFlightBytes, cGrantSize);
+    result.sessionReadQuota = qMax(result.sessionReadQuota, qint64(TcpProtocol::cMaxFrameSize) * 2);
+
+    return result;
+}
+
+void TransferScheduler::addSession(ClientSession *session, int weight)
+{
+    SessionState state;
+    state.weight = qMax(1, weight);
+    // Новое подключение не получает преимущества за время, когда его не было
+    state.virtualFinishTime = m_virtualTime;
+
+    m_sessions.insert(session, state);
+}
+
+void TransferScheduler::removeSession(ClientSession *session)
+{
+    auto it = m_sessions.find(session);
+    if (it == m_sessions.end())
+        return;
+
+    m_inFlightBytes -= it->heldBytes;
+    m_sessions.erase(it);
+    m_waitingSessions.removeOne(session);
+
+    dispatch();
+}
+
+void TransferScheduler::requestGrant(ClientSession *session)
+{
+    if (!m_sessions.contains(session) || m_waitingSessions.contains(session))
+        return;
+
+    m_waitingSessions << session;
+    dispatch();
+}
+
+void TransferScheduler::release(ClientSession *session, qint64 bytes)
+{
+    auto it = m_sessions.find(session);
+    if (it == m_sessions.end() || bytes <= 0)
+        return;
+
+    bytes = qMin(bytes, it->heldBytes);
+    it->heldBytes -= bytes;
+    m_inFlightBytes -= bytes;
+
+    dispatch();
+}
+
+void TransferScheduler::dispatch()
+{
+    // Хотя бы одно разрешение выдается всегда, даже если бюджет меньше его
+    while (!m_waitingSessions.isEmpty()
+           && (m_inFlightBytes + cGrantSize <= m_settings.inFlightBytes || m_inFlightBytes == 0))
+    {
+        int nextIndex = 0;
+        qint64 nextStartTime = 0;
+
+        for (int i = 0; i < m_waitingSessions.size(); i++)
+        {
+            qint64 startTime = qMax(m_virtualTime,
+                                    m_sessions.value(m_waitingSessions.at(i)).virtualFinishTime);
+
+            if (i == 0 || startTime < nextStartTime)
+            {
+                nextIndex = i;
+                nextStartTime = startTime;
+            }
+        }
+
+        ClientSession *session = m_waitingSessions.takeAt(nextIndex);
+        SessionState &state = m_sessions[session];
+
+        m_virtualTime = nextStartTime;
+        state.virtualFinishTime = nextStartTime + cGrantSize / state.weight;
+        state.heldBytes += cGrantSize;
+        m_inFlightBytes += cGrantSize;
+
+        // Если сессия будет удалена раньше, вызов не выполнится
+        QMetaObject::invokeMethod(session, [session]()
+        {
+            session->transferGranted();
+        }, Qt::QueuedConnection);
+    }
+}
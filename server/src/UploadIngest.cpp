@@ -0,0 +1,168 @@
+#include "UploadIngest.h"
+#include "FileUtils.h"
+
+#include <QCryptographicHash>
+#include <QMutexLocker>
+#include <QUuid>
+#include <QDebug>
+
+const QString UploadIngest::cPartFileSuffix = ".part";
+const qint64 UploadIngest::cPartFileTimeout = 6 * 60 * 60;
+const qint64 UploadIngest::cSyncInterval = 16 * 1024 * 1024;
+
+QSet<QString> UploadIngest::s_activePartFiles;
+QMutex UploadIngest::s_activePartFilesMutex;
+
+UploadIngest::UploadIngest(const QString &databasesPath, const QString &dbName, qint64 expectedSize,
+                           const QByteArray &transferId, const QByteArray &contentHash)
+    : m_dbName(dbName)
+    , m_expectedSize(expectedSize)
+    , m_contentHash(contentHash)
+{
+    QUuid transferUuid = QUuid::fromRfc4122(transferId);
+
+    // Без номера передачи продолжить ее после обрыва невозможно
+    m_isResumable = transferId.size() == 16 && !transferUuid.isNull()
+            && contentHash.size() == 32;
+
+    QString partFileName = ".upload-";
+    if (m_isResumable)
+    {
+        partFileName += transferUuid.toString(QUuid::WithoutBraces)
+                + "-" + QString::fromLatin1(contentHash.toHex());
+    }
+    else
+    {
+        partFileName += QUuid::createUuid().toString(QUuid::WithoutBraces);
+    }
+
+    m_partFile.setFileName(databasesPath + "/" + partFileName + cPartFileSuffix);
+}
+
+UploadIngest::~UploadIngest()
+{
+    if (m_isResumable && m_partFile.isOpen())
+        FileUtils::syncToDisk(m_partFile);
+
+    m_partFile.close();
+
+    if (!m_isResumable)
+        m_partFile.remove();
+
+    if (m_isActive)
+    {
+        QMutexLocker locker(&s_activePartFilesMutex);
+        s_activePartFiles.remove(m_partFile.fileName());
+    }
+}
+
+bool UploadIngest::open()
+{
+    {
+        QMutexLocker locker(&s_activePartFilesMutex);
+
+        if (s_activePartFiles.contains(m_partFile.fileName()))
+        {
+            qInfo() << "ОШИБКА: передача" << m_partFile.fileName() << "уже выполняется";
+            // Файл принадлежит другой сессии и не должен быть удален
+            m_isResumable = true;
+            return false;
+        }
+
+        s_activePartFiles.insert(m_partFile.fileName());
+        m_isActive = true;
+    }
+
+    QIODevice::OpenMode openMode = QIODevice::WriteOnly;
+    if (m_isResumable && m_partFile.exists() && m_partFile.size() <= m_expectedSize)
+        openMode |= QIODevice::Append;
+
+    if (!m_partFile.open(openMode))
+    {
+        qInfo() << "ОШИБКА: не удалось создать временный файл загрузки:" << m_partFile.fileName();
+        return false;
+    }
+
+    m_resumeOffset = m_partFile.size();
+    m_writtenSize = m_resumeOffset;
+    m_syncedSize = m_resumeOffset;
+
+    if (m_resumeOffset > 0)
+        qInfo() << "Загрузка" << m_dbName << "продолжается с" << m_resumeOffset << "байт";
+
+    return true;
+}
+
+bool UploadIngest::append(const QByteArray &chunk)
+{
+    if (m_writtenSize + chunk.size() > m_expectedSize)
+    {
+        qInfo() << "ОШИБКА: клиент прислал больше данных, чем заявил:" << m_dbName;
+        return false;
+    }
+
+    if (m_partFile.write(chunk) != chunk.size())
+    {
+        qInfo() << "ОШИБКА: не удалось записать часть базы данных:" << m_dbName;
+        return false;
+    }
+
+    m_writtenSize += chunk.size();
+
+    // Смещение, с которого продолжится передача, не должно опережать диск
+    if (m_isResumable && m_writtenSize - m_syncedSize >= cSyncInterval)
+    {
+        FileUtils::syncToDisk(m_partFile);
+        m_syncedSize = m_writtenSize;
+    }
+
+    return true;
+}
+
+bool UploadIngest::finish()
+{
+    // Завершенная или испорченная передача не продолжается
+    m_isResumable = false;
+
+    if (m_writtenSize != m_expectedSize)
+    {
+        qInfo() << "ОШИБКА: размер полученной базы данных не совпадает с заявленным:" << m_dbName;
+        return false;
+    }
+
+    if (!m_partFile.flush())
+    {
+        qInfo() << "ОШИБКА: не удалось записать базу данных:" << m_dbName;
+        return false;
+    }
+
+    m_partFile.close();
+
+    if (m_contentHash.isEmpty())
+        return true;
+
+    // Часть файла могла быть получена до обрыва, поэтому хеш считается по файлу
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    if (!m_partFile.open(QIODevice::ReadOnly) || !hash.addData(&m_partFile))
+    {
+        qInfo() << "ОШИБКА: не удалось прочитать полученную базу данных:" << m_dbName;
+        return false;
+    }
+
+    m_partFile.close();
+
+    if (hash.result() != m_contentHash)
+    {
+        qInfo() << "ОШИБКА: хеш полученной базы данных не совпадает с заявленным:" << m_dbName;
+        return false;
+    }
+
+    return true;
+}
+
+bool UploadIngest::isActive(const QString &partFilePath)
+{
+    QMutexLocker locker(&s_activePartFilesMutex);
+
+    return s_activePartFiles.contains(partFilePath);
+}
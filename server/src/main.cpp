@@ -1,10 +1,15 @@
 #include <QCoreApplication>
 #include "TcpServer.h"
+#include "AsyncLogger.h"
 
 int main(int argc, char *argv[])
 {
     setlocale(LC_ALL, "Russian");
 
+    // Создается первым, чтобы выводить сообщения до завершения всех потоков сервера
+    AsyncLogger logger(AsyncLogger::LevelInfo);
+    logger.install();
+
     QCoreApplication a(argc, argv);
     a.setApplicationName("Учет сотрудников организаций - сервер");
 
@@ -0,0 +1,233 @@
+#include "BackupDiffEngine.h"
+#include "DatabaseCreation.h"
+
+#include <QtTest>
+#include <QTemporaryDir>
+#include <QtSql/QSqlDatabase>
+#include <QtSql/QSqlQuery>
+
+/*
+ * Сравнение двух версий базы данных по сотрудникам.
+ */
+class BackupDiffEngineTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void reportsAddedRemovedAndChangedEmployees();
+    void sendsEntriesInBatches();
+    void stopsWhenHandlerRejectsEntries();
+    void reportsMissingVersionFile();
+
+private:
+    /*
+     * Создает базу данных программы filePath и выполняет в ней команды commands.
+     */
+    static bool createDatabase(const QString &filePath, const QStringList &commands);
+
+    static QString insertEmployee(int id, const QString &lastName, const QString &position);
+
+    /*
+     * Команды добавления сотрудников с номерами от 1 до count.
+     */
+    static QStringList employeesCommands(int count);
+};
+
+bool BackupDiffEngineTest::createDatabase(const QString &filePath, const QStringList &commands)
+{
+    const QString connectionName = "test-" + filePath;
+    bool isSucceeded = true;
+
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", connectionName);
+        db.setDatabaseName(filePath);
+
+        if (!db.open())
+            return false;
+
+        QSqlQuery query(db);
+        db.transaction();
+
+        for (const QString &command : DatabaseCreation::cTableCreationCommandsList + commands)
+        {
+            if (!query.exec(command))
+            {
+                isSucceeded = false;
+                break;
+            }
+        }
+
+        isSucceeded = db.commit() && isSucceeded;
+        db.close();
+    }
+
+    QSqlDatabase::removeDatabase(connectionName);
+
+    return isSucceeded;
+}
+
+QString BackupDiffEngineTest::insertEmployee(int id, const QString &lastName, const QString &position)
+{
+    return QString("INSERT INTO [Общая информация] ([ID], [Фамилия], [Имя], [Отчество], [Должность]) "
+                   "VALUES (%1, '%2', 'Иван', 'Иванович', '%3')").arg(id).arg(lastName, position);
+}
+
+QStringList BackupDiffEngineTest::employeesCommands(int count)
+{
+    QStringList commands;
+    for (int id = 1; id <= count; id++)
+        commands << insertEmployee(id, "Сотрудник", "Инженер");
+
+    return commands;
+}
+
+void BackupDiffEngineTest::reportsAddedRemovedAndChangedEmployees()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    const QString oldDbFilePath = dir.filePath("old.db");
+    const QString newDbFilePath = dir.filePath("new.db");
+
+    QVERIFY(createDatabase(oldDbFilePath, {
+        insertEmployee(1, "Иванов", "Инженер"),
+        insertEmployee(2, "Петров", "Инженер"),
+        insertEmployee(3, "Сидоров", "Инженер"),
+        "INSERT INTO [Паспортные данные] ([ID], [Серия], [Номер]) VALUES (3, '1234', '111111')"
+    }));
+
+    // Иванов не изменился, Петров уволен, Сидоров переведен и сменил паспорт, Смирнов принят
+    QVERIFY(createDatabase(newDbFilePath, {
+        insertEmployee(1, "Иванов", "Инженер"),
+        insertEmployee(3, "Сидоров", "Начальник отдела"),
+        insertEmployee(4, "Смирнов", "Техник"),
+        "INSERT INTO [Паспортные данные] ([ID], [Серия], [Номер]) VALUES (3, '1234', '222222')"
+    }));
+
+    QList<EmployeeDiff> entries;
+    BackupDiffEngine::Summary summary;
+    QString error;
+
+    const bool isSucceeded = BackupDiffEngine::run(oldDbFilePath, newDbFilePath,
+                                                   [&entries](const QList<EmployeeDiff> &batch)
+    {
+        entries << batch;
+        return true;
+    }, summary, error);
+
+    QVERIFY2(isSucceeded, qPrintable(error));
+
+    QCOMPARE(summary.addedCount, quint32(1));
+    QCOMPARE(summary.removedCount, quint32(1));
+    QCOMPARE(summary.changedCount, quint32(1));
+    QCOMPARE(entries.size(), 3);
+
+    // Отличия идут в порядке номеров сотрудников
+    const EmployeeDiff &removed = entries.at(0);
+    QCOMPARE(removed.employeeId, qint32(2));
+    QCOMPARE(removed.kind, quint8(EmployeeDiff::Removed));
+    QCOMPARE(removed.employeeName, QString("Петров Иван Иванович"));
+    QVERIFY(removed.changes.isEmpty());
+
+    const EmployeeDiff &changed = entries.at(1);
+    QCOMPARE(changed.employeeId, qint32(3));
+    QCOMPARE(changed.kind, quint8(EmployeeDiff::Changed));
+    QCOMPARE(changed.employeeName, QString("Сидоров Иван Иванович"));
+    QCOMPARE(changed.changes.size(), 2);
+
+    QCOMPARE(changed.changes.at(0).tableName, QString("Общая информация"));
+    QCOMPARE(changed.changes.at(0).fieldName, QString("Должность"));
+    QCOMPARE(changed.changes.at(0).oldValue.toString(), QString("Инженер"));
+    QCOMPARE(changed.changes.at(0).newValue.toString(), QString("Начальник отдела"));
+
+    QCOMPARE(changed.changes.at(1).tableName, QString("Паспортные данные"));
+    QCOMPARE(changed.changes.at(1).fieldName, QString("Номер"));
+    QCOMPARE(changed.changes.at(1).oldValue.toString(), QString("111111"));
+    QCOMPARE(changed.changes.at(1).newValue.toString(), QString("222222"));
+
+    const EmployeeDiff &added = entries.at(2);
+    QCOMPARE(added.employeeId, qint32(4));
+    QCOMPARE(added.kind, quint8(EmployeeDiff::Added));
+    QCOMPARE(added.employeeName, QString("Смирнов Иван Иванович"));
+    QVERIFY(added.changes.isEmpty());
+}
+
+void BackupDiffEngineTest::sendsEntriesInBatches()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    const int employeesCount = TcpProtocol::cDiffBatchEntries + 10;
+
+    const QString oldDbFilePath = dir.filePath("old.db");
+    const QString newDbFilePath = dir.filePath("new.db");
+    QVERIFY(createDatabase(oldDbFilePath, QStringList()));
+    QVERIFY(createDatabase(newDbFilePath, employeesCommands(employeesCount)));
+
+    QList<int> batchSizes;
+    BackupDiffEngine::Summary summary;
+    QString error;
+
+    const bool isSucceeded = BackupDiffEngine::run(oldDbFilePath, newDbFilePath,
+                                                   [&batchSizes](const QList<EmployeeDiff> &batch)
+    {
+        batchSizes << batch.size();
+        return true;
+    }, summary, error);
+
+    QVERIFY2(isSucceeded, qPrintable(error));
+    QCOMPARE(summary.addedCount, quint32(employeesCount));
+    QCOMPARE(batchSizes, QList<int>({ TcpProtocol::cDiffBatchEntries, 10 }));
+}
+
+void BackupDiffEngineTest::stopsWhenHandlerRejectsEntries()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    const QString oldDbFilePath = dir.filePath("old.db");
+    const QString newDbFilePath = dir.filePath("new.db");
+    QVERIFY(createDatabase(oldDbFilePath, employeesCommands(TcpProtocol::cDiffBatchEntries * 2)));
+    QVERIFY(createDatabase(newDbFilePath, QStringList()));
+
+    int batchesCount = 0;
+    BackupDiffEngine::Summary summary;
+    QString error;
+
+    // Обработчик отказывается от пачки, как при отмене запроса клиентом
+    const bool isSucceeded = BackupDiffEngine::run(oldDbFilePath, newDbFilePath,
+                                                   [&batchesCount](const QList<EmployeeDiff> &)
+    {
+        batchesCount++;
+        return false;
+    }, summary, error);
+
+    QVERIFY(!isSucceeded);
+    QCOMPARE(batchesCount, 1);
+    QCOMPARE(error, QString("Сравнение прервано"));
+}
+
+void BackupDiffEngineTest::reportsMissingVersionFile()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    const QString newDbFilePath = dir.filePath("new.db");
+    QVERIFY(createDatabase(newDbFilePath, QStringList()));
+
+    BackupDiffEngine::Summary summary;
+    QString error;
+
+    const bool isSucceeded = BackupDiffEngine::run(dir.filePath("missing.db"), newDbFilePath,
+                                                   [](const QList<EmployeeDiff> &)
+    {
+        return true;
+    }, summary, error);
+
+    QVERIFY(!isSucceeded);
+    QVERIFY(!error.isEmpty());
+}
+
+QTEST_GUILESS_MAIN(BackupDiffEngineTest)
+
+#include "BackupDiffEngineTest.moc"
@@ -0,0 +1,10 @@
+include(../tests.pri)
+
+SOURCES += \
+        BackupDiffEngineTest.cpp \
+        $$SERVER_DIR/src/BackupDiffEngine.cpp
+
+HEADERS += \
+    $$SERVER_DIR/include/BackupDiffEngine.h \
+    $$SERVER_DIR/include/DatabaseCreation.h \
+    $$SERVER_DIR/include/TcpDataTypes.h
@@ -0,0 +1,163 @@
+#include "BackupRetention.h"
+
+#include <QtTest>
+#include <QDateTime>
+
+/*
+ * Выбор устаревших версий по политике хранения.
+ */
+class BackupRetentionTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void keepsAllRecentVersions();
+    void keepsLastVersionOfEachDay();
+    void keepsLastVersionOfEachMonth();
+    void expiresVersionsOlderThanMonthlyPeriod();
+    void keepsNewestVersionOfEachOrganization();
+    void keepsVersionsWithUnknownTime();
+
+private:
+    static const qint64 cMsecsPerHour;
+    static const qint64 cMsecsPerDay;
+
+    /*
+     * Поздний вечер, чтобы версии за несколько часов
+     * до него попадали в один день.
+     */
+    static qint64 now();
+
+    /*
+     * Версия организации orgName, сохраненная за days дней и hours часов до now.
+     */
+    static BackupInfo backup(const QString &orgName, const QString &fileName, int days, int hours);
+
+    static BackupRetention::Policy policy(int keepAllDays, int keepDailyDays, int keepMonthlyMonths);
+
+    static QStringList sorted(QStringList list);
+};
+
+const qint64 BackupRetentionTest::cMsecsPerHour = 60LL * 60 * 1000;
+const qint64 BackupRetentionTest::cMsecsPerDay = 24 * cMsecsPerHour;
+
+qint64 BackupRetentionTest::now()
+{
+    return QDateTime(QDate(2024, 6, 15), QTime(23, 0)).toMSecsSinceEpoch();
+}
+
+BackupInfo BackupRetentionTest::backup(const QString &orgName, const QString &fileName,
+                                       int days, int hours)
+{
+    BackupInfo backupInfo;
+    backupInfo.fileName = fileName;
+    backupInfo.orgName = orgName;
+    backupInfo.createdAt = now() - days * cMsecsPerDay - hours * cMsecsPerHour;
+
+    return backupInfo;
+}
+
+BackupRetention::Policy BackupRetentionTest::policy(int keepAllDays, int keepDailyDays,
+                                                    int keepMonthlyMonths)
+{
+    BackupRetention::Policy retentionPolicy;
+    retentionPolicy.keepAllDays = keepAllDays;
+    retentionPolicy.keepDailyDays = keepDailyDays;
+    retentionPolicy.keepMonthlyMonths = keepMonthlyMonths;
+
+    return retentionPolicy;
+}
+
+QStringList BackupRetentionTest::sorted(QStringList list)
+{
+    list.sort();
+    return list;
+}
+
+void BackupRetentionTest::keepsAllRecentVersions()
+{
+    const QList<BackupInfo> backups = {
+        backup("Org", "a", 0, 1),
+        backup("Org", "b", 0, 2),
+        backup("Org", "c", 0, 3),
+        backup("Org", "d", 1, 2)
+    };
+
+    QCOMPARE(BackupRetention::expiredBackups(backups, policy(2, 0, 1), now()), QStringList());
+}
+
+void BackupRetentionTest::keepsLastVersionOfEachDay()
+{
+    const QList<BackupInfo> backups = {
+        backup("Org", "newest", 0, 1),
+        backup("Org", "day 2 last", 2, 1),
+        backup("Org", "day 2 first", 2, 2),
+        backup("Org", "day 3 last", 3, 1),
+        backup("Org", "day 3 middle", 3, 2),
+        backup("Org", "day 3 first", 3, 3)
+    };
+
+    QCOMPARE(sorted(BackupRetention::expiredBackups(backups, policy(1, 30, 0), now())),
+             sorted({ "day 2 first", "day 3 middle", "day 3 first" }));
+}
+
+void BackupRetentionTest::keepsLastVersionOfEachMonth()
+{
+    // 6 и 1 мая - один месяц, 16 апреля - другой
+    const QList<BackupInfo> backups = {
+        backup("Org", "newest", 0, 1),
+        backup("Org", "may last", 40, 1),
+        backup("Org", "may same day", 40, 2),
+        backup("Org", "may first", 45, 1),
+        backup("Org", "april", 60, 1)
+    };
+
+    QCOMPARE(sorted(BackupRetention::expiredBackups(backups, policy(1, 3, 0), now())),
+             sorted({ "may same day", "may first" }));
+}
+
+void BackupRetentionTest::expiresVersionsOlderThanMonthlyPeriod()
+{
+    // Ежемесячные версии хранятся 1 + 3 + 2 * 30 = 64 дня
+    const QList<BackupInfo> backups = {
+        backup("Org", "newest", 0, 1),
+        backup("Org", "may", 40, 1),
+        backup("Org", "march", 100, 1),
+        backup("Org", "last year", 400, 1)
+    };
+
+    QCOMPARE(sorted(BackupRetention::expiredBackups(backups, policy(1, 3, 2), now())),
+             sorted({ "march", "last year" }));
+}
+
+void BackupRetentionTest::keepsNewestVersionOfEachOrganization()
+{
+    const QList<BackupInfo> backups = {
+        backup("First", "first newest", 0, 1),
+        backup("First", "first old", 400, 1),
+        backup("Second", "second newest", 300, 1),
+        backup("Second", "second old", 400, 1)
+    };
+
+    QCOMPARE(sorted(BackupRetention::expiredBackups(backups, policy(1, 3, 1), now())),
+             sorted({ "first old", "second old" }));
+}
+
+void BackupRetentionTest::keepsVersionsWithUnknownTime()
+{
+    BackupInfo unknownTimeBackup = backup("Org", "unknown time", 0, 0);
+    unknownTimeBackup.createdAt = 0;
+
+    const QList<BackupInfo> backups = {
+        backup("Org", "newest", 0, 1),
+        unknownTimeBackup,
+        backup("Org", "old", 400, 1)
+    };
+
+    QCOMPARE(BackupRetention::expiredBackups(backups, policy(1, 3, 1), now()),
+             QStringList("old"));
+}
+
+QTEST_APPLESS_MAIN(BackupRetentionTest)
+
+#include "BackupRetentionTest.moc"
@@ -0,0 +1,19 @@
+include(../tests.pri)
+
+SOURCES += \
+        BackupRetentionTest.cpp \
+        $$SERVER_DIR/src/BackupRetention.cpp \
+        $$SERVER_DIR/src/BackupStore.cpp \
+        $$SERVER_DIR/src/BackupCatalog.cpp \
+        $$SERVER_DIR/src/BackupCache.cpp \
+        $$SERVER_DIR/src/Compression.cpp \
+        $$SERVER_DIR/src/FileUtils.cpp
+
+HEADERS += \
+    $$SERVER_DIR/include/BackupRetention.h \
+    $$SERVER_DIR/include/BackupStore.h \
+    $$SERVER_DIR/include/BackupCatalog.h \
+    $$SERVER_DIR/include/BackupCache.h \
+    $$SERVER_DIR/include/Compression.h \
+    $$SERVER_DIR/include/FileUtils.h \
+    $$SERVER_DIR/include/TcpDataTypes.h
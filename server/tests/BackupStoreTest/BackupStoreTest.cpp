@@ -0,0 +1,184 @@
+#include "BackupStore.h"
+#include "Compression.h"
+
+#include <QtTest>
+#include <QTemporaryDir>
+#include <QFile>
+
+/*
+ * Сохранение версий в хранилище и восстановление их файлов,
+ * в том числе из страниц, перенесенных в холодные пакеты.
+ */
+class BackupStoreTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void materializesImportedFile();
+    void storesOnlyChangedPagesOfNextVersion();
+    void materializesFileFromColdSegments();
+
+private:
+    static QByteArray makePage(char fill);
+
+    static bool writeFile(const QString &filePath, const QByteArray &data);
+
+    /*
+     * Восстанавливает файл версии и возвращает его содержимое.
+     * Восстановленный файл удаляется, чтобы следующий вызов
+     * снова собирал его из страниц.
+     */
+    static QByteArray materializeData(BackupStore &store, const QString &backupFileName);
+};
+
+QByteArray BackupStoreTest::makePage(char fill)
+{
+    QByteArray page(int(BackupStore::cDefaultPageSize), fill);
+    page[0] = 'p';
+
+    return page;
+}
+
+bool BackupStoreTest::writeFile(const QString &filePath, const QByteArray &data)
+{
+    QFile file(filePath);
+
+    return file.open(QIODevice::WriteOnly) && file.write(data) == data.size();
+}
+
+QByteArray BackupStoreTest::materializeData(BackupStore &store, const QString &backupFileName)
+{
+    const QString restoredFilePath = store.materialize(backupFileName);
+    if (restoredFilePath.isEmpty())
+        return QByteArray();
+
+    QByteArray data;
+    {
+        QFile restoredFile(restoredFilePath);
+        if (restoredFile.open(QIODevice::ReadOnly))
+            data = restoredFile.readAll();
+    }
+
+    store.releaseRestoredFile(backupFileName);
+    QFile::remove(restoredFilePath);
+
+    return data;
+}
+
+void BackupStoreTest::materializesImportedFile()
+{
+    QTemporaryDir databasesDir;
+    QVERIFY(databasesDir.isValid());
+
+    // Повторяющаяся страница и неполная последняя страница
+    const QByteArray data = makePage('a') + makePage('b') + makePage('a') + makePage('c')
+            + QByteArray(100, 't');
+    const QString filePath = databasesDir.filePath("source.db");
+    QVERIFY(writeFile(filePath, data));
+
+    BackupStore store(databasesDir.path());
+    QVERIFY(store.init());
+
+    const QString backupFileName = store.importFile(filePath, "Org 01-02-2024--10-00-00.db");
+    QCOMPARE(backupFileName, QString("Org 01-02-2024--10-00-00.db"));
+    QVERIFY(store.contains(backupFileName));
+    QCOMPARE(store.chunksList().size(), 4);
+
+    BackupStore::Manifest manifest;
+    QVERIFY(store.readManifest(backupFileName, manifest));
+    QCOMPARE(manifest.fileSize, qint64(data.size()));
+    QCOMPARE(manifest.pageSize, BackupStore::cDefaultPageSize);
+    QCOMPARE(manifest.pageHashes.size(), 5);
+
+    QCOMPARE(materializeData(store, backupFileName), data);
+}
+
+void BackupStoreTest::storesOnlyChangedPagesOfNextVersion()
+{
+    QTemporaryDir databasesDir;
+    QVERIFY(databasesDir.isValid());
+
+    const QString filePath = databasesDir.filePath("source.db");
+    const QByteArray firstData = makePage('a') + makePage('b') + makePage('c');
+    const QByteArray secondData = makePage('a') + makePage('x') + makePage('c');
+
+    BackupStore store(databasesDir.path());
+    QVERIFY(store.init());
+
+    QVERIFY(writeFile(filePath, firstData));
+    const QString firstBackup = store.importFile(filePath, "Org 01-02-2024--10-00-00.db");
+    QVERIFY(!firstBackup.isEmpty());
+
+    QVERIFY(writeFile(filePath, secondData));
+    const QString secondBackup = store.importFile(filePath, "Org 02-02-2024--10-00-00.db");
+    QVERIFY(!secondBackup.isEmpty());
+
+    QCOMPARE(store.chunksList().size(), 4);
+
+    // Версия с тем же именем сохраняется под новым
+    const QString thirdBackup = store.importFile(filePath, "Org 02-02-2024--10-00-00.db");
+    QVERIFY(!thirdBackup.isEmpty());
+    QVERIFY(thirdBackup != secondBackup);
+    QCOMPARE(store.chunksList().size(), 4);
+
+    QCOMPARE(materializeData(store, firstBackup), firstData);
+    QCOMPARE(materializeData(store, secondBackup), secondData);
+    QCOMPARE(materializeData(store, thirdBackup), secondData);
+}
+
+void BackupStoreTest::materializesFileFromColdSegments()
+{
+    QTemporaryDir databasesDir;
+    QVERIFY(databasesDir.isValid());
+
+    const QByteArray data = makePage('a') + makePage('b') + makePage('a') + makePage('c')
+            + QByteArray(100, 't');
+    const QString filePath = databasesDir.filePath("source.db");
+    QVERIFY(writeFile(filePath, data));
+
+    const QString backupFileName = "Org 01-02-2024--10-00-00.db";
+    QStringList warmPacks;
+
+    {
+        BackupStore store(databasesDir.path());
+        QVERIFY(store.init());
+        QVERIFY(!store.importFile(filePath, backupFileName).isEmpty());
+
+        warmPacks = store.packsList();
+        QVERIFY(!warmPacks.isEmpty());
+
+        BackupStore::Manifest manifest;
+        QVERIFY(store.readManifest(backupFileName, manifest));
+
+        const BackupStore::CompactionResult result =
+                store.compactChunks(manifest.pageHashes, Compression::CodecQCompress, -1);
+        QVERIFY(result.isSucceeded);
+        QCOMPARE(result.chunksCount, 4);
+        QCOMPARE(result.rawSize, qint64(3 * BackupStore::cDefaultPageSize + 100));
+        QVERIFY(result.packSize > 0);
+        QVERIFY(result.packSize < result.rawSize);
+
+        // Страницы уже в холодном пакете
+        QCOMPARE(store.compactChunks(manifest.pageHashes, Compression::CodecQCompress, -1).chunksCount, 0);
+
+        QCOMPARE(materializeData(store, backupFileName), data);
+
+        // Старые пакеты больше не нужны: все их страницы перенесены
+        for (const QString &packName : qAsConst(warmPacks))
+            QVERIFY(store.rewritePack(packName, 0) > 0);
+    }
+
+    // Индекс холодного пакета читается заново при запуске
+    BackupStore store(databasesDir.path());
+    QVERIFY(store.init());
+
+    for (const QString &packName : qAsConst(warmPacks))
+        QVERIFY(!store.packsList().contains(packName));
+
+    QCOMPARE(store.chunksList().size(), 4);
+    QCOMPARE(materializeData(store, backupFileName), data);
+}
+
+QTEST_APPLESS_MAIN(BackupStoreTest)
+
+#include "BackupStoreTest.moc"
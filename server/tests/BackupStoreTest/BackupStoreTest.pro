@@ -0,0 +1,12 @@
+include(../tests.pri)
+
+SOURCES += \
+        BackupStoreTest.cpp \
+        $$SERVER_DIR/src/BackupStore.cpp \
+        $$SERVER_DIR/src/Compression.cpp \
+        $$SERVER_DIR/src/FileUtils.cpp
+
+HEADERS += \
+    $$SERVER_DIR/include/BackupStore.h \
+    $$SERVER_DIR/include/Compression.h \
+    $$SERVER_DIR/include/FileUtils.h
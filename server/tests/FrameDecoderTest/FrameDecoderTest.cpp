@@ -0,0 +1,154 @@
+#include "FrameDecoder.h"
+
+#include <QtTest>
+#include <QBuffer>
+#include <QtEndian>
+
+/*
+ * Разбор кадров, которые приходят по частям, и кадров недопустимого размера.
+ */
+class FrameDecoderTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void readsFrameArrivingInParts();
+    void leavesNextFrameInDevice();
+    void readsFrameWithoutPayload();
+    void rejectsOversizedFrame();
+    void rejectsFrameShorterThanHeader();
+
+private:
+    static QByteArray encodeFrame(quint16 dataType, quint32 requestId, const QByteArray &payload);
+
+    /*
+     * Дописывает data в конец device, не сдвигая позицию чтения,
+     * как это происходит с буфером сокета.
+     */
+    static void appendData(QBuffer &device, const QByteArray &data);
+};
+
+QByteArray FrameDecoderTest::encodeFrame(quint16 dataType, quint32 requestId, const QByteArray &payload)
+{
+    return FrameDecoder::encodeHeader(dataType, requestId, quint64(payload.size())) + payload;
+}
+
+void FrameDecoderTest::appendData(QBuffer &device, const QByteArray &data)
+{
+    const qint64 readPosition = device.pos();
+
+    device.seek(device.size());
+    device.write(data);
+    device.seek(readPosition);
+}
+
+void FrameDecoderTest::readsFrameArrivingInParts()
+{
+    const QByteArray payload(1000, 'x');
+    const QByteArray data = encodeFrame(TcpDataType::DatabaseChunk, 7, payload);
+
+    QBuffer device;
+    device.open(QIODevice::ReadWrite);
+
+    FrameDecoder decoder;
+    FrameDecoder::Frame frame;
+
+    // Размер кадра, заголовок и содержимое разрезаны между сегментами
+    int offset = 0;
+    for (int end : { 3, 8, 12, 500 })
+    {
+        appendData(device, data.mid(offset, end - offset));
+        offset = end;
+
+        QCOMPARE(decoder.readFrame(&device, frame), FrameDecoder::NeedMoreData);
+    }
+
+    appendData(device, data.mid(offset));
+
+    QCOMPARE(decoder.readFrame(&device, frame), FrameDecoder::FrameReady);
+    QCOMPARE(frame.version, TcpProtocol::cVersion);
+    QCOMPARE(frame.dataType, quint16(TcpDataType::DatabaseChunk));
+    QCOMPARE(frame.requestId, quint32(7));
+    QCOMPARE(frame.payload, payload);
+    QCOMPARE(device.bytesAvailable(), qint64(0));
+}
+
+void FrameDecoderTest::leavesNextFrameInDevice()
+{
+    const QByteArray firstPayload("first");
+    const QByteArray secondPayload("second");
+
+    QBuffer device;
+    device.open(QIODevice::ReadWrite);
+
+    // Второй кадр пришел вместе с первым, но не целиком
+    const QByteArray secondFrame = encodeFrame(TcpDataType::DatabaseEnd, 2, secondPayload);
+    appendData(device, encodeFrame(TcpDataType::DatabaseChunk, 1, firstPayload) + secondFrame.left(10));
+
+    FrameDecoder decoder;
+    FrameDecoder::Frame frame;
+
+    QCOMPARE(decoder.readFrame(&device, frame), FrameDecoder::FrameReady);
+    QCOMPARE(frame.requestId, quint32(1));
+    QCOMPARE(frame.payload, firstPayload);
+
+    QCOMPARE(decoder.readFrame(&device, frame), FrameDecoder::NeedMoreData);
+
+    appendData(device, secondFrame.mid(10));
+
+    QCOMPARE(decoder.readFrame(&device, frame), FrameDecoder::FrameReady);
+    QCOMPARE(frame.dataType, quint16(TcpDataType::DatabaseEnd));
+    QCOMPARE(frame.requestId, quint32(2));
+    QCOMPARE(frame.payload, secondPayload);
+}
+
+void FrameDecoderTest::readsFrameWithoutPayload()
+{
+    QBuffer device;
+    device.open(QIODevice::ReadWrite);
+    appendData(device, encodeFrame(TcpDataType::CancelRequest, 42, QByteArray()));
+
+    FrameDecoder decoder;
+    FrameDecoder::Frame frame;
+
+    QCOMPARE(decoder.readFrame(&device, frame), FrameDecoder::FrameReady);
+    QCOMPARE(frame.dataType, quint16(TcpDataType::CancelRequest));
+    QCOMPARE(frame.requestId, quint32(42));
+    QVERIFY(frame.payload.isEmpty());
+}
+
+void FrameDecoderTest::rejectsOversizedFrame()
+{
+    const quint64 payloadSize = TcpProtocol::cMaxFrameSize - TcpProtocol::cHeaderSize + 1;
+
+    QBuffer device;
+    device.open(QIODevice::ReadWrite);
+
+    // Содержимое не передается: кадр отвергается по одному размеру
+    appendData(device, FrameDecoder::encodeHeader(TcpDataType::DatabaseChunk, 1, payloadSize));
+
+    FrameDecoder decoder;
+    FrameDecoder::Frame frame;
+
+    QCOMPARE(decoder.readFrame(&device, frame), FrameDecoder::InvalidFrame);
+    QCOMPARE(decoder.frameSize(), TcpProtocol::cMaxFrameSize + 1);
+}
+
+void FrameDecoderTest::rejectsFrameShorterThanHeader()
+{
+    QByteArray sizeBytes(int(sizeof(quint64)), '\0');
+    qToBigEndian<quint64>(TcpProtocol::cHeaderSize - 1, sizeBytes.data());
+
+    QBuffer device;
+    device.open(QIODevice::ReadWrite);
+    appendData(device, sizeBytes);
+
+    FrameDecoder decoder;
+    FrameDecoder::Frame frame;
+
+    QCOMPARE(decoder.readFrame(&device, frame), FrameDecoder::InvalidFrame);
+}
+
+QTEST_APPLESS_MAIN(FrameDecoderTest)
+
+#include "FrameDecoderTest.moc"
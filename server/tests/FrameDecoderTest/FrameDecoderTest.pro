@@ -0,0 +1,9 @@
+include(../tests.pri)
+
+SOURCES += \
+        FrameDecoderTest.cpp \
+        $$SERVER_DIR/src/FrameDecoder.cpp
+
+HEADERS += \
+    $$SERVER_DIR/include/FrameDecoder.h \
+    $$SERVER_DIR/include/TcpDataTypes.h
@@ -0,0 +1,12 @@
+QT -= gui
+QT += core network sql testlib
+
+CONFIG += c++11 console testcase
+CONFIG -= app_bundle
+
+# Тесты собираются из исходников сервера, как и нагрузочный прогон
+SERVER_DIR = $$PWD/..
+
+INCLUDEPATH += \
+    $$SERVER_DIR \
+    $$SERVER_DIR/include
@@ -0,0 +1,7 @@
+TEMPLATE = subdirs
+
+SUBDIRS = \
+    FrameDecoderTest \
+    BackupStoreTest \
+    BackupRetentionTest \
+    BackupDiffEngineTest